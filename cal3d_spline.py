@@ -0,0 +1,68 @@
+import imvu
+
+import sys
+import time
+import cal3d
+
+
+def usage():
+    print 'Usage: cal3d_spline.py <skeleton> <input> <output> [tolerance]'
+    print
+    print 'Fits spline tracks to the animation <input>, keeping every bone and'
+    print 'its descendants within <tolerance> (default 0.01) of the original,'
+    print 'saves the result to <output>, and reports size and sampling cost.'
+    return 2
+
+
+def keyframeCount(animation):
+    return sum(len(track.keyframes) for track in animation.tracks)
+
+
+def secondsPerSample(animation, sampleCount=50):
+    samples = 0
+    start = time.clock()
+    for i in range(sampleCount):
+        t = animation.duration * i / sampleCount
+        for track in animation.tracks:
+            track.getCurrentTransform(t)
+            samples += 1
+    return (time.clock() - start) / max(samples, 1)
+
+
+def report(name, animation):
+    data = cal3d.saveCoreAnimationToBuffer(animation)
+    print '%-8s %10d bytes %8d keyframes %8.2f us/sample' % (
+        name, len(data), keyframeCount(animation), secondsPerSample(animation) * 1e6)
+
+
+def main(argv=sys.argv):
+    if len(argv) not in (4, 5):
+        return usage()
+    c_skeleton = argv[1]
+    c_input    = argv[2]
+    c_output   = argv[3]
+    tolerance  = float(argv[4]) if len(argv) == 5 else 0.01
+
+    skeleton = cal3d.loadCoreSkeletonFromBuffer(open(c_skeleton, 'rb').read())
+    if not skeleton:
+        print 'could not load skeleton %s: %s' % (c_skeleton, cal3d.getLastErrorText())
+        return 1
+
+    data = open(c_input, 'rb').read()
+    animation = cal3d.loadCoreAnimationFromBuffer(data)
+    if not animation:
+        print 'could not load animation %s: %s' % (c_input, cal3d.getLastErrorText())
+        return 1
+    report('linear', animation)
+
+    animation = cal3d.loadCoreAnimationFromBuffer(data)
+    animation.fitSplines(skeleton, tolerance, 0)
+    report('spline', animation)
+
+    if not cal3d.saveCoreAnimation(animation, c_output):
+        print 'could not save %s: %s' % (c_output, cal3d.getLastErrorText())
+        return 1
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv) or 0)
@@ -543,8 +543,9 @@ BOOST_PYTHON_MODULE(_cal3d)
     class_<CalCoreTrack>("CoreTrack", init<int, const CalCoreTrack::KeyframeList&>())
         .def_readwrite("coreBoneId", &CalCoreTrack::coreBoneId)
         .def_readwrite("keyframes", &CalCoreTrack::keyframes)
+        .def_readwrite("splineInterpolated", &CalCoreTrack::splineInterpolated)
 
-        .def("getCurrentTransform", &CalCoreTrack::getCurrentTransform)
+        .def("getCurrentTransform", static_cast<cal3d::RotateTranslate (CalCoreTrack::*)(float) const>(&CalCoreTrack::getCurrentTransform))
         ;
     exportVector<CalCoreTrack>("CoreTrackVector");
 
@@ -552,6 +553,8 @@ BOOST_PYTHON_MODULE(_cal3d)
         .def("scale", &CalCoreAnimation::scale)
         .def("optimize", &CalCoreAnimation::optimize)
         .def("fixup", &CalCoreAnimation::fixup)
+        .def("reduceKeyframes", &CalCoreAnimation::reduceKeyframes)
+        .def("fitSplines", &CalCoreAnimation::fitSplines)
         .def_readwrite("duration", &CalCoreAnimation::duration)
         .def_readwrite("tracks", &CalCoreAnimation::tracks)
         ;
@@ -0,0 +1,175 @@
+#include "cal3d/animationlodscheduler.h"
+#include "cal3d/skeleton.h"
+
+// least common multiple of 1..MaxUpdateInterval, so every interval
+// repeats exactly within the slot table
+static const unsigned SlotCount = 840;
+
+CalAnimationLodScheduler::CalAnimationLodScheduler()
+    : nextId(1)
+    , frame(0)
+    , slotLoad(SlotCount)
+{}
+
+CalAnimationLodScheduler::InstanceId CalAnimationLodScheduler::addInstance(
+    CalMixer* mixer,
+    CalSkeleton* skeleton,
+    unsigned updateInterval
+) {
+    cal3d::verify(updateInterval >= 1 && updateInterval <= MaxUpdateInterval, "update interval out of range");
+
+    InstancePtr instance(new Instance);
+    instance->id = nextId++;
+    instance->mixer = mixer;
+    instance->skeleton = skeleton;
+    instance->updateInterval = updateInterval;
+    instance->phase = choosePhase(updateInterval);
+    addLoad(updateInterval, instance->phase, 1);
+    solve(*instance);
+    seed(*instance);
+
+    instances.push_back(instance);
+    return instance->id;
+}
+
+void CalAnimationLodScheduler::removeInstance(InstanceId id) {
+    for (auto i = instances.begin(); i != instances.end(); ++i) {
+        if ((*i)->id == id) {
+            addLoad((*i)->updateInterval, (*i)->phase, -1);
+            instances.erase(i);
+            return;
+        }
+    }
+}
+
+void CalAnimationLodScheduler::setUpdateInterval(InstanceId id, unsigned updateInterval) {
+    cal3d::verify(updateInterval >= 1 && updateInterval <= MaxUpdateInterval, "update interval out of range");
+
+    Instance& instance = getInstance(id);
+    if (instance.updateInterval == updateInterval) {
+        return;
+    }
+
+    addLoad(instance.updateInterval, instance.phase, -1);
+    instance.updateInterval = updateInterval;
+    instance.phase = choosePhase(updateInterval);
+    addLoad(instance.updateInterval, instance.phase, 1);
+
+    // the old palettes were spaced for the old interval; hold the pose
+    // on screen until the new phase's first solve
+    seed(instance);
+}
+
+std::vector<BoneTransformAdjustment>& CalAnimationLodScheduler::getBoneTransformAdjustments(InstanceId id) {
+    return getInstance(id).boneTransformAdjustments;
+}
+
+std::vector<BoneScaleAdjustment>& CalAnimationLodScheduler::getBoneScaleAdjustments(InstanceId id) {
+    return getInstance(id).boneScaleAdjustments;
+}
+
+size_t CalAnimationLodScheduler::update() {
+    const unsigned slot = frame % SlotCount;
+    size_t solves = 0;
+
+    for (auto i = instances.begin(); i != instances.end(); ++i) {
+        Instance& instance = **i;
+        const unsigned interval = instance.updateInterval;
+        const unsigned sinceSolve = (slot % interval + interval - instance.phase) % interval;
+
+        if (sinceSolve == 0) {
+            solve(instance);
+            ++solves;
+        }
+        if (interval > 1) {
+            interpolate(instance, float(sinceSolve + 1) / float(interval));
+        }
+    }
+
+    frame = (frame + 1) % SlotCount;
+    return solves;
+}
+
+CalAnimationLodScheduler::Instance& CalAnimationLodScheduler::getInstance(InstanceId id) {
+    for (auto i = instances.begin(); i != instances.end(); ++i) {
+        if ((*i)->id == id) {
+            return **i;
+        }
+    }
+    throw std::runtime_error("unknown animation LOD instance");
+}
+
+unsigned CalAnimationLodScheduler::choosePhase(unsigned updateInterval) const {
+    // pick the phase whose busiest frame is the least busy
+    unsigned bestPhase = 0;
+    unsigned bestPeak = ~0u;
+    unsigned bestTotal = ~0u;
+    for (unsigned phase = 0; phase < updateInterval; ++phase) {
+        unsigned peak = 0;
+        unsigned total = 0;
+        for (unsigned s = phase; s < SlotCount; s += updateInterval) {
+            peak = std::max(peak, slotLoad[s]);
+            total += slotLoad[s];
+        }
+        if (peak < bestPeak || (peak == bestPeak && total < bestTotal)) {
+            bestPhase = phase;
+            bestPeak = peak;
+            bestTotal = total;
+        }
+    }
+    return bestPhase;
+}
+
+void CalAnimationLodScheduler::addLoad(unsigned updateInterval, unsigned phase, int delta) {
+    for (unsigned s = phase; s < SlotCount; s += updateInterval) {
+        slotLoad[s] += delta;
+    }
+}
+
+void CalAnimationLodScheduler::solve(Instance& instance) {
+    CalSkeleton* skeleton = instance.skeleton;
+    instance.mixer->updateSkeleton(
+        skeleton,
+        instance.boneTransformAdjustments,
+        instance.boneScaleAdjustments);
+
+    const size_t boneCount = skeleton->boneTransforms.size();
+    instance.previousPalette.swap(instance.latestPalette);
+    instance.latestPalette.destructive_resize(boneCount);
+    std::copy(skeleton->boneTransforms.begin(), skeleton->boneTransforms.end(), instance.latestPalette.begin());
+
+    if (instance.previousPalette.size() != boneCount) {
+        seed(instance);
+    }
+}
+
+void CalAnimationLodScheduler::seed(Instance& instance) {
+    const auto& boneTransforms = instance.skeleton->boneTransforms;
+    instance.previousPalette.destructive_resize(boneTransforms.size());
+    instance.latestPalette.destructive_resize(boneTransforms.size());
+    std::copy(boneTransforms.begin(), boneTransforms.end(), instance.previousPalette.begin());
+    std::copy(boneTransforms.begin(), boneTransforms.end(), instance.latestPalette.begin());
+}
+
+/*****************************************************************************/
+/** Writes previousPalette + factor * (latestPalette - previousPalette) into
+  * the skeleton's boneTransforms.
+  *
+  * The rotation part is lerped component-wise, which is not exactly
+  * orthonormal, but consecutive solves are close enough for distant
+  * characters.
+  *****************************************************************************/
+
+void CalAnimationLodScheduler::interpolate(Instance& instance, float factor) {
+    const BoneTransform* previous = instance.previousPalette.data();
+    const BoneTransform* latest = instance.latestPalette.data();
+    BoneTransform* output = instance.skeleton->boneTransforms.data();
+
+    const size_t boneCount = instance.latestPalette.size();
+    for (size_t i = 0; i < boneCount; ++i) {
+        output[i].rowx = previous[i].rowx + factor * (latest[i].rowx - previous[i].rowx);
+        output[i].rowy = previous[i].rowy + factor * (latest[i].rowy - previous[i].rowy);
+        output[i].rowz = previous[i].rowz + factor * (latest[i].rowz - previous[i].rowz);
+    }
+    instance.skeleton->invalidatePose();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "cal3d/bonetransform.h"
+#include "cal3d/global.h"
+#include "cal3d/memory.h"
+#include "cal3d/mixer.h"
+
+class CalSkeleton;
+
+// Update-rate LOD for crowds.  Each registered character runs the full
+// CalMixer::updateSkeleton solve only every updateInterval frames; every
+// frame, its boneTransforms move a step from the previous solved palette
+// toward the newest, reaching it on the frame before the next solve.
+// Phases are chosen so that solves are spread evenly across frames.  The
+// interpolated palette trails the newest solve by up to updateInterval - 1
+// frames.
+class CAL3D_API CalAnimationLodScheduler : private boost::noncopyable {
+public:
+    typedef unsigned InstanceId;
+
+    static const unsigned MaxUpdateInterval = 8;
+
+    CalAnimationLodScheduler();
+
+    // The mixer and skeleton must outlive the registration.  The instance
+    // is solved once here, so its first frames have a palette to show.
+    InstanceId addInstance(CalMixer* mixer, CalSkeleton* skeleton, unsigned updateInterval = 1);
+    void removeInstance(InstanceId id);
+    void setUpdateInterval(InstanceId id, unsigned updateInterval);
+
+    // passed to CalMixer::updateSkeleton whenever the instance is solved
+    std::vector<BoneTransformAdjustment>& getBoneTransformAdjustments(InstanceId id);
+    std::vector<BoneScaleAdjustment>& getBoneScaleAdjustments(InstanceId id);
+
+    // Advances one frame and returns the number of instances solved.
+    size_t update();
+
+private:
+    struct Instance {
+        InstanceId id;
+        CalMixer* mixer;
+        CalSkeleton* skeleton;
+        unsigned updateInterval;
+        unsigned phase;
+
+        std::vector<BoneTransformAdjustment> boneTransformAdjustments;
+        std::vector<BoneScaleAdjustment> boneScaleAdjustments;
+
+        cal3d::SSEArray<BoneTransform> previousPalette;
+        cal3d::SSEArray<BoneTransform> latestPalette;
+    };
+    typedef boost::shared_ptr<Instance> InstancePtr;
+
+    Instance& getInstance(InstanceId id);
+    unsigned choosePhase(unsigned updateInterval) const;
+    void addLoad(unsigned updateInterval, unsigned phase, int delta);
+
+    static void solve(Instance& instance);
+    // sets both palettes to the skeleton's current boneTransforms
+    static void seed(Instance& instance);
+    static void interpolate(Instance& instance, float factor);
+
+    std::vector<InstancePtr> instances;
+    InstanceId nextId;
+    unsigned frame;
+
+    // solves scheduled per frame over one period of all intervals
+    std::vector<unsigned> slotLoad;
+};
@@ -0,0 +1,247 @@
+#include <string.h>
+#include <vector>
+#include "cal3d/assetcache.h"
+#include "cal3d/buffersource.h"
+#include "cal3d/coreanimation.h"
+#include "cal3d/corematerial.h"
+#include "cal3d/coremesh.h"
+#include "cal3d/coremorphanimation.h"
+#include "cal3d/coreskeleton.h"
+#include "cal3d/loader.h"
+
+static CalCoreSkeletonPtr decodeSkeleton(const std::string& data) {
+    CalBufferSource cbs(data.data(), data.size());
+    return CalLoader::loadCoreSkeleton(cbs);
+}
+
+static CalCoreAnimationPtr decodeAnimation(const std::string& data) {
+    CalBufferSource cbs(data.data(), data.size());
+    return CalLoader::loadCoreAnimation(cbs);
+}
+
+static CalCoreMorphAnimationPtr decodeMorphAnimation(const std::string& data) {
+    CalBufferSource cbs(data.data(), data.size());
+    return CalLoader::loadCoreMorphAnimation(cbs);
+}
+
+static CalCoreMeshPtr decodeMesh(const std::string& data) {
+    CalBufferSource cbs(data.data(), data.size());
+    return CalLoader::loadCoreMesh(cbs);
+}
+
+static CalCoreMaterialPtr decodeMaterial(const std::string& data) {
+    CalBufferSource cbs(data.data(), data.size());
+    return CalLoader::loadCoreMaterial(cbs);
+}
+
+CalAssetCache::CalAssetCache(size_t budgetInBytes)
+    : budget(budgetInBytes)
+{}
+
+CalCoreSkeletonPtr CalAssetCache::loadCoreSkeleton(const std::string& data) {
+    return load(SKELETON, data, &decodeSkeleton);
+}
+
+CalCoreAnimationPtr CalAssetCache::loadCoreAnimation(const std::string& data) {
+    return load(ANIMATION, data, &decodeAnimation);
+}
+
+CalCoreMorphAnimationPtr CalAssetCache::loadCoreMorphAnimation(const std::string& data) {
+    return load(MORPH_ANIMATION, data, &decodeMorphAnimation);
+}
+
+CalCoreMeshPtr CalAssetCache::loadCoreMesh(const std::string& data) {
+    return load(MESH, data, &decodeMesh);
+}
+
+CalCoreMaterialPtr CalAssetCache::loadCoreMaterial(const std::string& data) {
+    return load(MATERIAL, data, &decodeMaterial);
+}
+
+void CalAssetCache::setBudget(size_t budgetInBytes) {
+    std::vector<boost::shared_ptr<void> > evicted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = budgetInBytes;
+        evictOverBudget(evicted);
+    }
+}
+
+size_t CalAssetCache::getBudget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return budget;
+}
+
+void CalAssetCache::clear() {
+    EntryMap cleared;
+    std::lock_guard<std::mutex> lock(mutex);
+    cleared.swap(entries);
+    usage.clear();
+    stats.bytes = 0;
+}
+
+CalAssetCache::Stats CalAssetCache::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = stats;
+    result.entries = entries.size();
+    return result;
+}
+
+static inline cal3d_uint64 rotateLeft(cal3d_uint64 x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline cal3d_uint64 finalMix(cal3d_uint64 k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+CalAssetCache::ContentHash CalAssetCache::hashContent(const void* data, size_t size) {
+    const cal3d_uint64 c1 = 0x87c37b91114253d5ULL;
+    const cal3d_uint64 c2 = 0x4cf5ad432745937fULL;
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const size_t blockCount = size / 16;
+    cal3d_uint64 h1 = 0;
+    cal3d_uint64 h2 = 0;
+
+    for (size_t i = 0; i < blockCount; ++i) {
+        cal3d_uint64 k1;
+        cal3d_uint64 k2;
+        memcpy(&k1, bytes + i * 16, 8);
+        memcpy(&k2, bytes + i * 16 + 8, 8);
+
+        k1 *= c1;
+        k1 = rotateLeft(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = rotateLeft(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2;
+        k2 = rotateLeft(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+        h2 = rotateLeft(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // the last 0 to 15 bytes, little-endian, in two words
+    const unsigned char* tail = bytes + blockCount * 16;
+    const size_t tailSize = size & 15;
+    cal3d_uint64 k1 = 0;
+    cal3d_uint64 k2 = 0;
+    for (size_t i = 8; i < tailSize; ++i) {
+        k2 ^= cal3d_uint64(tail[i]) << (8 * (i - 8));
+    }
+    if (tailSize > 8) {
+        k2 *= c2;
+        k2 = rotateLeft(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+    }
+    for (size_t i = 0; i < tailSize && i < 8; ++i) {
+        k1 ^= cal3d_uint64(tail[i]) << (8 * i);
+    }
+    if (tailSize > 0) {
+        k1 *= c1;
+        k1 = rotateLeft(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+    }
+
+    h1 ^= size;
+    h2 ^= size;
+    h1 += h2;
+    h2 += h1;
+    h1 = finalMix(h1);
+    h2 = finalMix(h2);
+    h1 += h2;
+    h2 += h1;
+
+    ContentHash hash = { h1, h2 };
+    return hash;
+}
+
+bool CalAssetCache::Key::operator<(const Key& rhs) const {
+    if (hash.low != rhs.hash.low) {
+        return hash.low < rhs.hash.low;
+    }
+    if (hash.high != rhs.hash.high) {
+        return hash.high < rhs.hash.high;
+    }
+    if (size != rhs.size) {
+        return size < rhs.size;
+    }
+    return type < rhs.type;
+}
+
+template<typename AssetPtr>
+AssetPtr CalAssetCache::load(AssetType type, const std::string& data, AssetPtr (*decode)(const std::string&)) {
+    typedef typename AssetPtr::element_type Asset;
+
+    Key key;
+    key.type = type;
+    key.size = data.size();
+    key.hash = hashContent(data.data(), data.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EntryMap::iterator i = entries.find(key);
+        if (i != entries.end()) {
+            ++stats.hits;
+            usage.splice(usage.begin(), usage, i->second.usage);
+            return boost::static_pointer_cast<Asset>(i->second.asset);
+        }
+        ++stats.misses;
+    }
+
+    AssetPtr asset = decode(data);
+    if (!asset) {
+        return asset;
+    }
+    return boost::static_pointer_cast<Asset>(insert(key, asset, asset->sizeInBytes()));
+}
+
+boost::shared_ptr<void> CalAssetCache::insert(const Key& key, const boost::shared_ptr<void>& asset, size_t bytes) {
+    std::vector<boost::shared_ptr<void> > evicted;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // another thread may have decoded the same bytes in the meantime
+    EntryMap::iterator i = entries.find(key);
+    if (i != entries.end()) {
+        return i->second.asset;
+    }
+
+    if (bytes > budget) {
+        return asset;
+    }
+
+    usage.push_front(key);
+    Entry& entry = entries[key];
+    entry.asset = asset;
+    entry.bytes = bytes;
+    entry.usage = usage.begin();
+    stats.bytes += bytes;
+
+    // the new entry is the most recently used, so it fits and stays
+    evictOverBudget(evicted);
+    return asset;
+}
+
+void CalAssetCache::evictOverBudget(std::vector<boost::shared_ptr<void> >& evicted) {
+    while (stats.bytes > budget) {
+        EntryMap::iterator i = entries.find(usage.back());
+        stats.bytes -= i->second.bytes;
+        ++stats.evictions;
+        evicted.push_back(i->second.asset);
+        entries.erase(i);
+        usage.pop_back();
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "cal3d/global.h"
+
+CAL3D_PTR(CalCoreAnimation);
+CAL3D_PTR(CalCoreMaterial);
+CAL3D_PTR(CalCoreMesh);
+CAL3D_PTR(CalCoreMorphAnimation);
+CAL3D_PTR(CalCoreSkeleton);
+
+// Shares decoded core assets between everything that loads the same bytes,
+// as when many avatars in a crowd wear the same mesh.  Assets are keyed by
+// a 128-bit hash of the file contents, so the same file under two names is
+// decoded once, and handed out as shared pointers.  Callers must treat them
+// as immutable: scaling or fixing up a cached asset changes it for everyone.
+//
+// Cached assets are accounted by their sizeInBytes().  When the total goes
+// over the budget the least recently used ones are dropped; anyone still
+// holding one keeps it alive, but the next load of those bytes decodes a new
+// copy.  An asset larger than the whole budget is returned without being
+// cached.  Failed loads return null, as CalLoader does, with CalError set
+// on the calling thread, and are not cached.
+//
+// The load functions may be called from several threads at once.  Decoding
+// happens outside the lock, so two threads missing on the same file both
+// decode it and the first to finish is the one that gets shared.
+class CAL3D_API CalAssetCache : private boost::noncopyable {
+public:
+    struct Stats {
+        Stats()
+            : hits(0)
+            , misses(0)
+            , evictions(0)
+            , entries(0)
+            , bytes(0)
+        {}
+
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t entries; // currently cached
+        size_t bytes;   // currently cached, by sizeInBytes()
+    };
+
+    struct ContentHash {
+        cal3d_uint64 low;
+        cal3d_uint64 high;
+    };
+
+    explicit CalAssetCache(size_t budgetInBytes);
+
+    CalCoreSkeletonPtr loadCoreSkeleton(const std::string& data);
+    CalCoreAnimationPtr loadCoreAnimation(const std::string& data);
+    CalCoreMorphAnimationPtr loadCoreMorphAnimation(const std::string& data);
+    CalCoreMeshPtr loadCoreMesh(const std::string& data);
+    CalCoreMaterialPtr loadCoreMaterial(const std::string& data);
+
+    // Shrinking the budget evicts right away.
+    void setBudget(size_t budgetInBytes);
+    size_t getBudget() const;
+
+    void clear();
+    Stats getStats() const;
+
+    // MurmurHash3's x64 128-bit variant with a zero seed.
+    static ContentHash hashContent(const void* data, size_t size);
+
+private:
+    enum AssetType {
+        SKELETON,
+        ANIMATION,
+        MORPH_ANIMATION,
+        MESH,
+        MATERIAL
+    };
+
+    struct Key {
+        AssetType type;
+        size_t size;
+        ContentHash hash;
+
+        bool operator<(const Key& rhs) const;
+    };
+    typedef std::list<Key> UsageList;
+
+    struct Entry {
+        boost::shared_ptr<void> asset;
+        size_t bytes;
+        UsageList::iterator usage;
+    };
+    typedef std::map<Key, Entry> EntryMap;
+
+    template<typename AssetPtr>
+    AssetPtr load(AssetType type, const std::string& data, AssetPtr (*decode)(const std::string&));
+
+    // returns the asset that ends up shared: asset, or one another thread cached first
+    boost::shared_ptr<void> insert(const Key& key, const boost::shared_ptr<void>& asset, size_t bytes);
+    // Evicted assets are handed back so they are destroyed after the lock
+    // is released.
+    void evictOverBudget(std::vector<boost::shared_ptr<void> >& evicted);
+
+    mutable std::mutex mutex;
+    size_t budget;
+    EntryMap entries;
+    UsageList usage; // most recently used first
+    Stats stats;
+};
@@ -0,0 +1,311 @@
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <locale>
+#include <sstream>
+#include "cal3d/assetloader.h"
+#include "cal3d/buffersource.h"
+#include "cal3d/error.h"
+#include "cal3d/loader.h"
+
+// picks the CalLoader entry point by result type
+static void load(CalBufferSource& source, CalCoreSkeletonPtr& result) {
+    result = CalLoader::loadCoreSkeleton(source);
+}
+
+static void load(CalBufferSource& source, CalCoreAnimationPtr& result) {
+    result = CalLoader::loadCoreAnimation(source);
+}
+
+static void load(CalBufferSource& source, CalCoreMeshPtr& result) {
+    result = CalLoader::loadCoreMesh(source);
+}
+
+static void load(CalBufferSource& source, CalCoreMaterialPtr& result) {
+    result = CalLoader::loadCoreMaterial(source);
+}
+
+// Parts of a bundle are null however they failed, including by throwing.
+template<typename AssetPtr>
+static AssetPtr getOrNull(std::future<AssetPtr>& future) {
+    try {
+        return future.get();
+    } catch (...) {
+        return AssetPtr();
+    }
+}
+
+static double secondsBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+CalAssetLoader::CalAssetLoader(unsigned threadCount)
+    : unfinishedJobs(0)
+    , stopping(false)
+{
+    if (!threadCount) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // reserved so that only starting a thread can throw, and the workers
+    // already started are joined before the exception leaves
+    workers.reserve(threadCount);
+    try {
+        for (unsigned t = 0; t < threadCount; ++t) {
+            workers.emplace_back(&CalAssetLoader::work, this);
+        }
+    } catch (...) {
+        stopWorkers();
+        throw;
+    }
+}
+
+CalAssetLoader::~CalAssetLoader() {
+    stopWorkers();
+}
+
+void CalAssetLoader::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobsQueued.notify_all();
+    for (auto t = workers.begin(); t != workers.end(); ++t) {
+        t->join();
+    }
+}
+
+unsigned CalAssetLoader::getThreadCount() const {
+    return unsigned(workers.size());
+}
+
+std::future<CalCoreSkeletonPtr> CalAssetLoader::loadCoreSkeleton(std::string data) {
+    return submitForFuture<CalCoreSkeletonPtr>(SKELETON, std::move(data), std::string());
+}
+
+std::future<CalCoreAnimationPtr> CalAssetLoader::loadCoreAnimation(std::string data) {
+    return submitForFuture<CalCoreAnimationPtr>(ANIMATION, std::move(data), std::string());
+}
+
+std::future<CalCoreMeshPtr> CalAssetLoader::loadCoreMesh(std::string data) {
+    return submitForFuture<CalCoreMeshPtr>(MESH, std::move(data), std::string());
+}
+
+std::future<CalCoreMaterialPtr> CalAssetLoader::loadCoreMaterial(std::string data) {
+    return submitForFuture<CalCoreMaterialPtr>(MATERIAL, std::move(data), std::string());
+}
+
+void CalAssetLoader::loadCoreSkeleton(std::string data, std::function<void(const CalCoreSkeletonPtr&)> done) {
+    submitForCallback(SKELETON, std::move(data), std::move(done));
+}
+
+void CalAssetLoader::loadCoreAnimation(std::string data, std::function<void(const CalCoreAnimationPtr&)> done) {
+    submitForCallback(ANIMATION, std::move(data), std::move(done));
+}
+
+void CalAssetLoader::loadCoreMesh(std::string data, std::function<void(const CalCoreMeshPtr&)> done) {
+    submitForCallback(MESH, std::move(data), std::move(done));
+}
+
+void CalAssetLoader::loadCoreMaterial(std::string data, std::function<void(const CalCoreMaterialPtr&)> done) {
+    submitForCallback(MATERIAL, std::move(data), std::move(done));
+}
+
+/*****************************************************************************/
+/** Loads a model .cfg's parts in parallel.
+  *
+  * The .cfg itself is small and parsed here; every file it names becomes a
+  * job, and the futures are collected in file order once all are queued.
+  * Unknown keys are ignored, as the viewer ignores them.
+  *****************************************************************************/
+
+CalCoreModelBundle CalAssetLoader::loadCoreModel(const std::string& cfgPath) {
+    const size_t slash = cfgPath.find_last_of("/\\");
+    const std::string directory = slash == std::string::npos ? std::string() : cfgPath.substr(0, slash + 1);
+
+    CalCoreModelBundle bundle;
+    std::future<CalCoreSkeletonPtr> skeleton;
+    std::vector<std::future<CalCoreAnimationPtr>> animations;
+    std::vector<std::future<CalCoreMeshPtr>> meshes;
+    std::vector<std::future<CalCoreMaterialPtr>> materials;
+
+    std::ifstream cfg(cfgPath.c_str());
+    if (!cfg) {
+        CalError::setLastError(CalError::FILE_NOT_FOUND, __FILE__, __LINE__, cfgPath);
+        return bundle;
+    }
+
+    std::string line;
+    while (std::getline(cfg, line)) {
+        const size_t equals = line.find('=');
+        if (line.empty() || line[0] == '#' || equals == std::string::npos) {
+            continue;
+        }
+        const std::string key = line.substr(0, equals);
+        std::string value = line.substr(equals + 1);
+        value.erase(value.find_last_not_of(" \r\n\t") + 1);
+
+        if (key == "scale") {
+            std::istringstream is(value);
+            is.imbue(std::locale::classic());
+            is >> bundle.scale;
+        } else if (key == "skeleton") {
+            skeleton = submitForFuture<CalCoreSkeletonPtr>(SKELETON, std::string(), directory + value);
+        } else if (key == "animation") {
+            animations.push_back(submitForFuture<CalCoreAnimationPtr>(ANIMATION, std::string(), directory + value));
+        } else if (key == "mesh") {
+            meshes.push_back(submitForFuture<CalCoreMeshPtr>(MESH, std::string(), directory + value));
+        } else if (key == "material") {
+            materials.push_back(submitForFuture<CalCoreMaterialPtr>(MATERIAL, std::string(), directory + value));
+        }
+    }
+
+    if (skeleton.valid()) {
+        bundle.skeleton = getOrNull(skeleton);
+    }
+    for (auto i = animations.begin(); i != animations.end(); ++i) {
+        bundle.animations.push_back(getOrNull(*i));
+    }
+    for (auto i = meshes.begin(); i != meshes.end(); ++i) {
+        bundle.meshes.push_back(getOrNull(*i));
+    }
+    for (auto i = materials.begin(); i != materials.end(); ++i) {
+        bundle.materials.push_back(getOrNull(*i));
+    }
+    return bundle;
+}
+
+void CalAssetLoader::waitForAll() {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobsFinished.wait(lock, [this] { return unfinishedJobs == 0; });
+}
+
+CalAssetLoader::StageTimes CalAssetLoader::getStageTimes(AssetType type) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stageTimes[type];
+}
+
+template<typename AssetPtr>
+std::future<AssetPtr> CalAssetLoader::submitForFuture(AssetType type, std::string data, std::string path) {
+    // shared, since std::function needs a copyable target
+    boost::shared_ptr<std::promise<AssetPtr>> promise(new std::promise<AssetPtr>);
+    std::future<AssetPtr> future = promise->get_future();
+
+    Job job;
+    job.type = type;
+    job.data = std::move(data);
+    job.path = std::move(path);
+    job.decode = [promise](CalBufferSource& source) {
+        try {
+            AssetPtr result;
+            load(source, result);
+            promise->set_value(result);
+            return bool(result);
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+            return false;
+        }
+    };
+    job.fail = [promise](std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(AssetPtr());
+        }
+    };
+    submit(job);
+    return future;
+}
+
+template<typename AssetPtr>
+void CalAssetLoader::submitForCallback(AssetType type, std::string data, std::function<void(const AssetPtr&)> done) {
+    Job job;
+    job.type = type;
+    job.data = std::move(data);
+    job.decode = [done](CalBufferSource& source) {
+        AssetPtr result;
+        try {
+            load(source, result);
+        } catch (...) {
+            // reported as a failed load; there is no caller to rethrow to
+        }
+        try {
+            done(result);
+        } catch (...) {
+            // nor for the callback's own exceptions, which would otherwise
+            // end the worker thread and the process with it
+        }
+        return bool(result);
+    };
+    submit(job);
+}
+
+void CalAssetLoader::submit(Job& job) {
+    job.submitted = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+        ++unfinishedJobs;
+    }
+    jobsQueued.notify_one();
+}
+
+void CalAssetLoader::work() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobsQueued.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        run(job);
+    }
+}
+
+void CalAssetLoader::run(Job& job) {
+    const Clock::time_point started = Clock::now();
+    Clock::time_point read = started;
+    bool loaded = false;
+    // Every job delivers exactly one result and is counted and finished,
+    // however it ends, or futures would be abandoned and waitForAll would
+    // wait forever.  decode and fail catch their own exceptions.
+    std::exception_ptr readFailure;
+    bool readable = true;
+    if (!job.path.empty()) {
+        try {
+            std::ifstream file(job.path.c_str(), std::ios::binary);
+            if (file) {
+                job.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            } else {
+                CalError::setLastError(CalError::FILE_NOT_FOUND, __FILE__, __LINE__, job.path);
+                readable = false;
+            }
+        } catch (...) {
+            readFailure = std::current_exception();
+            readable = false;
+        }
+        read = Clock::now();
+    }
+
+    if (readable) {
+        CalBufferSource source(job.data.data(), job.data.size());
+        loaded = job.decode(source);
+    } else {
+        job.fail(readFailure);
+    }
+    const Clock::time_point decoded = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    StageTimes& times = stageTimes[job.type];
+    ++times.count;
+    times.failures += !loaded;
+    times.queued += secondsBetween(job.submitted, started);
+    times.read += secondsBetween(started, read);
+    times.decoded += secondsBetween(read, decoded);
+    if (!--unfinishedJobs) {
+        jobsFinished.notify_all();
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "cal3d/global.h"
+
+CAL3D_PTR(CalCoreAnimation);
+CAL3D_PTR(CalCoreMaterial);
+CAL3D_PTR(CalCoreMesh);
+CAL3D_PTR(CalCoreSkeleton);
+class CalBufferSource;
+
+// Everything a model .cfg file names, in file order.  Parts that failed to
+// load are null.
+struct CalCoreModelBundle {
+    CalCoreModelBundle()
+        : scale(1.0f)
+    {}
+
+    float scale;
+    CalCoreSkeletonPtr skeleton;
+    std::vector<CalCoreAnimationPtr> animations;
+    std::vector<CalCoreMeshPtr> meshes;
+    std::vector<CalCoreMaterialPtr> materials;
+};
+
+// Decodes assets with CalLoader on a pool of worker threads, so independent
+// files load in parallel.  Results are delivered through a future or a
+// callback; either way a failed load produces null, as CalLoader does.
+// Exceptions thrown while reading or decoding are rethrown by the future's
+// get(), and delivered to callbacks as null.  Callbacks run on the worker
+// thread, where CalError still describes the failure; exceptions they
+// throw are swallowed.
+//
+// Destroying the loader finishes every queued load first.
+class CAL3D_API CalAssetLoader : private boost::noncopyable {
+public:
+    enum AssetType {
+        SKELETON,
+        ANIMATION,
+        MESH,
+        MATERIAL,
+        ASSET_TYPE_COUNT
+    };
+
+    // Seconds spent in each stage, summed over the completed loads of one
+    // asset type.
+    struct StageTimes {
+        StageTimes()
+            : count(0)
+            , failures(0)
+            , queued(0.0)
+            , read(0.0)
+            , decoded(0.0)
+        {}
+
+        size_t count;
+        size_t failures;
+        double queued;  // waiting for a worker
+        double read;    // reading the file; zero for buffers
+        double decoded; // in CalLoader
+    };
+
+    // threadCount 0 means one thread per core.
+    explicit CalAssetLoader(unsigned threadCount = 0);
+    ~CalAssetLoader();
+
+    unsigned getThreadCount() const;
+
+    std::future<CalCoreSkeletonPtr> loadCoreSkeleton(std::string data);
+    std::future<CalCoreAnimationPtr> loadCoreAnimation(std::string data);
+    std::future<CalCoreMeshPtr> loadCoreMesh(std::string data);
+    std::future<CalCoreMaterialPtr> loadCoreMaterial(std::string data);
+
+    void loadCoreSkeleton(std::string data, std::function<void(const CalCoreSkeletonPtr&)> done);
+    void loadCoreAnimation(std::string data, std::function<void(const CalCoreAnimationPtr&)> done);
+    void loadCoreMesh(std::string data, std::function<void(const CalCoreMeshPtr&)> done);
+    void loadCoreMaterial(std::string data, std::function<void(const CalCoreMaterialPtr&)> done);
+
+    // Reads and decodes every file a model .cfg names on the pool and
+    // waits for all of them.  File names are relative to the .cfg's
+    // directory.  Parts that fail to load for any reason are null; a .cfg
+    // that cannot be opened gives an empty bundle and sets CalError.  Must
+    // not be called from a callback, which would wait on its own worker.
+    CalCoreModelBundle loadCoreModel(const std::string& cfgPath);
+
+    // Blocks until every submitted load has been delivered and counted in
+    // the stage times.
+    void waitForAll();
+
+    StageTimes getStageTimes(AssetType type) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Job {
+        AssetType type;
+        std::string data;
+        std::string path; // read into data first, when set
+        // decodes data and delivers the result; returns whether it loaded
+        std::function<bool(CalBufferSource&)> decode;
+        // for jobs with a path, delivers a failure instead when reading
+        // the file failed: null, or the exception the read threw
+        std::function<void(std::exception_ptr)> fail;
+        Clock::time_point submitted;
+    };
+
+    template<typename AssetPtr>
+    std::future<AssetPtr> submitForFuture(AssetType type, std::string data, std::string path);
+
+    template<typename AssetPtr>
+    void submitForCallback(AssetType type, std::string data, std::function<void(const AssetPtr&)> done);
+
+    void submit(Job& job);
+    void stopWorkers();
+    void work();
+    void run(Job& job);
+
+    mutable std::mutex mutex;
+    std::condition_variable jobsQueued;
+    std::condition_variable jobsFinished;
+    std::deque<Job> jobs;
+    size_t unfinishedJobs; // queued or running
+    bool stopping;
+    StageTimes stageTimes[ASSET_TYPE_COUNT];
+
+    std::vector<std::thread> workers;
+};
@@ -80,6 +80,10 @@ void CalBone::blendPose(
     currentAttenuation *= (1.0f - subsequentAttenuation);
 }
 
+void CalBone::setRelativeTransform(const cal3d::RotateTranslate& transform) {
+    transformAccumulator.reset(transform);
+}
+
 static void removeScale(CalMatrix& m) {
     m.cx.normalize();
     m.cy.normalize();
@@ -91,6 +95,14 @@ static cal3d::Transform removeScale(cal3d::Transform t) {
     return t;
 }
 
+cal3d::Transform cal3d::calculateAbsoluteTransform(
+    const Transform& parentTransform,
+    const RotateTranslate& relativeTransform,
+    const Scale& absoluteScale
+) {
+    return removeScale(parentTransform * relativeTransform) * absoluteScale;
+}
+
 template<typename T>
 T* null_ptr() {
     T* p = 0;
@@ -108,5 +120,10 @@ void CalBone::calculateAbsolutePose(const CalBone* bones) {
         : cal3d::Transform();
 
     absoluteScale = parentScale * scale;
-    absoluteTransform = removeScale(parentTransform * getRelativeTransform()) * absoluteScale;
+    absoluteTransform = cal3d::calculateAbsoluteTransform(parentTransform, getRelativeTransform(), absoluteScale);
+}
+
+void CalBone::setAbsoluteTransform(const cal3d::Transform& transform) {
+    absoluteScale.setIdentity();
+    absoluteTransform = transform;
 }
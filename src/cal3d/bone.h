@@ -33,6 +33,13 @@ namespace cal3d {
         float totalWeight;
         RotateTranslate currentTransform;
     };
+
+    // The absolute transform of a bone given its parent's absolute transform,
+    // its relative transform, and the product of the scales down its chain.
+    CAL3D_API Transform calculateAbsoluteTransform(
+        const Transform& parentTransform,
+        const RotateTranslate& relativeTransform,
+        const Scale& absoluteScale);
 }
 
 class CAL3D_API CalBone {
@@ -47,6 +54,10 @@ public:
         return transformAccumulator.getWeightedMean();
     }
 
+    const cal3d::RotateTranslate& getOriginalTransform() const {
+        return coreRelativeTransform;
+    }
+
     const CalVector& getOriginalTranslation() const {
         return coreRelativeTransform.translation;
     }
@@ -57,8 +68,16 @@ public:
         const cal3d::RotateTranslate& transform,
         float subsequentAttenuation);
 
+    // Replaces the blended relative transform outright, for callers
+    // such as CalMixer that do their own blending.
+    void setRelativeTransform(const cal3d::RotateTranslate& transform);
+
     void calculateAbsolutePose(const CalBone* bones);
 
+    // Stores an absolute pose computed elsewhere, e.g. by CalSkeleton's
+    // batched solver.  The transform must be unscaled.
+    void setAbsoluteTransform(const cal3d::Transform& transform);
+
 private:
     // from core bone. stored locally for better cache locality
     const cal3d::RotateTranslate coreRelativeTransform;
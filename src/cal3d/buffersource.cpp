@@ -38,6 +38,16 @@ bool CalBufferSource::readBytes(void* pBuffer, int length) {
     return result;
 }
 
+const char* CalBufferSource::readBlock(size_t length) {
+    if (length > mLength - mOffset) {
+        return 0;
+    }
+
+    const char* block = static_cast<const char*>(mInputBuffer) + mOffset;
+    mOffset += length;
+    return block;
+}
+
 bool CalBufferSource::readFloat(float& value) {
     //Check that the buffer is usable
     if (mOffset + 4 > mLength) {
@@ -10,6 +10,8 @@
 
 #pragma once
 
+#include <string.h>
+#include <utility>
 #include "cal3d/global.h"
 #include "cal3d/datasource.h"
 
@@ -29,6 +31,16 @@ public:
     bool readInteger(int& value);
     bool readString(std::string& strValue);
 
+    // Returns the next length bytes and moves past them, or null without
+    // moving if fewer remain.  Lets a loader bounds-check a fixed-size
+    // record once and decode its fields with cal3d::decodeFloat and
+    // cal3d::decodeInteger.
+    const char* readBlock(size_t length);
+
+    size_t remaining() const {
+        return mLength - mOffset;
+    }
+
     const void* data() const {
         return mInputBuffer;
     }
@@ -46,6 +58,30 @@ private:
 
 namespace cal3d {
 
+    // the little-endian float or integer at p, as CalPlatform::readFloat
+    // and CalPlatform::readInteger decode them
+    inline float decodeFloat(const char* p) {
+        float value;
+        memcpy(&value, p, 4);
+#ifdef CAL3D_BIG_ENDIAN
+        char* b = reinterpret_cast<char*>(&value);
+        std::swap(b[0], b[3]);
+        std::swap(b[1], b[2]);
+#endif
+        return value;
+    }
+
+    inline int decodeInteger(const char* p) {
+        int value;
+        memcpy(&value, p, 4);
+#ifdef CAL3D_BIG_ENDIAN
+        char* b = reinterpret_cast<char*>(&value);
+        std::swap(b[0], b[3]);
+        std::swap(b[1], b[2]);
+#endif
+        return value;
+    }
+
     // This interface provides some bytes and a length.
     class Buffer {
     public:
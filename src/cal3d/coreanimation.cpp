@@ -17,6 +17,7 @@
 #include "cal3d/coreskeleton.h"
 #include "cal3d/corebone.h"
 #include "cal3d/memory.h"
+#include "cal3d/parallel.h"
 
 #include "cal3d/error.h"
 #include "cal3d/bone.h"
@@ -30,10 +31,25 @@ size_t sizeInBytes(const CalCoreTrack& t) {
 }
 
 size_t CalCoreAnimation::sizeInBytes() const {
-    return sizeof(*this) + ::sizeInBytes(tracks);
+    return sizeof(*this) + ::sizeInBytes(tracks) +
+        sizeof(int) * (trackIndexByBone.capacity() + nextTrackForBone.capacity());
 }
 
+// Bone ids come straight from files, so the table only covers ids below
+// this; tracks for larger ids are found by the scan.
+static const cal3d_uint64 maxIndexedBoneCount = 1 << 16;
+
 const CalCoreTrack* CalCoreAnimation::getCoreTrack(unsigned coreBoneId) const {
+    if (indexedTrackCount == tracks.size()) {
+        if (coreBoneId < trackIndexByBone.size()) {
+            const int index = trackIndexByBone[coreBoneId];
+            return index == -1 ? 0 : &tracks[index];
+        }
+        if (coreBoneId < maxIndexedBoneCount || !hasUnindexedTracks) {
+            return 0;
+        }
+    }
+
     for (
         TrackList::const_iterator iteratorCoreTrack = tracks.begin();
         iteratorCoreTrack != tracks.end();
@@ -48,6 +64,48 @@ const CalCoreTrack* CalCoreAnimation::getCoreTrack(unsigned coreBoneId) const {
     return 0;
 }
 
+const CalCoreTrack* CalCoreAnimation::getNextCoreTrack(const CalCoreTrack* track) const {
+    const size_t index = track - cal3d::pointerFromVector(tracks);
+    if (indexedTrackCount == tracks.size() && track->coreBoneId < maxIndexedBoneCount) {
+        const int next = nextTrackForBone[index];
+        return next == -1 ? 0 : &tracks[next];
+    }
+
+    for (size_t i = index + 1; i < tracks.size(); ++i) {
+        if (tracks[i].coreBoneId == track->coreBoneId) {
+            return &tracks[i];
+        }
+    }
+    return 0;
+}
+
+void CalCoreAnimation::buildTrackTable() {
+    cal3d_uint64 boneCount = 0;
+    hasUnindexedTracks = false;
+    for (auto i = tracks.begin(); i != tracks.end(); ++i) {
+        if (i->coreBoneId < maxIndexedBoneCount) {
+            boneCount = std::max(boneCount, cal3d_uint64(i->coreBoneId) + 1);
+        } else {
+            hasUnindexedTracks = true;
+        }
+    }
+
+    trackIndexByBone.assign(size_t(boneCount), -1);
+    nextTrackForBone.assign(tracks.size(), -1);
+
+    // the first track for a bone wins, as with the linear scan, and links
+    // to the one after it
+    for (size_t i = tracks.size(); i--;) {
+        if (tracks[i].coreBoneId < boneCount) {
+            int& first = trackIndexByBone[tracks[i].coreBoneId];
+            nextTrackForBone[i] = first;
+            first = static_cast<int>(i);
+        }
+    }
+
+    indexedTrackCount = tracks.size();
+}
+
 void CalCoreAnimation::scale(float factor) {
     std::for_each(
         tracks.begin(),
@@ -62,6 +120,32 @@ void CalCoreAnimation::optimize() {
         std::mem_fun_ref(&CalCoreTrack::optimize));
 }
 
+void CalCoreAnimation::reduceKeyframes(const CalCoreSkeleton& skeleton, float tolerance, unsigned threadCount) {
+    reduceTracks(&CalCoreTrack::reduce, skeleton, tolerance, threadCount);
+}
+
+void CalCoreAnimation::fitSplines(const CalCoreSkeleton& skeleton, float tolerance, unsigned threadCount) {
+    reduceTracks(&CalCoreTrack::fitSpline, skeleton, tolerance, threadCount);
+}
+
+void CalCoreAnimation::reduceTracks(TrackReduction reduction, const CalCoreSkeleton& skeleton, float tolerance, unsigned threadCount) {
+    std::vector<CalCoreTrackPtr> reduced(tracks.size());
+    cal3d::parallelFor(tracks.size(), threadCount, [&](size_t i) {
+        const CalCoreTrack& track = tracks[i];
+        const std::vector<CalVector> offsets = track.coreBoneId < skeleton.coreBones.size()
+            ? skeleton.getDescendantOffsets(track.coreBoneId)
+            : std::vector<CalVector>();
+        reduced[i] = (track.*reduction)(offsets, tolerance, &skeleton);
+        return true;
+    });
+
+    // parallelFor rethrows, leaving the tracks untouched, if any reduction threw
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        tracks[i] = *reduced[i];
+    }
+    buildTrackTable();
+}
+
 void CalCoreAnimation::fixup(const CalCoreSkeletonPtr& skeleton, cal3d::RotateTranslate rt, bool doFingerFix) {
     const auto& coreBones = skeleton->coreBones;
 
@@ -90,6 +174,10 @@ void CalCoreAnimation::fixup(const CalCoreSkeletonPtr& skeleton, cal3d::RotateTr
         if (coreBone.parentId == -1) {
             i->zeroTransforms();
             i->rotateTranslate(rt);
+            // every keyframe is now rt, which the bone's bind translation
+            // knows nothing about
+            i->translationRequired = true;
+            i->translationIsDynamic = false;
         } else {
             i->fixup(
                 coreBone,
@@ -177,4 +265,5 @@ void CalCoreAnimation::fixup(const CalCoreSkeletonPtr& skeleton, cal3d::RotateTr
     }
 
     swap(tracks, output);
+    buildTrackTable();
 }
@@ -21,11 +21,27 @@ class CAL3D_API CalCoreAnimation {
 public:
     CalCoreAnimation()
         : duration(0.0f)
+        , indexedTrackCount(size_t(-1))
+        , hasUnindexedTracks(false)
     {}
 
     size_t sizeInBytes() const;
+
+    // Constant time while the table from buildTrackTable is current, for
+    // any bone id; a linear scan if the table was never built or the track
+    // count has changed since.
     const CalCoreTrack* getCoreTrack(unsigned coreBoneId) const;
 
+    // The next track after track, which must be one of ours, for the same
+    // bone; 0 if there is none.  Constant time under the same conditions.
+    const CalCoreTrack* getNextCoreTrack(const CalCoreTrack* track) const;
+
+    // Indexes tracks by bone id.  The loaders and fixup call this; anyone
+    // else adding or removing tracks should call it again, and anyone
+    // changing a track's bone id must, since that leaves the count as it
+    // was and the stale table would still be trusted.
+    void buildTrackTable();
+
     void scale(float factor);
     void fixup(
         const CalCoreSkeletonPtr& skeleton,
@@ -33,9 +49,32 @@ public:
         bool doFingerFix = false);
     void optimize();
 
+    // Runs CalCoreTrack::reduce on every track, measuring error at each
+    // bone's descendants in the skeleton's bind pose.  Tracks are reduced
+    // on threadCount threads, or one per core if 0.  If any reduction
+    // throws, the tracks are left as they were and the exception rethrown.
+    void reduceKeyframes(const CalCoreSkeleton& skeleton, float tolerance, unsigned threadCount = 0);
+
+    // As reduceKeyframes, but with CalCoreTrack::fitSpline.
+    void fitSplines(const CalCoreSkeleton& skeleton, float tolerance, unsigned threadCount = 0);
+
     float duration;
     typedef std::vector<CalCoreTrack> TrackList;
     TrackList tracks;
+
+private:
+    typedef CalCoreTrackPtr (CalCoreTrack::*TrackReduction)(
+        const std::vector<CalVector>&, float, const CalCoreSkeleton*) const;
+    void reduceTracks(TrackReduction reduction, const CalCoreSkeleton& skeleton, float tolerance, unsigned threadCount);
+
+    // track index for each bone id, or -1 if the bone has no track
+    std::vector<int> trackIndexByBone;
+    // for each track, the index of the next track for its bone, or -1
+    std::vector<int> nextTrackForBone;
+    // tracks.size() when the table was built, or -1 if it never was
+    size_t indexedTrackCount;
+    // whether any track's bone id is too large for the table
+    bool hasUnindexedTracks;
 };
 CAL3D_PTR(CalCoreAnimation);
 
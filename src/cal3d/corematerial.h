@@ -26,6 +26,14 @@ public:
 
     std::vector<Map> maps;
 
+    size_t sizeInBytes() const {
+        size_t r = sizeof(*this) + sizeof(Map) * maps.capacity();
+        for (size_t i = 0; i < maps.size(); ++i) {
+            r += maps[i].filename.capacity() + maps[i].type.capacity();
+        }
+        return r;
+    }
+
     bool getTwoSided() const {
         return maps.size() > 1;    // Should come from check box.
     }
@@ -12,9 +12,12 @@
 #include "config.h"
 #endif
 
+#include <map>
 #include <string>
 #include "cal3d/coremorphanimation.h"
+#include "cal3d/coremorphtarget.h"
 #include "cal3d/coremorphtrack.h"
+#include "cal3d/coresubmesh.h"
 #include "cal3d/memory.h"
 
 CAL3D_DEFINE_SIZE(CalCoreMorphTrack*);
@@ -75,3 +78,22 @@ CalCoreMorphTrack* CalCoreMorphAnimation::getCoreTrack(std::string const& name)
     // no match found
     return 0;
 }
+
+std::vector<int> CalCoreMorphAnimation::getMorphChannelTable(const CalCoreSubmesh& coreSubmesh) const {
+    const CalCoreSubmesh::MorphTargetArray& morphTargets = coreSubmesh.getMorphTargets();
+
+    // the first morph target of a name wins, as in CalSubmesh's name lookups
+    std::map<std::string, int> morphTargetIds;
+    for (size_t i = morphTargets.size(); i--;) {
+        morphTargetIds[morphTargets[i]->name] = static_cast<int>(i);
+    }
+
+    std::vector<int> table(tracks.size(), -1);
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        auto found = morphTargetIds.find(tracks[i].morphName);
+        if (found != morphTargetIds.end()) {
+            table[i] = found->second;
+        }
+    }
+    return table;
+}
@@ -16,6 +16,7 @@
 #include "cal3d/coremorphtrack.h"
 
 class CalCoreMorphTrack;
+class CalCoreSubmesh;
 
 class CAL3D_API CalCoreMorphAnimation {
 public:
@@ -28,6 +29,12 @@ public:
 
     CalCoreMorphTrack* getCoreTrack(const std::string& trackId);
 
+    // For each track, the index of the submesh morph target it drives, or
+    // -1 if the submesh has no morph target of that name.  Build once per
+    // animation and core submesh, then pass to CalSubmesh::blendMorphAnimation
+    // so per-frame blending does no name matching.
+    std::vector<int> getMorphChannelTable(const CalCoreSubmesh& coreSubmesh) const;
+
     void removeZeroScaleTracks();
     void scale(float factor);
 
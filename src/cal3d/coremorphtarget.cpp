@@ -37,6 +37,18 @@ CalCoreMorphTarget::CalCoreMorphTarget(const std::string& n, size_t vertexCount,
     , morphTargetType(calculateType(n.c_str()))
     , vertexOffsets(vertexOffsets)
 {
+    verifyVertexOffsets(vertexCount);
+}
+
+CalCoreMorphTarget::CalCoreMorphTarget(const std::string& n, size_t vertexCount, const VertexOffset* begin, const VertexOffset* end)
+    : name(n)
+    , morphTargetType(calculateType(n.c_str()))
+    , vertexOffsets(begin, end)
+{
+    verifyVertexOffsets(vertexCount);
+}
+
+void CalCoreMorphTarget::verifyVertexOffsets(size_t vertexCount) const {
     cal3d::verify(vertexOffsets.size() <= vertexCount, "Cannot morph more vertices than in the base mesh");
     for (size_t i = 0; i < vertexOffsets.size(); ++i) {
         cal3d::verify(vertexOffsets[i].vertexId < vertexCount, "Cannot morph vertices outside of the base mesh");
@@ -45,11 +57,8 @@ CalCoreMorphTarget::CalCoreMorphTarget(const std::string& n, size_t vertexCount,
 
 size_t CalCoreMorphTarget::size() const {
     size_t r = sizeof(CalCoreMorphTarget);
-    r += sizeof(CalMorphTargetType);
-
-    // Assume single texture coordinate pair.
     r += ::sizeInBytes(vertexOffsets);
-    r += name.size();
+    r += name.capacity();
     return r;
 }
 
@@ -41,10 +41,14 @@ public:
     const VertexOffsetArray vertexOffsets;
 
     CalCoreMorphTarget(const std::string& name, const size_t vertexCount, const VertexOffsetArray& vertexOffsets);
+    CalCoreMorphTarget(const std::string& name, const size_t vertexCount, const VertexOffset* begin, const VertexOffset* end);
 
     size_t size() const;
 
     void scale(float factor);
     void addVertexOffset(const size_t vertexId, const CalCoreSubmesh::Vertex& v);
+
+private:
+    void verifyVertexOffsets(size_t vertexCount) const;
 };
 CAL3D_PTR(CalCoreMorphTarget);
@@ -40,9 +40,9 @@ void CalCoreMorphTrack::addCoreMorphKeyframe(CalCoreMorphKeyframe keyframe) {
     std::sort(keyframes.begin(), keyframes.end());
 }
 
-float CalCoreMorphTrack::getState(float time) {
-    std::vector<CalCoreMorphKeyframe>::iterator iteratorCoreMorphKeyframeBefore;
-    std::vector<CalCoreMorphKeyframe>::iterator iteratorCoreMorphKeyframeAfter;
+float CalCoreMorphTrack::getState(float time) const {
+    MorphKeyframeList::const_iterator iteratorCoreMorphKeyframeBefore;
+    MorphKeyframeList::const_iterator iteratorCoreMorphKeyframeAfter;
 
     // get the keyframe after the requested time
     iteratorCoreMorphKeyframeAfter = getUpperBound(time);
@@ -65,8 +65,8 @@ float CalCoreMorphTrack::getState(float time) {
     --iteratorCoreMorphKeyframeBefore;
 
     // get the two keyframe pointers
-    CalCoreMorphKeyframe* pCoreMorphKeyframeBefore = &(*iteratorCoreMorphKeyframeBefore);
-    CalCoreMorphKeyframe* pCoreMorphKeyframeAfter = &(*iteratorCoreMorphKeyframeAfter);
+    const CalCoreMorphKeyframe* pCoreMorphKeyframeBefore = &(*iteratorCoreMorphKeyframeBefore);
+    const CalCoreMorphKeyframe* pCoreMorphKeyframeAfter = &(*iteratorCoreMorphKeyframeAfter);
 
     // calculate the blending factor between the two keyframe states
     float blendFactor = (time - pCoreMorphKeyframeBefore->time) / (pCoreMorphKeyframeAfter->time - pCoreMorphKeyframeBefore->time);
@@ -81,7 +81,7 @@ void CalCoreMorphTrack::scale(float factor) {
     std::for_each(keyframes.begin(), keyframes.end(), std::bind2nd(std::mem_fun_ref(&CalCoreMorphKeyframe::scale), factor));
 }
 
-std::vector<CalCoreMorphKeyframe>::iterator CalCoreMorphTrack::getUpperBound(float time) {
+CalCoreMorphTrack::MorphKeyframeList::const_iterator CalCoreMorphTrack::getUpperBound(float time) const {
     return std::upper_bound(
         keyframes.begin(),
         keyframes.end(),
@@ -27,13 +27,13 @@ public:
 
     size_t size() const;
 
-    float getState(float time);
+    float getState(float time) const;
 
     void addCoreMorphKeyframe(CalCoreMorphKeyframe pCoreKeyframe);
     void scale(float factor);
 
 private:
-    std::vector<CalCoreMorphKeyframe>::iterator getUpperBound(float time);
+    MorphKeyframeList::const_iterator getUpperBound(float time) const;
 };
 
 inline bool operator==(const CalCoreMorphTrack& lhs, const CalCoreMorphTrack& rhs) {
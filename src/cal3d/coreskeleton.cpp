@@ -17,6 +17,7 @@
 #include "cal3d/error.h"
 #include "cal3d/coreskeleton.h"
 #include "cal3d/corebone.h"
+#include "cal3d/memory.h"
 
 std::vector<CalCoreBonePtr> findInvalidParents(
     const std::vector<CalCoreBonePtr>& bones,
@@ -103,6 +104,19 @@ CalCoreSkeleton::CalCoreSkeleton(const std::vector<CalCoreBonePtr>& bones)
     cal3d::verify(boneIdTranslation.size() == m_coreBones.size(), "ID->index translation table and bone list must have identical lengths");
 }
 
+size_t sizeInBytes(const CalCoreBonePtr& coreBone) {
+    return sizeof(CalCoreBonePtr) + sizeof(CalCoreBone) + coreBone->name.capacity();
+}
+
+size_t CalCoreSkeleton::sizeInBytes() const {
+    size_t r = sizeof(*this);
+    r += ::sizeInBytes(m_coreBones);
+    r += ::sizeInBytes(boneIdTranslation);
+    // as the std::set sizeInBytes counts its nodes
+    r += (20 + sizeof(size_t)) * adjustedRoots.size();
+    return r;
+}
+
 size_t CalCoreSkeleton::addCoreBone(const CalCoreBonePtr& coreBone) {
     cal3d::verify(coreBone->parentId == -1 || size_t(coreBone->parentId) < coreBones.size(), "bones must be added in topological order");
 
@@ -171,6 +185,45 @@ std::vector<int> CalCoreSkeleton::getChildIds(const CalCoreBone* coreBone) const
     return rv;
 }
 
+std::vector<bool> CalCoreSkeleton::getBoneMaskForDepth(unsigned maxDepth) const {
+    std::vector<unsigned> depths(coreBones.size());
+    std::vector<bool> mask(coreBones.size());
+    for (size_t i = 0; i < coreBones.size(); ++i) {
+        const int parentId = coreBones[i]->parentId;
+        // bones are stored in topological order, so the parent's depth is known
+        depths[i] = (parentId == -1) ? 0 : depths[parentId] + 1;
+        mask[i] = depths[i] <= maxDepth;
+    }
+    return mask;
+}
+
+std::vector<bool> CalCoreSkeleton::getBoneMaskExcluding(const std::vector<std::string>& boneNames) const {
+    std::set<std::string> excluded(boneNames.begin(), boneNames.end());
+
+    std::vector<bool> mask(coreBones.size());
+    for (size_t i = 0; i < coreBones.size(); ++i) {
+        const int parentId = coreBones[i]->parentId;
+        mask[i] = !excluded.count(coreBones[i]->name) && (parentId == -1 || mask[parentId]);
+    }
+    return mask;
+}
+
+std::vector<CalVector> CalCoreSkeleton::getDescendantOffsets(size_t boneId) const {
+    std::vector<CalVector> offsets;
+    for (size_t i = 0; i < coreBones.size(); ++i) {
+        cal3d::RotateTranslate transform = coreBones[i]->relativeTransform;
+        int parentId = coreBones[i]->parentId;
+        while (parentId != -1 && parentId != static_cast<int>(boneId)) {
+            transform = coreBones[parentId]->relativeTransform * transform;
+            parentId = coreBones[parentId]->parentId;
+        }
+        if (parentId == static_cast<int>(boneId)) {
+            offsets.push_back(transform.translation);
+        }
+    }
+    return offsets;
+}
+
  void CalCoreSkeleton::rotateTranslate(cal3d::RotateTranslate& rt) {
     for (size_t i = 0; i < m_coreBones.size(); ++i) {
         if (m_coreBones[i]->parentId == -1) {
@@ -25,6 +25,8 @@ class CAL3D_API CalCoreSkeleton : private boost::noncopyable {
 public:
     CalCoreSkeleton(const std::vector<CalCoreBonePtr>& bones = std::vector<CalCoreBonePtr>());
 
+    size_t sizeInBytes() const;
+
     size_t addCoreBone(const CalCoreBonePtr& coreBone);
     int getBoneId(const CalCoreBone* coreBone) const;
 
@@ -44,6 +46,16 @@ public:
 
     std::vector<int> getChildIds(const CalCoreBone* coreBone) const;
 
+    // Bone masks for skeletal LOD (see CalSkeleton::setBoneMask); true keeps the bone.
+    // Roots have depth 0.
+    std::vector<bool> getBoneMaskForDepth(unsigned maxDepth) const;
+    // Masks out the named bones and everything below them.
+    std::vector<bool> getBoneMaskExcluding(const std::vector<std::string>& boneNames) const;
+
+    // Bind-pose positions of every descendant of the bone, in the bone's own
+    // space.  These are the points keyframe reduction measures error at.
+    std::vector<CalVector> getDescendantOffsets(size_t boneId) const;
+
     CalVector sceneAmbientColor;
 
 private:
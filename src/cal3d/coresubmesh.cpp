@@ -35,6 +35,7 @@ CalCoreSubmesh::CalCoreSubmesh(int vertexCount, bool hasTextureCoordinates, int
     , m_minimumVertexBufferSize(0)
 {
     m_vertexColors.resize(vertexCount);
+    m_influences.reserve(vertexCount);
 
     if (hasTextureCoordinates) {
         m_textureCoordinates.resize(vertexCount);
@@ -45,6 +46,11 @@ CalCoreSubmesh::CalCoreSubmesh(int vertexCount, bool hasTextureCoordinates, int
 
 CAL3D_DEFINE_SIZE(CalCoreSubmesh::Face);
 CAL3D_DEFINE_SIZE(CalCoreSubmesh::Influence);
+CAL3D_DEFINE_SIZE(CalCoreSubmesh::TextureCoordinate);
+
+size_t sizeInBytes(const CalCoreMorphTargetPtr& morphTarget) {
+    return sizeof(CalCoreMorphTargetPtr) + morphTarget->size();
+}
 
 size_t sizeInBytes(const CalCoreSubmesh::InfluenceSet& is) {
     return sizeof(is) + sizeInBytes(is.influences);
@@ -54,6 +60,8 @@ size_t CalCoreSubmesh::sizeInBytes() const {
     size_t r = sizeof(*this);
     r += ::sizeInBytes(m_vertices);
     r += ::sizeInBytes(m_vertexColors);
+    r += ::sizeInBytes(m_textureCoordinates);
+    r += ::sizeInBytes(m_morphTargets);
     r += ::sizeInBytes(m_faces);
     r += ::sizeInBytes(m_staticInfluenceSet);
     r += ::sizeInBytes(m_influences);
@@ -108,7 +116,7 @@ void CalCoreSubmesh::addVertex(const Vertex& vertex, CalColor32 vertexColor, con
         m_boundingVolume.min = vertex.position.asCalVector();
         m_boundingVolume.max = vertex.position.asCalVector();
     } else if (m_isStatic) {
-        m_isStatic = m_staticInfluenceSet == inf_;
+        m_isStatic = m_staticInfluenceSet.matches(inf_);
     }
 
     if (vertexId) {
@@ -124,25 +132,22 @@ void CalCoreSubmesh::addVertex(const Vertex& vertex, CalColor32 vertexColor, con
     m_vertices[vertexId] = vertex;
     m_vertexColors[vertexId] = vertexColor;
 
-    // Each vertex needs at least one influence.
-    std::vector<Influence> inf(inf_);
-    if (inf.empty()) {
+    // Each vertex needs at least one influence.  Sorted in place, after
+    // the influences of the previous vertices.
+    const size_t first = m_influences.size();
+    if (inf_.empty()) {
         m_isStatic = false;
-        Influence i;
-        i.boneId = 0;
-        i.weight = 0.0f;
-        inf.push_back(i);
+        m_influences.push_back(Influence(0, 0.0f, true));
     } else {
-        std::sort(inf.begin(), inf.end(), descendingByWeight);
+        m_influences.insert(m_influences.end(), inf_.begin(), inf_.end());
+        std::sort(m_influences.begin() + first, m_influences.end(), descendingByWeight);
     }
 
     // Mark the last influence as the last one.  :)
-    for (size_t i = 0; i + 1 < inf.size(); ++i) {
-        inf[i].lastInfluenceForThisVertex = 0;
+    for (size_t i = first; i + 1 < m_influences.size(); ++i) {
+        m_influences[i].lastInfluenceForThisVertex = 0;
     }
-    inf[inf.size() - 1].lastInfluenceForThisVertex = 1;
-
-    m_influences.insert(m_influences.end(), inf.begin(), inf.end());
+    m_influences.back().lastInfluenceForThisVertex = 1;
 }
 
 void CalCoreSubmesh::scale(float factor) {
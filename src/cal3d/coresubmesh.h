@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <ostream>
 #include <set>
 #include <map>
@@ -127,6 +128,22 @@ public:
 
         std::set<Influence> influences;
 
+        // The same as *this == InfluenceSet(vi), without building a set
+        // for every vertex.
+        bool matches(const std::vector<Influence>& vi) const {
+            for (std::vector<Influence>::const_iterator i = vi.begin(); i != vi.end(); ++i) {
+                if (!influences.count(*i)) {
+                    return false;
+                }
+            }
+            for (std::set<Influence>::const_iterator i = influences.begin(); i != influences.end(); ++i) {
+                if (std::find(vi.begin(), vi.end(), *i) == vi.end()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
         bool operator==(const InfluenceSet& rhs) const {
             if (influences.size() != rhs.influences.size()) {
                 return false;
@@ -293,6 +310,8 @@ public:
     CalExportedInfluences exportInfluences(unsigned int influenceLimit);
 
 private:
+    friend class CalRuntimeImage;
+
     unsigned int m_currentVertexId;
     int m_isolateds;
     std::vector<reduxVertex *> vertices;
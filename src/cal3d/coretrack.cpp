@@ -19,6 +19,9 @@
 #include "cal3d/corekeyframe.h"
 #include "cal3d/loader.h"
 #include "cal3d/memory.h"
+#include "cal3d/vector4.h"
+#include <limits>
+#include <queue>
 
 bool sortByTime(const CalCoreKeyframe& lhs, const CalCoreKeyframe& rhs) {
     return lhs.time < rhs.time;
@@ -34,6 +37,16 @@ CalCoreTrack::CalCoreTrack(int coreBone, const KeyframeList& kf)
     , keyframes(sorted(kf)) {
     translationRequired = true;
     translationIsDynamic = true;
+    splineInterpolated = false;
+}
+
+CalCoreTrack::CalCoreTrack(int coreBone, KeyframeList&& kf)
+    : coreBoneId(coreBone)
+    , keyframes(std::move(kf)) {
+    std::sort(keyframes.begin(), keyframes.end(), sortByTime);
+    translationRequired = true;
+    translationIsDynamic = true;
+    splineInterpolated = false;
 }
 
 size_t sizeInBytes(const CalCoreKeyframe&) {
@@ -209,8 +222,10 @@ CalCoreTrackPtr CalCoreTrack::compress(
         kl->eliminated_ = false;
     }
 
-    // Iterate until quiescence.
-    bool removedFrame = true;
+    // Iterate until quiescence.  The elimination test interpolates
+    // linearly, which says nothing about a spline's error, so spline
+    // keys are all kept.
+    bool removedFrame = !splineInterpolated;
     while (removedFrame) {
         removedFrame = false;
 
@@ -256,6 +271,7 @@ CalCoreTrackPtr CalCoreTrack::compress(
     }
 
     CalCoreTrackPtr result(new CalCoreTrack(coreBoneId, output));
+    result->splineInterpolated = splineInterpolated;
 
     // Update the flag saying whether the translation, which I have loaded, is actually required.
     // If translation is not required, I can't do any better than that so I leave it alone.
@@ -271,11 +287,344 @@ CalCoreTrackPtr CalCoreTrack::compress(
 
 
 
+namespace {
+    inline CalVector4 asVector4(const CalQuaternion& q) {
+        return CalVector4(q.x, q.y, q.z, q.w);
+    }
+
+    inline float dot4(const CalVector4& a, const CalVector4& b) {
+        const CalVector4 p = a * b;
+        return p.x + p.y + p.z + p.w;
+    }
+
+    // q or -q, whichever is nearer to reference; both are the same rotation
+    inline CalVector4 nearestTo(const CalVector4& q, const CalVector4& reference) {
+        return dot4(q, reference) < 0.0f ? CalVector4(-1.0f * q) : q;
+    }
+
+    // Samples the segment from k1 to k2.  k0 and k3 are the keys on either
+    // side, or k1 and k2 themselves at the ends of the track, which makes
+    // the end tangents one-sided.
+    //
+    // The curve is a cubic Hermite segment whose tangents are the
+    // finite differences (p2 - p0) / (t2 - t0) and (p3 - p1) / (t3 - t1).
+    // Both are linear in the keys, so the whole curve folds into one
+    // weight per key, computed once and shared by every lane of the
+    // rotation and the translation.
+    struct SplineSegment {
+        SplineSegment(
+            const CalCoreKeyframe& k0, const CalCoreKeyframe& k1,
+            const CalCoreKeyframe& k2, const CalCoreKeyframe& k3,
+            float time
+        )
+            : k0(k0), k1(k1), k2(k2), k3(k3)
+        {
+            const float span = k2.time - k1.time;
+            const float s = span > 0.0f ? (time - k1.time) / span : 0.0f;
+            const float s2 = s * s;
+            const float s3 = s2 * s;
+
+            // Hermite basis, with the tangent terms scaled from per second
+            // to per segment and divided by their finite-difference spans
+            const float startSpan = k2.time - k0.time;
+            const float endSpan = k3.time - k1.time;
+            const float startTangent = startSpan > 0.0f ? (s3 - 2.0f * s2 + s) * span / startSpan : 0.0f;
+            const float endTangent = endSpan > 0.0f ? (s3 - s2) * span / endSpan : 0.0f;
+
+            w0 = -startTangent;
+            w1 = 2.0f * s3 - 3.0f * s2 + 1.0f - endTangent;
+            w2 = 3.0f * s2 - 2.0f * s3 + startTangent;
+            w3 = endTangent;
+        }
+
+        CalVector4 evaluate(
+            const CalVector4& p0, const CalVector4& p1,
+            const CalVector4& p2, const CalVector4& p3
+        ) const {
+            return w0 * p0 + w1 * p1 + w2 * p2 + w3 * p3;
+        }
+
+        CalQuaternion rotation() const {
+            const CalVector4 q1 = asVector4(k1.transform.rotation);
+            const CalVector4 q0 = nearestTo(asVector4(k0.transform.rotation), q1);
+            const CalVector4 q2 = nearestTo(asVector4(k2.transform.rotation), q1);
+            const CalVector4 q3 = nearestTo(asVector4(k3.transform.rotation), q2);
+
+            CalVector4 q = evaluate(q0, q1, q2, q3);
+            q *= 1.0f / sqrtf(dot4(q, q));
+            return CalQuaternion(q.x, q.y, q.z, q.w);
+        }
+
+        CalVector translation() const {
+            return evaluate(
+                CalVector4(k0.transform.translation),
+                CalVector4(k1.transform.translation),
+                CalVector4(k2.transform.translation),
+                CalVector4(k3.transform.translation)).asCalVector();
+        }
+
+        const CalCoreKeyframe& k0;
+        const CalCoreKeyframe& k1;
+        const CalCoreKeyframe& k2;
+        const CalCoreKeyframe& k3;
+        float w0;
+        float w1;
+        float w2;
+        float w3;
+    };
+
+    // the segment from before to the key after it, which must exist
+    SplineSegment getSplineSegment(
+        const CalCoreTrack::KeyframeList& keyframes,
+        CalCoreTrack::KeyframeList::const_iterator before,
+        float time
+    ) {
+        const CalCoreTrack::KeyframeList::const_iterator after = before + 1;
+        return SplineSegment(
+            before == keyframes.begin() ? *before : *(before - 1),
+            *before,
+            *after,
+            after + 1 == keyframes.end() ? *after : *(after + 1),
+            time);
+    }
+
+    struct RemovalCandidate {
+        float cost;
+        size_t keyframe;
+        unsigned version;
+
+        bool operator<(const RemovalCandidate& rhs) const {
+            // std::priority_queue is a max-heap; pop the cheapest first
+            return cost > rhs.cost;
+        }
+    };
+
+    struct TrackReducer {
+        // original keyframes between two surviving ones, at most; a few
+        // seconds at typical sample rates
+        static const size_t maxRemovalSpan = 256;
+
+        TrackReducer(const CalCoreTrack::KeyframeList& keyframes, const std::vector<CalVector>& effectorOffsets, bool spline)
+            : keyframes(keyframes)
+            , effectorOffsets(effectorOffsets)
+            , spline(spline)
+            , previous(keyframes.size())
+            , next(keyframes.size())
+            , versions(keyframes.size())
+        {
+            for (size_t i = 0; i < keyframes.size(); ++i) {
+                previous[i] = i - 1;
+                next[i] = i + 1;
+            }
+        }
+
+        float pointError(const cal3d::RotateTranslate& expected, const cal3d::RotateTranslate& actual) const {
+            float error = DistanceSquared(expected.translation, actual.translation);
+            for (auto i = effectorOffsets.begin(); i != effectorOffsets.end(); ++i) {
+                error = std::max(error, DistanceSquared(expected * *i, actual * *i));
+            }
+            return error;
+        }
+
+        // squared error at every original keyframe spanned if the keyframe
+        // were removed, interpolating as getCurrentTransform does
+        float removalCost(size_t k) const {
+            // Every original keyframe in the gap is rescanned, so gaps are
+            // capped to keep long static runs from costing O(n^2).
+            if (next[k] - previous[k] > maxRemovalSpan) {
+                return std::numeric_limits<float>::max();
+            }
+            if (spline) {
+                return splineRemovalCost(k);
+            }
+
+            const CalCoreKeyframe& before = keyframes[previous[k]];
+            const CalCoreKeyframe& after = keyframes[next[k]];
+            const float span = after.time - before.time;
+
+            float cost = 0.0f;
+            for (size_t j = previous[k] + 1; j < next[k]; ++j) {
+                const float blendFactor = span != 0.0f ? (keyframes[j].time - before.time) / span : 0.0f;
+                const cal3d::RotateTranslate interpolated = blend(blendFactor, before.transform, after.transform);
+                cost = std::max(cost, pointError(keyframes[j].transform, interpolated));
+            }
+            return cost;
+        }
+
+        // Removing a spline key changes the tangents of its neighbours, so
+        // the curve moves over two segments either side of it.  Those
+        // segments' tangents need one more live key beyond them.
+        float splineRemovalCost(size_t k) const {
+            size_t chain[6];
+            size_t before = 0;
+            for (size_t i = k; before < 3 && i != 0; ++before) {
+                i = previous[i];
+                chain[2 - before] = i;
+            }
+            size_t* const first = chain + 3 - before;
+            size_t length = before;
+            for (size_t i = k; length < before + 3 && i + 1 != keyframes.size(); ++length) {
+                i = next[i];
+                first[length] = i;
+            }
+
+            const size_t lo = before > 2 ? before - 2 : 0;
+            const size_t hi = std::min(length - 1, before + 1);
+
+            float cost = 0.0f;
+            for (size_t s = lo; s < hi; ++s) {
+                const CalCoreKeyframe& k0 = keyframes[first[s > 0 ? s - 1 : s]];
+                const CalCoreKeyframe& k1 = keyframes[first[s]];
+                const CalCoreKeyframe& k2 = keyframes[first[s + 1]];
+                const CalCoreKeyframe& k3 = keyframes[first[s + 2 < length ? s + 2 : s + 1]];
+                for (size_t j = first[s] + 1; j < first[s + 1]; ++j) {
+                    const SplineSegment segment(k0, k1, k2, k3, keyframes[j].time);
+                    const cal3d::RotateTranslate interpolated(segment.rotation(), segment.translation());
+                    cost = std::max(cost, pointError(keyframes[j].transform, interpolated));
+                }
+            }
+            return cost;
+        }
+
+        void push(size_t k) {
+            if (k == 0 || k + 1 >= keyframes.size()) {
+                return;
+            }
+            RemovalCandidate c = { removalCost(k), k, ++versions[k] };
+            candidates.push(c);
+        }
+
+        std::vector<bool> run(float tolerance) {
+            std::vector<bool> kept(keyframes.size(), true);
+            for (size_t k = 1; k + 1 < keyframes.size(); ++k) {
+                push(k);
+            }
+
+            const float limit = tolerance * tolerance;
+            while (!candidates.empty()) {
+                const RemovalCandidate c = candidates.top();
+                candidates.pop();
+                if (c.version != versions[c.keyframe]) {
+                    continue;
+                }
+                if (c.cost > limit) {
+                    break;
+                }
+
+                kept[c.keyframe] = false;
+                const size_t before = previous[c.keyframe];
+                const size_t after = next[c.keyframe];
+                next[before] = after;
+                previous[after] = before;
+
+                // a spline removal's cost depends on three live keys either side
+                const size_t reach = spline ? 3 : 1;
+                for (size_t i = before, n = 0; n < reach; i = previous[i], ++n) {
+                    push(i);
+                    if (i == 0) {
+                        break;
+                    }
+                }
+                for (size_t i = after, n = 0; n < reach; i = next[i], ++n) {
+                    push(i);
+                    if (i + 1 == keyframes.size()) {
+                        break;
+                    }
+                }
+            }
+            return kept;
+        }
+
+        const CalCoreTrack::KeyframeList& keyframes;
+        const std::vector<CalVector>& effectorOffsets;
+        const bool spline;
+        std::vector<size_t> previous;
+        std::vector<size_t> next;
+        std::vector<unsigned> versions;
+        std::priority_queue<RemovalCandidate> candidates;
+    };
+}
+
+/*****************************************************************************/
+/** Greedy error-bounded keyframe reduction.
+  *
+  * Unlike compress, adjacent keyframes may both be removed: the cost of a
+  * removal is checked against every original keyframe between the surviving
+  * neighbours, so runs of removals cannot flatten a curve.  Each removal
+  * only changes the cost of its two neighbours, which are re-queued.  A
+  * cost rescans the original keyframes in the gap, and gaps are capped at
+  * TrackReducer::maxRemovalSpan, so the whole reduction is
+  * O(n log n * maxRemovalSpan).
+  *****************************************************************************/
+
+static CalCoreTrackPtr reduceTrack(
+    const CalCoreTrack& track,
+    const std::vector<CalVector>& effectorOffsets,
+    float tolerance,
+    const CalCoreSkeleton* skelOrNull,
+    bool spline
+) {
+    // a spline's keys only describe it as a spline
+    spline = spline || track.splineInterpolated;
+
+    const CalCoreTrack::KeyframeList& keyframes = track.keyframes;
+    CalCoreTrack::KeyframeList output;
+    if (keyframes.size() > 2) {
+        const std::vector<bool> kept = TrackReducer(keyframes, effectorOffsets, spline).run(tolerance);
+        for (size_t i = 0; i < keyframes.size(); ++i) {
+            if (kept[i]) {
+                output.push_back(keyframes[i]);
+            }
+        }
+    } else {
+        output = keyframes;
+    }
+
+    CalCoreTrackPtr result(new CalCoreTrack(track.coreBoneId, output));
+    result->translationRequired = track.translationRequired;
+    result->translationIsDynamic = track.translationIsDynamic;
+    result->splineInterpolated = spline;
+
+    if (skelOrNull && track.translationRequired && track.coreBoneId < skelOrNull->coreBones.size()) {
+        result->translationCompressibility(
+            &result->translationRequired,
+            &result->translationIsDynamic,
+            tolerance, skelOrNull);
+    }
+
+    return result;
+}
+
+CalCoreTrackPtr CalCoreTrack::reduce(
+    const std::vector<CalVector>& effectorOffsets,
+    float tolerance,
+    const CalCoreSkeleton* skelOrNull
+) const {
+    return reduceTrack(*this, effectorOffsets, tolerance, skelOrNull, false);
+}
+
+/*****************************************************************************/
+/** Fits a spline through a subset of the keyframes.
+  *
+  * Uses the same greedy removal as reduce, but each removal is costed by
+  * evaluating the spline through the surviving keys, which keeps the
+  * curve within tolerance at every original keyframe.  Fitting costs more
+  * than reduce because a removal reshapes four segments rather than one.
+  *****************************************************************************/
+
+CalCoreTrackPtr CalCoreTrack::fitSpline(
+    const std::vector<CalVector>& effectorOffsets,
+    float tolerance,
+    const CalCoreSkeleton* skelOrNull
+) const {
+    return reduceTrack(*this, effectorOffsets, tolerance, skelOrNull, true);
+}
+
 void CalCoreTrack::translationCompressibility(
     bool* transRequiredResult,
     bool* transDynamicResult,
     float threshold,
-    CalCoreSkeleton* skel
+    const CalCoreSkeleton* skel
 ) const {
     * transRequiredResult = false;
     * transDynamicResult = false;
@@ -321,6 +670,11 @@ cal3d::RotateTranslate CalCoreTrack::getCurrentTransform(float time) const {
     KeyframeList::const_iterator iteratorCoreKeyframeBefore = iteratorCoreKeyframeAfter;
     --iteratorCoreKeyframeBefore;
 
+    if (splineInterpolated) {
+        const SplineSegment segment = getSplineSegment(keyframes, iteratorCoreKeyframeBefore, time);
+        return cal3d::RotateTranslate(segment.rotation(), segment.translation());
+    }
+
     const CalCoreKeyframe& pCoreKeyframeBefore = *iteratorCoreKeyframeBefore;
     const CalCoreKeyframe& pCoreKeyframeAfter  = *iteratorCoreKeyframeAfter;
 
@@ -332,6 +686,46 @@ cal3d::RotateTranslate CalCoreTrack::getCurrentTransform(float time) const {
     return blend(blendFactor, pCoreKeyframeBefore.transform, pCoreKeyframeAfter.transform);
 }
 
+CalQuaternion CalCoreTrack::getCurrentRotation(float time) const {
+    if (keyframes.empty()) {
+        return CalQuaternion();
+    }
+
+    KeyframeList::const_iterator after = getUpperBound(time);
+
+    if (after == keyframes.end()) {
+        return keyframes.back().transform.rotation;
+    }
+
+    if (after == keyframes.begin()) {
+        return after->transform.rotation;
+    }
+
+    KeyframeList::const_iterator before = after - 1;
+
+    if (splineInterpolated) {
+        return getSplineSegment(keyframes, before, time).rotation();
+    }
+
+    float blendFactor = 0.0;
+    if (after->time != before->time) {
+        blendFactor = (time - before->time) / (after->time - before->time);
+    }
+
+    return slerp(blendFactor, before->transform.rotation, after->transform.rotation);
+}
+
+cal3d::RotateTranslate CalCoreTrack::getCurrentTransform(float time, const CalVector& bindTranslation) const {
+    if (!hasStaticTranslation() || keyframes.empty()) {
+        return getCurrentTransform(time);
+    }
+
+    // skip the translation lerp; it's the same in every keyframe
+    return cal3d::RotateTranslate(
+        getCurrentRotation(time),
+        translationRequired ? keyframes.front().transform.translation : bindTranslation);
+}
+
 CalCoreTrack::KeyframeList::const_iterator CalCoreTrack::getUpperBound(float time) const {
     return std::upper_bound(
         keyframes.begin(),
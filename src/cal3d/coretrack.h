@@ -31,7 +31,14 @@ public:
     bool translationRequired;
     bool translationIsDynamic;
 
+    // When set, the keyframes are control points of a Catmull-Rom spline
+    // (cubic Hermite with finite-difference tangents) instead of being
+    // interpolated linearly.  See fitSpline.
+    bool splineInterpolated;
+
     CalCoreTrack(int coreBoneId, const KeyframeList& keyframes);
+    // takes the keyframes rather than copying them, as loaders do
+    CalCoreTrack(int coreBoneId, KeyframeList&& keyframes);
 
     size_t sizeInBytes() const;
     void scale(float factor);
@@ -44,12 +51,51 @@ public:
 
     cal3d::RotateTranslate getCurrentTransform(float time) const;
 
+    // True when the translation may be treated as constant: compress()
+    // found it within tolerance of the bone's bind translation
+    // (!translationRequired) or of the first keyframe's
+    // (!translationIsDynamic).  Such tracks only need their rotations
+    // sampled.
+    bool hasStaticTranslation() const {
+        return !translationRequired || !translationIsDynamic;
+    }
+    CalQuaternion getCurrentRotation(float time) const;
+
+    // Like getCurrentTransform, but only samples the rotation when the
+    // translation is static, taking it from bindTranslation if
+    // !translationRequired.
+    cal3d::RotateTranslate getCurrentTransform(float time, const CalVector& bindTranslation) const;
+
+    // Removes keyframes the neighbouring keys interpolate linearly within
+    // tolerance.  Spline tracks keep every keyframe.
     CalCoreTrackPtr compress(double translationTolerance, double rotationToleranceDegrees, CalCoreSkeleton* skelOrNull) const;
     void translationCompressibility(
         bool* transRequiredResult, bool* transDynamicResult,
-        float threshold, CalCoreSkeleton* skel
+        float threshold, const CalCoreSkeleton* skel
     ) const;
 
+    // Removes keyframes while the interpolated track stays within tolerance
+    // of the original at every original keyframe time.  Error is the
+    // largest displacement of the bone's origin or of any point in
+    // effectorOffsets, which are in the bone's own space (see
+    // CalCoreSkeleton::getDescendantOffsets).  Keyframes are removed
+    // cheapest first.  Translation flags are recomputed when skelOrNull is
+    // given, as in compress.  Spline tracks stay splines, reduced as
+    // fitSpline would reduce them.
+    CalCoreTrackPtr reduce(
+        const std::vector<CalVector>& effectorOffsets,
+        float tolerance,
+        const CalCoreSkeleton* skelOrNull) const;
+
+    // Like reduce, but the kept keyframes become the control points of a
+    // spline, which follows curved motion with far fewer keys than linear
+    // interpolation does.  Sampling the result costs a little more per
+    // sample than a linear track.
+    CalCoreTrackPtr fitSpline(
+        const std::vector<CalVector>& effectorOffsets,
+        float tolerance,
+        const CalCoreSkeleton* skelOrNull) const;
+
 private:
     KeyframeList::const_iterator getUpperBound(float time) const;
 };
@@ -57,5 +103,6 @@ CAL3D_PTR(CalCoreTrack);
 
 inline bool operator==(const CalCoreTrack& lhs, const CalCoreTrack& rhs) {
     return lhs.coreBoneId == rhs.coreBoneId &&
+           lhs.splineInterpolated == rhs.splineInterpolated &&
            lhs.keyframes == rhs.keyframes;
 }
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <locale.h>
+#include <string>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+// Parses numbers in the C locale for the lifetime of the object.  Only the
+// calling thread's locale changes, so loads on other threads, and
+// whatever else those threads are doing, are unaffected.
+struct ForceCLocale {
+    ForceCLocale() {
+#ifdef _WIN32
+        previousThreadState = _configthreadlocale(_ENABLE_PER_THREAD_LOCALE);
+        // copied, since the next setlocale call may overwrite it
+        previousLocale = setlocale(LC_ALL, 0);
+        setlocale(LC_ALL, "C");
+#else
+        previousLocale = uselocale(cLocale());
+#endif
+    }
+
+    ~ForceCLocale() {
+#ifdef _WIN32
+        setlocale(LC_ALL, previousLocale.c_str());
+        _configthreadlocale(previousThreadState);
+#else
+        uselocale(previousLocale);
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    int previousThreadState;
+    std::string previousLocale;
+#else
+    static locale_t cLocale() {
+        static const locale_t c = newlocale(LC_ALL_MASK, "C", 0);
+        return c;
+    }
+
+    locale_t previousLocale;
+#endif
+};
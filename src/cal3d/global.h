@@ -50,11 +50,12 @@ namespace cal3d {
     const char MESH_FILE_MAGIC[4]      = { 'C', 'M', 'F', '\0' };
     const char MATERIAL_FILE_MAGIC[4]  = { 'C', 'R', 'F', '\0' };
 
-    const int LIBRARY_VERSION = 919;
+    const int LIBRARY_VERSION = 920;
 
     const int CURRENT_FILE_VERSION = LIBRARY_VERSION;
     const int EARLIEST_COMPATIBLE_FILE_VERSION = 699;
 
+    const int FIRST_FILE_VERSION_WITH_SPLINE_TRACKS = 920;
     const int FIRST_FILE_VERSION_WITH_ANIMATION_COMPRESSION6 = 918;
     const int FIRST_FILE_VERSION_WITH_ANIMATION_COMPRESSION5 = 917;
     const int FIRST_FILE_VERSION_WITH_ANIMATION_COMPRESSION4 = 916;
@@ -12,12 +12,14 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <boost/optional.hpp>
 #include <stdexcept>
 #include <rapidxml.hpp>
 #include "cal3d/memory.h"
 #include "cal3d/loader.h"
 #include "cal3d/error.h"
+#include "cal3d/forceclocale.h"
 #include "cal3d/vector.h"
 #include "cal3d/quaternion.h"
 #include "cal3d/coreskeleton.h"
@@ -105,6 +107,18 @@ bool CAL3D_API CalVectorFromDataSrc(CalBufferSource& dataSrc, CalVector4* calVec
     }
 }
 
+// The three little-endian floats at p, with w.  Vertex records are longer
+// than 16 bytes, so the fourth float read by the SIMD path is in bounds.
+static inline CalBase4 decodeVector(const char* p, float w) {
+#if defined(IMVU_NO_INTRINSICS) || defined(CAL3D_BIG_ENDIAN)
+    return CalBase4(cal3d::decodeFloat(p), cal3d::decodeFloat(p + 4), cal3d::decodeFloat(p + 8), w);
+#else
+    const __m128 xyz = _mm_loadu_ps(reinterpret_cast<const float*>(p));
+    // (z, w, _, w), then (x, y, z, w)
+    return CalBase4(_mm_movelh_ps(xyz, _mm_unpackhi_ps(xyz, _mm_set1_ps(w))));
+#endif
+}
+
 bool
 TranslationWritten(CalCoreKeyframe* lastCoreKeyframe, bool translationRequired, bool translationIsDynamic) {
     return (translationRequired && (!lastCoreKeyframe || translationIsDynamic));
@@ -133,33 +147,11 @@ private:
     ScopedArray& operator=(const ScopedArray&);
 };
 
-struct ForceCLocale {
-    ForceCLocale() {
-#ifdef _WIN32
-        previousThreadState = _configthreadlocale(_ENABLE_PER_THREAD_LOCALE);
-#endif
-        previousLocale = setlocale(LC_ALL, "C");
-    }
-
-    ~ForceCLocale() {
-        setlocale(LC_ALL, previousLocale);
-#ifdef _WIN32
-        _configthreadlocale(previousThreadState);
-#endif
-    }
-
-private:
-#ifdef _WIN32
-    int previousThreadState;
-#endif
-    const char* previousLocale;
-};
-
-template<typename RV>
+template<typename RV, typename XmlLoader>
 RV tryBothLoaders(
     CalBufferSource& inputSource,
     RV(*binaryLoader)(CalBufferSource&),
-    RV(*xmlLoader)(char*)
+    XmlLoader xmlLoader
 ) {
     try {
         if (RV anim = binaryLoader(inputSource)) {
@@ -189,8 +181,10 @@ CalCoreMaterialPtr CalLoader::loadCoreMaterial(CalBufferSource& inputSrc) {
     return tryBothLoaders(inputSrc, &loadBinaryCoreMaterial, &loadXmlCoreMaterial);
 }
 
-CalCoreMeshPtr CalLoader::loadCoreMesh(CalBufferSource& inputSrc) {
-    return tryBothLoaders(inputSrc, &loadBinaryCoreMesh, &loadXmlCoreMesh);
+CalCoreMeshPtr CalLoader::loadCoreMesh(CalBufferSource& inputSrc, unsigned threadCount) {
+    return tryBothLoaders(inputSrc, &loadBinaryCoreMesh, [threadCount](char* data) {
+        return loadXmlCoreMesh(data, threadCount);
+    });
 }
 
 CalCoreSkeletonPtr CalLoader::loadCoreSkeleton(CalBufferSource& inputSrc) {
@@ -252,18 +246,16 @@ CalCoreAnimationPtr CalLoader::loadBinaryCoreAnimation(CalBufferSource& dataSrc)
         return null;
     }
 
-    // load all core bones
+    // every track takes at least four bytes, so a corrupt count can't
+    // reserve more than the file could hold
+    pCoreAnimation->tracks.reserve(std::min<size_t>(trackCount, dataSrc.remaining() / 4));
     for (int trackId = 0; trackId < trackCount; ++trackId) {
-        // load the core track
-        CalCoreTrackPtr pCoreTrack(loadCoreTrack(dataSrc, version, useAnimationCompression));
-        if (!pCoreTrack) {
+        if (!loadCoreTrack(dataSrc, version, useAnimationCompression, pCoreAnimation.get())) {
             return null;
         }
-
-        // add the core track to the core animation instance
-        pCoreAnimation->tracks.push_back(*pCoreTrack);
     }
 
+    pCoreAnimation->buildTrackTable();
     return pCoreAnimation;
 }
 
@@ -311,13 +303,11 @@ CalCoreMorphAnimationPtr CalLoader::loadBinaryCoreMorphAnimation(CalBufferSource
         return null;
     }
 
+    pCoreMorphAnimation->tracks.reserve(std::min<size_t>(trackCount, dataSrc.remaining() / 4));
     for (int trackId = 0; trackId < trackCount; ++trackId) {
-        CalCoreMorphTrackPtr pCoreTrack = loadCoreMorphTrack(dataSrc);
-        if (!pCoreTrack) {
+        if (!loadCoreMorphTrack(dataSrc, pCoreMorphAnimation.get())) {
             return null;
         }
-
-        pCoreMorphAnimation->tracks.push_back(*pCoreTrack);
     }
 
     return pCoreMorphAnimation;
@@ -636,14 +626,13 @@ CalLoader::usesAnimationCompression(int version) {
 }
 
 
-CalCoreKeyframePtr CalLoader::loadCoreKeyframe(
+bool CalLoader::loadCoreKeyframe(
     CalBufferSource& dataSrc, int version,
     CalCoreKeyframe* prevCoreKeyframe,
     bool translationRequired, bool highRangeRequired, bool translationIsDynamic,
-    bool useAnimationCompression
+    bool useAnimationCompression,
+    CalCoreKeyframe* keyframe
 ) {
-    const CalCoreKeyframePtr null;
-
     float time;
     CalVector t;
     float rx, ry, rz, rw;
@@ -653,7 +642,7 @@ CalCoreKeyframePtr CalLoader::loadCoreKeyframe(
         unsigned char buf[ 100 ];
         if (!dataSrc.readBytes(buf, bytesRequired)) {
             CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-            return null;
+            return false;
         }
         CalVector vec;
         CalQuaternion quat;
@@ -663,7 +652,7 @@ CalCoreKeyframePtr CalLoader::loadCoreKeyframe(
             translationRequired, highRangeRequired, translationIsDynamic);
         if (bytesRead != bytesRequired) {
             CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-            return null;
+            return false;
         }
         t = vec;
         rx = quat.x;
@@ -702,10 +691,136 @@ CalCoreKeyframePtr CalLoader::loadCoreKeyframe(
         dataSrc.readFloat(rw);
     }
 
-    CalCoreKeyframePtr pCoreKeyframe(new CalCoreKeyframe(time, t, CalQuaternion(rx, ry, rz, -rw)));
-    return pCoreKeyframe;
+    *keyframe = CalCoreKeyframe(time, t, CalQuaternion(rx, ry, rz, -rw));
+    return true;
+}
+
+
+/*****************************************************************************/
+/** Fixed-layout decoders for compressed keyframes.
+  *
+  * Every field of a compressed keyframe has a fixed width, so rather than
+  * pulling fields out of a BitReader one call at a time, each record is
+  * assembled into a single little-endian word and the fields are masked
+  * out of it.  The bit layouts, lowest bit first, are:
+  *
+  *   rotation and time, 6 bytes: 2 bits for the index of the largest
+  *   quaternion component, which is omitted; then sign and 11 bits for each
+  *   of the other three; then 10 bits of time in 30ths of a second.
+  *
+  *   translation, 10 bytes: sign-magnitude x, y and z of 25 bits plus
+  *   sign, then 2 bits of padding.  Or 4 bytes: 9 bits plus sign each.
+  *
+  * Results match ReadQuatAndExtra and the BitReader decoding bit for bit.
+  *****************************************************************************/
+
+static inline cal3d_uint64 loadLittleEndian(const unsigned char* p, unsigned bytes) {
+    cal3d_uint64 word = 0;
+    for (unsigned i = 0; i < bytes; ++i) {
+        word |= cal3d_uint64(p[i]) << (8 * i);
+    }
+    return word;
 }
 
+// a magnitude of bits bits followed by a sign bit, scaled to range
+static inline float decodeSignMagnitude(cal3d_uint64 field, unsigned bits, float range) {
+    const float magnitude = FixedPointToFloatZeroToOne(unsigned(field & ((1u << bits) - 1)), bits) * range;
+    return (field >> bits) & 1 ? -magnitude : magnitude;
+}
+
+static inline void decodeCompressedRotation(const unsigned char* p, CalQuaternion* rotation, float* time) {
+    const unsigned componentBits = CalLoader::keyframeBitsPerOriComponent;
+    const cal3d_uint64 word = loadLittleEndian(p, 6);
+
+    const unsigned largest = unsigned(word & 3);
+    float q[4];
+    float sum = 0.0f;
+    unsigned shift = 2;
+    for (unsigned i = 0; i < 4; ++i) {
+        if (i != largest) {
+            // the sign comes first here, below the magnitude
+            const float magnitude = FixedPointToFloatZeroToOne(unsigned((word >> (shift + 1)) & ((1u << componentBits) - 1)), componentBits);
+            q[i] = (word >> shift) & 1 ? -magnitude : magnitude;
+            sum += q[i] * q[i];
+            shift += componentBits + 1;
+        }
+    }
+    if (sum > 1.0f) {
+        sum = 1.0f;    // Safety for sqrt.
+    }
+    q[largest] = sqrtf(1.0f - sum);
+
+    *rotation = CalQuaternion(q[0], q[1], q[2], q[3]);
+    *time = unsigned((word >> shift) & ((1u << CalLoader::keyframeBitsPerTime) - 1)) / 30.0f;
+}
+
+static inline void decodeCompressedTranslation(const unsigned char* p, bool highRangeRequired, CalVector* translation) {
+    if (highRangeRequired) {
+        const unsigned bits = CalLoader::keyframeBitsPerUnsignedPosComponent;
+        const float range = CalLoader::keyframePosRange;
+        // z straddles the first eight bytes; it starts 4 bits into byte 6
+        const cal3d_uint64 xy = loadLittleEndian(p, 8);
+        const cal3d_uint64 z = loadLittleEndian(p + 6, 4) >> 4;
+        translation->set(
+            decodeSignMagnitude(xy, bits, range),
+            decodeSignMagnitude(xy >> (bits + 1), bits, range),
+            decodeSignMagnitude(z, bits, range));
+    } else {
+        const unsigned bits = CalLoader::keyframeBitsPerUnsignedPosComponentSmall;
+        const float range = CalLoader::keyframePosRangeSmall;
+        const cal3d_uint64 xyz = loadLittleEndian(p, 4);
+        translation->set(
+            decodeSignMagnitude(xyz, bits, range),
+            decodeSignMagnitude(xyz >> (bits + 1), bits, range),
+            decodeSignMagnitude(xyz >> (2 * (bits + 1)), bits, range));
+    }
+}
+
+/*****************************************************************************/
+/** Decodes all of a track's compressed keyframes in one pass.
+  *
+  * From version 6 of the compressed format, keyframes hold nothing but
+  * their packed bits, and every keyframe after the first has the same
+  * size.  So the track is bounds checked and read as one block, and the
+  * keyframes are decoded straight into the list.
+  *****************************************************************************/
+
+bool CalLoader::loadCompressedKeyframes(
+    CalBufferSource& dataSrc, int keyframeCount,
+    bool translationRequired, bool highRangeRequired, bool translationIsDynamic,
+    std::vector<CalCoreKeyframe>* keyframes
+) {
+    if (keyframeCount <= 0) {
+        return true;
+    }
+
+    const size_t translationBytes = highRangeRequired ? keyframePosBytes : keyframePosBytesSmall;
+    const bool dynamicTranslation = translationRequired && translationIsDynamic;
+    const size_t firstBytes = (translationRequired ? translationBytes : 0) + 6;
+    const size_t stride = (dynamicTranslation ? translationBytes : 0) + 6;
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(
+        dataSrc.readBlock(firstBytes + (keyframeCount - 1) * stride));
+    if (!p) {
+        CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+        return false;
+    }
+
+    keyframes->resize(keyframeCount);
+    CalVector translation = InvalidTranslation;
+    CalQuaternion rotation;
+    float time;
+    for (int i = 0; i < keyframeCount; ++i) {
+        if (dynamicTranslation || (translationRequired && i == 0)) {
+            decodeCompressedTranslation(p, highRangeRequired, &translation);
+            p += translationBytes;
+        }
+        decodeCompressedRotation(p, &rotation, &time);
+        p += 6;
+        (*keyframes)[i] = CalCoreKeyframe(time, translation, CalQuaternion(rotation.x, rotation.y, rotation.z, -rotation.w));
+    }
+    return true;
+}
 
 // Return the number of bytes required by the compressed binary format of a keyframe with these attributes.
 unsigned int
@@ -753,88 +868,16 @@ CalLoader::readCompressedKeyframe(
         if (lastCoreKeyframe && !translationIsDynamic) {
             * vecResult = lastCoreKeyframe->transform.translation;
         } else {
-            unsigned int data;
-            float tx, ty, tz;
-            if (highRangeRequired) {
-                BitReader br(buf);
-
-                // Read x.
-                br.read(& data, keyframeBitsPerUnsignedPosComponent);
-                tx = FixedPointToFloatZeroToOne(data, keyframeBitsPerUnsignedPosComponent) * keyframePosRange;
-                br.read(& data, 1);
-                if (data) {
-                    tx = - tx;
-                }
-
-                // Read y.
-                br.read(& data, keyframeBitsPerUnsignedPosComponent);
-                ty = FixedPointToFloatZeroToOne(data, keyframeBitsPerUnsignedPosComponent) * keyframePosRange;
-                br.read(& data, 1);
-                if (data) {
-                    ty = - ty;
-                }
-
-                // Read z.
-                br.read(& data, keyframeBitsPerUnsignedPosComponent);
-                tz = FixedPointToFloatZeroToOne(data, keyframeBitsPerUnsignedPosComponent) * keyframePosRange;
-                br.read(& data, 1);
-                if (data) {
-                    tz = - tz;
-                }
-
-                // Now even it off to n bytes.
-                br.read(& data, keyframeBitsPerPosPadding);
-                assert(br.bytesRead() == keyframePosBytes);
-                buf += keyframePosBytes;
-            } else {
-                BitReader br(buf);
-
-                // Read x.
-                br.read(& data, keyframeBitsPerUnsignedPosComponentSmall);
-                tx = FixedPointToFloatZeroToOne(data, keyframeBitsPerUnsignedPosComponentSmall) * keyframePosRangeSmall;
-                br.read(& data, 1);
-                if (data) {
-                    tx = - tx;
-                }
-
-                // Read y.
-                br.read(& data, keyframeBitsPerUnsignedPosComponentSmall);
-                ty = FixedPointToFloatZeroToOne(data, keyframeBitsPerUnsignedPosComponentSmall) * keyframePosRangeSmall;
-                br.read(& data, 1);
-                if (data) {
-                    ty = - ty;
-                }
-
-                // Read z.
-                br.read(& data, keyframeBitsPerUnsignedPosComponentSmall);
-                tz = FixedPointToFloatZeroToOne(data, keyframeBitsPerUnsignedPosComponentSmall) * keyframePosRangeSmall;
-                br.read(& data, 1);
-                if (data) {
-                    tz = - tz;
-                }
-
-                // Now even it off to n bytes.
-                br.read(& data, keyframeBitsPerPosPaddingSmall);
-                assert(br.bytesRead() == keyframePosBytesSmall);
-                buf += keyframePosBytesSmall;
-            }
-            vecResult->set(tx, ty, tz);
+            decodeCompressedTranslation(buf, highRangeRequired, vecResult);
+            buf += highRangeRequired ? keyframePosBytes : keyframePosBytesSmall;
         }
     } else {
         *vecResult = InvalidTranslation;
     }
 
     // Read in the quat and time.
-    float quat[ 4 ];
-    unsigned int steps;
-    unsigned int bytesRead = ReadQuatAndExtra(buf, quat, & steps, keyframeBitsPerOriComponent, keyframeBitsPerTime);
+    decodeCompressedRotation(buf, quatResult, timeResult);
     buf += 6;
-
-    (void)bytesRead;
-    assert(bytesRead == 6);
-
-    *quatResult = CalQuaternion(quat[ 0 ], quat[ 1 ], quat[ 2 ], quat[ 3 ]);
-    *timeResult = steps / 30.0f;
     return buf - bufStart;
 }
 
@@ -852,9 +895,7 @@ CalLoader::readCompressedKeyframe(
  *         \li \b 0 if an error happened
  *****************************************************************************/
 
-CalCoreMorphKeyframePtr CalLoader::loadCoreMorphKeyframe(CalBufferSource& dataSrc) {
-    const CalCoreMorphKeyframePtr null;
-
+bool CalLoader::loadCoreMorphKeyframe(CalBufferSource& dataSrc, CalCoreMorphKeyframe* keyframe) {
     // get the time of the morphKeyframe
     float time;
     dataSrc.readFloat(time);
@@ -863,14 +904,14 @@ CalCoreMorphKeyframePtr CalLoader::loadCoreMorphKeyframe(CalBufferSource& dataSr
     float weight;
     dataSrc.readFloat(weight);
 
-    CalCoreMorphKeyframePtr pCoreMorphKeyframe(new CalCoreMorphKeyframe);
-    pCoreMorphKeyframe->time = time;
-    pCoreMorphKeyframe->weight = weight;
-    return pCoreMorphKeyframe;
+    *keyframe = CalCoreMorphKeyframe(time, weight);
+    return true;
 }
 
 
 CalCoreSubmeshPtr CalLoader::loadCoreSubmesh(CalBufferSource& dataSrc, int version) {
+    const CalCoreSubmeshPtr null;
+
     bool hasVertexColors = (version >= cal3d::FIRST_FILE_VERSION_WITH_VERTEX_COLORS);
     bool hasMorphTargetsInMorphFiles = (version >= cal3d::FIRST_FILE_VERSION_WITH_MORPH_TARGETS_IN_MORPH_FILES);
 
@@ -900,81 +941,83 @@ CalCoreSubmeshPtr CalLoader::loadCoreSubmesh(CalBufferSource& dataSrc, int versi
         dataSrc.readInteger(morphCount);
     }
 
+    // Every vertex starts with a fixed-size record: position, normal,
+    // optional color, collapse id, face collapse count, texture
+    // coordinates, and influence count.  Its influences follow.  Check
+    // that the counts fit in what is left before allocating anything.
+    const size_t vertexRecordBytes = 24 + (hasVertexColors ? 12 : 0) + 8 + 8 * size_t(std::max(textureCoordinateCount, 0)) + 4;
+    if (
+        vertexCount < 0 || faceCount < 0 || springCount < 0 || textureCoordinateCount < 0 ||
+        size_t(vertexCount) > dataSrc.remaining() / vertexRecordBytes ||
+        size_t(faceCount) > (dataSrc.remaining() - vertexCount * vertexRecordBytes) / 12
+    ) {
+        CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+        return null;
+    }
+
     CalCoreSubmeshPtr pCoreSubmesh(new CalCoreSubmesh(vertexCount, textureCoordinateCount ? true : false, faceCount));
     pCoreSubmesh->coreMaterialThreadId = coreMaterialThreadId;
 
+    const CalColor32 white = CalMakeColor(CalVector(1.0f, 1.0f, 1.0f));
+    const size_t springBytes = (springCount > 0) ? 4 : 0;
+    std::vector<CalCoreSubmesh::Influence> influences;
+
     for (int vertexId = 0; vertexId < vertexCount; ++vertexId) {
+        const char* record = dataSrc.readBlock(vertexRecordBytes);
+        if (!record) {
+            CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+            return null;
+        }
+
         CalCoreSubmesh::Vertex vertex;
-        CalColor32 vertexColor;
-
-        // load data of the vertex
-        dataSrc.readFloat(vertex.position.x);
-        dataSrc.readFloat(vertex.position.y);
-        dataSrc.readFloat(vertex.position.z);
-        dataSrc.readFloat(vertex.normal.x);
-        dataSrc.readFloat(vertex.normal.y);
-        dataSrc.readFloat(vertex.normal.z);
-        vertexColor = CalMakeColor(CalVector(1.0f, 1.0f, 1.0f));
+        vertex.position = decodeVector(record, 1.0f);
+        vertex.normal = decodeVector(record + 12, 0.0f);
+        record += 24;
+
+        CalColor32 vertexColor = white;
         if (hasVertexColors) {
-            CalVector vc;
-            dataSrc.readFloat(vc.x);
-            dataSrc.readFloat(vc.y);
-            dataSrc.readFloat(vc.z);
-            vertexColor = CalMakeColor(vc);
+            vertexColor = CalMakeColor(CalVector(cal3d::decodeFloat(record), cal3d::decodeFloat(record + 4), cal3d::decodeFloat(record + 8)));
+            record += 12;
         }
-        int collapseId;
-        int faceCollapseCount;
-        dataSrc.readInteger(collapseId);
-        dataSrc.readInteger(faceCollapseCount);
-
-        for (int textureCoordinateId = 0; textureCoordinateId < textureCoordinateCount; ++textureCoordinateId) {
-            CalCoreSubmesh::TextureCoordinate textureCoordinate;
 
-            dataSrc.readFloat(textureCoordinate.u);
-            dataSrc.readFloat(textureCoordinate.v);
+        // collapse id and face collapse count are unused
+        record += 8;
 
-            if (textureCoordinateId == 0) {
-                pCoreSubmesh->setTextureCoordinate(vertexId, textureCoordinate);
-            }
+        if (textureCoordinateCount > 0) {
+            pCoreSubmesh->setTextureCoordinate(vertexId, CalCoreSubmesh::TextureCoordinate(cal3d::decodeFloat(record), cal3d::decodeFloat(record + 4)));
         }
-
-        // get the number of influences
-        int influenceCount;
-        if (!dataSrc.readInteger(influenceCount) || (influenceCount < 0)) {
-            return CalCoreSubmeshPtr();
+        record += 8 * textureCoordinateCount;
+
+        // the influences, then the physical property of the vertex if
+        // there are springs in the core submesh
+        const int influenceCount = cal3d::decodeInteger(record);
+        const char* influenceRecord = (influenceCount < 0 || size_t(influenceCount) > dataSrc.remaining() / 8)
+            ? 0
+            : dataSrc.readBlock(8 * influenceCount + springBytes);
+        if (!influenceRecord) {
+            CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+            return null;
         }
 
-        std::vector<CalCoreSubmesh::Influence> influences;
-        allocateVectorWhereSizeIsGuarded(influenceCount, influences, __LINE__);
-
+        influences.resize(influenceCount);
         for (int influenceId = 0; influenceId < influenceCount; ++influenceId) {
-            dataSrc.readInteger(influences[influenceId].boneId);
-            dataSrc.readFloat(influences[influenceId].weight);
+            influences[influenceId].boneId = cal3d::decodeInteger(influenceRecord);
+            influences[influenceId].weight = cal3d::decodeFloat(influenceRecord + 4);
+            influenceRecord += 8;
         }
 
         // set vertex in the core submesh instance
         pCoreSubmesh->addVertex(vertex, vertexColor, influences);
-
-        // load the physical property of the vertex if there are springs in the core submesh
-        if (springCount > 0) {
-            float f;
-            // load data of the physical property
-            dataSrc.readFloat(f);
-        }
     }
 
-    // load all springs
-    for (int springId = 0; springId < springCount; ++springId) {
-        int i;
-        float f;
-
-        // load data of the spring
-        dataSrc.readInteger(i);
-        dataSrc.readInteger(i);
-        dataSrc.readFloat(f);
-        dataSrc.readFloat(f);
+    // skip all springs: two ids and two floats each
+    if (size_t(springCount) > dataSrc.remaining() / 16 || !dataSrc.readBlock(16 * springCount)) {
+        CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+        return null;
     }
 
+    // position, normal and texture coordinates, then the next blend vertex id
+    const size_t blendVertexRecordBytes = 24 + 8 * textureCoordinateCount + 4;
     for (int morphId = 0; morphId < morphCount; morphId++) {
         std::string morphName;
         dataSrc.readString(morphName);
@@ -984,67 +1027,67 @@ CalCoreSubmeshPtr CalLoader::loadCoreSubmesh(CalBufferSource& dataSrc, int versi
 
         CalCoreMorphTarget::VertexOffsetArray vertexOffsets;
 
-        for (int blendVertI = 0; blendVertI < vertexCount; blendVertI++) {
-            VertexOffset Vertex;
-
+        for (int blendVertI = std::max(blendVertId, 0); blendVertI < vertexCount; blendVertI++) {
             if (blendVertI >= blendVertId) {
-                CalVectorFromDataSrc(dataSrc, &Vertex.position);
-                CalVectorFromDataSrc(dataSrc, &Vertex.normal);
-                for (int textureCoordinateId = 0; textureCoordinateId < textureCoordinateCount; ++textureCoordinateId) {
-                    CalCoreSubmesh::TextureCoordinate textureCoordinate;
-                    dataSrc.readFloat(textureCoordinate.u);
-                    dataSrc.readFloat(textureCoordinate.v);
+                const char* record = dataSrc.readBlock(blendVertexRecordBytes);
+                if (!record) {
+                    CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+                    return null;
                 }
 
-                Vertex.vertexId = blendVertI;
-                Vertex.position -= pCoreSubmesh->getVectorVertex()[blendVertI].position;
-                Vertex.normal -= pCoreSubmesh->getVectorVertex()[blendVertI].normal;
-                vertexOffsets.push_back(Vertex);
-                dataSrc.readInteger(blendVertId);
+                VertexOffset offset(blendVertI, decodeVector(record, 1.0f), decodeVector(record + 12, 0.0f));
+                offset.position -= pCoreSubmesh->getVectorVertex()[blendVertI].position;
+                offset.normal -= pCoreSubmesh->getVectorVertex()[blendVertI].normal;
+                vertexOffsets.push_back(offset);
+                blendVertId = cal3d::decodeInteger(record + blendVertexRecordBytes - 4);
             }
         }
         CalCoreMorphTargetPtr morphTarget(new CalCoreMorphTarget(morphName, vertexCount, vertexOffsets));
         pCoreSubmesh->addMorphTarget(morphTarget);
     }
 
+    const char* faces = dataSrc.readBlock(12 * faceCount);
+    if (!faces) {
+        CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+        return null;
+    }
     for (int faceId = 0; faceId < faceCount; ++faceId) {
-        int tmp[3];
-        dataSrc.readInteger(tmp[0]);
-        dataSrc.readInteger(tmp[1]);
-        dataSrc.readInteger(tmp[2]);
+        const int v0 = cal3d::decodeInteger(faces);
+        const int v1 = cal3d::decodeInteger(faces + 4);
+        const int v2 = cal3d::decodeInteger(faces + 8);
+        faces += 12;
 
-        if (tmp[0] > 65535 || tmp[1] > 65535 || tmp[2] > 65535) {
+        if (v0 > 65535 || v1 > 65535 || v2 > 65535) {
             CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-            return CalCoreSubmeshPtr();
+            return null;
         }
 
-        pCoreSubmesh->addFace(CalCoreSubmesh::Face(tmp[0], tmp[1], tmp[2]));
+        pCoreSubmesh->addFace(CalCoreSubmesh::Face(v0, v1, v2));
     }
 
     return pCoreSubmesh;
 }
 
-CalCoreTrackPtr CalLoader::loadCoreTrack(
+bool CalLoader::loadCoreTrack(
     CalBufferSource& dataSrc,
     int version,
-    bool useAnimationCompression
+    bool useAnimationCompression,
+    CalCoreAnimation* coreAnimation
 ) {
-    const CalCoreTrackPtr null;
-
     // Read the bone id.
     int coreBoneId;
     bool translationRequired = true;
     bool highRangeRequired = true;
     bool translationIsDynamic = true;
     int keyframeCount;
-    static unsigned char buf[ 4 ];
+    unsigned char buf[ 4 ];
 
     // If this file version supports animation compression, then I store the boneId in 15 bits,
     // and use the 16th bit to record if translation is required.
     if (useAnimationCompression) {
         if (!dataSrc.readBytes(buf, 4)) {
             CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-            return null;
+            return false;
         }
 
         // Stored low byte first.  Top 3 bits of coreBoneId are compression flags.
@@ -1056,45 +1099,58 @@ CalCoreTrackPtr CalLoader::loadCoreTrack(
     } else {
         if (!dataSrc.readInteger(coreBoneId) || (coreBoneId < 0)) {
             CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-            return null;
+            return false;
         }
 
         // Read the number of keyframes.
         if (!dataSrc.readInteger(keyframeCount) || (keyframeCount <= 0)) {
             CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-            return null;
+            return false;
         }
     }
 
-    CalCoreTrack::KeyframeList keyframes;
+    // Bit 0 of the track flags marks spline-interpolated tracks.
+    int trackFlags = 0;
+    if (version >= cal3d::FIRST_FILE_VERSION_WITH_SPLINE_TRACKS) {
+        if (!dataSrc.readInteger(trackFlags)) {
+            CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+            return false;
+        }
+    }
 
-    // load all core keyframes
-    bool hasLastKeyframe = false;
-    CalCoreKeyframe lastCoreKeyframe;
-    for (int keyframeId = 0; keyframeId < keyframeCount; ++keyframeId) {
-        // load the core keyframe
-        CalCoreKeyframePtr pCoreKeyframe = loadCoreKeyframe(
-            dataSrc,
-            version,
-            (hasLastKeyframe ? &lastCoreKeyframe : 0),
-            translationRequired,
-            highRangeRequired,
-            translationIsDynamic,
-            useAnimationCompression);
-        if (!pCoreKeyframe) {
-            return null;
+    CalCoreTrack::KeyframeList keyframes;
+    if (useAnimationCompression && version >= cal3d::FIRST_FILE_VERSION_WITH_ANIMATION_COMPRESSION6) {
+        if (!loadCompressedKeyframes(dataSrc, keyframeCount, translationRequired, highRangeRequired, translationIsDynamic, &keyframes)) {
+            return false;
+        }
+    } else {
+        // every keyframe takes at least a byte
+        keyframes.reserve(std::min<size_t>(keyframeCount, dataSrc.remaining()));
+
+        // load all core keyframes
+        for (int keyframeId = 0; keyframeId < keyframeCount; ++keyframeId) {
+            CalCoreKeyframe keyframe;
+            if (!loadCoreKeyframe(
+                    dataSrc,
+                    version,
+                    (keyframes.empty() ? 0 : &keyframes.back()),
+                    translationRequired,
+                    highRangeRequired,
+                    translationIsDynamic,
+                    useAnimationCompression,
+                    &keyframe)) {
+                return false;
+            }
+            keyframes.push_back(keyframe);
         }
-        // add the core keyframe to the core track instance
-        CalCoreKeyframe kf = *pCoreKeyframe;
-        lastCoreKeyframe = kf;
-        hasLastKeyframe = true;
-        keyframes.push_back(kf);
     }
 
-    CalCoreTrackPtr pCoreTrack(new CalCoreTrack(coreBoneId, keyframes));
-    pCoreTrack->translationRequired = translationRequired;
-    pCoreTrack->translationIsDynamic = translationIsDynamic;
-    return pCoreTrack;
+    coreAnimation->tracks.push_back(CalCoreTrack(coreBoneId, std::move(keyframes)));
+    CalCoreTrack& coreTrack = coreAnimation->tracks.back();
+    coreTrack.translationRequired = translationRequired;
+    coreTrack.translationIsDynamic = translationIsDynamic;
+    coreTrack.splineInterpolated = (trackFlags & 1) != 0;
+    return true;
 }
 
 
@@ -1110,40 +1166,38 @@ CalCoreTrackPtr CalLoader::loadCoreTrack(
  *         \li \b 0 if an error happened
  *****************************************************************************/
 
-CalCoreMorphTrackPtr CalLoader::loadCoreMorphTrack(CalBufferSource& dataSrc) {
-    const CalCoreMorphTrackPtr null;
-    
+bool CalLoader::loadCoreMorphTrack(CalBufferSource& dataSrc, CalCoreMorphAnimation* coreMorphAnimation) {
     // read the morph name
     std::string morphName;
     if (!dataSrc.readString(morphName)) {
         CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-        return null;
+        return false;
     }
 
-    // allocate a new core morphTrack instance
-    CalCoreMorphTrackPtr pCoreMorphTrack(new CalCoreMorphTrack);
-
-    // link the core morphTrack to the appropriate morph name
-    pCoreMorphTrack->morphName = morphName;
-
     // read the number of keyframes
     int keyframeCount;
     if (!dataSrc.readInteger(keyframeCount) || (keyframeCount < 0)) {
         CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
-        return null;
+        return false;
     }
 
+    // every keyframe takes eight bytes
+    CalCoreMorphTrack::MorphKeyframeList keyframes;
+    keyframes.reserve(std::min<size_t>(keyframeCount, dataSrc.remaining() / 8));
+
     // load all core keyframes
     for (int keyframeId = 0; keyframeId < keyframeCount; ++keyframeId) {
-        // load the core keyframe
-        CalCoreMorphKeyframePtr pCoreKeyframe = loadCoreMorphKeyframe(dataSrc);
-        if (!pCoreKeyframe) {
-            return null;
+        CalCoreMorphKeyframe keyframe;
+        if (!loadCoreMorphKeyframe(dataSrc, &keyframe)) {
+            return false;
         }
-
-        // add the core keyframe to the core morphTrack instance
-        pCoreMorphTrack->keyframes.push_back(*pCoreKeyframe);
+        keyframes.push_back(keyframe);
     }
 
-    return pCoreMorphTrack;
+    // link the core morphTrack to the appropriate morph name
+    coreMorphAnimation->tracks.push_back(CalCoreMorphTrack());
+    CalCoreMorphTrack& coreMorphTrack = coreMorphAnimation->tracks.back();
+    coreMorphTrack.morphName.swap(morphName);
+    coreMorphTrack.keyframes.swap(keyframes);
+    return true;
 }
@@ -13,6 +13,7 @@
 #include <boost/shared_ptr.hpp>
 #include <math.h>
 #include <string>
+#include <vector>
 #include "cal3d/global.h"
 #include "cal3d/datasource.h"
 
@@ -59,7 +60,9 @@ public:
     static CalCoreAnimationPtr loadCoreAnimation(CalBufferSource& inputSrc);
     static CalCoreMorphAnimationPtr loadCoreMorphAnimation(CalBufferSource& inputSrc);
     static CalCoreMaterialPtr loadCoreMaterial(CalBufferSource& inputSrc);
-    static CalCoreMeshPtr loadCoreMesh(CalBufferSource& inputSrc);
+    // Large XML meshes have their submeshes converted on up to threadCount
+    // threads, or one per core if 0.
+    static CalCoreMeshPtr loadCoreMesh(CalBufferSource& inputSrc, unsigned threadCount = 1);
     static CalCoreSkeletonPtr loadCoreSkeleton(CalBufferSource& inputSrc);
 
 private:
@@ -78,8 +81,8 @@ private:
     static CalCoreSkeletonPtr loadXmlCoreSkeleton(char*);
     static CalCoreSkeletonPtr loadXmlCoreSkeletonDoc(const rapidxml::xml_document<char>& doc);
 
-    static CalCoreMeshPtr loadXmlCoreMesh(char*);
-    static CalCoreMeshPtr loadXmlCoreMeshDoc(const rapidxml::xml_document<char>& doc);
+    static CalCoreMeshPtr loadXmlCoreMesh(char*, unsigned threadCount);
+    static CalCoreMeshPtr loadXmlCoreMeshDoc(const rapidxml::xml_document<char>& doc, unsigned threadCount);
 
     static CalCoreMaterialPtr loadXmlCoreMaterial(char*);
     static CalCoreMaterialPtr loadXmlCoreMaterialDoc(const rapidxml::xml_document<char>& doc);
@@ -87,14 +90,20 @@ private:
     static bool isHeaderWellFormed(const rapidxml::xml_node<char>* node);
 
     static CalCoreBonePtr loadCoreBones(CalBufferSource& dataSrc, int version);
-    static CalCoreKeyframePtr loadCoreKeyframe(CalBufferSource& dataSrc,
+    // Tracks and keyframes are decoded in place, into the animation's
+    // track list and each track's keyframe list, rather than allocated one
+    // at a time and copied.
+    static bool loadCoreKeyframe(CalBufferSource& dataSrc,
             int version, CalCoreKeyframe* lastCoreKeyframe,
             bool translationRequired, bool highRangeRequired, bool translationIsDynamic,
-            bool useAnimationCompression);
-    static CalCoreMorphKeyframePtr loadCoreMorphKeyframe(CalBufferSource& dataSrc);
+            bool useAnimationCompression, CalCoreKeyframe* keyframe);
+    static bool loadCompressedKeyframes(CalBufferSource& dataSrc, int keyframeCount,
+            bool translationRequired, bool highRangeRequired, bool translationIsDynamic,
+            std::vector<CalCoreKeyframe>* keyframes);
+    static bool loadCoreMorphKeyframe(CalBufferSource& dataSrc, CalCoreMorphKeyframe* keyframe);
     static CalCoreSubmeshPtr loadCoreSubmesh(CalBufferSource& dataSrc, int version);
-    static CalCoreTrackPtr loadCoreTrack(CalBufferSource& dataSrc, int version, bool useAnimationCompresssion);
-    static CalCoreMorphTrackPtr loadCoreMorphTrack(CalBufferSource& dataSrc);
+    static bool loadCoreTrack(CalBufferSource& dataSrc, int version, bool useAnimationCompresssion, CalCoreAnimation* coreAnimation);
+    static bool loadCoreMorphTrack(CalBufferSource& dataSrc, CalCoreMorphAnimation* coreMorphAnimation);
 
     static bool usesAnimationCompression(int version);
     static unsigned int compressedKeyframeRequiredBytes(CalCoreKeyframe* lastCoreKeyframe, bool translationRequired, bool highRangeRequired, bool translationIsDynamic);
@@ -96,6 +96,10 @@ namespace cal3d {
             return _size;
         }
 
+        size_t capacity() const {
+            return _capacity;
+        }
+
         void push_back(const T& v) {
             if (_size + 1 > _capacity) {
                 size_t new_capacity = _capacity ? (_capacity * 2) : 1;
@@ -179,7 +183,7 @@ CAL3D_DEFINE_SIZE(unsigned);
 
 template<typename T>
 size_t sizeInBytes(const cal3d::SSEArray<T>& v) {
-    return sizeof(T) * v.size();
+    return sizeof(T) * v.capacity();
 }
 
 template<typename T>
@@ -21,17 +21,121 @@
 #include "cal3d/skeleton.h"
 #include "cal3d/bone.h"
 #include "cal3d/animation.h"
+#include "cal3d/posesamplecache.h"
 
-void CalMixer::addAnimation(const CalAnimationPtr& animation) {
+/*****************************************************************************/
+/** Accumulates one weighted transform into a bone's blend sums.
+  *
+  * Equivalent to CalBone::blendPose, except that the weighted mean is kept
+  * as a running sum of weighted quaternions and translations and only
+  * normalized in blendedTransform.  The quaternion is negated when needed so
+  * that it lies in the same hemisphere as the sum.  attenuation scales this
+  * and every later layer of the bone.
+  *****************************************************************************/
+
+static inline void accumulateBlend(
+    CalVector4& rotationSum,
+    CalVector4& translationSum,
+    float& weightSum,
+    float& attenuation,
+    const cal3d::RotateTranslate& transform,
+    float weight,
+    float remaining
+) {
+    const float w = weight * attenuation;
+    attenuation *= remaining;
+    if (!w) {
+        return;
+    }
+
+    const CalQuaternion& q = transform.rotation;
+    const float d = rotationSum.x * q.x + rotationSum.y * q.y + rotationSum.z * q.z + rotationSum.w * q.w;
+
+    rotationSum += (d < 0.0f ? -w : w) * CalVector4(q.x, q.y, q.z, q.w);
+    translationSum += w * CalVector4(transform.translation);
+    weightSum += w;
+}
+
+// the weighted mean of the accumulated transforms; weightSum must be nonzero
+static inline cal3d::RotateTranslate blendedTransform(
+    const CalVector4& rotationSum,
+    const CalVector4& translationSum,
+    float weightSum
+) {
+    const float rl = sqrtf(
+        rotationSum.x * rotationSum.x + rotationSum.y * rotationSum.y +
+        rotationSum.z * rotationSum.z + rotationSum.w * rotationSum.w);
+    const CalVector4 rotation = (1.0f / rl) * rotationSum;
+    const CalVector4 translation = (1.0f / weightSum) * translationSum;
+    return cal3d::RotateTranslate(
+        CalQuaternion(rotation.x, rotation.y, rotation.z, rotation.w),
+        translation.asCalVector());
+}
+
+CalMixer::CalMixer()
+    : nextHandle(1)
+    , boneQuerySkeleton(0)
+{
+    // enough for a typical avatar's layered animations and gestures
+    activeAnimations.reserve(8);
+}
+
+CalMixer::AnimationHandle CalMixer::addAnimation(const CalAnimationPtr& animation) {
     AnimationList::iterator i = activeAnimations.begin();
-    while (i != activeAnimations.end() && animation->priority < (*i)->priority) {
+    while (i != activeAnimations.end() && animation->priority < i->priority) {
         ++i;
     }
-    activeAnimations.insert(i, animation);
+
+    // Once the counter wraps, skip 0 and any handle still in use, so
+    // a live handle never names two animations.
+    AnimationHandle handle;
+    do {
+        handle = nextHandle++;
+        if (!nextHandle) {
+            nextHandle = 1;
+        }
+    } while (getAnimation(handle));
+
+    ActiveAnimation entry;
+    entry.animation = animation.get();
+    entry.priority = animation->priority;
+    entry.handle = handle;
+    entry.owner = animation;
+
+    activeAnimations.insert(i, std::move(entry));
+    clearBoneQueryCache();
+    return handle;
 }
 
 void CalMixer::removeAnimation(const CalAnimationPtr& animation) {
-    activeAnimations.remove(animation);
+    AnimationList::iterator i = activeAnimations.begin();
+    while (i != activeAnimations.end()) {
+        if (i->animation == animation.get()) {
+            i = activeAnimations.erase(i);
+            clearBoneQueryCache();
+        } else {
+            ++i;
+        }
+    }
+}
+
+void CalMixer::removeAnimation(AnimationHandle handle) {
+    for (AnimationList::iterator i = activeAnimations.begin(); i != activeAnimations.end(); ++i) {
+        if (i->handle == handle) {
+            activeAnimations.erase(i);
+            clearBoneQueryCache();
+            return;
+        }
+    }
+}
+
+CalAnimation* CalMixer::getAnimation(AnimationHandle handle) const {
+    for (AnimationList::const_iterator i = activeAnimations.begin(); i != activeAnimations.end(); ++i) {
+        if (i->handle == handle) {
+            return i->animation;
+        }
+    }
+    return 0;
 }
 
 void CalMixer::updateSkeleton(
@@ -39,9 +143,11 @@ void CalMixer::updateSkeleton(
     const std::vector<BoneTransformAdjustment>& boneTransformAdjustments,
     const std::vector<BoneScaleAdjustment>& boneScaleAdjustments
 ) {
+    clearBoneQueryCache();
     skeleton->resetPose();
 
-    auto& bones = skeleton->bones;
+    const size_t boneCount = skeleton->bones.size();
+    resetBlendBuffer(boneCount);
 
     // The bone adjustments are "replace" so they have to go first, giving them
     // highest priority and full influence.  Subsequent animations affecting the same bones,
@@ -50,24 +156,189 @@ void CalMixer::updateSkeleton(
 
     // loop through all animation actions
     for (auto itaa = activeAnimations.begin(); itaa != activeAnimations.end(); ++itaa) {
-        const auto& animation = itaa->get();
+        const CalAnimation* animation = itaa->animation;
 
-        const auto& tracks = animation->coreAnimation->tracks;
+        sampleAnimation(skeleton, *animation);
 
-        for (auto track = tracks.begin(); track != tracks.end(); ++track) {
-            if (track->coreBoneId >= bones.size()) {
-                continue;
+        blendLayer(
+            cal3d::pointerFromVector(sampledBoneIds),
+            cal3d::pointerFromVector(sampledTransforms),
+            sampledBoneIds.size(),
+            animation->weight * animation->rampValue,
+            // higher priority animations replace 0-priority animations
+            animation->priority != 0 ? animation->rampValue : 0.0f);
+    }
+
+    writeBlendBuffer(skeleton);
+
+    skeleton->calculateAbsolutePose();
+}
+
+const cal3d::Transform& CalMixer::getBoneAbsoluteTransform(
+    const CalSkeleton* skeleton,
+    unsigned boneId,
+    const std::vector<BoneTransformAdjustment>& boneTransformAdjustments,
+    const std::vector<BoneScaleAdjustment>& boneScaleAdjustments
+) {
+    const CalSkeleton::BoneArray& bones = skeleton->bones;
+    cal3d::verify(boneId < bones.size(), "bone id out of range");
+
+    if (boneQuerySkeleton != skeleton) {
+        boneQuerySkeleton = skeleton;
+        boneQueryCached.assign(bones.size(), false);
+        boneQueryTransforms.resize(bones.size());
+        boneQueryScales.resize(bones.size());
+        boneQueryPoses.assign(activeAnimations.size(), CalSampledPosePtr());
+    }
+
+    // walk up to the nearest cached ancestor, then solve back down
+    boneQueryChain.clear();
+    for (int id = boneId; id != -1 && !boneQueryCached[id]; id = bones[id].parentId) {
+        boneQueryChain.push_back(id);
+    }
+
+    for (auto i = boneQueryChain.rbegin(); i != boneQueryChain.rend(); ++i) {
+        const unsigned id = *i;
+        const int parentId = bones[id].parentId;
+
+        cal3d::Scale scale;
+        for (size_t s = 0; s < boneScaleAdjustments.size(); ++s) {
+            if (boneScaleAdjustments[s].boneId == id) {
+                scale = cal3d::Scale(boneScaleAdjustments[s].scale);
             }
+        }
+
+        const cal3d::Transform parentTransform = (parentId == -1) ? cal3d::Transform() : boneQueryTransforms[parentId];
+        const cal3d::Scale parentScale = (parentId == -1) ? cal3d::Scale() : boneQueryScales[parentId];
 
-            bones[track->coreBoneId].blendPose(
-                animation->weight * animation->rampValue,
-                track->getCurrentTransform(animation->time),
-                // higher priority animations replace 0-priority animations
-                animation->priority != 0 ? animation->rampValue : 0.0f);
+        boneQueryScales[id] = parentScale * scale;
+        boneQueryTransforms[id] = cal3d::calculateAbsoluteTransform(
+            parentTransform,
+            sampleBone(skeleton, id, boneTransformAdjustments),
+            boneQueryScales[id]);
+        boneQueryCached[id] = true;
+    }
+
+    return boneQueryTransforms[boneId];
+}
+
+/*****************************************************************************/
+/** Blends the relative transform of one bone.
+  *
+  * The same layering as updateSkeleton's blend buffer, restricted to one bone:
+  * every track for the bone in every animation is accumulated with the same
+  * helpers.  Masked bones keep their bind pose.  With a pose sample cache,
+  * each animation's pose is fetched once per query and shared by the bones
+  * of the chain.
+  *****************************************************************************/
+
+cal3d::RotateTranslate CalMixer::sampleBone(
+    const CalSkeleton* skeleton,
+    unsigned boneId,
+    const std::vector<BoneTransformAdjustment>& boneTransformAdjustments
+) {
+    const CalBone& bone = skeleton->bones[boneId];
+    if (!skeleton->isBoneActive(boneId)) {
+        return bone.getOriginalTransform();
+    }
+
+    CalVector4 rotationSum;
+    CalVector4 translationSum;
+    float weightSum = 0.0f;
+    float attenuation = 1.0f;
+
+    for (size_t i = 0; i < boneTransformAdjustments.size(); ++i) {
+        const BoneTransformAdjustment& ba = boneTransformAdjustments[i];
+        if (ba.boneId == boneId) {
+            accumulateBlend(
+                rotationSum, translationSum, weightSum, attenuation,
+                cal3d::RotateTranslate(ba.localOri, bone.getOriginalTranslation()),
+                ba.rampValue,
+                1.0f - ba.rampValue);
         }
     }
 
-    skeleton->calculateAbsolutePose();
+    for (size_t a = 0; a < activeAnimations.size(); ++a) {
+        const CalAnimation* animation = activeAnimations[a].animation;
+        const CalCoreAnimation& coreAnimation = *animation->coreAnimation;
+        // every track for the bone, in order, blended as sampleAnimation
+        // blends them
+        const CalCoreTrack* track = coreAnimation.getCoreTrack(boneId);
+        if (!track) {
+            continue;
+        }
+
+        // sample as updateSkeleton would: through the cache when there is
+        // one, whose poses are in track order
+        const CalSampledPose* pose = 0;
+        if (poseSampleCache) {
+            CalSampledPosePtr& cached = boneQueryPoses[a];
+            if (!cached) {
+                cached = poseSampleCache->sample(animation->coreAnimation, animation->time);
+            }
+            pose = cached.get();
+        }
+
+        const float weight = animation->weight * animation->rampValue;
+        const float remaining = 1.0f - (animation->priority != 0 ? animation->rampValue : 0.0f);
+        for (; track; track = coreAnimation.getNextCoreTrack(track)) {
+            cal3d::RotateTranslate transform;
+            if (pose) {
+                const size_t index = track - cal3d::pointerFromVector(coreAnimation.tracks);
+                transform = pose->transforms[index];
+                if (pose->usesBindTranslation[index]) {
+                    transform.translation = bone.getOriginalTranslation();
+                }
+            } else {
+                transform = track->getCurrentTransform(animation->time, bone.getOriginalTranslation());
+            }
+            accumulateBlend(
+                rotationSum, translationSum, weightSum, attenuation,
+                transform,
+                weight,
+                remaining);
+        }
+    }
+
+    if (!weightSum) {
+        return bone.getOriginalTransform();
+    }
+    return blendedTransform(rotationSum, translationSum, weightSum);
+}
+
+void CalMixer::sampleAnimation(const CalSkeleton* skeleton, const CalAnimation& animation) {
+    const CalSkeleton::BoneArray& bones = skeleton->bones;
+    const size_t boneCount = bones.size();
+
+    sampledBoneIds.clear();
+    sampledTransforms.clear();
+
+    if (poseSampleCache) {
+        CalSampledPosePtr pose = poseSampleCache->sample(animation.coreAnimation, animation.time);
+        for (size_t i = 0; i < pose->boneIds.size(); ++i) {
+            const unsigned boneId = pose->boneIds[i];
+            if (boneId >= boneCount || !skeleton->isBoneActive(boneId)) {
+                continue;
+            }
+            sampledBoneIds.push_back(boneId);
+            sampledTransforms.push_back(pose->transforms[i]);
+            if (pose->usesBindTranslation[i]) {
+                sampledTransforms.back().translation = bones[boneId].getOriginalTranslation();
+            }
+        }
+        return;
+    }
+
+    const auto& tracks = animation.coreAnimation->tracks;
+    for (auto track = tracks.begin(); track != tracks.end(); ++track) {
+        if (track->coreBoneId >= boneCount || !skeleton->isBoneActive(track->coreBoneId)) {
+            continue;
+        }
+        sampledBoneIds.push_back(track->coreBoneId);
+        sampledTransforms.push_back(track->getCurrentTransform(
+            animation.time,
+            bones[track->coreBoneId].getOriginalTranslation()));
+    }
 }
 
 void CalMixer::applyBoneAdjustments(
@@ -79,12 +350,14 @@ void CalMixer::applyBoneAdjustments(
 
     for (size_t i = 0; i < boneTransformAdjustments.size(); ++i) {
         const BoneTransformAdjustment& ba = boneTransformAdjustments[i];
-        CalBone& bo = bones[ba.boneId];
-        bo.blendPose(
+        const cal3d::RotateTranslate transform(
+            ba.localOri,
+            bones[ba.boneId].getOriginalTranslation() /* adjustedLocalPos */);
+        blendLayer(
+            &ba.boneId,
+            &transform,
+            1,
             ba.rampValue, /* weight */
-            cal3d::RotateTranslate(
-                ba.localOri,
-                bo.getOriginalTranslation() /* adjustedLocalPos */),
             ba.rampValue /* subsequentAttenuation */);
     }
 
@@ -93,3 +366,55 @@ void CalMixer::applyBoneAdjustments(
         bones[ba.boneId].scale = ba.scale;
     }
 }
+
+void CalMixer::resetBlendBuffer(size_t boneCount) {
+    blendRotations.destructive_resize(boneCount);
+    blendTranslations.destructive_resize(boneCount);
+    blendWeights.assign(boneCount, 0.0f);
+    blendAttenuations.assign(boneCount, 1.0f);
+
+    const CalVector4 zero;
+    std::fill(blendRotations.begin(), blendRotations.end(), zero);
+    std::fill(blendTranslations.begin(), blendTranslations.end(), zero);
+}
+
+// Accumulates one layer of sampled bone transforms into the blend buffer.
+
+void CalMixer::blendLayer(
+    const unsigned* boneIds,
+    const cal3d::RotateTranslate* transforms,
+    size_t count,
+    float weight,
+    float subsequentAttenuation
+) {
+    CalVector4* rotations = blendRotations.data();
+    CalVector4* translations = blendTranslations.data();
+    float* weights = cal3d::pointerFromVector(blendWeights);
+    float* attenuations = cal3d::pointerFromVector(blendAttenuations);
+
+    const float remaining = 1.0f - subsequentAttenuation;
+
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned boneId = boneIds[i];
+        accumulateBlend(
+            rotations[boneId], translations[boneId], weights[boneId], attenuations[boneId],
+            transforms[i],
+            weight,
+            remaining);
+    }
+}
+
+void CalMixer::writeBlendBuffer(CalSkeleton* skeleton) const {
+    CalBone* bones = cal3d::pointerFromVector(skeleton->bones);
+    const size_t boneCount = skeleton->bones.size();
+
+    for (size_t boneId = 0; boneId < boneCount; ++boneId) {
+        const float w = blendWeights[boneId];
+        if (!w) {
+            // no animation touched this bone; leave it in the bind pose
+            continue;
+        }
+
+        bones[boneId].setRelativeTransform(blendedTransform(blendRotations[boneId], blendTranslations[boneId], w));
+    }
+}
@@ -11,11 +11,17 @@
 
 #pragma once
 
-#include <list>
+#include <vector>
 #include "cal3d/animation.h"
+#include "cal3d/memory.h"
 #include "cal3d/quaternion.h"
+#include "cal3d/transform.h"
+#include "cal3d/vector4.h"
 
 CAL3D_PTR(CalAnimation);
+CAL3D_PTR(CalPoseSampleCache);
+struct CalSampledPose;
+typedef boost::shared_ptr<const CalSampledPose> CalSampledPosePtr;
 class CalSkeleton;
 
 struct BoneTransformAdjustment {
@@ -41,20 +47,107 @@ struct BoneScaleAdjustment {
 
 class CAL3D_API CalMixer {
 public:
-    void addAnimation(const CalAnimationPtr& animation);
+    // Identifies an active animation.  Handles stay valid until the
+    // animation is removed, and a live handle is never given out again;
+    // a removed one is only reused once the counter wraps past 2^32 adds.
+    // 0 is never a valid handle.
+    typedef unsigned AnimationHandle;
+
+    CalMixer();
+
+    AnimationHandle addAnimation(const CalAnimationPtr& animation);
     void removeAnimation(const CalAnimationPtr& animation);
+    void removeAnimation(AnimationHandle handle);
+
+    // returns 0 if the handle does not name an active animation
+    CalAnimation* getAnimation(AnimationHandle handle) const;
+    size_t getAnimationCount() const {
+        return activeAnimations.size();
+    }
+
+    // When set, animations are sampled through the shared cache instead of
+    // per mixer.  Pass a null pointer to go back to sampling directly.
+    void setPoseSampleCache(const CalPoseSampleCachePtr& cache) {
+        poseSampleCache = cache;
+    }
 
     void updateSkeleton(
         CalSkeleton* skeleton,
         const std::vector<BoneTransformAdjustment>& boneTransformAdjustments,
         const std::vector<BoneScaleAdjustment>& boneScaleAdjustments);
 
+    // Absolute transform of a single bone under the active animations,
+    // evaluated without solving the rest of the skeleton: only the bone's
+    // ancestor chain is sampled and composed.  Matches, up to rounding, the
+    // bone's absoluteTransform after updateSkeleton with the same
+    // adjustments, including the time snapping of a pose sample cache:
+    // with one set, each animation is sampled whole through the cache, at
+    // most once per query.  Each bone evaluated is cached until clearBoneQueryCache,
+    // updateSkeleton, or a change to the active animations, so call
+    // clearBoneQueryCache once per frame after advancing animation times.
+    const cal3d::Transform& getBoneAbsoluteTransform(
+        const CalSkeleton* skeleton,
+        unsigned boneId,
+        const std::vector<BoneTransformAdjustment>& boneTransformAdjustments,
+        const std::vector<BoneScaleAdjustment>& boneScaleAdjustments);
+    void clearBoneQueryCache() {
+        boneQuerySkeleton = 0;
+    }
+
 private:
+    cal3d::RotateTranslate sampleBone(
+        const CalSkeleton* skeleton,
+        unsigned boneId,
+        const std::vector<BoneTransformAdjustment>& boneTransformAdjustments);
+
     void applyBoneAdjustments(
         CalSkeleton* skeleton,
         const std::vector<BoneTransformAdjustment>& boneTransformAdjustments,
         const std::vector<BoneScaleAdjustment>& boneScaleAdjustments);
 
-    typedef std::list<CalAnimationPtr> AnimationList;
+    void sampleAnimation(const CalSkeleton* skeleton, const CalAnimation& animation);
+    void resetBlendBuffer(size_t boneCount);
+    void blendLayer(
+        const unsigned* boneIds,
+        const cal3d::RotateTranslate* transforms,
+        size_t count,
+        float weight,
+        float subsequentAttenuation);
+    void writeBlendBuffer(CalSkeleton* skeleton) const;
+
+    struct ActiveAnimation {
+        // cached from owner so the update loop doesn't go through the shared_ptr
+        CalAnimation* animation;
+        unsigned priority;
+        AnimationHandle handle;
+        CalAnimationPtr owner;
+    };
+
+    // Sorted by descending priority.  Capacity is retained on removal so
+    // adding and removing animations does not allocate in steady state.
+    typedef std::vector<ActiveAnimation> AnimationList;
     AnimationList activeAnimations;
+    AnimationHandle nextHandle;
+    CalPoseSampleCachePtr poseSampleCache;
+
+    // Dense, bone-indexed blend state.  Each layer is sampled into
+    // sampledBoneIds/sampledTransforms and then accumulated as a
+    // weighted sum, so the bones are only written once per update.
+    // Kept between updates so steady-state updates do not allocate.
+    cal3d::SSEArray<CalVector4> blendRotations;
+    cal3d::SSEArray<CalVector4> blendTranslations;
+    std::vector<float> blendWeights;
+    std::vector<float> blendAttenuations;
+
+    std::vector<unsigned> sampledBoneIds;
+    std::vector<cal3d::RotateTranslate> sampledTransforms;
+
+    // getBoneAbsoluteTransform results, valid for boneQuerySkeleton only
+    const CalSkeleton* boneQuerySkeleton;
+    std::vector<bool> boneQueryCached;
+    std::vector<cal3d::Transform> boneQueryTransforms;
+    std::vector<cal3d::Scale> boneQueryScales;
+    std::vector<unsigned> boneQueryChain;
+    // per active animation, fetched from poseSampleCache as first needed
+    std::vector<CalSampledPosePtr> boneQueryPoses;
 };
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <limits>
+#include "cal3d/morphsampler.h"
+#include "cal3d/coremorphanimation.h"
+#include "cal3d/coremorphkeyframe.h"
+#include "cal3d/coremorphtrack.h"
+#include "cal3d/poselanes.h"
+
+using cal3d::lanes::lane;
+
+CalMorphSampler::CalMorphSampler(const CalCoreMorphAnimationPtr& coreMorphAnimation)
+    : coreMorphAnimation(coreMorphAnimation)
+{
+    const size_t trackCount = coreMorphAnimation->tracks.size();
+    cursors.assign(trackCount, 0);
+    // empty, so the first sample seeks every track
+    segmentStarts.assign(trackCount, std::numeric_limits<float>::infinity());
+    segmentEnds.assign(trackCount, -std::numeric_limits<float>::infinity());
+
+    // at least one group so getWeights() is always a valid pointer
+    const size_t groupCount = std::max<size_t>(1, (trackCount + 3) / 4);
+    startTimes.destructive_resize(groupCount);
+    startWeights.destructive_resize(groupCount);
+    slopes.destructive_resize(groupCount);
+    weights.destructive_resize(groupCount);
+
+    const CalVector4 zero;
+    std::fill(startTimes.begin(), startTimes.end(), zero);
+    std::fill(startWeights.begin(), startWeights.end(), zero);
+    std::fill(slopes.begin(), slopes.end(), zero);
+    std::fill(weights.begin(), weights.end(), zero);
+}
+
+const float* CalMorphSampler::sample(float time) {
+    const size_t trackCount = cursors.size();
+    for (size_t i = 0; i < trackCount; ++i) {
+        if (!(segmentStarts[i] <= time && time < segmentEnds[i])) {
+            seek(i, time);
+        }
+    }
+
+    const CalVector4 t(time);
+    for (size_t g = 0; g < weights.size(); ++g) {
+        weights[g] = startWeights[g] + (t - startTimes[g]) * slopes[g];
+    }
+    return getWeights();
+}
+
+/*****************************************************************************/
+/** Moves a track's cursor to the segment containing time.
+  *
+  * The cursor is the index of the first keyframe after time, as
+  * CalCoreMorphTrack::getState's upper_bound finds.  Playback usually only
+  * crosses into the next or previous segment, so that is tried first.
+  *****************************************************************************/
+
+void CalMorphSampler::seek(size_t track, float time) {
+    const CalCoreMorphTrack::MorphKeyframeList& keyframes = coreMorphAnimation->tracks[track].keyframes;
+    const size_t n = keyframes.size();
+
+    float& startTime = lane(startTimes[track / 4], track % 4);
+    float& startWeight = lane(startWeights[track / 4], track % 4);
+    float& slope = lane(slopes[track / 4], track % 4);
+
+    if (!n) {
+        segmentStarts[track] = -std::numeric_limits<float>::infinity();
+        segmentEnds[track] = std::numeric_limits<float>::infinity();
+        startTime = startWeight = slope = 0.0f;
+        return;
+    }
+
+    size_t c = cursors[track];
+    if (c < n && keyframes[c].time <= time) {
+        ++c;
+    } else if (c > 0 && keyframes[c - 1].time > time) {
+        --c;
+    }
+    if ((c < n && keyframes[c].time <= time) || (c > 0 && keyframes[c - 1].time > time)) {
+        c = std::upper_bound(keyframes.begin(), keyframes.end(), CalCoreMorphKeyframe(time, 0.0f)) - keyframes.begin();
+    }
+    cursors[track] = c;
+
+    segmentStarts[track] = c > 0 ? keyframes[c - 1].time : -std::numeric_limits<float>::infinity();
+    segmentEnds[track] = c < n ? keyframes[c].time : std::numeric_limits<float>::infinity();
+
+    if (c == 0 || c == n) {
+        // before the first or after the last keyframe: hold its weight
+        startTime = 0.0f;
+        startWeight = keyframes[c == 0 ? 0 : n - 1].weight;
+        slope = 0.0f;
+    } else {
+        const CalCoreMorphKeyframe& before = keyframes[c - 1];
+        const CalCoreMorphKeyframe& after = keyframes[c];
+        startTime = before.time;
+        startWeight = before.weight;
+        slope = (after.weight - before.weight) / (after.time - before.time);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "cal3d/global.h"
+#include "cal3d/memory.h"
+#include "cal3d/vector4.h"
+
+CAL3D_PTR(CalCoreMorphAnimation);
+
+// Samples every track of a core morph animation into a dense array of
+// weights, one per track in track order, matching CalCoreMorphTrack::getState.
+//
+// Each track keeps a cursor on the keyframe segment of the previous sample
+// and that segment's line, so steady playback finds its segment with a
+// compare instead of a binary search, and the interpolation itself runs
+// four tracks at a time.  A sampler is per playing instance; the core
+// animation must not be edited while samplers use it.
+class CAL3D_API CalMorphSampler {
+public:
+    explicit CalMorphSampler(const CalCoreMorphAnimationPtr& coreMorphAnimation);
+
+    // Samples all tracks and returns getWeights().
+    const float* sample(float time);
+
+    // getTrackCount() weights from the last sample, all 0 before the first.
+    const float* getWeights() const {
+        return &weights.data()->x;
+    }
+    size_t getTrackCount() const {
+        return cursors.size();
+    }
+
+private:
+    void seek(size_t track, float time);
+
+    const CalCoreMorphAnimationPtr coreMorphAnimation;
+
+    // per track: index of the first keyframe after the cursor's segment,
+    // and the time span the segment covers
+    std::vector<size_t> cursors;
+    std::vector<float> segmentStarts;
+    std::vector<float> segmentEnds;
+
+    // per track, four to a CalVector4: weight = startWeight + (time - startTime) * slope
+    cal3d::SSEArray<CalVector4> startTimes;
+    cal3d::SSEArray<CalVector4> startWeights;
+    cal3d::SSEArray<CalVector4> slopes;
+    cal3d::SSEArray<CalVector4> weights;
+};
+CAL3D_PTR(CalMorphSampler);
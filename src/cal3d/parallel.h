@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace cal3d {
+    // constructed on each thread of parallelFor when no other state is needed
+    struct NoThreadState {
+    };
+
+    // Calls work(i) for every i below count, handing indices out one at a
+    // time to threadCount threads (one per core if 0, and never more than
+    // count), the calling thread among them.  Each thread constructs a
+    // ThreadState before its first call and keeps it until its last, for
+    // per-thread setup such as ForceCLocale.
+    //
+    // Once any call returns false or throws, no further indices are handed
+    // out.  Every thread is joined before returning; the first exception
+    // thrown is then rethrown.  Returns whether every call returned true.
+    //
+    // If the system won't start another thread, the threads already
+    // running share its work.
+    template<typename ThreadState = NoThreadState, typename Work>
+    bool parallelFor(size_t count, unsigned threadCount, Work work) {
+        if (!threadCount) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        threadCount = std::min<unsigned>(threadCount, std::max<size_t>(1, count));
+
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+        std::exception_ptr exception;
+        std::atomic_flag exceptionTaken = ATOMIC_FLAG_INIT;
+
+        auto run = [&] {
+            ThreadState state;
+            for (size_t i = next++; i < count && !failed; i = next++) {
+                try {
+                    if (!work(i)) {
+                        failed = true;
+                    }
+                } catch (...) {
+                    if (!exceptionTaken.test_and_set()) {
+                        exception = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+        };
+
+        // Reserved up front, so a joinable thread is never dropped by a
+        // throwing push_back.
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned t = 1; t < threadCount; ++t) {
+            try {
+                threads.emplace_back(run);
+            } catch (const std::system_error&) {
+                break;
+            }
+        }
+        run();
+        for (auto t = threads.begin(); t != threads.end(); ++t) {
+            t->join();
+        }
+
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return !failed;
+    }
+}
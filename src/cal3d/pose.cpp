@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include "cal3d/pose.h"
+#include "cal3d/bone.h"
+#include "cal3d/coreanimation.h"
+#include "cal3d/coretrack.h"
+#include "cal3d/error.h"
+#include "cal3d/poselanes.h"
+#include "cal3d/skeleton.h"
+
+using namespace cal3d::lanes;
+
+namespace {
+    size_t groupCount(size_t boneCount) {
+        return (boneCount + 3) / 4;
+    }
+
+    // 1 or -1 per lane, with the sign of v
+    inline CalVector4 signOf(const CalVector4& v) {
+#ifdef IMVU_NO_INTRINSICS
+        return CalVector4(
+            v.x < 0.0f ? -1.0f : 1.0f,
+            v.y < 0.0f ? -1.0f : 1.0f,
+            v.z < 0.0f ? -1.0f : 1.0f,
+            v.w < 0.0f ? -1.0f : 1.0f);
+#else
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        return CalBase4(_mm_or_ps(_mm_and_ps(v.v, signBit), _mm_set1_ps(1.0f)));
+#endif
+    }
+
+    inline CalVector4 reciprocalSqrt(const CalVector4& v) {
+#ifdef IMVU_NO_INTRINSICS
+        return CalVector4(
+            1.0f / sqrtf(v.x),
+            1.0f / sqrtf(v.y),
+            1.0f / sqrtf(v.z),
+            1.0f / sqrtf(v.w));
+#else
+        return CalBase4(_mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(v.v)));
+#endif
+    }
+
+    inline CalVector4 dot(const QuaternionLanes& a, const QuaternionLanes& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    }
+
+    inline QuaternionLanes normalized(const QuaternionLanes& q) {
+        const CalVector4 s = reciprocalSqrt(dot(q, q));
+        QuaternionLanes r;
+        r.x = q.x * s;
+        r.y = q.y * s;
+        r.z = q.z * s;
+        r.w = q.w * s;
+        return r;
+    }
+
+    // a + w * (b - a) per lane, with b negated where needed so the
+    // rotations take the shorter arc
+    inline PoseLanes nlerp(const PoseLanes& a, const PoseLanes& b, const CalVector4& w) {
+        const CalVector4 sw = w * signOf(dot(a.rotation, b.rotation));
+        const CalVector4 rw = CalVector4(1.0f) - w;
+
+        QuaternionLanes q;
+        q.x = rw * a.rotation.x + sw * b.rotation.x;
+        q.y = rw * a.rotation.y + sw * b.rotation.y;
+        q.z = rw * a.rotation.z + sw * b.rotation.z;
+        q.w = rw * a.rotation.w + sw * b.rotation.w;
+
+        PoseLanes r;
+        r.rotation = normalized(q);
+        r.translation.x = a.translation.x + w * (b.translation.x - a.translation.x);
+        r.translation.y = a.translation.y + w * (b.translation.y - a.translation.y);
+        r.translation.z = a.translation.z + w * (b.translation.z - a.translation.z);
+        return r;
+    }
+
+    inline QuaternionLanes conjugate(const QuaternionLanes& q) {
+        const CalVector4 minusOne(-1.0f);
+        QuaternionLanes r;
+        r.x = minusOne * q.x;
+        r.y = minusOne * q.y;
+        r.z = minusOne * q.z;
+        r.w = q.w;
+        return r;
+    }
+
+    inline CalVector4 weightLanes(const std::vector<float>& weights, size_t group) {
+        CalVector4 w;
+        const size_t end = std::min(weights.size(), group * 4 + 4);
+        for (size_t i = group * 4; i < end; ++i) {
+            lane(w, i % 4) = weights[i];
+        }
+        return w;
+    }
+}
+
+CalPose::CalPose()
+    : boneCount(0)
+{}
+
+CalPose::CalPose(size_t boneCount)
+    : boneCount(0)
+{
+    reset(boneCount);
+}
+
+void CalPose::reset(size_t count) {
+    boneCount = count;
+    lanes.destructive_resize(groupCount(count) * PoseLaneStride);
+
+    PoseLanes identity;
+    identity.rotation.w = CalVector4(1.0f);
+    for (size_t g = 0; g < groupCount(count); ++g) {
+        storePose(&lanes[g * PoseLaneStride], identity);
+    }
+}
+
+cal3d::RotateTranslate CalPose::getTransform(size_t boneId) const {
+    const CalVector4* group = &lanes[(boneId / 4) * PoseLaneStride];
+    const size_t i = boneId % 4;
+    return cal3d::RotateTranslate(
+        CalQuaternion(lane(group[0], i), lane(group[1], i), lane(group[2], i), lane(group[3], i)),
+        CalVector(lane(group[4], i), lane(group[5], i), lane(group[6], i)));
+}
+
+void CalPose::setTransform(size_t boneId, const cal3d::RotateTranslate& transform) {
+    CalVector4* group = &lanes[(boneId / 4) * PoseLaneStride];
+    const size_t i = boneId % 4;
+    lane(group[0], i) = transform.rotation.x;
+    lane(group[1], i) = transform.rotation.y;
+    lane(group[2], i) = transform.rotation.z;
+    lane(group[3], i) = transform.rotation.w;
+    lane(group[4], i) = transform.translation.x;
+    lane(group[5], i) = transform.translation.y;
+    lane(group[6], i) = transform.translation.z;
+}
+
+void CalPose::setBindPose(const CalSkeleton* skeleton) {
+    const CalSkeleton::BoneArray& bones = skeleton->bones;
+    if (boneCount != bones.size()) {
+        reset(bones.size());
+    }
+    for (size_t boneId = 0; boneId < boneCount; ++boneId) {
+        setTransform(boneId, bones[boneId].getOriginalTransform());
+    }
+}
+
+void CalPose::sample(const CalSkeleton* skeleton, const CalCoreAnimation& coreAnimation, float time) {
+    setBindPose(skeleton);
+
+    const CalSkeleton::BoneArray& bones = skeleton->bones;
+    const auto& tracks = coreAnimation.tracks;
+    for (auto track = tracks.begin(); track != tracks.end(); ++track) {
+        const unsigned boneId = track->coreBoneId;
+        if (boneId >= boneCount || !skeleton->isBoneActive(boneId)) {
+            continue;
+        }
+        setTransform(boneId, track->getCurrentTransform(time, bones[boneId].getOriginalTranslation()));
+    }
+}
+
+void CalPose::blend(const CalPose& target, float weight) {
+    cal3d::verify(target.boneCount == boneCount, "poses must have the same bone count");
+
+    const CalVector4 w(weight);
+    for (size_t g = 0; g < groupCount(boneCount); ++g) {
+        CalVector4* group = &lanes[g * PoseLaneStride];
+        storePose(group, nlerp(loadPose(group), loadPose(&target.lanes[g * PoseLaneStride]), w));
+    }
+}
+
+void CalPose::blend(const CalPose& target, float weight, const std::vector<float>& boneWeights) {
+    cal3d::verify(target.boneCount == boneCount, "poses must have the same bone count");
+    cal3d::verify(boneWeights.size() == boneCount, "need one weight per bone");
+
+    const CalVector4 w(weight);
+    for (size_t g = 0; g < groupCount(boneCount); ++g) {
+        CalVector4* group = &lanes[g * PoseLaneStride];
+        storePose(group, nlerp(loadPose(group), loadPose(&target.lanes[g * PoseLaneStride]), w * weightLanes(boneWeights, g)));
+    }
+}
+
+void CalPose::setDifference(const CalPose& pose, const CalPose& reference) {
+    cal3d::verify(pose.boneCount == reference.boneCount, "poses must have the same bone count");
+    if (boneCount != pose.boneCount) {
+        reset(pose.boneCount);
+    }
+
+    for (size_t g = 0; g < groupCount(boneCount); ++g) {
+        const PoseLanes p = loadPose(&pose.lanes[g * PoseLaneStride]);
+        const PoseLanes r = loadPose(&reference.lanes[g * PoseLaneStride]);
+
+        PoseLanes d;
+        d.rotation = p.rotation * conjugate(r.rotation);
+        d.translation.x = p.translation.x - r.translation.x;
+        d.translation.y = p.translation.y - r.translation.y;
+        d.translation.z = p.translation.z - r.translation.z;
+        storePose(&lanes[g * PoseLaneStride], d);
+    }
+}
+
+void CalPose::add(const CalPose& difference, float weight) {
+    cal3d::verify(difference.boneCount == boneCount, "poses must have the same bone count");
+
+    PoseLanes identity;
+    identity.rotation.w = CalVector4(1.0f);
+    const CalVector4 w(weight);
+    for (size_t g = 0; g < groupCount(boneCount); ++g) {
+        CalVector4* group = &lanes[g * PoseLaneStride];
+        const PoseLanes p = loadPose(group);
+        const PoseLanes d = nlerp(identity, loadPose(&difference.lanes[g * PoseLaneStride]), w);
+
+        PoseLanes r;
+        r.rotation = d.rotation * p.rotation;
+        r.translation = p.translation + d.translation;
+        storePose(group, r);
+    }
+}
+
+void CalPose::writeTo(CalSkeleton* skeleton) const {
+    CalSkeleton::BoneArray& bones = skeleton->bones;
+    cal3d::verify(bones.size() == boneCount, "pose and skeleton must have the same bone count");
+
+    for (size_t boneId = 0; boneId < boneCount; ++boneId) {
+        bones[boneId].setRelativeTransform(getTransform(boneId));
+    }
+}
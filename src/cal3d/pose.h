@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "cal3d/global.h"
+#include "cal3d/memory.h"
+#include "cal3d/transform.h"
+#include "cal3d/vector4.h"
+
+class CalCoreAnimation;
+class CalSkeleton;
+
+// A bone-indexed set of relative transforms, for animation graphs that do
+// their own blending instead of using CalMixer's priority layers.
+//
+// Bones are stored four to a group, one component per CalVector4 (see
+// cal3d/poselanes.h), so every operation works on four bones at a time.
+// reset() to the same bone count does not allocate, so poses can be kept
+// as scratch buffers from frame to frame.
+class CAL3D_API CalPose {
+public:
+    CalPose();
+    explicit CalPose(size_t boneCount);
+
+    size_t size() const {
+        return boneCount;
+    }
+
+    // Resizes to boneCount bones, all identity.
+    void reset(size_t boneCount);
+
+    cal3d::RotateTranslate getTransform(size_t boneId) const;
+    void setTransform(size_t boneId, const cal3d::RotateTranslate& transform);
+
+    // Every bone's bind pose relative transform.
+    void setBindPose(const CalSkeleton* skeleton);
+
+    // The bind pose, with each active bone that has a track in
+    // coreAnimation replaced by the track sampled at time.
+    void sample(const CalSkeleton* skeleton, const CalCoreAnimation& coreAnimation, float time);
+
+    // Moves each bone weight of the way to target.  Translations are
+    // lerped and rotations nlerped along the shorter arc, as CalMixer blends.
+    void blend(const CalPose& target, float weight);
+
+    // As blend, with weight scaled by boneWeights, one entry per bone.
+    // Bones with zero weight are left unchanged.
+    void blend(const CalPose& target, float weight, const std::vector<float>& boneWeights);
+
+    // Sets this to the change that takes reference to pose, for add.
+    void setDifference(const CalPose& pose, const CalPose& reference);
+
+    // Applies weight of a difference from setDifference on top of this
+    // pose.  The rotation change is nlerped from identity.
+    void add(const CalPose& difference, float weight);
+
+    // Replaces every bone's relative transform, bypassing CalBone::blendPose.
+    // Scales are left alone.  Call CalSkeleton::calculateAbsolutePose after.
+    void writeTo(CalSkeleton* skeleton) const;
+
+private:
+    size_t boneCount;
+    // PoseLaneStride components per group of four bones
+    cal3d::SSEArray<CalVector4> lanes;
+};
+CAL3D_PTR(CalPose);
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "cal3d/global.h"
+#include "cal3d/transform.h"
+#include "cal3d/vector4.h"
+
+// Structure-of-arrays helpers for working on four bone transforms at once.
+// Each CalVector4 holds one component of four bones, so the quaternion and
+// vector arithmetic below needs no shuffles.  Used by CalSkeleton's batched
+// solver and by CalPose.
+namespace cal3d {
+    namespace lanes {
+        // components per group of four bones: qx, qy, qz, qw, tx, ty, tz
+        const size_t PoseLaneStride = 7;
+
+        struct QuaternionLanes {
+            CalVector4 x, y, z, w;
+        };
+
+        struct VectorLanes {
+            CalVector4 x, y, z;
+        };
+
+        struct PoseLanes {
+            QuaternionLanes rotation;
+            VectorLanes translation;
+        };
+
+        inline float& lane(CalVector4& v, size_t i) {
+            return (&v.x)[i];
+        }
+
+        inline float lane(const CalVector4& v, size_t i) {
+            return (&v.x)[i];
+        }
+
+        // same arithmetic as CalQuaternion's operator*
+        inline QuaternionLanes operator*(const QuaternionLanes& o, const QuaternionLanes& i) {
+            QuaternionLanes r;
+            r.x = o.w * i.x + o.x * i.w + o.y * i.z - o.z * i.y;
+            r.y = o.w * i.y - o.x * i.z + o.y * i.w + o.z * i.x;
+            r.z = o.w * i.z + o.x * i.y - o.y * i.x + o.z * i.w;
+            r.w = o.w * i.w - o.x * i.x - o.y * i.y - o.z * i.z;
+            return r;
+        }
+
+        // q * v * conjugate(q), as CalQuaternion's operator* on CalVector
+        // with the zero terms dropped
+        inline VectorLanes operator*(const QuaternionLanes& q, const VectorLanes& v) {
+            const CalVector4 tx = v.x * q.w - v.y * q.z + v.z * q.y;
+            const CalVector4 ty = v.x * q.z + v.y * q.w - v.z * q.x;
+            const CalVector4 tz = v.y * q.x - v.x * q.y + v.z * q.w;
+            const CalVector4 tw = v.x * q.x + v.y * q.y + v.z * q.z;
+
+            VectorLanes r;
+            r.x = q.w * tx + q.x * tw + q.y * tz - q.z * ty;
+            r.y = q.w * ty - q.x * tz + q.y * tw + q.z * tx;
+            r.z = q.w * tz + q.x * ty - q.y * tx + q.z * tw;
+            return r;
+        }
+
+        inline VectorLanes operator+(const VectorLanes& a, const VectorLanes& b) {
+            VectorLanes r;
+            r.x = a.x + b.x;
+            r.y = a.y + b.y;
+            r.z = a.z + b.z;
+            return r;
+        }
+
+        inline PoseLanes operator*(const PoseLanes& outer, const PoseLanes& inner) {
+            PoseLanes r;
+            r.rotation = outer.rotation * inner.rotation;
+            r.translation = outer.rotation * inner.translation + outer.translation;
+            return r;
+        }
+
+        inline PoseLanes loadPose(const CalVector4* group) {
+            PoseLanes p;
+            p.rotation.x = group[0];
+            p.rotation.y = group[1];
+            p.rotation.z = group[2];
+            p.rotation.w = group[3];
+            p.translation.x = group[4];
+            p.translation.y = group[5];
+            p.translation.z = group[6];
+            return p;
+        }
+
+        inline void storePose(CalVector4* group, const PoseLanes& p) {
+            group[0] = p.rotation.x;
+            group[1] = p.rotation.y;
+            group[2] = p.rotation.z;
+            group[3] = p.rotation.w;
+            group[4] = p.translation.x;
+            group[5] = p.translation.y;
+            group[6] = p.translation.z;
+        }
+
+        inline void setLane(PoseLanes& p, size_t i, const cal3d::RotateTranslate& t) {
+            lane(p.rotation.x, i) = t.rotation.x;
+            lane(p.rotation.y, i) = t.rotation.y;
+            lane(p.rotation.z, i) = t.rotation.z;
+            lane(p.rotation.w, i) = t.rotation.w;
+            lane(p.translation.x, i) = t.translation.x;
+            lane(p.translation.y, i) = t.translation.y;
+            lane(p.translation.z, i) = t.translation.z;
+        }
+
+        inline void copyLane(PoseLanes& p, size_t i, const CalVector4* group, size_t groupLane) {
+            lane(p.rotation.x, i) = lane(group[0], groupLane);
+            lane(p.rotation.y, i) = lane(group[1], groupLane);
+            lane(p.rotation.z, i) = lane(group[2], groupLane);
+            lane(p.rotation.w, i) = lane(group[3], groupLane);
+            lane(p.translation.x, i) = lane(group[4], groupLane);
+            lane(p.translation.y, i) = lane(group[5], groupLane);
+            lane(p.translation.z, i) = lane(group[6], groupLane);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include <math.h>
+#include "cal3d/posesamplecache.h"
+#include "cal3d/coreanimation.h"
+#include "cal3d/coretrack.h"
+
+CalPoseSampleCache::CalPoseSampleCache(size_t maxEntries, float timeQuantum)
+    : maxEntries(maxEntries)
+    , timeQuantum(timeQuantum)
+    , clock(0)
+    , hits(0)
+    , misses(0)
+{
+    cal3d::verify(maxEntries > 0, "pose sample cache needs at least one entry");
+    cal3d::verify(timeQuantum > 0.0f, "pose sample cache time quantum must be positive");
+}
+
+CalSampledPosePtr CalPoseSampleCache::sample(const CalCoreAnimationPtr& coreAnimation, float time) {
+    const int step = static_cast<int>(floorf(time / timeQuantum + 0.5f));
+    const Key key(coreAnimation.get(), step);
+
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(mutex);
+        EntryMap::iterator i = entries.find(key);
+        if (i != entries.end()) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            // skip the store when it would change nothing, so entries
+            // hit from several threads don't bounce between caches
+            const cal3d_uint64 now = clock.load(std::memory_order_relaxed);
+            if (i->second.lastUsed.load(std::memory_order_relaxed) != now) {
+                i->second.lastUsed.store(now, std::memory_order_relaxed);
+            }
+            return i->second.pose;
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+
+    CalSampledPosePtr pose = samplePose(*coreAnimation, step * timeQuantum);
+
+    // Evicted entries may hold the last reference to a pose or an
+    // animation, so they are destroyed after the lock is released.
+    std::vector<std::pair<CalCoreAnimationPtr, CalSampledPosePtr> > evicted;
+    std::lock_guard<std::shared_timed_mutex> lock(mutex);
+
+    // another thread may have sampled the same pose in the meantime
+    EntryMap::iterator i = entries.find(key);
+    if (i != entries.end()) {
+        return i->second.pose;
+    }
+
+    Entry& entry = entries[key];
+    entry.coreAnimation = coreAnimation;
+    entry.pose = pose;
+    entry.lastUsed.store(++clock, std::memory_order_relaxed);
+
+    while (entries.size() > maxEntries) {
+        EntryMap::iterator oldest = entries.begin();
+        for (EntryMap::iterator j = entries.begin(); j != entries.end(); ++j) {
+            if (j->second.lastUsed.load(std::memory_order_relaxed) < oldest->second.lastUsed.load(std::memory_order_relaxed)) {
+                oldest = j;
+            }
+        }
+        evicted.push_back(std::make_pair(
+            std::move(oldest->second.coreAnimation),
+            std::move(oldest->second.pose)));
+        entries.erase(oldest);
+    }
+
+    return pose;
+}
+
+void CalPoseSampleCache::clear() {
+    EntryMap cleared;
+    std::lock_guard<std::shared_timed_mutex> lock(mutex);
+    cleared.swap(entries);
+}
+
+size_t CalPoseSampleCache::getEntryCount() const {
+    std::shared_lock<std::shared_timed_mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t CalPoseSampleCache::getHitCount() const {
+    return hits.load(std::memory_order_relaxed);
+}
+
+size_t CalPoseSampleCache::getMissCount() const {
+    return misses.load(std::memory_order_relaxed);
+}
+
+CalSampledPosePtr CalPoseSampleCache::samplePose(const CalCoreAnimation& coreAnimation, float time) {
+    const CalCoreAnimation::TrackList& tracks = coreAnimation.tracks;
+
+    boost::shared_ptr<CalSampledPose> pose(new CalSampledPose);
+    pose->time = time;
+    pose->boneIds.reserve(tracks.size());
+    pose->transforms.reserve(tracks.size());
+    pose->usesBindTranslation.reserve(tracks.size());
+
+    for (auto track = tracks.begin(); track != tracks.end(); ++track) {
+        pose->boneIds.push_back(track->coreBoneId);
+        pose->transforms.push_back(track->getCurrentTransform(time, CalVector()));
+        pose->usesBindTranslation.push_back(!track->translationRequired);
+    }
+
+    return pose;
+}
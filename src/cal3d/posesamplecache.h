@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <shared_mutex>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "cal3d/global.h"
+#include "cal3d/transform.h"
+
+CAL3D_PTR(CalCoreAnimation);
+
+// All tracks of a core animation sampled at one time, in track order.
+struct CalSampledPose {
+    float time;
+    std::vector<unsigned> boneIds;
+    std::vector<cal3d::RotateTranslate> transforms;
+    // Set for tracks without a required translation.  The translation must
+    // then come from the bone's bind pose (CalBone::getOriginalTranslation).
+    std::vector<bool> usesBindTranslation;
+};
+typedef boost::shared_ptr<const CalSampledPose> CalSampledPosePtr;
+
+// Shares sampled poses between mixers that play the same core animation at
+// nearly the same time, as in crowds.  Times are snapped to multiples of
+// timeQuantum, so a cached pose may be up to half a quantum away from the
+// requested time.  At most maxEntries poses are kept; the least recently
+// used one is evicted first.
+//
+// sample() may be called from several threads at once.  Poses are
+// immutable once cached, and sampling happens outside the lock.  Hits only
+// take the lock shared and stamp their entry with the current clock, so
+// concurrent hits don't serialize; entries hit since the last miss tie for
+// recency.  Misses take it exclusively and evict by scanning for the
+// oldest stamp, which costs far less than sampling the pose did.
+class CAL3D_API CalPoseSampleCache : private boost::noncopyable {
+public:
+    CalPoseSampleCache(size_t maxEntries, float timeQuantum = 1.0f / 60.0f);
+
+    CalSampledPosePtr sample(const CalCoreAnimationPtr& coreAnimation, float time);
+    void clear();
+
+    size_t getEntryCount() const;
+    size_t getHitCount() const;
+    size_t getMissCount() const;
+
+    static CalSampledPosePtr samplePose(const CalCoreAnimation& coreAnimation, float time);
+
+private:
+    typedef std::pair<const CalCoreAnimation*, int> Key;
+
+    struct Entry {
+        // keeps the animation alive so its address can't be reused by another
+        CalCoreAnimationPtr coreAnimation;
+        CalSampledPosePtr pose;
+        // clock when last sampled; written by hits under the shared lock
+        std::atomic<cal3d_uint64> lastUsed;
+    };
+    typedef std::map<Key, Entry> EntryMap;
+
+    const size_t maxEntries;
+    const float timeQuantum;
+
+    mutable std::shared_timed_mutex mutex;
+    EntryMap entries;
+    // advanced by every insertion
+    std::atomic<cal3d_uint64> clock;
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+};
@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <string.h>
+#include "cal3d/runtimeimage.h"
+#include "cal3d/coreanimation.h"
+#include "cal3d/corekeyframe.h"
+#include "cal3d/coremesh.h"
+#include "cal3d/coremorphtarget.h"
+#include "cal3d/coresubmesh.h"
+#include "cal3d/coretrack.h"
+#include "cal3d/error.h"
+#include "cal3d/memory.h"
+
+namespace {
+    enum ImageKind {
+        MeshImage = 1,
+        AnimationImage = 2,
+    };
+
+    const size_t ImageAlignment = 16;
+
+    enum TrackFlags {
+        TranslationRequired = 1,
+        TranslationIsDynamic = 2,
+        SplineInterpolated = 4,
+    };
+
+    // A count of T stored at offset bytes from the start of the image.
+    struct ArrayRecord {
+        cal3d_uint64 offset;
+        cal3d_uint64 count;
+    };
+
+    // The sizes of the structures stored in the image, so builds that lay
+    // them out differently reject each other's images.
+    struct StructureSizes {
+        static StructureSizes current() {
+            StructureSizes s;
+            s.pointer = sizeof(void*);
+            s.vertex = sizeof(CalCoreSubmesh::Vertex);
+            s.textureCoordinate = sizeof(CalCoreSubmesh::TextureCoordinate);
+            s.influence = sizeof(CalCoreSubmesh::Influence);
+            s.face = sizeof(CalCoreSubmesh::Face);
+            s.vertexOffset = sizeof(VertexOffset);
+            s.keyframe = sizeof(CalCoreKeyframe);
+            s.endianness = 0x01020304;
+            return s;
+        }
+
+        bool operator==(const StructureSizes& rhs) const {
+            return memcmp(this, &rhs, sizeof(*this)) == 0;
+        }
+
+        unsigned pointer;
+        unsigned vertex;
+        unsigned textureCoordinate;
+        unsigned influence;
+        unsigned face;
+        unsigned vertexOffset;
+        unsigned keyframe;
+        unsigned endianness;
+    };
+
+    struct ImageHeader {
+        char magic[4];
+        int version;
+        unsigned kind;
+        float duration; // animations only
+        StructureSizes sizes;
+        ArrayRecord records; // SubmeshRecords or TrackRecords
+    };
+
+    struct SubmeshRecord {
+        int coreMaterialThreadId;
+        cal3d_uint64 minimumVertexBufferSize;
+        float boundsMin[3];
+        float boundsMax[3];
+        ArrayRecord vertices;
+        ArrayRecord vertexColors;
+        ArrayRecord textureCoordinates;
+        ArrayRecord influences;
+        ArrayRecord faces;
+        ArrayRecord morphTargets; // MorphTargetRecords
+    };
+
+    struct MorphTargetRecord {
+        ArrayRecord name;
+        ArrayRecord vertexOffsets;
+    };
+
+    struct TrackRecord {
+        unsigned coreBoneId;
+        unsigned flags;
+        ArrayRecord keyframes;
+    };
+
+    class ImageWriter {
+    public:
+        ImageWriter()
+            : image(sizeof(ImageHeader), '\0')
+        {}
+
+        template<typename T>
+        ArrayRecord write(const T* data, size_t count) {
+            image.resize((image.size() + ImageAlignment - 1) & ~(ImageAlignment - 1), '\0');
+            ArrayRecord r;
+            r.offset = image.size();
+            r.count = count;
+            if (count) {
+                image.append(reinterpret_cast<const char*>(data), sizeof(T) * count);
+            }
+            return r;
+        }
+
+        template<typename C>
+        ArrayRecord write(const C& container) {
+            return write(cal3d::pointerFromVector(container), container.size());
+        }
+
+        std::string finish(ImageKind kind, float duration, const ArrayRecord& records) {
+            ImageHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, cal3d::RUNTIME_IMAGE_MAGIC, sizeof(header.magic));
+            header.version = cal3d::RUNTIME_IMAGE_VERSION;
+            header.kind = kind;
+            header.duration = duration;
+            header.sizes = StructureSizes::current();
+            header.records = records;
+            image.replace(0, sizeof(header), reinterpret_cast<const char*>(&header), sizeof(header));
+            return image;
+        }
+
+    private:
+        std::string image;
+    };
+
+    class ImageReader {
+    public:
+        ImageReader(const void* image, size_t size)
+            : image(static_cast<const char*>(image))
+            , size(size)
+        {}
+
+        // null, with CalError set, unless the image is a compatible image of kind
+        const ImageHeader* header(ImageKind kind) const {
+            if (!image || reinterpret_cast<size_t>(image) % ImageAlignment || size < sizeof(ImageHeader)) {
+                CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+                return 0;
+            }
+            const ImageHeader* h = reinterpret_cast<const ImageHeader*>(image);
+            if (memcmp(h->magic, cal3d::RUNTIME_IMAGE_MAGIC, sizeof(h->magic)) != 0 || h->kind != unsigned(kind)) {
+                CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+                return 0;
+            }
+            if (h->version != cal3d::RUNTIME_IMAGE_VERSION || !(h->sizes == StructureSizes::current())) {
+                CalError::setLastError(CalError::INCOMPATIBLE_FILE_VERSION, __FILE__, __LINE__);
+                return 0;
+            }
+            return h;
+        }
+
+        // null unless the whole array lies inside the image, aligned
+        template<typename T>
+        const T* get(const ArrayRecord& r) const {
+            if (r.offset % ImageAlignment || r.offset > size || r.count > (size - r.offset) / sizeof(T)) {
+                return 0;
+            }
+            return reinterpret_cast<const T*>(image + r.offset);
+        }
+
+    private:
+        const char* image;
+        size_t size;
+    };
+
+    // InfluenceSet::matches, for a run of influences in place
+    bool matchesRun(const std::set<CalCoreSubmesh::Influence>& set, const CalCoreSubmesh::Influence* begin, const CalCoreSubmesh::Influence* end) {
+        for (const CalCoreSubmesh::Influence* i = begin; i != end; ++i) {
+            if (!set.count(*i)) {
+                return false;
+            }
+        }
+        for (auto i = set.begin(); i != set.end(); ++i) {
+            if (std::find(begin, end, *i) == end) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Every vertex's influences end with exactly one marked last, so the
+    // skinning loops step through one run per vertex and stop at the end.
+    // In the same pass, derives whether every vertex has the first
+    // vertex's influences, as CalCoreSubmesh::addVertex would.
+    bool validInfluences(
+        const CalCoreSubmesh::Influence* influences, size_t count, size_t vertexCount,
+        bool& isStatic, std::set<CalCoreSubmesh::Influence>& staticInfluences
+    ) {
+        isStatic = false;
+        staticInfluences.clear();
+
+        size_t runCount = 0;
+        const CalCoreSubmesh::Influence* run = influences;
+        for (size_t i = 0; i < count; ++i) {
+            if (!influences[i].lastInfluenceForThisVertex) {
+                continue;
+            }
+            const CalCoreSubmesh::Influence* const end = influences + i + 1;
+            if (runCount++ == 0) {
+                staticInfluences.insert(run, end);
+                // addVertex stands in this influence for an empty list,
+                // which never counts as static
+                isStatic = !(end - run == 1 && run->boneId == 0 && run->weight == 0.0f);
+            } else if (isStatic) {
+                isStatic = matchesRun(staticInfluences, run, end);
+            }
+            run = end;
+        }
+        return runCount == vertexCount && (count == 0 || influences[count - 1].lastInfluenceForThisVertex);
+    }
+
+    // false if a face indexes past the vertices; otherwise the vertex buffer
+    // size the faces need, as CalCoreSubmesh::addFace would compute it
+    bool validFaces(const CalCoreSubmesh::Face* faces, size_t count, size_t vertexCount, size_t& minimumVertexBufferSize) {
+        minimumVertexBufferSize = 0;
+        for (size_t f = 0; f < count; ++f) {
+            for (int i = 0; i < 3; ++i) {
+                const size_t vertexId = size_t(faces[f].vertexId[i]);
+                if (vertexId >= vertexCount) {
+                    return false;
+                }
+                minimumVertexBufferSize = std::max(minimumVertexBufferSize, vertexId + 1);
+            }
+        }
+        return true;
+    }
+
+    // CalCoreMorphTarget verifies the same, but by throwing
+    bool validVertexOffsets(const VertexOffset* offsets, size_t count, size_t vertexCount) {
+        if (count > vertexCount) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (offsets[i].vertexId >= vertexCount) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+std::string CalRuntimeImage::saveCoreMesh(const CalCoreMesh& coreMesh) {
+    ImageWriter writer;
+
+    std::vector<SubmeshRecord> submeshes;
+    for (auto i = coreMesh.submeshes.begin(); i != coreMesh.submeshes.end(); ++i) {
+        const CalCoreSubmesh& submesh = **i;
+
+        std::vector<MorphTargetRecord> morphTargets;
+        for (auto m = submesh.m_morphTargets.begin(); m != submesh.m_morphTargets.end(); ++m) {
+            MorphTargetRecord mr;
+            mr.name = writer.write((*m)->name.data(), (*m)->name.size());
+            mr.vertexOffsets = writer.write((*m)->vertexOffsets);
+            morphTargets.push_back(mr);
+        }
+
+        SubmeshRecord r;
+        memset(&r, 0, sizeof(r));
+        r.coreMaterialThreadId = submesh.coreMaterialThreadId;
+        r.minimumVertexBufferSize = submesh.m_minimumVertexBufferSize;
+        const CalAABox& bounds = submesh.m_boundingVolume;
+        r.boundsMin[0] = bounds.min.x;
+        r.boundsMin[1] = bounds.min.y;
+        r.boundsMin[2] = bounds.min.z;
+        r.boundsMax[0] = bounds.max.x;
+        r.boundsMax[1] = bounds.max.y;
+        r.boundsMax[2] = bounds.max.z;
+        r.vertices = writer.write(submesh.m_vertices);
+        r.vertexColors = writer.write(submesh.m_vertexColors);
+        r.textureCoordinates = writer.write(submesh.m_textureCoordinates);
+        r.influences = writer.write(submesh.m_influences);
+        r.faces = writer.write(submesh.m_faces);
+        r.morphTargets = writer.write(morphTargets);
+        submeshes.push_back(r);
+    }
+
+    return writer.finish(MeshImage, 0.0f, writer.write(submeshes));
+}
+
+std::string CalRuntimeImage::saveCoreAnimation(const CalCoreAnimation& coreAnimation) {
+    ImageWriter writer;
+
+    std::vector<TrackRecord> tracks;
+    for (auto i = coreAnimation.tracks.begin(); i != coreAnimation.tracks.end(); ++i) {
+        TrackRecord r;
+        memset(&r, 0, sizeof(r));
+        r.coreBoneId = i->coreBoneId;
+        r.flags =
+            (i->translationRequired ? TranslationRequired : 0) |
+            (i->translationIsDynamic ? TranslationIsDynamic : 0) |
+            (i->splineInterpolated ? SplineInterpolated : 0);
+        r.keyframes = writer.write(i->keyframes);
+        tracks.push_back(r);
+    }
+
+    return writer.finish(AnimationImage, coreAnimation.duration, writer.write(tracks));
+}
+
+/*****************************************************************************/
+/** Loads a core mesh from a runtime image.
+  *
+  * Every array is checked to lie inside the image before it is touched,
+  * and everything later code indexes with (influence runs, face indices,
+  * morphed vertex ids) is checked against the vertex count.  The bounds
+  * come from the image, so each array is a single copy; the static
+  * influences and the minimum vertex buffer size are recomputed in the
+  * passes that validate the influences and the faces.
+  *****************************************************************************/
+
+CalCoreMeshPtr CalRuntimeImage::loadCoreMesh(const void* image, size_t size) {
+    const CalCoreMeshPtr null;
+
+    const ImageReader reader(image, size);
+    const ImageHeader* header = reader.header(MeshImage);
+    if (!header) {
+        return null;
+    }
+
+    const SubmeshRecord* records = reader.get<SubmeshRecord>(header->records);
+    if (!records) {
+        CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+        return null;
+    }
+
+    CalCoreMeshPtr coreMesh(new CalCoreMesh);
+    for (size_t s = 0; s < header->records.count; ++s) {
+        const SubmeshRecord& r = records[s];
+        const size_t vertexCount = size_t(r.vertices.count);
+
+        const CalCoreSubmesh::Vertex* vertices = reader.get<CalCoreSubmesh::Vertex>(r.vertices);
+        const CalColor32* vertexColors = reader.get<CalColor32>(r.vertexColors);
+        const CalCoreSubmesh::TextureCoordinate* textureCoordinates = reader.get<CalCoreSubmesh::TextureCoordinate>(r.textureCoordinates);
+        const CalCoreSubmesh::Influence* influences = reader.get<CalCoreSubmesh::Influence>(r.influences);
+        const CalCoreSubmesh::Face* faces = reader.get<CalCoreSubmesh::Face>(r.faces);
+        const MorphTargetRecord* morphTargets = reader.get<MorphTargetRecord>(r.morphTargets);
+        if (
+            !vertices || !vertexColors || !textureCoordinates || !influences ||
+            !faces || !morphTargets ||
+            r.vertexColors.count != vertexCount ||
+            (r.textureCoordinates.count != 0 && r.textureCoordinates.count != vertexCount)
+        ) {
+            CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+            return null;
+        }
+
+        CalCoreSubmeshPtr submesh(new CalCoreSubmesh(0, false, 0));
+        if (!validInfluences(
+                influences, size_t(r.influences.count), vertexCount,
+                submesh->m_isStatic, submesh->m_staticInfluenceSet.influences)
+        ) {
+            CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+            return null;
+        }
+
+        size_t minimumVertexBufferSize;
+        if (!validFaces(faces, size_t(r.faces.count), vertexCount, minimumVertexBufferSize)) {
+            CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+            return null;
+        }
+
+        submesh->coreMaterialThreadId = r.coreMaterialThreadId;
+        submesh->m_currentVertexId = static_cast<unsigned>(vertexCount);
+        submesh->m_vertices.destructive_resize(vertexCount);
+        std::copy(vertices, vertices + vertexCount, submesh->m_vertices.data());
+        submesh->m_vertexColors.assign(vertexColors, vertexColors + vertexCount);
+        submesh->m_textureCoordinates.assign(textureCoordinates, textureCoordinates + r.textureCoordinates.count);
+        submesh->m_influences.assign(influences, influences + r.influences.count);
+        submesh->m_faces.assign(faces, faces + r.faces.count);
+        submesh->m_minimumVertexBufferSize = minimumVertexBufferSize;
+        submesh->m_boundingVolume = CalAABox(
+            CalVector(r.boundsMin[0], r.boundsMin[1], r.boundsMin[2]),
+            CalVector(r.boundsMax[0], r.boundsMax[1], r.boundsMax[2]));
+
+        for (size_t m = 0; m < r.morphTargets.count; ++m) {
+            const char* name = reader.get<char>(morphTargets[m].name);
+            const VertexOffset* offsets = reader.get<VertexOffset>(morphTargets[m].vertexOffsets);
+            if (!name || !offsets || !validVertexOffsets(offsets, size_t(morphTargets[m].vertexOffsets.count), vertexCount)) {
+                CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+                return null;
+            }
+            submesh->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget(
+                std::string(name, name + morphTargets[m].name.count),
+                vertexCount,
+                offsets,
+                offsets + morphTargets[m].vertexOffsets.count)));
+        }
+
+        coreMesh->submeshes.push_back(submesh);
+    }
+    return coreMesh;
+}
+
+CalCoreAnimationPtr CalRuntimeImage::loadCoreAnimation(const void* image, size_t size) {
+    const CalCoreAnimationPtr null;
+
+    const ImageReader reader(image, size);
+    const ImageHeader* header = reader.header(AnimationImage);
+    if (!header) {
+        return null;
+    }
+
+    const TrackRecord* records = reader.get<TrackRecord>(header->records);
+    if (!records || !(header->duration > 0.0f)) {
+        CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+        return null;
+    }
+
+    CalCoreAnimationPtr coreAnimation(new CalCoreAnimation);
+    coreAnimation->duration = header->duration;
+    coreAnimation->tracks.reserve(size_t(header->records.count));
+    for (size_t t = 0; t < header->records.count; ++t) {
+        const TrackRecord& r = records[t];
+        const CalCoreKeyframe* keyframes = reader.get<CalCoreKeyframe>(r.keyframes);
+        // the binary loader rejects negative bone ids; so do images
+        if (!keyframes || r.coreBoneId > unsigned(std::numeric_limits<int>::max())) {
+            CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+            return null;
+        }
+        // sampling binary searches the times, which NaN would also break
+        for (size_t k = 1; k < r.keyframes.count; ++k) {
+            if (!(keyframes[k].time >= keyframes[k - 1].time)) {
+                CalError::setLastError(CalError::INVALID_FILE_FORMAT, __FILE__, __LINE__);
+                return null;
+            }
+        }
+
+        // saved sorted, so skip the sort in CalCoreTrack's constructor
+        coreAnimation->tracks.push_back(CalCoreTrack(r.coreBoneId, CalCoreTrack::KeyframeList()));
+        CalCoreTrack& track = coreAnimation->tracks.back();
+        track.keyframes.assign(keyframes, keyframes + r.keyframes.count);
+        track.translationRequired = (r.flags & TranslationRequired) != 0;
+        track.translationIsDynamic = (r.flags & TranslationIsDynamic) != 0;
+        track.splineInterpolated = (r.flags & SplineInterpolated) != 0;
+    }
+
+    coreAnimation->buildTrackTable();
+    return coreAnimation;
+}
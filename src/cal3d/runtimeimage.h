@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include "cal3d/global.h"
+
+CAL3D_PTR(CalCoreAnimation);
+CAL3D_PTR(CalCoreMesh);
+
+namespace cal3d {
+    const char RUNTIME_IMAGE_MAGIC[4] = { 'C', 'R', 'I', '\0' };
+
+    // Bumped whenever the image layout, or the layout of any structure
+    // stored in an image, changes.
+    const int RUNTIME_IMAGE_VERSION = 2;
+}
+
+// Runtime images are a cache format for core meshes and animations.  Every
+// vertex, influence, face, morph offset and keyframe array is stored
+// exactly as the in-memory structure lays it out, 16-byte aligned, along
+// with each submesh's bounds.
+//
+// Loading validates the header and each array's offset and size and then
+// copies each array in one block; nothing is parsed per field.  The image
+// is meant to be memory-mapped, so it must start on a 16-byte boundary.
+//
+// Images depend on structure layout, so they are only readable by builds
+// with the same RUNTIME_IMAGE_VERSION, pointer size and endianness.  Keep
+// the .cmf/.caf files as the source of truth and regenerate images from
+// them.
+class CAL3D_API CalRuntimeImage {
+public:
+    static std::string saveCoreMesh(const CalCoreMesh& coreMesh);
+    static std::string saveCoreAnimation(const CalCoreAnimation& coreAnimation);
+
+    // Return null and set CalError on a malformed or incompatible image.
+    static CalCoreMeshPtr loadCoreMesh(const void* image, size_t size);
+    static CalCoreAnimationPtr loadCoreAnimation(const void* image, size_t size);
+
+private:
+    CalRuntimeImage();
+};
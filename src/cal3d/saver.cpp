@@ -12,6 +12,7 @@
 #include "config.h"
 #endif
 
+#include <string.h>
 #include <fstream>
 #include <sstream>
 #include "cal3d/loader.h"
@@ -33,19 +34,318 @@
 #include "cal3d/corematerial.h"
 #include "cal3d/tinyxml.h"
 #include "cal3d/xmlformat.h"
+#include "cal3d/xmlwriter.h"
+
+namespace {
+    const size_t wordSize = 4;
+
+    /*****************************************************************************/
+    /** Serializes the binary formats into memory sized up front.
+      *
+      * Every binary save runs its writeBinary twice: first with a counting
+      * writer, which only adds up the size, then into a buffer of exactly
+      * that size, in the little-endian layout the CalPlatform write
+      * functions produce, with no stream in between.  Both passes run the
+      * same code, so the size cannot disagree with the bytes written.
+      *****************************************************************************/
+
+    class BinaryWriter {
+    public:
+        // counts the bytes that would be written
+        BinaryWriter()
+            : begin(0)
+            , written(0)
+        {}
+
+        explicit BinaryWriter(char* begin)
+            : begin(begin)
+            , written(0)
+        {}
+
+        size_t size() const {
+            return written;
+        }
 
-template<typename T>
-std::string save(const boost::shared_ptr<T>& t, bool (saveBinary)(std::ostream&, T*)) {
-    std::ostringstream os;
-    if (saveBinary(os, t.get())) {
-        return os.str();
-    } else {
-        return "";
+        void writeBytes(const void* data, size_t size) {
+            if (begin) {
+                memcpy(begin + written, data, size);
+            }
+            written += size;
+        }
+
+        void writeInteger(int value) {
+            writeWord(&value);
+        }
+
+        void writeFloat(float value) {
+            writeWord(&value);
+        }
+
+        void writeIntegers(const int* values, size_t count) {
+#ifdef CAL3D_BIG_ENDIAN
+            for (size_t i = 0; i < count; ++i) {
+                writeInteger(values[i]);
+            }
+#else
+            writeBytes(values, count * wordSize);
+#endif
+        }
+
+        void writeVector(const CalVector& v) {
+            writeFloat(v.x);
+            writeFloat(v.y);
+            writeFloat(v.z);
+        }
+
+        // the file stores the conjugate
+        void writeConjugate(const CalQuaternion& q) {
+            writeFloat(q.x);
+            writeFloat(q.y);
+            writeFloat(q.z);
+            writeFloat(-q.w);
+        }
+
+        void writeString(const std::string& s) {
+            writeInteger(int(s.size() + 1));
+            writeBytes(s.c_str(), s.size() + 1);
+        }
+
+    private:
+        void writeWord(const void* word) {
+#ifdef CAL3D_BIG_ENDIAN
+            const char* bytes = static_cast<const char*>(word);
+            const char swapped[wordSize] = { bytes[3], bytes[2], bytes[1], bytes[0] };
+            writeBytes(swapped, wordSize);
+#else
+            writeBytes(word, wordSize);
+#endif
+        }
+
+        char* begin;
+        size_t written;
+    };
+
+    // each track: bone id, keyframe count, flags, then time, translation and rotation per keyframe
+    void writeBinary(BinaryWriter& writer, const CalCoreAnimation& animation) {
+        writer.writeBytes(cal3d::ANIMATION_FILE_MAGIC, sizeof(cal3d::ANIMATION_FILE_MAGIC));
+        writer.writeInteger(cal3d::CURRENT_FILE_VERSION);
+        if (cal3d::versionHasCompressionFlag(cal3d::CURRENT_FILE_VERSION)) {
+            writer.writeInteger(0); // no compression
+        }
+        writer.writeFloat(animation.duration);
+        writer.writeInteger(animation.tracks.size());
+
+        for (size_t i = 0; i < animation.tracks.size(); ++i) {
+            const CalCoreTrack& track = animation.tracks[i];
+            writer.writeInteger(track.coreBoneId);
+            writer.writeInteger(track.keyframes.size());
+            // bit 0 marks spline interpolation
+            writer.writeInteger(track.splineInterpolated ? 1 : 0);
+
+            for (size_t k = 0; k < track.keyframes.size(); ++k) {
+                const CalCoreKeyframe& keyframe = track.keyframes[k];
+                writer.writeFloat(keyframe.time);
+                writer.writeVector(keyframe.transform.translation);
+                writer.writeConjugate(keyframe.transform.rotation);
+            }
+        }
+    }
+
+    // each track: name, keyframe count, then time and weight per keyframe
+    void writeBinary(BinaryWriter& writer, const CalCoreMorphAnimation& animation) {
+        writer.writeBytes(cal3d::ANIMATEDMORPH_FILE_MAGIC, sizeof(cal3d::ANIMATEDMORPH_FILE_MAGIC));
+        writer.writeInteger(cal3d::CURRENT_FILE_VERSION);
+        writer.writeFloat(animation.duration);
+        writer.writeInteger(animation.tracks.size());
+
+        for (size_t i = 0; i < animation.tracks.size(); ++i) {
+            const CalCoreMorphTrack& track = animation.tracks[i];
+            writer.writeString(track.morphName);
+            writer.writeInteger(track.keyframes.size());
+#ifdef CAL3D_BIG_ENDIAN
+            for (size_t k = 0; k < track.keyframes.size(); ++k) {
+                writer.writeFloat(track.keyframes[k].time);
+                writer.writeFloat(track.keyframes[k].weight);
+            }
+#else
+            // the keyframes are laid out as the file stores them
+            static_assert(sizeof(CalCoreMorphKeyframe) == 2 * wordSize, "CalCoreMorphKeyframe is time and weight");
+            if (!track.keyframes.empty()) {
+                writer.writeBytes(&track.keyframes[0], track.keyframes.size() * sizeof(CalCoreMorphKeyframe));
+            }
+#endif
+        }
+    }
+
+    // colors and shininess, which are no longer stored, then filename and type per map
+    void writeBinary(BinaryWriter& writer, const CalCoreMaterial& material) {
+        writer.writeBytes(cal3d::MATERIAL_FILE_MAGIC, sizeof(cal3d::MATERIAL_FILE_MAGIC));
+        writer.writeInteger(cal3d::CURRENT_FILE_VERSION);
+
+        const unsigned char colors[12] = {0}; // ambient, diffuse, specular
+        writer.writeBytes(colors, sizeof(colors));
+        writer.writeFloat(0.0f); // shininess
+
+        writer.writeInteger(material.maps.size());
+        for (size_t i = 0; i < material.maps.size(); ++i) {
+            writer.writeString(material.maps[i].filename);
+            writer.writeString(material.maps[i].type);
+        }
+    }
+
+    // morph targets only store offsets at least this long
+    const float morphDifferenceTolerance = 0.01f;
+
+    bool isMorphOffsetStored(const VertexOffset& offset) {
+        return offset.position.asCalVector().length() >= morphDifferenceTolerance;
+    }
+
+    // a vertex's influences run up to and including the one marked last
+    const CalCoreSubmesh::Influence* nextVertexInfluences(const CalCoreSubmesh::Influence* influence) {
+        while (!influence->lastInfluenceForThisVertex) {
+            ++influence;
+        }
+        return influence + 1;
+    }
+
+    void writeBinary(BinaryWriter& writer, const CalCoreSubmesh& submesh) {
+        const cal3d::SSEArray<CalCoreSubmesh::Vertex>& vertices = submesh.getVectorVertex();
+        const std::vector<CalColor32>& vertexColors = submesh.getVertexColors();
+        const std::vector<CalCoreSubmesh::Face>& faces = submesh.getFaces();
+        const CalCoreSubmesh::MorphTargetArray& morphTargets = submesh.getMorphTargets();
+        const bool hasTextureCoordinates = submesh.hasTextureCoordinates();
+
+        writer.writeInteger(submesh.coreMaterialThreadId);
+        writer.writeInteger(vertices.size());
+        writer.writeInteger(faces.size());
+        writer.writeInteger(0); // lod count
+        writer.writeInteger(0); // spring count
+        writer.writeInteger(hasTextureCoordinates ? 1 : 0);
+        writer.writeInteger(morphTargets.size());
+
+        const CalCoreSubmesh::Influence* influence = cal3d::pointerFromVector(submesh.getInfluences());
+        for (size_t vertexId = 0; vertexId < vertices.size(); ++vertexId) {
+            const CalCoreSubmesh::Vertex& vertex = vertices[vertexId];
+            writer.writeVector(vertex.position.asCalVector());
+            writer.writeVector(vertex.normal.asCalVector());
+            writer.writeVector(CalVectorFromColor(vertexColors[vertexId]));
+            writer.writeInteger(-1); // collapse id
+            writer.writeInteger(0); // face collapse count
+
+            if (hasTextureCoordinates) {
+                const CalCoreSubmesh::TextureCoordinate& textureCoordinate = submesh.getTextureCoordinates()[vertexId];
+                writer.writeFloat(textureCoordinate.u);
+                writer.writeFloat(textureCoordinate.v);
+            }
+
+            const CalCoreSubmesh::Influence* nextVertex = nextVertexInfluences(influence);
+            writer.writeInteger(nextVertex - influence);
+            for (; influence != nextVertex; ++influence) {
+                writer.writeInteger(influence->boneId);
+                writer.writeFloat(influence->weight);
+            }
+        }
+
+        for (size_t morphId = 0; morphId < morphTargets.size(); ++morphId) {
+            const CalCoreMorphTarget::VertexOffsetArray& offsets = morphTargets[morphId]->vertexOffsets;
+            writer.writeString(morphTargets[morphId]->name);
+
+            // the file stores morphed vertices rather than offsets
+            for (size_t i = 0; i < offsets.size(); ++i) {
+                const VertexOffset& offset = offsets[i];
+                if (!isMorphOffsetStored(offset)) {
+                    continue;
+                }
+                const CalCoreSubmesh::Vertex& vertex = vertices[offset.vertexId];
+                writer.writeInteger(offset.vertexId);
+                writer.writeVector((vertex.position + offset.position).asCalVector());
+                writer.writeVector((vertex.normal + offset.normal).asCalVector());
+                if (hasTextureCoordinates) {
+                    writer.writeFloat(0.0f);
+                    writer.writeFloat(0.0f);
+                }
+            }
+            writer.writeInteger(vertices.size() + 1);
+        }
+
+        for (size_t faceId = 0; faceId < faces.size(); ++faceId) {
+            const CalCoreSubmesh::Face& face = faces[faceId];
+            writer.writeInteger(face.vertexId[0]);
+            writer.writeInteger(face.vertexId[1]);
+            writer.writeInteger(face.vertexId[2]);
+        }
+    }
+
+    void writeBinary(BinaryWriter& writer, const CalCoreMesh& mesh) {
+        writer.writeBytes(cal3d::MESH_FILE_MAGIC, sizeof(cal3d::MESH_FILE_MAGIC));
+        writer.writeInteger(cal3d::CURRENT_FILE_VERSION);
+        writer.writeInteger(mesh.submeshes.size());
+        for (size_t i = 0; i < mesh.submeshes.size(); ++i) {
+            writeBinary(writer, *mesh.submeshes[i]);
+        }
+    }
+
+    // each bone: name, relative and inverse bind pose transforms, parent id,
+    // light type and color, child count, then the child ids
+    void writeBinary(BinaryWriter& writer, const CalCoreSkeleton& skeleton) {
+        const size_t boneCount = skeleton.coreBones.size();
+
+        writer.writeBytes(cal3d::SKELETON_FILE_MAGIC, sizeof(cal3d::SKELETON_FILE_MAGIC));
+        writer.writeInteger(cal3d::CURRENT_FILE_VERSION);
+        writer.writeInteger(boneCount);
+        writer.writeVector(skeleton.sceneAmbientColor);
+
+        // the same lists CalCoreSkeleton::getChildIds builds, in one pass
+        std::vector<std::vector<int> > children(boneCount);
+        for (size_t boneId = 0; boneId < boneCount; ++boneId) {
+            const int parentId = skeleton.coreBones[boneId]->parentId;
+            if (parentId >= 0 && size_t(parentId) < boneCount) {
+                children[parentId].push_back(int(boneId));
+            }
+        }
+
+        for (size_t boneId = 0; boneId < boneCount; ++boneId) {
+            const CalCoreBone& bone = *skeleton.coreBones[boneId];
+            writer.writeString(bone.name);
+            writer.writeVector(bone.relativeTransform.translation);
+            writer.writeConjugate(bone.relativeTransform.rotation);
+            writer.writeVector(bone.inverseBindPoseTransform.translation);
+            // files have always carried the relative rotation here; the
+            // loader ignores it, so keep the bytes as they were
+            writer.writeConjugate(bone.relativeTransform.rotation);
+            writer.writeInteger(bone.parentId);
+            writer.writeInteger(bone.lightType);
+            writer.writeVector(bone.lightColor);
+            writer.writeInteger(children[boneId].size());
+            writer.writeIntegers(cal3d::pointerFromVector(children[boneId]), children[boneId].size());
+        }
+    }
+
+    template<typename T>
+    std::string encodeBinary(const T& asset) {
+        BinaryWriter counter;
+        writeBinary(counter, asset);
+
+        std::string buffer(counter.size(), '\0');
+        BinaryWriter writer(&buffer[0]);
+        writeBinary(writer, asset);
+        return buffer;
+    }
+
+    template<typename T>
+    bool writeBinaryToStream(std::ostream& os, const T& asset) {
+        const std::string buffer = encodeBinary(asset);
+        os.write(buffer.data(), buffer.size());
+        if (!os) {
+            CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
+            return false;
+        }
+        return true;
     }
 }
 
 std::string CalSaver::saveCoreAnimationToBuffer(CalCoreAnimationPtr pCoreAnimation) {
-    return save(pCoreAnimation, &saveCoreAnimation);
+    return encodeBinary(*pCoreAnimation);
 }
 
 std::string CalSaver::saveCoreAnimationXmlToBuffer(CalCoreAnimationPtr pCoreAnimation) {
@@ -58,7 +358,7 @@ std::string CalSaver::saveCoreAnimationXmlToBuffer(CalCoreAnimationPtr pCoreAnim
 }
 
 std::string CalSaver::saveCoreMorphAnimationToBuffer(CalCoreMorphAnimationPtr pCoreMorphAnimation) {
-    return save(pCoreMorphAnimation, &saveCoreMorphAnimation);
+    return encodeBinary(*pCoreMorphAnimation);
 }
 
 std::string CalSaver::saveCoreMorphAnimationXmlToBuffer(CalCoreMorphAnimationPtr pCoreMorphAnimation) {
@@ -71,15 +371,15 @@ std::string CalSaver::saveCoreMorphAnimationXmlToBuffer(CalCoreMorphAnimationPtr
 }
 
 std::string CalSaver::saveCoreMaterialToBuffer(CalCoreMaterialPtr pCoreMaterial) {
-    return save(pCoreMaterial, &saveCoreMaterial);
+    return encodeBinary(*pCoreMaterial);
 }
 
 std::string CalSaver::saveCoreMeshToBuffer(CalCoreMeshPtr pCoreMesh) {
-    return save(pCoreMesh, &saveCoreMesh);
+    return encodeBinary(*pCoreMesh);
 }
 
 std::string CalSaver::saveCoreSkeletonToBuffer(CalCoreSkeletonPtr pCoreSkeleton) {
-    return save(pCoreSkeleton, &saveCoreSkeleton);
+    return encodeBinary(*pCoreSkeleton);
 }
 
 bool CalSaver::saveCoreAnimation(const std::string& strFilename, CalCoreAnimation* pCoreAnimation) {
@@ -102,54 +402,7 @@ bool CalSaver::saveCoreAnimation(const std::string& strFilename, CalCoreAnimatio
 }
 
 bool CalSaver::saveCoreAnimation(std::ostream& file, CalCoreAnimation* pCoreAnimation) {
-    const char* strFilename = ""; // do we care?
-
-    // write magic tag
-    if (!CalPlatform::writeBytes(file, &cal3d::ANIMATION_FILE_MAGIC, sizeof(cal3d::ANIMATION_FILE_MAGIC))) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // write version info
-    int version = cal3d::CURRENT_FILE_VERSION;
-    if (!CalPlatform::writeInteger(file, version)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    if (cal3d::versionHasCompressionFlag(cal3d::CURRENT_FILE_VERSION)) {
-        int useCompressionFlag = 0; // no compression
-        if (!CalPlatform::writeInteger(file, useCompressionFlag)) {
-            CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-            return false;
-        }
-    }
-
-    // write the duration of the core animation
-    if (!CalPlatform::writeFloat(file, pCoreAnimation->duration)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // get core track list
-    CalCoreAnimation::TrackList& listCoreTrack = pCoreAnimation->tracks;
-
-    // write the number of tracks
-    if (!CalPlatform::writeInteger(file, listCoreTrack.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return 0;
-    }
-
-    // write all core bones
-    CalCoreAnimation::TrackList::iterator iteratorCoreTrack;
-    for (iteratorCoreTrack = listCoreTrack.begin(); iteratorCoreTrack != listCoreTrack.end(); ++iteratorCoreTrack) {
-        // save core track
-        if (!saveCoreTrack(file, strFilename, &*iteratorCoreTrack)) {
-            return false;
-        }
-    }
-
-    return true;
+    return writeBinaryToStream(file, *pCoreAnimation);
 }
 
 
@@ -172,167 +425,7 @@ bool CalSaver::saveCoreMorphAnimation(const std::string& strFilename, CalCoreMor
 }
 
 bool CalSaver::saveCoreMorphAnimation(std::ostream& file, CalCoreMorphAnimation* pCoreMorphAnimation) {
-    const char* strFilename = "";
-
-    // write magic tag
-    if (!CalPlatform::writeBytes(file, &cal3d::ANIMATEDMORPH_FILE_MAGIC, sizeof(cal3d::ANIMATEDMORPH_FILE_MAGIC))) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // write version info
-    if (!CalPlatform::writeInteger(file, cal3d::CURRENT_FILE_VERSION)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // write the duration of the core animatedMorph
-    if (!CalPlatform::writeFloat(file, pCoreMorphAnimation->duration)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // get core track list
-    std::vector<CalCoreMorphTrack>& listCoreMorphTrack = pCoreMorphAnimation->tracks;
-
-    // write the number of tracks
-    if (!CalPlatform::writeInteger(file, listCoreMorphTrack.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return 0;
-    }
-
-    std::vector<CalCoreMorphTrack>::iterator iteratorCoreMorphTrack;
-    for (iteratorCoreMorphTrack = listCoreMorphTrack.begin(); iteratorCoreMorphTrack != listCoreMorphTrack.end(); ++iteratorCoreMorphTrack) {
-        // save coreMorph track
-        if (!saveCoreMorphTrack(file, strFilename, &(*iteratorCoreMorphTrack))) {
-            return false;
-        }
-    }
-
-    return true;
-}
-
-bool CalSaver::saveCoreBone(std::ostream& file, const CalCoreSkeleton* coreSkeleton, const CalCoreBone* pCoreBone) {
-    if (!file) {
-        CalError::setLastError(CalError::INVALID_HANDLE, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write the name of the bone
-    if (!CalPlatform::writeString(file, pCoreBone->name)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    CalPlatform::writeVector(file, pCoreBone->relativeTransform.translation);
-    CalQuaternion rq = pCoreBone->relativeTransform.rotation; 
-    rq.w = -rq.w;
-    CalPlatform::writeQuat(file, rq);
-    CalPlatform::writeVector(file, pCoreBone->inverseBindPoseTransform.translation);
-    CalQuaternion iq = pCoreBone->relativeTransform.rotation; 
-    iq.w = -iq.w;
-    CalPlatform::writeQuat(file, iq);
-
-    // write the parent bone id
-    if (!CalPlatform::writeInteger(file, pCoreBone->parentId)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write lighting data
-    CalPlatform::writeInteger(file, pCoreBone->lightType);
-    CalPlatform::writeVector(file, pCoreBone->lightColor);
-
-    std::vector<int> children(coreSkeleton->getChildIds(pCoreBone));
-
-    if (!CalPlatform::writeInteger(file, children.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    std::vector<int>::const_iterator iteratorChildId;
-    for (iteratorChildId = children.begin(); iteratorChildId != children.end(); ++iteratorChildId) {
-        if (!CalPlatform::writeInteger(file, *iteratorChildId)) {
-            CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-            return false;
-        }
-    }
-
-    return true;
-}
-
-/*****************************************************************************/
-/** Saves a core keyframe instance.
-  *
-  * This function saves a core keyframe instance to a file stream.
-  *
-  * @param file The file stream to save the core keyframe instance to.
-  * @param strFilename The name of the file stream.
-  * @param pCoreKeyframe A pointer to the core keyframe instance that should be
-  *                      saved.
-  *
-  * @return One of the following values:
-  *         \li \b true if successful
-  *         \li \b false if an error happend
-  *****************************************************************************/
-
-bool CalSaver::saveCoreKeyframe(
-    std::ostream& file,
-    const std::string& strFilename,
-    const CalCoreKeyframe* pCoreKeyframe
-) {
-    if (!file) {
-        CalError::setLastError(CalError::INVALID_HANDLE, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    CalPlatform::writeFloat(file, pCoreKeyframe->time);
-    CalPlatform::writeVector(file, pCoreKeyframe->transform.translation);
-    CalQuaternion rt = pCoreKeyframe->transform.rotation;
-    rt.w = -rt.w;
-    CalPlatform::writeQuat(file, rt);
-
-    // check if an error happend
-    if (!file) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    return true;
-}
-
-
-/*****************************************************************************/
-/** Saves a core morphKeyframe instance.
-  *
-  * This function saves a core morphKeyframe instance to a file stream.
-  *
-  * @param file The file stream to save the core morphKeyframe instance to.
-  * @param strFilename The name of the file stream.
-  * @param pCoreMorphKeyframe A pointer to the core morphKeyframe instance that should be
-  *                      saved.
-  *
-  * @return One of the following values:
-  *         \li \b true if successful
-  *         \li \b false if an error happend
-  *****************************************************************************/
-
-bool CalSaver::saveCoreMorphKeyframe(std::ostream& file, const std::string& strFilename, CalCoreMorphKeyframe* pCoreMorphKeyframe) {
-    if (!file) {
-        CalError::setLastError(CalError::INVALID_HANDLE, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    CalPlatform::writeFloat(file, pCoreMorphKeyframe->time);
-    CalPlatform::writeFloat(file, pCoreMorphKeyframe->weight);
-
-    // check if an error happend
-    if (!file) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    return true;
+    return writeBinaryToStream(file, *pCoreMorphAnimation);
 }
 
 /*****************************************************************************/
@@ -369,61 +462,7 @@ bool CalSaver::saveCoreMaterial(const std::string& strFilename, CalCoreMaterial*
 }
 
 bool CalSaver::saveCoreMaterial(std::ostream& file, CalCoreMaterial* pCoreMaterial) {
-    // write magic tag
-    if (!CalPlatform::writeBytes(file, &cal3d::MATERIAL_FILE_MAGIC, sizeof(cal3d::MATERIAL_FILE_MAGIC))) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write version info
-    if (!CalPlatform::writeInteger(file, cal3d::CURRENT_FILE_VERSION)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    unsigned char ambientColor[4] = {0, 0, 0, 0};
-    CalPlatform::writeBytes(file, &ambientColor, sizeof(ambientColor));
-
-    unsigned char diffusetColor[4] = {0, 0, 0, 0};
-    CalPlatform::writeBytes(file, &diffusetColor, sizeof(diffusetColor));
-
-    unsigned char specularColor[4] = {0, 0, 0, 0};
-    CalPlatform::writeBytes(file, &specularColor, sizeof(specularColor));
-
-    CalPlatform::writeFloat(file, 0.0f);
-
-    // check if an error happend
-    if (!file) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // get the map vector
-    std::vector<CalCoreMaterial::Map>& vectorMap = pCoreMaterial->maps;
-
-    // write the number of maps
-    if (!CalPlatform::writeInteger(file, vectorMap.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write all maps
-    int mapId;
-    for (mapId = 0; mapId < (int)vectorMap.size(); ++mapId) {
-        CalCoreMaterial::Map& map = vectorMap[mapId];
-
-        // write the filename of the map
-        bool ret = CalPlatform::writeString(file, map.filename);
-        if (ret) {
-            ret = CalPlatform::writeString(file, map.type);
-        }
-        if (!ret) {
-            CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-            return false;
-        }
-    }
-
-    return true;
+    return writeBinaryToStream(file, *pCoreMaterial);
 }
 
 /*****************************************************************************/
@@ -456,37 +495,7 @@ bool CalSaver::saveCoreMesh(const std::string& strFilename, CalCoreMesh* pCoreMe
 
 
 bool CalSaver::saveCoreMesh(std::ostream& os, CalCoreMesh* pCoreMesh) {
-
-    // write magic tag
-    if (!CalPlatform::writeBytes(os, &cal3d::MESH_FILE_MAGIC, sizeof(cal3d::MESH_FILE_MAGIC))) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write version info
-    if (!CalPlatform::writeInteger(os, cal3d::CURRENT_FILE_VERSION)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // get the submesh vector
-    CalCoreMesh::CalCoreSubmeshVector& vectorCoreSubmesh = pCoreMesh->submeshes;
-
-    // write the number of submeshes
-    if (!CalPlatform::writeInteger(os, vectorCoreSubmesh.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write all core submeshes
-    int submeshId;
-    for (submeshId = 0; submeshId < (int)vectorCoreSubmesh.size(); ++submeshId) {
-        // write the core submesh
-        if (!saveCoreSubmesh(os, vectorCoreSubmesh[submeshId].get())) {
-            return false;
-        }
-    }
-    return true;
+    return writeBinaryToStream(os, *pCoreMesh);
 }
 /*****************************************************************************/
 /** Saves a core skeleton instance.
@@ -520,268 +529,7 @@ bool CalSaver::saveCoreSkeleton(const std::string& strFilename, CalCoreSkeleton*
 }
 
 bool CalSaver::saveCoreSkeleton(std::ostream& file, CalCoreSkeleton* pCoreSkeleton) {
-    // write magic tag
-    if (!CalPlatform::writeBytes(file, &cal3d::SKELETON_FILE_MAGIC, sizeof(cal3d::SKELETON_FILE_MAGIC))) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write version info
-    if (!CalPlatform::writeInteger(file, cal3d::CURRENT_FILE_VERSION)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write the number of bones
-    if (!CalPlatform::writeInteger(file, pCoreSkeleton->coreBones.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write the sceneambient
-    CalVector sceneColor = pCoreSkeleton->sceneAmbientColor;
-    CalPlatform::writeFloat(file, sceneColor.x);
-    CalPlatform::writeFloat(file, sceneColor.y);
-    CalPlatform::writeFloat(file, sceneColor.z);
-
-
-    for (size_t boneId = 0; boneId < pCoreSkeleton->coreBones.size(); ++boneId) {
-        if (!saveCoreBone(file, pCoreSkeleton, pCoreSkeleton->coreBones[boneId].get())) {
-            return false;
-        }
-    }
-
-    return true;
-}
-
-/*****************************************************************************/
-/** Saves a core submesh instance.
-  *
-  * This function saves a core submesh instance to a file stream.
-  *
-  * @param file The file stream to save the core submesh instance to.
-  * @param optionalFilename The name of the file stream.
-  * @param pCoreSubmesh A pointer to the core submesh instance that should be
-  *                     saved.
-  *
-  * @return One of the following values:
-  *         \li \b true if successful
-  *         \li \b false if an error happend
-  *****************************************************************************/
-
-bool CalSaver::saveCoreSubmesh(std::ostream& os, CalCoreSubmesh* pCoreSubmesh) {
-    if (!os) {
-        CalError::setLastError(CalError::INVALID_HANDLE, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write the core material thread id
-    if (!CalPlatform::writeInteger(os, pCoreSubmesh->coreMaterialThreadId)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // get the vertex, face, physical property and spring vector
-    const cal3d::SSEArray<CalCoreSubmesh::Vertex>& vectorVertex = pCoreSubmesh->getVectorVertex();
-    const std::vector<CalColor32>& vertexColors = pCoreSubmesh->getVertexColors();
-    const std::vector<CalCoreSubmesh::Face>& vectorFace = pCoreSubmesh->getFaces();
-
-    // write the number of vertices, faces, level-of-details and springs
-    CalPlatform::writeInteger(os, vectorVertex.size());
-    CalPlatform::writeInteger(os, vectorFace.size());
-    CalPlatform::writeInteger(os, 0); // lod count
-    CalPlatform::writeInteger(os, 0); // spring count
-
-    // get the texture coordinate vector vector
-    std::vector<CalCoreSubmesh::VectorTextureCoordinate> vectorvectorTextureCoordinate;
-    if (pCoreSubmesh->hasTextureCoordinates()) {
-        vectorvectorTextureCoordinate.push_back(pCoreSubmesh->getTextureCoordinates());
-    }
-
-    // write the number of texture coordinates per vertex
-    CalPlatform::writeInteger(os, vectorvectorTextureCoordinate.size());
-
-    // write the number of morph targets
-    const CalCoreSubmesh::MorphTargetArray& vectorMorphs = pCoreSubmesh->getMorphTargets();
-
-    CalPlatform::writeInteger(os, vectorMorphs.size());
-
-    // check if an error happend
-    if (!os) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-        return false;
-    }
-
-    // write all vertices
-    const CalCoreSubmesh::Influence* currentInfluence = cal3d::pointerFromVector(pCoreSubmesh->getInfluences());
-    for (int vertexId = 0; vertexId < (int)vectorVertex.size(); ++vertexId) {
-        const CalCoreSubmesh::Vertex& vertex = vectorVertex[vertexId];
-
-        // write the vertex data
-        CalPlatform::writeFloat(os, vertex.position.x);
-        CalPlatform::writeFloat(os, vertex.position.y);
-        CalPlatform::writeFloat(os, vertex.position.z);
-        CalPlatform::writeFloat(os, vertex.normal.x);
-        CalPlatform::writeFloat(os, vertex.normal.y);
-        CalPlatform::writeFloat(os, vertex.normal.z);
-        CalVector vc(CalVectorFromColor(vertexColors[vertexId]));
-        CalPlatform::writeFloat(os, vc.x);
-        CalPlatform::writeFloat(os, vc.y);
-        CalPlatform::writeFloat(os, vc.z);
-        CalPlatform::writeInteger(os, -1); // collapseId
-        CalPlatform::writeInteger(os, 0); // faceCollapseCount
-
-        // write all texture coordinates of this vertex
-        int textureCoordinateId;
-        for (textureCoordinateId = 0; textureCoordinateId < (int)vectorvectorTextureCoordinate.size(); ++textureCoordinateId) {
-            const CalCoreSubmesh::TextureCoordinate& textureCoordinate = vectorvectorTextureCoordinate[textureCoordinateId][vertexId];
-
-            // write the influence data
-            CalPlatform::writeFloat(os, textureCoordinate.u);
-            CalPlatform::writeFloat(os, textureCoordinate.v);
-
-            // check if an error happend
-            if (!os) {
-                CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-                return false;
-            }
-        }
-
-        const CalCoreSubmesh::Influence* nextVertex = currentInfluence;
-        while (!nextVertex->lastInfluenceForThisVertex) {
-            ++nextVertex;
-        }
-        ++nextVertex;
-
-        if (!CalPlatform::writeInteger(os, size_t(nextVertex - currentInfluence))) {
-            CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-            return false;
-        }
-
-        // write all influences of this vertex
-        for (; currentInfluence != nextVertex; ++currentInfluence) {
-            CalPlatform::writeInteger(os, currentInfluence->boneId);
-            CalPlatform::writeFloat(os, currentInfluence->weight);
-
-            // check if an error happend
-            if (!os) {
-                CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-                return false;
-            }
-        }
-    }
-
-    for (size_t morphId = 0; morphId < vectorMorphs.size(); morphId++) {
-        CalCoreMorphTargetPtr morphTarget = vectorMorphs[morphId];
-        CalPlatform::writeString(os, morphTarget->name);
-
-        const CalCoreMorphTarget::VertexOffsetArray& vertices = morphTarget->vertexOffsets;
-        for (size_t i = 0; i < vertices.size(); ++i) {
-            VertexOffset const& bv = vertices[i];
-
-            const size_t blendId = bv.vertexId;
-            const CalCoreSubmesh::Vertex& Vertex = vectorVertex[blendId];
-            const float differenceTolerance = 0.01f;
-            if (bv.position.asCalVector().length() < differenceTolerance) {
-                continue;
-            }
-
-            CalPlatform::writeInteger(os, blendId);
-            CalPlatform::writeVector(os, Vertex.position + bv.position);
-            CalPlatform::writeVector(os, Vertex.normal + bv.normal);
-
-            for (size_t tcI = 0; tcI < vectorvectorTextureCoordinate.size(); tcI++) {
-                CalPlatform::writeFloat(os, 0.f);
-                CalPlatform::writeFloat(os, 0.f);
-            }
-        }
-        CalPlatform::writeInteger(os, vectorVertex.size() + 1);
-    }
-
-    for (int faceId = 0; faceId < (int)vectorFace.size(); ++faceId) {
-        const CalCoreSubmesh::Face& face = vectorFace[faceId];
-
-        CalPlatform::writeInteger(os, face.vertexId[0]);
-        CalPlatform::writeInteger(os, face.vertexId[1]);
-        CalPlatform::writeInteger(os, face.vertexId[2]);
-
-        if (!os) {
-            CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, "");
-            return false;
-        }
-    }
-
-    return true;
-}
-
-/*****************************************************************************/
-/** Saves a core track instance.
-  *
-  * This function saves a core track instance to a file stream.
-  *
-  * @param file The file stream to save the core track instance to.
-  * @param strFilename The name of the file stream.
-  * @param pCoreTrack A pointer to the core track instance that should be saved.
-  *
-  * @return One of the following values:
-  *         \li \b true if successful
-  *         \li \b false if an error happend
-  *****************************************************************************/
-
-bool CalSaver::saveCoreTrack(std::ostream& file, const std::string& strFilename, CalCoreTrack* pCoreTrack) {
-    if (!file) {
-        CalError::setLastError(CalError::INVALID_HANDLE, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // Write the coreBoneId.
-    if (!CalPlatform::writeInteger(file, pCoreTrack->coreBoneId)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // Write the number of keyframes
-    if (!CalPlatform::writeInteger(file, pCoreTrack->keyframes.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    for (size_t i = 0; i < pCoreTrack->keyframes.size(); ++i) {
-        if (!saveCoreKeyframe(file, strFilename, &pCoreTrack->keyframes[i])) {
-            return false;
-        }
-    }
-
-    return true;
-}
-
-bool CalSaver::saveCoreMorphTrack(std::ostream& file, const std::string& strFilename, CalCoreMorphTrack* pCoreMorphTrack) {
-    if (!file) {
-        CalError::setLastError(CalError::INVALID_HANDLE, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // write the morph name
-    if (!CalPlatform::writeString(file, pCoreMorphTrack->morphName)) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // read the number of keyframes
-    if (!CalPlatform::writeInteger(file, pCoreMorphTrack->keyframes.size())) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-
-    // save all core keyframes
-    for (size_t i = 0; i < pCoreMorphTrack->keyframes.size(); ++i) {
-        // save the core keyframe
-        if (!saveCoreMorphKeyframe(file, strFilename, &pCoreMorphTrack->keyframes[i])) {
-            return false;
-        }
-    }
-
-    return true;
+    return writeBinaryToStream(file, *pCoreSkeleton);
 }
 
 /*****************************************************************************/
@@ -800,124 +548,82 @@ bool CalSaver::saveCoreMorphTrack(std::ostream& file, const std::string& strFile
   *****************************************************************************/
 
 bool CalSaver::saveXmlCoreSkeleton(const std::string& strFilename, CalCoreSkeleton* pCoreSkeleton) {
-    std::stringstream str;
+    std::ofstream of(strFilename.c_str());
+    if (!of || !saveXmlCoreSkeleton(of, pCoreSkeleton)) {
+        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
+        return false;
+    }
+    return true;
+}
 
-    TiXmlDocument doc(strFilename);
+bool CalSaver::saveXmlCoreSkeleton(std::ostream& os, CalCoreSkeleton* pCoreSkeleton) {
+    CalXmlWriter xml(os);
 
-    TiXmlElement header("HEADER");
-    header.SetAttribute("MAGIC", cal3d::SKELETON_XMLFILE_EXTENSION);
-    header.SetAttribute("VERSION", cal3d::LIBRARY_VERSION);
-
-    doc.InsertEndChild(header);
+    xml.openElement("HEADER");
+    xml.attribute("MAGIC", cal3d::SKELETON_XMLFILE_EXTENSION);
+    xml.intAttribute("VERSION", cal3d::LIBRARY_VERSION);
+    xml.closeElement();
 
-    TiXmlElement skeleton("SKELETON");
-    skeleton.SetAttribute("NUMBONES", pCoreSkeleton->coreBones.size());
+    xml.openElement("SKELETON");
+    xml.intAttribute("NUMBONES", int(pCoreSkeleton->coreBones.size()));
 
-    CalVector sceneColor = pCoreSkeleton->sceneAmbientColor;
-    str << sceneColor.x << " " << sceneColor.y << " " << sceneColor.z;
-    skeleton.SetAttribute("SCENEAMBIENTCOLOR", str.str());
+    const CalVector& sceneColor = pCoreSkeleton->sceneAmbientColor;
+    const float sceneColorValues[] = { sceneColor.x, sceneColor.y, sceneColor.z };
+    xml.floatsAttribute("SCENEAMBIENTCOLOR", sceneColorValues, 3);
 
     for (int boneId = 0; boneId < (int)pCoreSkeleton->coreBones.size(); ++boneId) {
         CalCoreBone* pCoreBone = pCoreSkeleton->coreBones[boneId].get();
 
-        TiXmlElement bone("BONE");
-        bone.SetAttribute("ID", boneId);
-        bone.SetAttribute("NAME", pCoreBone->name);
+        xml.openElement("BONE");
+        xml.intAttribute("ID", boneId);
+        xml.attribute("NAME", pCoreBone->name);
         if (pCoreBone->hasLightingData()) {
-            bone.SetAttribute("LIGHTTYPE", pCoreBone->lightType);
-            str.str("");
-            CalVector c = pCoreBone->lightColor;
-            str << c.x << " " << c.y << " " << c.z;
-            bone.SetAttribute("LIGHTCOLOR", str.str());
+            xml.intAttribute("LIGHTTYPE", pCoreBone->lightType);
+            const CalVector& c = pCoreBone->lightColor;
+            const float lightColor[] = { c.x, c.y, c.z };
+            xml.floatsAttribute("LIGHTCOLOR", lightColor, 3);
         }
 
-        TiXmlElement translation("TRANSLATION");
         const CalVector& translationVector = pCoreBone->relativeTransform.translation;
+        const float translation[] = { translationVector.x, translationVector.y, translationVector.z };
+        xml.openElement("TRANSLATION");
+        xml.floatsText(translation, 3);
+        xml.closeElement();
 
-
-        str.str("");
-        str << translationVector.x << " "
-            << translationVector.y << " "
-            << translationVector.z;
-
-        TiXmlText translationdata(str.str());
-
-        translation.InsertEndChild(translationdata);
-        bone.InsertEndChild(translation);
-
-
-        TiXmlElement rotation("ROTATION");
         const CalQuaternion& rotationQuad = pCoreBone->relativeTransform.rotation;
+        const float rotation[] = { rotationQuad.x, rotationQuad.y, rotationQuad.z, -rotationQuad.w };
+        xml.openElement("ROTATION");
+        xml.floatsText(rotation, 4);
+        xml.closeElement();
 
-
-        str.str("");
-        str << rotationQuad.x << " "
-            << rotationQuad.y << " "
-            << rotationQuad.z << " "
-            << -rotationQuad.w;
-
-        TiXmlText rotationdata(str.str());
-        rotation.InsertEndChild(rotationdata);
-        bone.InsertEndChild(rotation);
-
-
-        TiXmlElement localtranslation("LOCALTRANSLATION");
         const CalVector& localtranslationVector = pCoreBone->inverseBindPoseTransform.translation;
+        const float localTranslation[] = { localtranslationVector.x, localtranslationVector.y, localtranslationVector.z };
+        xml.openElement("LOCALTRANSLATION");
+        xml.floatsText(localTranslation, 3);
+        xml.closeElement();
 
-        str.str("");
-        str << localtranslationVector.x << " "
-            << localtranslationVector.y << " "
-            << localtranslationVector.z;
-
-        TiXmlText localtranslationdata(str.str());
-
-        localtranslation.InsertEndChild(localtranslationdata);
-        bone.InsertEndChild(localtranslation);
-
-
-        TiXmlElement localrotation("LOCALROTATION");
         const CalQuaternion& localrotationQuad = pCoreBone->inverseBindPoseTransform.rotation;
+        const float localRotation[] = { localrotationQuad.x, localrotationQuad.y, localrotationQuad.z, -localrotationQuad.w };
+        xml.openElement("LOCALROTATION");
+        xml.floatsText(localRotation, 4);
+        xml.closeElement();
 
-        str.str("");
-        str << localrotationQuad.x << " "
-            << localrotationQuad.y << " "
-            << localrotationQuad.z << " "
-            << -localrotationQuad.w;
-
-        TiXmlText localrotationdata(str.str());
-        localrotation.InsertEndChild(localrotationdata);
-        bone.InsertEndChild(localrotation);
-
-
-        TiXmlElement parent("PARENTID");
-        str.str("");
-        str << pCoreBone->parentId;
-        TiXmlText parentid(str.str());
-        parent.InsertEndChild(parentid);
-        bone.InsertEndChild(parent);
+        xml.openElement("PARENTID");
+        xml.intText(pCoreBone->parentId);
+        xml.closeElement();
 
         std::vector<int> listChildId(pCoreSkeleton->getChildIds(pCoreBone));
-
-        std::vector<int>::const_iterator iteratorChildId;
-        for (iteratorChildId = listChildId.begin(); iteratorChildId != listChildId.end(); ++iteratorChildId) {
-            TiXmlElement child("CHILDID");
-            str.str("");
-            //int id=*iteratorChildId;
-            str << *iteratorChildId;
-            TiXmlText childid(str.str());
-            child.InsertEndChild(childid);
-            bone.InsertEndChild(child);
+        for (auto childId = listChildId.begin(); childId != listChildId.end(); ++childId) {
+            xml.openElement("CHILDID");
+            xml.intText(*childId);
+            xml.closeElement();
         }
-        skeleton.InsertEndChild(bone);
 
+        xml.closeElement();
     }
-    doc.InsertEndChild(skeleton);
+    xml.closeElement();
 
-    if (!doc.SaveFile()) {
-        CalError::setLastError(CalError::FILE_WRITING_FAILED, __FILE__, __LINE__, strFilename);
-        return false;
-    }
-    return true;
+    return xml.flush();
 }
 
 
@@ -928,98 +634,74 @@ bool CalSaver::saveXmlCoreAnimation(const std::string& strFilename, CalCoreAnima
 
 
 bool CalSaver::saveXmlCoreAnimation(std::ostream& os, CalCoreAnimation* pCoreAnimation) {
+    CalXmlWriter xml(os);
 
-    std::stringstream str;
-
-    TiXmlDocument doc;
-
-    TiXmlElement animation("ANIMATION");
+    xml.openElement("HEADER");
+    xml.attribute("MAGIC", cal3d::ANIMATION_XMLFILE_EXTENSION);
+    xml.intAttribute("VERSION", cal3d::LIBRARY_VERSION);
+    xml.closeElement();
 
-    TiXmlElement header("HEADER");
-    header.SetAttribute("MAGIC", cal3d::ANIMATION_XMLFILE_EXTENSION);
-    header.SetAttribute("VERSION", cal3d::LIBRARY_VERSION);
-
-    doc.InsertEndChild(header);
-
-    str.str("");
-    str << pCoreAnimation->duration;
-    animation.SetAttribute("DURATION", str.str());
+    xml.openElement("ANIMATION");
+    xml.floatAttribute("DURATION", pCoreAnimation->duration);
 
     // get core track list
     CalCoreAnimation::TrackList& listCoreTrack = pCoreAnimation->tracks;
 
-    animation.SetAttribute("NUMTRACKS", listCoreTrack.size());
-
+    xml.intAttribute("NUMTRACKS", int(listCoreTrack.size()));
 
     // write all core bones
     CalCoreAnimation::TrackList::iterator iteratorCoreTrack;
     for (iteratorCoreTrack = listCoreTrack.begin(); iteratorCoreTrack != listCoreTrack.end(); ++iteratorCoreTrack) {
         const CalCoreTrack* pCoreTrack = &*iteratorCoreTrack;
 
-        TiXmlElement track("TRACK");
-        track.SetAttribute("BONEID", pCoreTrack->coreBoneId);
+        xml.openElement("TRACK");
+        xml.intAttribute("BONEID", pCoreTrack->coreBoneId);
 
         // Always save out the TRANSLATIONREQUIRED flag in XML, and save the translations iff the flag is true.
         bool translationIsDynamic = pCoreTrack->translationIsDynamic;
 
-        track.SetAttribute("TRANSLATIONREQUIRED", (pCoreTrack->translationRequired ? 1 : 0));
-        track.SetAttribute("TRANSLATIONISDYNAMIC", (translationIsDynamic ? 1 : 0));
-        track.SetAttribute("HIGHRANGEREQUIRED", 1);
-        track.SetAttribute("NUMKEYFRAMES", pCoreTrack->keyframes.size());
+        xml.intAttribute("TRANSLATIONREQUIRED", (pCoreTrack->translationRequired ? 1 : 0));
+        xml.intAttribute("TRANSLATIONISDYNAMIC", (translationIsDynamic ? 1 : 0));
+        xml.intAttribute("HIGHRANGEREQUIRED", 1);
+        xml.intAttribute("NUMKEYFRAMES", int(pCoreTrack->keyframes.size()));
+        if (pCoreTrack->splineInterpolated) {
+            xml.attribute("INTERPOLATION", "SPLINE");
+        }
 
         // save all core keyframes
         for (size_t i = 0; i < pCoreTrack->keyframes.size(); ++i) {
             const CalCoreKeyframe& pCoreKeyframe = pCoreTrack->keyframes[i];
 
-            TiXmlElement keyframe("KEYFRAME");
-
-            str.str("");
-            str << pCoreKeyframe.time;
-            keyframe.SetAttribute("TIME", str.str());
+            xml.openElement("KEYFRAME");
+            xml.floatAttribute("TIME", pCoreKeyframe.time);
 
             if (pCoreTrack->translationRequired) {
 
                 // If translation required but not dynamic and i != 0, then I won't write the translation.
                 if (translationIsDynamic || i == 0) {
-                    TiXmlElement translation("TRANSLATION");
                     const CalVector& translationVector = pCoreKeyframe.transform.translation;
-
-                    str.str("");
-                    str << translationVector.x << " "
-                        << translationVector.y << " "
-                        << translationVector.z;
-
-                    TiXmlText translationdata(str.str());
-
-                    translation.InsertEndChild(translationdata);
-                    keyframe.InsertEndChild(translation);
+                    const float translation[] = { translationVector.x, translationVector.y, translationVector.z };
+                    xml.openElement("TRANSLATION");
+                    xml.floatsText(translation, 3);
+                    xml.closeElement();
                 }
             }
 
-            TiXmlElement rotation("ROTATION");
             const CalQuaternion& rotationQuad = pCoreKeyframe.transform.rotation;
+            const float rotation[] = { rotationQuad.x, rotationQuad.y, rotationQuad.z, -rotationQuad.w };
+            xml.openElement("ROTATION");
+            xml.floatsText(rotation, 4);
+            xml.closeElement();
 
-            str.str("");
-            str << rotationQuad.x << " "
-                << rotationQuad.y << " "
-                << rotationQuad.z << " "
-                << -rotationQuad.w;
-
-            TiXmlText rotationdata(str.str());
-            rotation.InsertEndChild(rotationdata);
-            keyframe.InsertEndChild(rotation);
-
-            track.InsertEndChild(keyframe);
+            xml.closeElement();
         }
 
-        animation.InsertEndChild(track);
+        xml.closeElement();
     }
 
-    doc.InsertEndChild(animation);
-
-    doc.Print(os);
+    xml.closeElement();
 
-    return true;
+    return xml.flush();
 }
 
 
@@ -1046,67 +728,49 @@ bool CalSaver::saveXmlCoreMorphAnimation(const std::string& strFilename, CalCore
 }
 
 bool CalSaver::saveXmlCoreMorphAnimation(std::ostream& os, CalCoreMorphAnimation* pCoreMorphAnimation) {
-    TiXmlDocument doc;
-    std::stringstream str;
+    CalXmlWriter xml(os);
 
-    TiXmlElement animation("ANIMATION");
+    xml.openElement("HEADER");
+    xml.attribute("MAGIC", cal3d::ANIMATEDMORPH_XMLFILE_EXTENSION);
+    xml.intAttribute("VERSION", cal3d::LIBRARY_VERSION);
+    xml.closeElement();
 
-    TiXmlElement header("HEADER");
-    header.SetAttribute("MAGIC", cal3d::ANIMATEDMORPH_XMLFILE_EXTENSION);
-    header.SetAttribute("VERSION", cal3d::LIBRARY_VERSION);
-
-    doc.InsertEndChild(header);
-
-    str.str("");
-    str << pCoreMorphAnimation->duration;
-    animation.SetAttribute("DURATION", str.str());
+    xml.openElement("ANIMATION");
+    xml.floatAttribute("DURATION", pCoreMorphAnimation->duration);
 
     // get core track list
     std::vector<CalCoreMorphTrack>& listCoreMorphTrack = pCoreMorphAnimation->tracks;
 
-    animation.SetAttribute("NUMTRACKS", listCoreMorphTrack.size());
+    xml.intAttribute("NUMTRACKS", int(listCoreMorphTrack.size()));
 
     std::vector<CalCoreMorphTrack>::iterator iteratorCoreMorphTrack;
     for (iteratorCoreMorphTrack = listCoreMorphTrack.begin(); iteratorCoreMorphTrack != listCoreMorphTrack.end(); ++iteratorCoreMorphTrack) {
         CalCoreMorphTrack* pCoreMorphTrack = &(*iteratorCoreMorphTrack);
 
-        TiXmlElement track("TRACK");
-        track.SetAttribute("MORPHNAME", pCoreMorphTrack->morphName);
-
-        track.SetAttribute("NUMKEYFRAMES", pCoreMorphTrack->keyframes.size());
+        xml.openElement("TRACK");
+        xml.attribute("MORPHNAME", pCoreMorphTrack->morphName);
+        xml.intAttribute("NUMKEYFRAMES", int(pCoreMorphTrack->keyframes.size()));
 
         // save all core keyframes
         for (size_t i = 0; i < pCoreMorphTrack->keyframes.size(); ++i) {
-            CalCoreMorphKeyframe pCoreMorphKeyframe = pCoreMorphTrack->keyframes[i];
+            const CalCoreMorphKeyframe& pCoreMorphKeyframe = pCoreMorphTrack->keyframes[i];
 
-            TiXmlElement keyframe("KEYFRAME");
+            xml.openElement("KEYFRAME");
+            xml.floatAttribute("TIME", pCoreMorphKeyframe.time);
 
-            str.str("");
-            str << pCoreMorphKeyframe.time;
-            keyframe.SetAttribute("TIME", str.str());
+            xml.openElement("WEIGHT");
+            xml.floatsText(&pCoreMorphKeyframe.weight, 1);
+            xml.closeElement();
 
-            TiXmlElement weight("WEIGHT");
-            float w = pCoreMorphKeyframe.weight;
-
-            str.str("");
-            str << w;
-
-            TiXmlText weightdata(str.str());
-
-            weight.InsertEndChild(weightdata);
-            keyframe.InsertEndChild(weight);
-
-            track.InsertEndChild(keyframe);
+            xml.closeElement();
         }
 
-        animation.InsertEndChild(track);
+        xml.closeElement();
     }
 
-    doc.InsertEndChild(animation);
+    xml.closeElement();
 
-    doc.Print(os);
-
-    return true;
+    return xml.flush();
 }
 
 /*****************************************************************************/
@@ -1130,18 +794,15 @@ bool CalSaver::saveXmlCoreMesh(const std::string& strFilename, CalCoreMesh* pCor
 }
 
 bool CalSaver::saveXmlCoreMesh(std::ostream& os, CalCoreMesh* pCoreMesh) {
-    TiXmlDocument doc;
+    CalXmlWriter xml(os);
 
-    std::stringstream str;
+    xml.openElement("HEADER");
+    xml.attribute("MAGIC", cal3d::MESH_XMLFILE_EXTENSION);
+    xml.intAttribute("VERSION", cal3d::LIBRARY_VERSION);
+    xml.closeElement();
 
-    TiXmlElement header("HEADER");
-    header.SetAttribute("MAGIC", cal3d::MESH_XMLFILE_EXTENSION);
-    header.SetAttribute("VERSION", cal3d::LIBRARY_VERSION);
-
-    doc.InsertEndChild(header);
-
-    TiXmlElement mesh("MESH");
-    mesh.SetAttribute("NUMSUBMESH", pCoreMesh->submeshes.size());
+    xml.openElement("MESH");
+    xml.intAttribute("NUMSUBMESH", int(pCoreMesh->submeshes.size()));
 
     // get the submesh vector
     CalCoreMesh::CalCoreSubmeshVector& vectorCoreSubmesh = pCoreMesh->submeshes;
@@ -1151,23 +812,20 @@ bool CalSaver::saveXmlCoreMesh(std::ostream& os, CalCoreMesh* pCoreMesh) {
     for (submeshId = 0; submeshId < (int)vectorCoreSubmesh.size(); ++submeshId) {
         const CalCoreSubmeshPtr& pCoreSubmesh = vectorCoreSubmesh[submeshId];
 
-        TiXmlElement submesh("SUBMESH");
-
         const CalCoreSubmesh::MorphTargetArray& vectorMorphs = pCoreSubmesh->getMorphTargets();
 
-        // get the texture coordinate vector vector
-        std::vector<std::vector<CalCoreSubmesh::TextureCoordinate>> vectorvectorTextureCoordinate;
-        if (pCoreSubmesh->hasTextureCoordinates()) {
-            vectorvectorTextureCoordinate.push_back(pCoreSubmesh->getTextureCoordinates());
-        }
+        // the XML format allows several texture coordinate sets; submeshes have at most one
+        const int textureCoordinateCount = pCoreSubmesh->hasTextureCoordinates() ? 1 : 0;
+        const std::vector<CalCoreSubmesh::TextureCoordinate>& textureCoordinates = pCoreSubmesh->getTextureCoordinates();
 
-        submesh.SetAttribute("NUMVERTICES", pCoreSubmesh->getVertexCount());
-        submesh.SetAttribute("NUMFACES", pCoreSubmesh->getFaces().size());
-        submesh.SetAttribute("MATERIAL", pCoreSubmesh->coreMaterialThreadId);
-        submesh.SetAttribute("NUMLODSTEPS", 0);
-        submesh.SetAttribute("NUMSPRINGS", 0);
-        submesh.SetAttribute("NUMMORPHS", vectorMorphs.size());
-        submesh.SetAttribute("NUMTEXCOORDS", vectorvectorTextureCoordinate.size());
+        xml.openElement("SUBMESH");
+        xml.intAttribute("NUMVERTICES", int(pCoreSubmesh->getVertexCount()));
+        xml.intAttribute("NUMFACES", int(pCoreSubmesh->getFaces().size()));
+        xml.intAttribute("MATERIAL", pCoreSubmesh->coreMaterialThreadId);
+        xml.intAttribute("NUMLODSTEPS", 0);
+        xml.intAttribute("NUMSPRINGS", 0);
+        xml.intAttribute("NUMMORPHS", int(vectorMorphs.size()));
+        xml.intAttribute("NUMTEXCOORDS", textureCoordinateCount);
 
         const cal3d::SSEArray<CalCoreSubmesh::Vertex>& vectorVertex = pCoreSubmesh->getVectorVertex();
         const std::vector<CalColor32>& vertexColors = pCoreSubmesh->getVertexColors();
@@ -1185,101 +843,70 @@ bool CalSaver::saveXmlCoreMesh(std::ostream& os, CalCoreMesh* pCoreMesh) {
             }
             ++nextVertex;
 
-            TiXmlElement vertex("VERTEX");
-            vertex.SetAttribute("ID", vertexId);
-            vertex.SetAttribute("NUMINFLUENCES", size_t(nextVertex - currentInfluence));
+            xml.openElement("VERTEX");
+            xml.intAttribute("ID", vertexId);
+            xml.intAttribute("NUMINFLUENCES", int(nextVertex - currentInfluence));
 
             // write the vertex data
-
-            TiXmlElement position("POS");
-
-            str.str("");
-            str << Vertex.position.x << " "
-                << Vertex.position.y << " "
-                << Vertex.position.z;
-
-            TiXmlText positiondata(str.str());
-
-            position.InsertEndChild(positiondata);
-            vertex.InsertEndChild(position);
-
-            TiXmlElement normal("NORM");
-
-            str.str("");
-            str << Vertex.normal.x << " "
-                << Vertex.normal.y << " "
-                << Vertex.normal.z;
-
-            TiXmlText normaldata(str.str());
-
-            normal.InsertEndChild(normaldata);
-            vertex.InsertEndChild(normal);
-
-            TiXmlElement vertColor("COLOR");
-
-            str.str("");
-            CalVector vc(CalVectorFromColor(vertexColor));
-            str << vc.x << " " << vc.y << " " << vc.z;
-
-            TiXmlText colordata(str.str());
-
-            vertColor.InsertEndChild(colordata);
-            vertex.InsertEndChild(vertColor);
+            const float position[] = { Vertex.position.x, Vertex.position.y, Vertex.position.z };
+            xml.openElement("POS");
+            xml.floatsText(position, 3);
+            xml.closeElement();
+
+            const float normal[] = { Vertex.normal.x, Vertex.normal.y, Vertex.normal.z };
+            xml.openElement("NORM");
+            xml.floatsText(normal, 3);
+            xml.closeElement();
+
+            const CalVector vc(CalVectorFromColor(vertexColor));
+            const float color[] = { vc.x, vc.y, vc.z };
+            xml.openElement("COLOR");
+            xml.floatsText(color, 3);
+            xml.closeElement();
 
             // write all texture coordinates of this vertex
-            int textureCoordinateId;
-            for (textureCoordinateId = 0; textureCoordinateId < (int)vectorvectorTextureCoordinate.size(); ++textureCoordinateId) {
-                const CalCoreSubmesh::TextureCoordinate& textureCoordinate = vectorvectorTextureCoordinate[textureCoordinateId][vertexId];
-
-                TiXmlElement tex("TEXCOORD");
-
-                str.str("");
-                str << textureCoordinate.u << " "
-                    << textureCoordinate.v;
-
-                TiXmlText texdata(str.str());
-
-                tex.InsertEndChild(texdata);
-
-                vertex.InsertEndChild(tex);
+            if (textureCoordinateCount) {
+                const CalCoreSubmesh::TextureCoordinate& textureCoordinate = textureCoordinates[vertexId];
+                const float uv[] = { textureCoordinate.u, textureCoordinate.v };
+                xml.openElement("TEXCOORD");
+                xml.floatsText(uv, 2);
+                xml.closeElement();
             }
 
             for (; currentInfluence != nextVertex; ++currentInfluence) {
-                TiXmlElement influence("INFLUENCE");
-
-                influence.SetAttribute("ID", currentInfluence->boneId);
-
-                str.str("");
-                str << currentInfluence->weight;
-
-                TiXmlText influencedata(str.str());
-
-                influence.InsertEndChild(influencedata);
-                vertex.InsertEndChild(influence);
+                xml.openElement("INFLUENCE");
+                xml.intAttribute("ID", int(currentInfluence->boneId));
+                xml.floatsText(&currentInfluence->weight, 1);
+                xml.closeElement();
             }
 
-            submesh.InsertEndChild(vertex);
+            xml.closeElement();
         }
 
         // write all morphs
         for (size_t morphId = 0; morphId < vectorMorphs.size(); ++morphId) {
             CalCoreMorphTargetPtr morphTarget = vectorMorphs[morphId];
 
-            TiXmlElement morph("MORPH");
-            str.str("");
-            str << morphId;
-
-            morph.SetAttribute("MORPHID", str.str());
-            morph.SetAttribute("NAME", morphTarget->name);
+            xml.openElement("MORPH");
+            xml.intAttribute("MORPHID", int(morphId));
+            xml.attribute("NAME", morphTarget->name);
 
+            // counted up front, since attributes precede the blend vertices
             int morphVertCount = 0;
             const CalCoreMorphTarget::VertexOffsetArray& vertices = morphTarget->vertexOffsets;
+            static float differenceTolerance = 1.0;
+            for (size_t i = 0; i < vertices.size(); ++i) {
+                if (vertices[i].position.asCalVector().length() >= differenceTolerance) {
+                    ++morphVertCount;
+                }
+            }
+            xml.intAttribute("NUMBLENDVERTS", morphVertCount);
+
             for (size_t i = 0; i < vertices.size(); ++i) {
                 VertexOffset const& bv = vertices[i];
 
                 size_t blendId = bv.vertexId;
                 const CalCoreSubmesh::Vertex& Vertex = vectorVertex[blendId];
-                static float differenceTolerance = 1.0;
                 CalVector positionDiff = bv.position.asCalVector();
                 float positionDiffLength = positionDiff.length();
 
@@ -1287,72 +914,51 @@ bool CalSaver::saveXmlCoreMesh(std::ostream& os, CalCoreMesh* pCoreMesh) {
                 if (skip) {
                     continue;
                 }
-                morphVertCount++;
-                TiXmlElement blendVert("BLENDVERTEX");
-                str.str("");
-                str << blendId;
-
-                blendVert.SetAttribute("VERTEXID", str.str());
-                str.str("");
-                str << positionDiffLength;
-                blendVert.SetAttribute("POSDIFF", str.str());
+                xml.openElement("BLENDVERTEX");
+                xml.intAttribute("VERTEXID", int(blendId));
+                xml.floatAttribute("POSDIFF", positionDiffLength);
 
                 const CalVector4 p = Vertex.position + bv.position;
                 const CalVector4 n = Vertex.normal + bv.normal;
 
-                TiXmlElement pos("POSITION");
-                str.str("");
-                str << p.x << " " << p.y << " " << p.z;
-                TiXmlText posdata(str.str());
-                pos.InsertEndChild(posdata);
-
-                TiXmlElement norm("NORMAL");
-                str.str("");
-                str << n.x << " " << n.y << " " << n.z;
-                TiXmlText normdata(str.str());
-                norm.InsertEndChild(normdata);
-
-                blendVert.InsertEndChild(pos);
-                blendVert.InsertEndChild(norm);
-                for (size_t tcI = 0; tcI < vectorvectorTextureCoordinate.size(); tcI++) {
-                    TiXmlElement tcXml("TEXCOORD");
-                    str.str("");
-                    str << 0.0f << " " << 0.0f;
-                    TiXmlText tcdata(str.str());
-                    tcXml.InsertEndChild(tcdata);
-                    blendVert.InsertEndChild(tcXml);
+                const float blendPosition[] = { p.x, p.y, p.z };
+                xml.openElement("POSITION");
+                xml.floatsText(blendPosition, 3);
+                xml.closeElement();
+
+                const float blendNormal[] = { n.x, n.y, n.z };
+                xml.openElement("NORMAL");
+                xml.floatsText(blendNormal, 3);
+                xml.closeElement();
+
+                for (int tcI = 0; tcI < textureCoordinateCount; tcI++) {
+                    const float zero[] = { 0.0f, 0.0f };
+                    xml.openElement("TEXCOORD");
+                    xml.floatsText(zero, 2);
+                    xml.closeElement();
                 }
 
-                morph.InsertEndChild(blendVert);
+                xml.closeElement();
             }
-            str.str("");
-            str << morphVertCount;
-            morph.SetAttribute("NUMBLENDVERTS", str.str());
-            submesh.InsertEndChild(morph);
+            xml.closeElement();
         }
 
         // write all faces
         int faceId;
         for (faceId = 0; faceId < (int)vectorFace.size(); ++faceId) {
             const CalCoreSubmesh::Face& Face = vectorFace[faceId];
+            const int vertexIds[] = { Face.vertexId[0], Face.vertexId[1], Face.vertexId[2] };
 
-            TiXmlElement face("FACE");
-
-            str.str("");
-            str << Face.vertexId[0] << " "
-                << Face.vertexId[1] << " "
-                << Face.vertexId[2];
-            face.SetAttribute("VERTEXID", str.str());
-            submesh.InsertEndChild(face);
+            xml.openElement("FACE");
+            xml.intsAttribute("VERTEXID", vertexIds, 3);
+            xml.closeElement();
         }
 
-        mesh.InsertEndChild(submesh);
-
+        xml.closeElement();
     }
-    doc.InsertEndChild(mesh);
+    xml.closeElement();
 
-    doc.Print(os);
-    return true;
+    return xml.flush();
 }
 
 
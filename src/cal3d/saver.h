@@ -55,6 +55,7 @@ public:
     static bool saveCoreSkeleton(std::ostream& os, CalCoreSkeleton* pCoreSkeleton);
 
     static bool saveXmlCoreSkeleton(const std::string& strFilename, CalCoreSkeleton* pCoreSkeleton);
+    static bool saveXmlCoreSkeleton(std::ostream& os, CalCoreSkeleton* pCoreSkeleton);
     static bool saveXmlCoreAnimation(const std::string& strFilename, CalCoreAnimation* pCoreAnimation);
     static bool saveXmlCoreAnimation(std::ostream& os, CalCoreAnimation* pCoreAnimation);
     static bool saveXmlCoreMorphAnimation(const std::string& strFilename, CalCoreMorphAnimation* pCoreMorphAnimation);
@@ -63,14 +64,6 @@ public:
     static bool saveXmlCoreMesh(std::ostream& os, CalCoreMesh* pCoreMesh);
     static bool saveXmlCoreMaterial(const std::string& strFilename, CalCoreMaterial* pCoreMaterial);
 
-private:
-    static bool saveCoreBone(std::ostream& file, const CalCoreSkeleton* coreSkeleton, const CalCoreBone* pCoreBone);
-    static bool saveCoreKeyframe(std::ostream& file, const std::string& strFilename, const CalCoreKeyframe* pCoreKeyframe);
-    static bool saveCoreSubmesh(std::ostream& file, CalCoreSubmesh* pCoreSubmesh);
-    static bool saveCoreTrack(std::ostream& file, const std::string& strFilename, CalCoreTrack* pCoreTrack);
-    static bool saveCoreMorphKeyframe(std::ostream& file, const std::string& strFilename, CalCoreMorphKeyframe* pCoreMorphKeyframe);
-    static bool saveCoreMorphTrack(std::ostream& file, const std::string& strFilename, CalCoreMorphTrack* pCoreMorphTrack);
-
 private:
     CalSaver();
     ~CalSaver();
@@ -19,8 +19,55 @@
 #include "cal3d/bone.h"
 #include "cal3d/coreskeleton.h"
 #include "cal3d/corebone.h" // DEBUG
+#include "cal3d/matrix.h"
+#include "cal3d/poselanes.h"
 
-CalSkeleton::CalSkeleton(const CalCoreSkeletonPtr& coreSkeleton) {
+namespace {
+    using namespace cal3d::lanes;
+
+    // columns of the rotation matrix, as CalMatrix(const CalQuaternion&)
+    struct MatrixLanes {
+        explicit MatrixLanes(const QuaternionLanes& q) {
+            const CalVector4 two(2.0f);
+            const CalVector4 one(1.0f);
+            const CalVector4 x2 = q.x * two;
+            const CalVector4 y2 = q.y * two;
+            const CalVector4 z2 = q.z * two;
+
+            const CalVector4 xx2 = q.x * x2;
+            const CalVector4 yy2 = q.y * y2;
+            const CalVector4 zz2 = q.z * z2;
+            const CalVector4 xy2 = q.x * y2;
+            const CalVector4 zw2 = q.w * z2;
+            const CalVector4 xz2 = q.x * z2;
+            const CalVector4 yw2 = q.w * y2;
+            const CalVector4 yz2 = q.y * z2;
+            const CalVector4 xw2 = q.w * x2;
+
+            cx.x = one - yy2 - zz2;
+            cy.x = xy2 - zw2;
+            cz.x = xz2 + yw2;
+            cx.y = xy2 + zw2;
+            cy.y = one - xx2 - zz2;
+            cz.y = yz2 - xw2;
+            cx.z = xz2 - yw2;
+            cy.z = yz2 + xw2;
+            cz.z = one - xx2 - yy2;
+        }
+
+        CalMatrix matrix(size_t i) const {
+            CalMatrix m;
+            m.cx = CalVector(lane(cx.x, i), lane(cx.y, i), lane(cx.z, i));
+            m.cy = CalVector(lane(cy.x, i), lane(cy.y, i), lane(cy.z, i));
+            m.cz = CalVector(lane(cz.x, i), lane(cz.y, i), lane(cz.z, i));
+            return m;
+        }
+
+        VectorLanes cx, cy, cz;
+    };
+}
+
+CalSkeletonPrototype::CalSkeletonPrototype(const CalCoreSkeletonPtr& coreSkeleton) {
     // clone the skeleton structure of the core skeleton
     const auto& coreBones = coreSkeleton->coreBones;
 
@@ -36,7 +83,72 @@ CalSkeleton::CalSkeleton(const CalCoreSkeletonPtr& coreSkeleton) {
         inverseBindPoseTransforms[boneId] = coreBones[boneId]->inverseBindPoseTransform;
     }
 
-    boneTransforms.destructive_resize(boneCount);
+    // lay the bones out by depth for the batched solver
+    std::vector<std::vector<int>> levels;
+    std::vector<size_t> depths(boneCount);
+    for (size_t boneId = 0; boneId < boneCount; ++boneId) {
+        const int parentId = bones[boneId].parentId;
+        cal3d::verify(parentId < static_cast<int>(boneId), "parent bones must precede their children");
+        depths[boneId] = (parentId == -1) ? 0 : depths[parentId] + 1;
+        if (depths[boneId] == levels.size()) {
+            levels.push_back(std::vector<int>());
+        }
+        levels[depths[boneId]].push_back(static_cast<int>(boneId));
+    }
+
+    std::vector<int> boneSlots(boneCount);
+    for (size_t depth = 0; depth < levels.size(); ++depth) {
+        const auto& level = levels[depth];
+        for (size_t i = 0; i < level.size(); ++i) {
+            boneSlots[level[i]] = static_cast<int>(solveBoneIds.size());
+            solveBoneIds.push_back(level[i]);
+        }
+        while (solveBoneIds.size() % 4) {
+            solveBoneIds.push_back(-1);
+        }
+    }
+
+    const size_t groupCount = solveBoneIds.size() / 4;
+    solveParentSlots.resize(solveBoneIds.size(), -1);
+    solveInverseBindPoses.destructive_resize(groupCount * PoseLaneStride);
+    for (size_t group = 0; group < groupCount; ++group) {
+        PoseLanes inverseBindPoses;
+        for (size_t i = 0; i < 4; ++i) {
+            const int boneId = solveBoneIds[group * 4 + i];
+            if (boneId == -1) {
+                setLane(inverseBindPoses, i, cal3d::RotateTranslate());
+            } else {
+                const int parentId = bones[boneId].parentId;
+                solveParentSlots[group * 4 + i] = (parentId == -1) ? -1 : boneSlots[parentId];
+                setLane(inverseBindPoses, i, inverseBindPoseTransforms[boneId]);
+            }
+        }
+        storePose(&solveInverseBindPoses[group * PoseLaneStride], inverseBindPoses);
+    }
+}
+
+CalSkeleton::CalSkeleton(const CalCoreSkeletonPtr& coreSkeleton)
+    : CalSkeleton(CalSkeletonPrototypePtr(new CalSkeletonPrototype(coreSkeleton)))
+{}
+
+CalSkeleton::CalSkeleton(const CalSkeletonPrototypePtr& prototype)
+    : bones(prototype->bones)
+    , inverseBindPoseTransforms(prototype->inverseBindPoseTransforms)
+    , boneTransforms(prototype->bones.size())
+    , prototype(prototype)
+    , solveAbsolutePoses(prototype->solveInverseBindPoses.size())
+    , scaledChains(prototype->bones.size())
+    , solvedRelativeTransforms(prototype->bones.size())
+    , solvedScales(prototype->bones.size())
+    , dirtyBones(prototype->bones.size())
+    , solvedPoseValid(false)
+{}
+
+void CalSkeleton::spawn(const CalSkeletonPrototypePtr& prototype, size_t count, std::vector<CalSkeleton>& instances) {
+    instances.reserve(instances.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        instances.emplace_back(prototype);
+    }
 }
 
 void CalSkeleton::resetPose() {
@@ -45,8 +157,193 @@ void CalSkeleton::resetPose() {
 
 void CalSkeleton::calculateAbsolutePose() {
     CalBone* bones_ptr = cal3d::pointerFromVector(bones);
+
+    if (activeAncestors.empty()) {
+        if (!solvedPoseValid) {
+            calculateFullPose();
+            return;
+        }
+
+        const size_t dirtyCount = markDirtyBones();
+        if (!dirtyCount) {
+            return;
+        }
+
+        // past this point the batched solve is cheaper than walking the
+        // dirty subtrees one bone at a time
+        if (dirtyCount * 4 > bones.size()) {
+            calculateFullPose();
+            return;
+        }
+
+        for (unsigned i = 0; i < bones.size(); ++i) {
+            if (dirtyBones[i]) {
+                bones_ptr[i].calculateAbsolutePose(bones_ptr);
+                boneTransforms[i] = bones_ptr[i].absoluteTransform * inverseBindPoseTransforms[i];
+            }
+        }
+        return;
+    }
+
+    // masking changes which bones are solved; start over once it is cleared
+    solvedPoseValid = false;
+
     for (unsigned i = 0; i < bones.size(); ++i) {
-        bones_ptr[i].calculateAbsolutePose(bones_ptr);
-        boneTransforms[i] = bones_ptr[i].absoluteTransform * inverseBindPoseTransforms[i];
+        const int activeAncestor = activeAncestors[i];
+        if (activeAncestor == static_cast<int>(i)) {
+            bones_ptr[i].calculateAbsolutePose(bones_ptr);
+            boneTransforms[i] = bones_ptr[i].absoluteTransform * inverseBindPoseTransforms[i];
+        } else if (activeAncestor == -1) {
+            // the whole chain is in bind pose
+            boneTransforms[i] = BoneTransform(cal3d::Transform());
+        } else {
+            // parents precede children, so the ancestor is already solved
+            boneTransforms[i] = boneTransforms[activeAncestor];
+        }
     }
 }
+
+static bool exactlyEqual(const cal3d::RotateTranslate& a, const cal3d::RotateTranslate& b) {
+    return a.rotation.x == b.rotation.x
+        && a.rotation.y == b.rotation.y
+        && a.rotation.z == b.rotation.z
+        && a.rotation.w == b.rotation.w
+        && a.translation.x == b.translation.x
+        && a.translation.y == b.translation.y
+        && a.translation.z == b.translation.z;
+}
+
+/*****************************************************************************/
+/** Marks the bones whose relative pose or scale changed since the last
+  * solve, along with their descendants, and records the new poses.
+  *
+  * @return The number of dirty bones.
+  *****************************************************************************/
+
+size_t CalSkeleton::markDirtyBones() {
+    size_t dirtyCount = 0;
+    for (unsigned i = 0; i < bones.size(); ++i) {
+        const CalBone& bone = bones[i];
+        const cal3d::RotateTranslate& relative = bone.getRelativeTransform();
+
+        bool dirty = bone.parentId != -1 && dirtyBones[bone.parentId];
+        if (!exactlyEqual(relative, solvedRelativeTransforms[i]) || !(bone.scale.scale == solvedScales[i].scale)) {
+            solvedRelativeTransforms[i] = relative;
+            solvedScales[i] = bone.scale;
+            dirty = true;
+        }
+
+        dirtyBones[i] = dirty;
+        dirtyCount += dirty;
+    }
+    return dirtyCount;
+}
+
+void CalSkeleton::calculateFullPose() {
+    CalBone* bones_ptr = cal3d::pointerFromVector(bones);
+
+    size_t scaledCount = 0;
+    for (unsigned i = 0; i < bones.size(); ++i) {
+        const int parentId = bones_ptr[i].parentId;
+        scaledChains[i] = !bones_ptr[i].scale.isIdentity() || (parentId != -1 && scaledChains[parentId]);
+        scaledCount += scaledChains[i];
+
+        solvedRelativeTransforms[i] = bones_ptr[i].getRelativeTransform();
+        solvedScales[i] = bones_ptr[i].scale;
+    }
+
+    if (scaledCount < bones.size()) {
+        calculateUnscaledPose();
+    }
+
+    // an unscaled bone never has a scaled ancestor, so the batched
+    // results these read are valid
+    if (scaledCount) {
+        for (unsigned i = 0; i < bones.size(); ++i) {
+            if (scaledChains[i]) {
+                bones_ptr[i].calculateAbsolutePose(bones_ptr);
+                boneTransforms[i] = bones_ptr[i].absoluteTransform * inverseBindPoseTransforms[i];
+            }
+        }
+    }
+
+    solvedPoseValid = true;
+}
+
+/*****************************************************************************/
+/** Solves every bone as if no chain were scaled.
+  *
+  * Each group of four slots gathers its relative transforms and its parents'
+  * absolute poses, composes them as quaternion/translation pairs in SoA form,
+  * and only converts to matrices at the end, for absoluteTransform and for the
+  * skinning transform.  Without scale the column normalization that
+  * CalBone::calculateAbsolutePose performs is unnecessary.
+  *****************************************************************************/
+
+void CalSkeleton::calculateUnscaledPose() {
+    const size_t groupCount = prototype->solveBoneIds.size() / 4;
+    const cal3d::RotateTranslate identity;
+
+    for (size_t group = 0; group < groupCount; ++group) {
+        const int* boneIds = &prototype->solveBoneIds[group * 4];
+        const int* parentSlots = &prototype->solveParentSlots[group * 4];
+
+        PoseLanes relative;
+        PoseLanes parent;
+        for (size_t i = 0; i < 4; ++i) {
+            const int boneId = boneIds[i];
+            setLane(relative, i, boneId == -1 ? identity : bones[boneId].getRelativeTransform());
+
+            const int parentSlot = parentSlots[i];
+            if (parentSlot == -1) {
+                setLane(parent, i, identity);
+            } else {
+                copyLane(parent, i, &solveAbsolutePoses[(parentSlot / 4) * PoseLaneStride], parentSlot % 4);
+            }
+        }
+
+        const PoseLanes absolute = parent * relative;
+        storePose(&solveAbsolutePoses[group * PoseLaneStride], absolute);
+
+        const PoseLanes skinning = absolute * loadPose(&prototype->solveInverseBindPoses[group * PoseLaneStride]);
+
+        const MatrixLanes absoluteBasis(absolute.rotation);
+        const MatrixLanes skinningBasis(skinning.rotation);
+        for (size_t i = 0; i < 4; ++i) {
+            const int boneId = boneIds[i];
+            if (boneId == -1) {
+                continue;
+            }
+            bones[boneId].setAbsoluteTransform(cal3d::Transform(
+                absoluteBasis.matrix(i),
+                CalVector(lane(absolute.translation.x, i), lane(absolute.translation.y, i), lane(absolute.translation.z, i))));
+
+            const auto& m = skinningBasis;
+            boneTransforms[boneId] = BoneTransform(
+                CalVector4(lane(m.cx.x, i), lane(m.cy.x, i), lane(m.cz.x, i), lane(skinning.translation.x, i)),
+                CalVector4(lane(m.cx.y, i), lane(m.cy.y, i), lane(m.cz.y, i), lane(skinning.translation.y, i)),
+                CalVector4(lane(m.cx.z, i), lane(m.cy.z, i), lane(m.cz.z, i), lane(skinning.translation.z, i)));
+        }
+    }
+}
+
+void CalSkeleton::setBoneMask(const std::vector<bool>& activeBones) {
+    cal3d::verify(activeBones.size() == bones.size(), "bone mask must have one entry per bone");
+    solvedPoseValid = false;
+
+    activeAncestors.resize(bones.size());
+    for (size_t i = 0; i < bones.size(); ++i) {
+        const int parentId = bones[i].parentId;
+        const int parentActive = (parentId == -1) ? -1 : activeAncestors[parentId];
+        if (activeBones[i] && (parentId == -1 || parentActive == parentId)) {
+            activeAncestors[i] = static_cast<int>(i);
+        } else {
+            activeAncestors[i] = parentActive;
+        }
+    }
+}
+
+void CalSkeleton::clearBoneMask() {
+    activeAncestors.clear();
+    solvedPoseValid = false;
+}
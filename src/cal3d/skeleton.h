@@ -10,6 +10,8 @@
 
 #pragma once
 
+#include <vector>
+#include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include "cal3d/bone.h"
 #include "cal3d/bonetransform.h"
@@ -20,17 +22,105 @@
 
 CAL3D_PTR(CalCoreSkeleton);
 
+// The initial state of every CalSkeleton of one core skeleton: the bind
+// pose bones, the inverse bind poses, and the batched solver's layout.
+// Built once and never changed, so instances share its solve layout and
+// copy the rest, instead of each walking the core bones again.
+class CAL3D_API CalSkeletonPrototype : private boost::noncopyable {
+public:
+    explicit CalSkeletonPrototype(const CalCoreSkeletonPtr& coreSkeleton);
+
+    size_t getBoneCount() const {
+        return bones.size();
+    }
+
+private:
+    friend class CalSkeleton;
+
+    cal3d::SSEArray<CalBone> bones;
+    std::vector<cal3d::RotateTranslate> inverseBindPoseTransforms;
+
+    // Batched solve layout.  Bones are sorted by depth and each depth is
+    // padded to a multiple of four, so a group of four lanes depends only
+    // on groups before it.  Padding slots have a bone id of -1.
+    std::vector<int> solveBoneIds;
+    std::vector<int> solveParentSlots;
+
+    // SoA per group of four: rotation x, y, z, w, translation x, y, z
+    cal3d::SSEArray<CalVector4> solveInverseBindPoses;
+};
+CAL3D_PTR(CalSkeletonPrototype);
+
 class CAL3D_API CalSkeleton {
 public:
     typedef cal3d::SSEArray<CalBone> BoneArray;
 
     CalSkeleton(const CalCoreSkeletonPtr& coreSkeleton);
 
+    // Copies the prototype's initial state.  Prefer this over the core
+    // skeleton constructor when creating many instances of one skeleton.
+    explicit CalSkeleton(const CalSkeletonPrototypePtr& prototype);
+
+    // Appends count instances of prototype to instances, growing it once.
+    static void spawn(const CalSkeletonPrototypePtr& prototype, size_t count, std::vector<CalSkeleton>& instances);
+
     void resetPose();
+
+    // Unmasked bones whose chains carry no scale are solved four at a
+    // time, level by level, with quaternion math.  Scaled chains and
+    // masked skeletons take the per-bone CalBone path.
+    //
+    // Solves are incremental: a bone whose relative transform and scale
+    // are unchanged since the last solve, and whose ancestors are
+    // unchanged, keeps its absoluteTransform and boneTransform.  When only
+    // a few bones change, only they and their descendants are recomputed.
     void calculateAbsolutePose();
 
+    // Forces the next calculateAbsolutePose to recompute every bone.  Call
+    // after writing absoluteTransform or boneTransforms directly.
+    void invalidatePose() {
+        solvedPoseValid = false;
+    }
+
+    // Skeletal LOD.  Masked-out bones, and everything below them, are not
+    // sampled by CalMixer or solved by calculateAbsolutePose.  They stay in
+    // their bind pose relative to the nearest active ancestor and share its
+    // boneTransform, so skinning needs no changes.  Their absoluteTransform
+    // is not updated.
+    void setBoneMask(const std::vector<bool>& activeBones);
+    void clearBoneMask();
+
+    bool isBoneActive(size_t boneId) const {
+        return activeAncestors.empty() || activeAncestors[boneId] == static_cast<int>(boneId);
+    }
+
     // same length
     BoneArray bones;
     std::vector<cal3d::RotateTranslate> inverseBindPoseTransforms;
     cal3d::SSEArray<BoneTransform> boneTransforms;
+
+private:
+    void calculateUnscaledPose();
+    void calculateFullPose();
+    size_t markDirtyBones();
+
+    // holds the solve layout
+    CalSkeletonPrototypePtr prototype;
+
+    // laid out as the prototype's solveInverseBindPoses
+    cal3d::SSEArray<CalVector4> solveAbsolutePoses;
+
+    std::vector<bool> scaledChains;
+
+    // The relative pose each bone was last solved with.  Compared, rather
+    // than flagged on write, because CalMixer resets and re-blends every
+    // bone each update even when the result is unchanged.
+    std::vector<cal3d::RotateTranslate> solvedRelativeTransforms;
+    std::vector<cal3d::Scale> solvedScales;
+    std::vector<bool> dirtyBones;
+    bool solvedPoseValid;
+
+    // empty if no mask is set, otherwise the nearest active bone at or
+    // above each bone, or -1 if there is none
+    std::vector<int> activeAncestors;
 };
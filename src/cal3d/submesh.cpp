@@ -16,6 +16,7 @@
 #include <boost/static_assert.hpp>
 #include "cal3d/submesh.h"
 #include "cal3d/error.h"
+#include "cal3d/coremorphanimation.h"
 #include "cal3d/coresubmesh.h"
 #include "cal3d/coremorphtarget.h"
 
@@ -88,92 +89,145 @@ void CalSubmesh::blendMorphTargetScale(
 ) {
     size_t size = morphTargets.size();
     for (size_t i = 0; i < size; i++) {
-        cal3d::MorphTarget& morphTargetState = morphTargets[i];
         const CalCoreMorphTargetPtr& target = coreSubmesh->getMorphTargets()[i];
         if (target->name == morphName) {
-            CalMorphTargetType mtype = target->morphTargetType;
-            switch (mtype) {
-                case CalMorphTargetTypeAdditive: {
-
-                    // Actions affecting the same morph target channel add their ramped scales
-                    // if the channel is Additive.  The unrampedWeight parameter is ignored
-                    // because the actions are not affecting each other so there is no need
-                    // to assign them a relative weight.
-                    morphTargetState.weight += scale * rampValue;
-                    break;
-                }
-                case CalMorphTargetTypeClamped: {
+            blendMorphTargetScale(i, scale, unrampedWeight, rampValue, replace);
+            return;
+        }
+    }
+}
 
-                    // Like Additive, but clamped to 1.0.
-                    morphTargetState.weight += scale * rampValue;
-                    if (morphTargetState.weight > 1.0) {
-                        morphTargetState.weight = 1.0;
-                    }
-                    break;
-                }
-                case CalMorphTargetTypeExclusive:
-                case CalMorphTargetTypeAverage: {
-
-                    float attenuatedWeight = unrampedWeight * rampValue;
-
-                    // Each morph target is having multiple actions blended into it.  The composition mode (e.g., exclusive)
-                    // is a property of the morph target itself, so you don't ever get an exclusive blend competing with
-                    // an average blend, for example.  You get different actions all blending into the same morph target.
-
-                    // For morphs of the Exclusive type, I pick one of the Replace actions arbitrarily
-                    // and attenuate all the other actions' influence by the inverse of the Replace action's
-                    // rampValue.  If I don't have a Replace action, then the result is the same as the
-                    // Average type morph target.  This procedure is not exactly the same as the skeletal animation
-                    // Replace composition function.  The skeletal animation Replace function supports combined
-                    // attenuation of multiple Replace animations, whereas morph animation Exclusive type
-                    // supports only one Replace morph animation, arbitrarily chosen, to attenuate the other
-                    // animations.  The reason for the difference is that skeletal animations are sorted in
-                    // the mixer, and morph animations are in an arbitrary order.
-                    //
-                    // If I already have a Replace chosen, then I attenuate this action.
-                    // Otherwise, if this action is a Replace, then I record it and attenuate current scale.
-                    if (mtype == CalMorphTargetTypeExclusive) {
-                        if (morphTargetState.replacementAttenuation != ReplacementAttenuationNull) {
-                            attenuatedWeight *= morphTargetState.replacementAttenuation;
-                        } else {
-                            if (replace) {
-                                float attenuation = 1.0f - rampValue;
-                                morphTargetState.replacementAttenuation = attenuation;
-                                morphTargetState.weight *= attenuation;
-                                morphTargetState.accumulatedWeight *= attenuation;
-                            }
-                        }
-                    }
+void CalSubmesh::blendMorphTargetScale(
+    size_t morphTargetId,
+    float scale,
+    float unrampedWeight,
+    float rampValue,
+    bool replace
+) {
+    cal3d::MorphTarget& morphTargetState = morphTargets[morphTargetId];
+    CalMorphTargetType mtype = coreSubmesh->getMorphTargets()[morphTargetId]->morphTargetType;
+    switch (mtype) {
+        case CalMorphTargetTypeAdditive: {
+
+            // Actions affecting the same morph target channel add their ramped scales
+            // if the channel is Additive.  The unrampedWeight parameter is ignored
+            // because the actions are not affecting each other so there is no need
+            // to assign them a relative weight.
+            morphTargetState.weight += scale * rampValue;
+            break;
+        }
+        case CalMorphTargetTypeClamped: {
 
-                    // For morph targets of Average type, we average the actions' scales
-                    // according to the attenuatedWeight.  The first action assigns 100% of its
-                    // scale, and subsequent actions do a weighted average of their scale with
-                    // the accumulated scale.  The math works out.  By induction, you can reason
-                    // that the result will weight all the scales in proportion to their given weights.
-                    //
-                    // The influence of any of the averaged morph targets is,
-                    //
-                    //    Scale * rampValue * ( attenuatedWeight / sumOfAttentuatedWeights )
-                    //
-                    // The units of this expression are scaleUnits * rampUnits, which matches the units
-                    // for the other composition modes.  The term ( attenuatedWeight / sumOfAttentuatedWeights ),
-                    // is a ratio that doesn't have any units.
-                    float rampedScale = scale * rampValue;
-                    if (morphTargetState.accumulatedWeight == 0.0f) {
-                        morphTargetState.weight = rampedScale;
-                    } else {
-                        float factor = attenuatedWeight / (morphTargetState.accumulatedWeight + attenuatedWeight);
-                        morphTargetState.weight = morphTargetState.weight * (1.0f - factor) + rampedScale * factor;
+            // Like Additive, but clamped to 1.0.
+            morphTargetState.weight += scale * rampValue;
+            if (morphTargetState.weight > 1.0) {
+                morphTargetState.weight = 1.0;
+            }
+            break;
+        }
+        case CalMorphTargetTypeExclusive:
+        case CalMorphTargetTypeAverage: {
+
+            float attenuatedWeight = unrampedWeight * rampValue;
+
+            // Each morph target is having multiple actions blended into it.  The composition mode (e.g., exclusive)
+            // is a property of the morph target itself, so you don't ever get an exclusive blend competing with
+            // an average blend, for example.  You get different actions all blending into the same morph target.
+
+            // For morphs of the Exclusive type, I pick one of the Replace actions arbitrarily
+            // and attenuate all the other actions' influence by the inverse of the Replace action's
+            // rampValue.  If I don't have a Replace action, then the result is the same as the
+            // Average type morph target.  This procedure is not exactly the same as the skeletal animation
+            // Replace composition function.  The skeletal animation Replace function supports combined
+            // attenuation of multiple Replace animations, whereas morph animation Exclusive type
+            // supports only one Replace morph animation, arbitrarily chosen, to attenuate the other
+            // animations.  The reason for the difference is that skeletal animations are sorted in
+            // the mixer, and morph animations are in an arbitrary order.
+            //
+            // If I already have a Replace chosen, then I attenuate this action.
+            // Otherwise, if this action is a Replace, then I record it and attenuate current scale.
+            if (mtype == CalMorphTargetTypeExclusive) {
+                if (morphTargetState.replacementAttenuation != ReplacementAttenuationNull) {
+                    attenuatedWeight *= morphTargetState.replacementAttenuation;
+                } else {
+                    if (replace) {
+                        float attenuation = 1.0f - rampValue;
+                        morphTargetState.replacementAttenuation = attenuation;
+                        morphTargetState.weight *= attenuation;
+                        morphTargetState.accumulatedWeight *= attenuation;
                     }
-                    morphTargetState.accumulatedWeight += attenuatedWeight;
-                    break;
-                }
-                default: {
-                    assert(!"Unexpected");
-                    break;
                 }
             }
-            return;
+
+            // For morph targets of Average type, we average the actions' scales
+            // according to the attenuatedWeight.  The first action assigns 100% of its
+            // scale, and subsequent actions do a weighted average of their scale with
+            // the accumulated scale.  The math works out.  By induction, you can reason
+            // that the result will weight all the scales in proportion to their given weights.
+            //
+            // The influence of any of the averaged morph targets is,
+            //
+            //    Scale * rampValue * ( attenuatedWeight / sumOfAttentuatedWeights )
+            //
+            // The units of this expression are scaleUnits * rampUnits, which matches the units
+            // for the other composition modes.  The term ( attenuatedWeight / sumOfAttentuatedWeights ),
+            // is a ratio that doesn't have any units.
+            float rampedScale = scale * rampValue;
+            if (morphTargetState.accumulatedWeight == 0.0f) {
+                morphTargetState.weight = rampedScale;
+            } else {
+                float factor = attenuatedWeight / (morphTargetState.accumulatedWeight + attenuatedWeight);
+                morphTargetState.weight = morphTargetState.weight * (1.0f - factor) + rampedScale * factor;
+            }
+            morphTargetState.accumulatedWeight += attenuatedWeight;
+            break;
+        }
+        default: {
+            assert(!"Unexpected");
+            break;
+        }
+    }
+}
+
+void CalSubmesh::blendMorphAnimation(
+    const CalCoreMorphAnimation& animation,
+    const std::vector<int>& channelTable,
+    float time,
+    float unrampedWeight,
+    float rampValue,
+    bool replace
+) {
+    cal3d::verify(channelTable.size() == animation.tracks.size(), "morph channel table does not match the animation");
+
+    for (size_t i = 0; i < channelTable.size(); ++i) {
+        const int morphTargetId = channelTable[i];
+        if (morphTargetId != -1) {
+            blendMorphTargetScale(
+                morphTargetId,
+                animation.tracks[i].getState(time),
+                unrampedWeight,
+                rampValue,
+                replace);
+        }
+    }
+}
+
+void CalSubmesh::blendMorphWeights(
+    const float* weights,
+    const std::vector<int>& channelTable,
+    float unrampedWeight,
+    float rampValue,
+    bool replace
+) {
+    for (size_t i = 0; i < channelTable.size(); ++i) {
+        const int morphTargetId = channelTable[i];
+        if (morphTargetId != -1) {
+            blendMorphTargetScale(
+                morphTargetId,
+                weights[i],
+                unrampedWeight,
+                rampValue,
+                replace);
         }
     }
 }
@@ -16,6 +16,7 @@
 #include "cal3d/vector.h"
 
 CAL3D_PTR(CalCoreMaterial);
+class CalCoreMorphAnimation;
 
 namespace cal3d {
     class CAL3D_API MorphTarget {
@@ -49,4 +50,32 @@ public:
         float unrampedWeight,
         float rampValue,
         bool replace);
+
+    // As above, addressing the morph target by its index in morphTargets.
+    void blendMorphTargetScale(
+        size_t morphTargetId,
+        float scale,
+        float unrampedWeight,
+        float rampValue,
+        bool replace);
+
+    // Blends every track of the animation at the given time.  channelTable
+    // comes from CalCoreMorphAnimation::getMorphChannelTable for this
+    // submesh's core submesh.
+    void blendMorphAnimation(
+        const CalCoreMorphAnimation& animation,
+        const std::vector<int>& channelTable,
+        float time,
+        float unrampedWeight,
+        float rampValue,
+        bool replace);
+
+    // As blendMorphAnimation, taking the track weights already sampled,
+    // e.g. by CalMorphSampler.  weights has one entry per channelTable entry.
+    void blendMorphWeights(
+        const float* weights,
+        const std::vector<int>& channelTable,
+        float unrampedWeight,
+        float rampValue,
+        bool replace);
 };
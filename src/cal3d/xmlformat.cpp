@@ -1,9 +1,13 @@
 #include <boost/optional.hpp>
 #include <rapidxml.hpp>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <float.h>
 #include "cal3d/loader.h"
 #include "cal3d/error.h"
+#include "cal3d/forceclocale.h"
+#include "cal3d/parallel.h"
 #include "cal3d/vector.h"
 #include "cal3d/quaternion.h"
 #include "cal3d/coreskeleton.h"
@@ -29,30 +33,168 @@ struct InvalidFileFormat {
     operator CalCoreSkeletonPtr() const { return CalCoreSkeletonPtr(); }
     operator CalCoreMaterialPtr() const { return CalCoreMaterialPtr(); }
     operator CalCoreMeshPtr() const { return CalCoreMeshPtr(); }
+    operator CalCoreSubmeshPtr() const { return CalCoreSubmeshPtr(); }
     operator CalCoreAnimationPtr() const { return CalCoreAnimationPtr(); }
     operator CalCoreMorphAnimationPtr() const { return CalCoreMorphAnimationPtr(); }
 };
 
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// True when d lies exactly halfway between two floats.  Only then can
+// rounding the decimal to double and the double to float differ from
+// rounding the decimal to float directly.
+static bool isFloatHalfway(double d) {
+    cal3d_uint64 bits;
+    memcpy(&bits, &d, sizeof(bits));
+    // a normal float keeps 24 of the double's 53 significand bits
+    return (bits & 0x1FFFFFFF) == 0x10000000;
+}
+
+/*****************************************************************************/
+/** Parses a float without sscanf in the common case.
+  *
+  * A decimal with at most 15 significant digits and a power of ten no larger
+  * than 10^22 is exact in a double, so one multiplication or division gives
+  * the correctly rounded double, and narrowing that to a float is correctly
+  * rounded too unless it lands exactly between two floats.  Exporters write
+  * 6 to 9 significant digits, so nearly every number takes this path.
+  *****************************************************************************/
+
+const char* cal3d::parseFloat(const char* p, float* result) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    const int maxExactDigits = 15;
+    const int maxExactPower = 22;
+
+    while (isSpace(*p)) {
+        ++p;
+    }
+    const char* const start = p;
+
+    const bool negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+        ++p;
+    }
+
+    // digits beyond the 19th no longer fit, and force the fallback anyway
+    cal3d_uint64 mantissa = 0;
+    int significantDigits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+    for (; isDigit(*p); ++p) {
+        anyDigits = true;
+        if (significantDigits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            significantDigits += mantissa != 0;
+        } else {
+            ++exponent;
+        }
+    }
+    if (*p == '.') {
+        ++p;
+        for (; isDigit(*p); ++p) {
+            anyDigits = true;
+            if (significantDigits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                significantDigits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        const char* e = p + 1;
+        const bool negativeExponent = *e == '-';
+        if (*e == '-' || *e == '+') {
+            ++e;
+        }
+        int power = 0;
+        for (; isDigit(*e); ++e) {
+            if (power < 100000) {
+                power = power * 10 + (*e - '0');
+            }
+        }
+        exponent += negativeExponent ? -power : power;
+        // as sscanf does, a dangling "e" or "e+" is consumed too
+        p = e;
+    }
+
+    // nan, inf and hex floats are left to sscanf
+    if (anyDigits && *p != 'x' && *p != 'X' && significantDigits <= maxExactDigits) {
+        if (mantissa == 0) {
+            *result = negative ? -0.0f : 0.0f;
+            return p;
+        }
+        if (exponent >= -maxExactPower && exponent <= maxExactPower) {
+            double d = double(mantissa);
+            d = exponent < 0 ? d / powersOfTen[-exponent] : d * powersOfTen[exponent];
+            if (d >= FLT_MIN && d <= FLT_MAX && !isFloatHalfway(d)) {
+                *result = float(negative ? -d : d);
+                return p;
+            }
+        }
+    }
+
+    float f;
+    int length = 0;
+    if (sscanf(start, "%f%n", &f, &length) != 1) {
+        return 0;
+    }
+    *result = f;
+    return start + length;
+}
+
+static const char* parse(const char* p, float* result) {
+    return cal3d::parseFloat(p, result);
+}
+
+static const char* parse(const char* p, int* result) {
+    char* end;
+    const long value = strtol(p, &end, 10);
+    if (end == p) {
+        return 0;
+    }
+    *result = int(value);
+    return end;
+}
+
+// Like sscanf with count conversions: stops at the first that fails,
+// leaving it and the rest zero.
+template<typename T>
+static inline void ReadNumbers(char const* buffer, T* values, int count) {
+    for (int i = 0; i < count; ++i) {
+        values[i] = 0;
+    }
+    for (int i = 0; i < count && buffer; ++i) {
+        buffer = parse(buffer, &values[i]);
+    }
+}
+
 static inline void ReadPair(char const* buffer, float* f1, float* f2) {
-    float a = 0.0f;
-    float b = 0.0f;
-    sscanf(buffer, " %f %f", &a, &b);
-    *f1 = a;
-    *f2 = b;
+    float v[2];
+    ReadNumbers(buffer, v, 2);
+    *f1 = v[0];
+    *f2 = v[1];
 }
 
 static inline void ReadPair(char const* buffer, int* f1, int* f2) {
-    int a = 0;
-    int b = 0;
-    sscanf(buffer, " %d %d", &a, &b);
-    *f1 = a;
-    *f2 = b;
+    int v[2];
+    ReadNumbers(buffer, v, 2);
+    *f1 = v[0];
+    *f2 = v[1];
 }
 
 // atof does wacky things in VC++ 2010 CRT in Serbia...
 static inline float imvu_atof(const char* p) {
     float f = 0.0f;
-    sscanf(p, " %f", &f);
+    cal3d::parseFloat(p, &f);
     return f;
 }
 
@@ -167,35 +309,28 @@ static inline bool TexCoordFromXml(
 
 
 static inline void ReadTripleFloat(char const* buffer, float* f1, float* f2, float* f3) {
-    float a = 0.0f;
-    float b = 0.0f;
-    float c = 0.0f;
-    sscanf(buffer, " %f %f %f", &a, &b, &c);
-    *f1 = a;
-    *f2 = b;
-    *f3 = c;
+    float v[3];
+    ReadNumbers(buffer, v, 3);
+    *f1 = v[0];
+    *f2 = v[1];
+    *f3 = v[2];
 }
 
 static inline void ReadTripleInt(char const* buffer, int* f1, int* f2, int* f3) {
-    int a = 0;
-    int b = 0;
-    int c = 0;
-    sscanf(buffer, " %d %d %d", &a, &b, &c);
-    *f1 = a;
-    *f2 = b;
-    *f3 = c;
+    int v[3];
+    ReadNumbers(buffer, v, 3);
+    *f1 = v[0];
+    *f2 = v[1];
+    *f3 = v[2];
 }
 
 static inline void ReadQuadInt(char const* buffer, int* f1, int* f2, int* f3, int* f4) {
-    int a = 0;
-    int b = 0;
-    int c = 0;
-    int d = 0;
-    sscanf(buffer, " %d %d %d %d", &a, &b, &c, &d);
-    *f1 = a;
-    *f2 = b;
-    *f3 = c;
-    *f4 = d;
+    int v[4];
+    ReadNumbers(buffer, v, 4);
+    *f1 = v[0];
+    *f2 = v[1];
+    *f3 = v[2];
+    *f4 = v[3];
 }
 
 static inline bool CalVectorFromXml(
@@ -249,15 +384,12 @@ static inline bool CalVectorFromXml(
 }
 
 static inline void ReadQuadFloat(char const* buffer, float* f1, float* f2, float* f3, float* f4) {
-    float a = 0.0f;
-    float b = 0.0f;
-    float c = 0.0f;
-    float d = 0.0f;
-    sscanf(buffer, " %f %f %f %f", &a, &b, &c, &d);
-    *f1 = a;
-    *f2 = b;
-    *f3 = c;
-    *f4 = d;
+    float v[4];
+    ReadNumbers(buffer, v, 4);
+    *f1 = v[0];
+    *f2 = v[1];
+    *f3 = v[2];
+    *f4 = v[3];
 }
 
 CalCoreSkeletonPtr CalLoader::loadXmlCoreSkeleton(char* dataSrc) {
@@ -271,7 +403,7 @@ CalCoreSkeletonPtr CalLoader::loadXmlCoreSkeleton(char* dataSrc) {
     return loadXmlCoreSkeletonDoc(document);
 }
 
-CalCoreMeshPtr CalLoader::loadXmlCoreMesh(char* dataSrc) {
+CalCoreMeshPtr CalLoader::loadXmlCoreMesh(char* dataSrc, unsigned threadCount) {
     rapidxml::xml_document<> document;
     try {
         document.parse<rapidxml::parse_no_data_nodes | rapidxml::parse_no_entity_translation>(dataSrc);
@@ -279,7 +411,7 @@ CalCoreMeshPtr CalLoader::loadXmlCoreMesh(char* dataSrc) {
         return InvalidFileFormat();
     }
 
-    return loadXmlCoreMeshDoc(document);
+    return loadXmlCoreMeshDoc(document, threadCount);
 }
 
 CalCoreMaterialPtr CalLoader::loadXmlCoreMaterial(char* dataSrc) {
@@ -531,6 +663,9 @@ CalCoreAnimationPtr CalLoader::loadXmlCoreAnimationDoc(const rapidxml::xml_docum
             translationIsDynamic = atoi(trstr3) ? true : false;
         }
 
+        // Tracks without an INTERPOLATION attribute are linear.
+        const char* interpolation = get_string_attribute(track, "INTERPOLATION");
+
         // XML files may or may not have a translationRequired flag.  The default value is true if it is not supplied.
         // XML files may or may not have the translation in keyframes, but if they don't, then either (a) they do
         // have a translationRequired flag and it is false, or (b) they have a false translationIsDynamic flag AND
@@ -595,12 +730,14 @@ CalCoreAnimationPtr CalLoader::loadXmlCoreAnimationDoc(const rapidxml::xml_docum
 
             keyframes.push_back(pCoreKeyframe);
         }
-        CalCoreTrackPtr pCoreTrack(new CalCoreTrack(coreBoneId, keyframes));
-        pCoreTrack->translationRequired = translationRequired;
-        pCoreTrack->translationIsDynamic = translationIsDynamic;
-        pCoreAnimation->tracks.push_back(*pCoreTrack);
+        pCoreAnimation->tracks.push_back(CalCoreTrack(coreBoneId, std::move(keyframes)));
+        CalCoreTrack& coreTrack = pCoreAnimation->tracks.back();
+        coreTrack.translationRequired = translationRequired;
+        coreTrack.translationIsDynamic = translationIsDynamic;
+        coreTrack.splineInterpolated = !strcmp(interpolation, "SPLINE");
     }
 
+    pCoreAnimation->buildTrackTable();
     return pCoreAnimation;
 }
 
@@ -669,262 +806,293 @@ CalCoreMorphAnimationPtr CalLoader::loadXmlCoreMorphAnimationDoc(const rapidxml:
     return coreMorphAnimation;
 }
 
-CalCoreMeshPtr CalLoader::loadXmlCoreMeshDoc(const rapidxml::xml_document<>& doc) {
+// Converts one <submesh> element.  Reads nothing outside it, so different
+// submeshes of one document can be converted on different threads.
+static CalCoreSubmeshPtr loadXmlCoreSubmesh(rapidxml::xml_node<>* submesh, bool hasVertexColors) {
     typedef rapidxml::xml_node<> xml_node;
 
-    xml_node* header = doc.first_node();
-    if (!header || !has_name(header, "header")) {
-        return InvalidFileFormat();
-    }
+    // only for ValidateTag, which ignores it
+    const CalCoreMeshPtr pCoreMesh;
 
-    if (!isHeaderWellFormed(header)) {
-        return InvalidFileFormat();
-    }
+    int coreMaterialThreadId = get_int_attribute(submesh, "MATERIAL");
+    int vertexCount = get_int_attribute(submesh, "numvertices");
+    int faceCount = get_int_attribute(submesh, "NUMFACES");
+    int springCount = get_int_attribute(submesh, "NUMSPRINGS");
+    int textureCoordinateCount = get_int_attribute(submesh, "NUMTEXCOORDS");
+    int morphCount = get_int_attribute(submesh, "nummorphs");
 
-    if (!has_attribute_value(header, "magic", cal3d::MESH_XMLFILE_EXTENSION)) {
-        return InvalidFileFormat();
-    }
+    CalCoreSubmeshPtr pCoreSubmesh(new CalCoreSubmesh(vertexCount, textureCoordinateCount ? true : false, faceCount));
+    pCoreSubmesh->coreMaterialThreadId = coreMaterialThreadId;
 
-    int version = get_int_attribute(header, "version");
-    if (version < cal3d::EARLIEST_COMPATIBLE_FILE_VERSION) {
-        return InvalidFileFormat();
-    }
+    xml_node* vertex = submesh->first_node();
 
-    bool hasVertexColors = (version >= cal3d::FIRST_FILE_VERSION_WITH_VERTEX_COLORS);
-
-    xml_node* mesh = header->next_sibling();
-    if (!mesh || !has_name(mesh, "mesh")) {
-        return InvalidFileFormat();
-    }
-
-    CalCoreMeshPtr pCoreMesh(new CalCoreMesh);
+    // reused by every vertex; addVertex copies it
+    std::vector<CalCoreSubmesh::Influence> influences;
 
-    for (xml_node* submesh = mesh->first_node(); submesh; submesh = submesh->next_sibling()) {
-        if (!has_name(submesh, "submesh")) {
-            continue;
+    for (int vertexId = 0; vertexId < vertexCount; ++vertexId) {
+        if (!ValidateTag(vertex, "VERTEX", pCoreMesh, pCoreSubmesh)) {
+            return InvalidFileFormat();
         }
+        CalCoreSubmesh::Vertex Vertex;
+        CalColor32 vertexColor = CalMakeColor(CalVector(1.0f, 1.0f, 1.0f));
 
-        int coreMaterialThreadId = get_int_attribute(submesh, "MATERIAL");
-        int vertexCount = get_int_attribute(submesh, "numvertices");
-        int faceCount = get_int_attribute(submesh, "NUMFACES");
-        int springCount = get_int_attribute(submesh, "NUMSPRINGS");
-        int textureCoordinateCount = get_int_attribute(submesh, "NUMTEXCOORDS");
-        int morphCount = get_int_attribute(submesh, "nummorphs");
+        xml_node* pos = vertex->first_node();
+        if (!ValidateTag(pos, "POS", pCoreMesh, pCoreSubmesh)) {
+            return InvalidFileFormat();
+        }
+        ReadTripleFloat(pos->value(), &Vertex.position.x, &Vertex.position.y, &Vertex.position.z);
 
-        CalCoreSubmeshPtr pCoreSubmesh(new CalCoreSubmesh(vertexCount, textureCoordinateCount ? true : false, faceCount));
-        pCoreSubmesh->coreMaterialThreadId = coreMaterialThreadId;
+        xml_node* norm = pos->next_sibling();
+        if (!ValidateTag(norm, "NORM", pCoreMesh, pCoreSubmesh)) {
+            return InvalidFileFormat();
+        }
 
-        xml_node* vertex = submesh->first_node();
+        ReadTripleFloat(norm->value(),  &Vertex.normal.x, &Vertex.normal.y, &Vertex.normal.z);
 
-        for (int vertexId = 0; vertexId < vertexCount; ++vertexId) {
-            if (!ValidateTag(vertex, "VERTEX", pCoreMesh, pCoreSubmesh)) {
+        xml_node* vertColor = norm->next_sibling();
+        xml_node* collapse = 0;
+        if (!vertColor || !has_name(vertColor, "color")) {
+            if (hasVertexColors) {
                 return InvalidFileFormat();
+            } else {
+                collapse = vertColor;
             }
-            CalCoreSubmesh::Vertex Vertex;
-            CalColor32 vertexColor = CalMakeColor(CalVector(1.0f, 1.0f, 1.0f));
+        } else {
+            CalVector vc(1.0f, 1.0f, 1.0f);
+            ReadTripleFloat(vertColor->value(), &vc.x, &vc.y, &vc.z);
+            vertexColor = CalMakeColor(vc);
 
-            xml_node* pos = vertex->first_node();
-            if (!ValidateTag(pos, "POS", pCoreMesh, pCoreSubmesh)) {
+            collapse = vertColor->next_sibling();
+        }
+        if (!collapse) {
+            return InvalidFileFormat();
+        }
+        if (has_name(collapse, "COLLAPSEID")) {
+            const char* collapseid = collapse->value();
+            if (!collapseid) {
                 return InvalidFileFormat();
             }
-            ReadTripleFloat(pos->value(), &Vertex.position.x, &Vertex.position.y, &Vertex.position.z);
-
-            xml_node* norm = pos->next_sibling();
-            if (!ValidateTag(norm, "NORM", pCoreMesh, pCoreSubmesh)) {
+            xml_node* collapseCount = collapse->next_sibling();
+            if (!collapseCount || !has_name(collapseCount, "COLLAPSECOUNT")) {
                 return InvalidFileFormat();
             }
 
-            ReadTripleFloat(norm->value(),  &Vertex.normal.x, &Vertex.normal.y, &Vertex.normal.z);
+            const char* collapseCountData = collapseCount->value();
+            if (!collapseCountData) {
+                return InvalidFileFormat();
+            }
+            collapse = collapseCount->next_sibling();
+        }
 
-            xml_node* vertColor = norm->next_sibling();
-            xml_node* collapse = 0;
-            if (!vertColor || !has_name(vertColor, "color")) {
-                if (hasVertexColors) {
-                    return InvalidFileFormat();
-                } else {
-                    collapse = vertColor;
-                }
-            } else {
-                CalVector vc(1.0f, 1.0f, 1.0f);
-                ReadTripleFloat(vertColor->value(), &vc.x, &vc.y, &vc.z);
-                vertexColor = CalMakeColor(vc);
+        xml_node* texcoord = collapse;
 
-                collapse = vertColor->next_sibling();
-            }
-            if (!collapse) {
+        // load all texture coordinates of the vertex
+        for (int textureCoordinateId = 0; textureCoordinateId < textureCoordinateCount; ++textureCoordinateId) {
+            CalCoreSubmesh::TextureCoordinate textureCoordinate;
+            // load data of the influence
+            if (!texcoord || !has_name(texcoord, "TEXCOORD")) {
                 return InvalidFileFormat();
             }
-            if (has_name(collapse, "COLLAPSEID")) {
-                const char* collapseid = collapse->value();
-                if (!collapseid) {
-                    return InvalidFileFormat();
-                }
-                xml_node* collapseCount = collapse->next_sibling();
-                if (!collapseCount || !has_name(collapseCount, "COLLAPSECOUNT")) {
-                    return InvalidFileFormat();
-                }
 
-                const char* collapseCountData = collapseCount->value();
-                if (!collapseCountData) {
-                    return InvalidFileFormat();
-                }
-                collapse = collapseCount->next_sibling();
-            }
+            ReadPair(texcoord->value(), &textureCoordinate.u, &textureCoordinate.v);
 
-            xml_node* texcoord = collapse;
+            // set texture coordinate in the core submesh instance
+            if (textureCoordinateId == 0) {
+                pCoreSubmesh->setTextureCoordinate(vertexId, textureCoordinate);
+            }
+            texcoord = texcoord->next_sibling();
+        }
 
-            // load all texture coordinates of the vertex
-            for (int textureCoordinateId = 0; textureCoordinateId < textureCoordinateCount; ++textureCoordinateId) {
-                CalCoreSubmesh::TextureCoordinate textureCoordinate;
-                // load data of the influence
-                if (!texcoord || !has_name(texcoord, "TEXCOORD")) {
-                    return InvalidFileFormat();
-                }
+        // get the number of influences
+        int influenceCount = get_int_attribute(vertex, "NUMINFLUENCES");
+        if (influenceCount < 0) {
+            return InvalidFileFormat();
+        }
 
-                ReadPair(texcoord->value(), &textureCoordinate.u, &textureCoordinate.v);
+        influences.resize(influenceCount);
 
-                // set texture coordinate in the core submesh instance
-                if (textureCoordinateId == 0) {
-                    pCoreSubmesh->setTextureCoordinate(vertexId, textureCoordinate);
-                }
-                texcoord = texcoord->next_sibling();
-            }
+        xml_node* influence = texcoord;
 
-            // get the number of influences
-            int influenceCount = get_int_attribute(vertex, "NUMINFLUENCES");
-            if (influenceCount < 0) {
+        // load all influences of the vertex
+        int influenceId;
+        for (influenceId = 0; influenceId < influenceCount; ++influenceId) {
+            if (!influence || !has_name(influence, "INFLUENCE")) {
                 return InvalidFileFormat();
             }
 
-            std::vector<CalCoreSubmesh::Influence> influences(influenceCount);
-
-            xml_node* influence = texcoord;
+            influences[influenceId].boneId = get_int_attribute(influence, "ID");
+            influences[influenceId].weight = imvu_atof(influence->value());
 
-            // load all influences of the vertex
-            int influenceId;
-            for (influenceId = 0; influenceId < influenceCount; ++influenceId) {
-                if (!influence || !has_name(influence, "INFLUENCE")) {
-                    return InvalidFileFormat();
-                }
+            influence = influence->next_sibling();
+        }
 
-                influences[influenceId].boneId = get_int_attribute(influence, "ID");
-                influences[influenceId].weight = imvu_atof(influence->value());
+        pCoreSubmesh->addVertex(Vertex, vertexColor, influences);
+        vertex = vertex->next_sibling();
+    }
 
-                influence = influence->next_sibling();
-            }
+    xml_node* spring = vertex;
 
-            pCoreSubmesh->addVertex(Vertex, vertexColor, influences);
-            vertex = vertex->next_sibling();
+    for (int springId = 0; springId < springCount; ++springId) {
+        if (!spring || !has_name(spring, "SPRING")) {
+            return InvalidFileFormat();
         }
+        spring = spring->next_sibling();
+    }
 
-        xml_node* spring = vertex;
+    xml_node* face = spring;
 
-        for (int springId = 0; springId < springCount; ++springId) {
-            if (!spring || !has_name(spring, "SPRING")) {
-                return InvalidFileFormat();
-            }
-            spring = spring->next_sibling();
+    xml_node* morph = face;
+    for (int morphId = 0; morphId < morphCount; morphId++) {
+        if (!has_name(morph, "MORPH")) {
+            return InvalidFileFormat();
         }
 
-        xml_node* face = spring;
+        CalCoreMorphTarget::VertexOffsetArray vertexOffsets;
 
-        xml_node* morph = face;
-        for (int morphId = 0; morphId < morphCount; morphId++) {
-            if (!has_name(morph, "MORPH")) {
-                return InvalidFileFormat();
-            }
-
-            CalCoreMorphTarget::VertexOffsetArray vertexOffsets;
+        xml_node* blendVert = morph->first_node();
+        for (int blendVertI = 0; blendVertI < vertexCount; blendVertI++) {
+            VertexOffset Vertex;
 
-            xml_node* blendVert = morph->first_node();
-            for (int blendVertI = 0; blendVertI < vertexCount; blendVertI++) {
-                VertexOffset Vertex;
+            bool copyOrig = true;
+            if (blendVert && has_name(blendVert, "BLENDVERTEX")) {
+                int vertId = get_int_attribute(blendVert, "VERTEXID");
 
-                bool copyOrig = true;
-                if (blendVert && has_name(blendVert, "BLENDVERTEX")) {
-                    int vertId = get_int_attribute(blendVert, "VERTEXID");
+                if (vertId == blendVertI) {
+                    copyOrig = false;
+                }
+            }
 
-                    if (vertId == blendVertI) {
-                        copyOrig = false;
-                    }
+            if (!copyOrig) {
+                if (!ValidateTag(blendVert, "BLENDVERTEX", pCoreMesh, pCoreSubmesh)) {
+                    return InvalidFileFormat();
                 }
 
-                if (!copyOrig) {
-                    if (!ValidateTag(blendVert, "BLENDVERTEX", pCoreMesh, pCoreSubmesh)) {
-                        return InvalidFileFormat();
-                    }
+                xml_node* pos = blendVert->first_node();
+                if (!CalVectorFromXml(pos, "POSITION", &Vertex.position, pCoreMesh, pCoreSubmesh)) {
+                    return InvalidFileFormat();
+                }
 
-                    xml_node* pos = blendVert->first_node();
-                    if (!CalVectorFromXml(pos, "POSITION", &Vertex.position, pCoreMesh, pCoreSubmesh)) {
-                        return InvalidFileFormat();
-                    }
+                xml_node* norm = pos->next_sibling();
+                if (!CalVectorFromXml(norm, "NORMAL", &Vertex.normal, pCoreMesh, pCoreSubmesh)) {
+                    return InvalidFileFormat();
+                }
 
-                    xml_node* norm = pos->next_sibling();
-                    if (!CalVectorFromXml(norm, "NORMAL", &Vertex.normal, pCoreMesh, pCoreSubmesh)) {
+                xml_node* texcoord = norm->next_sibling();
+                int textureCoordinateId;
+                for (textureCoordinateId = 0; textureCoordinateId < textureCoordinateCount; ++textureCoordinateId) {
+                    CalCoreSubmesh::TextureCoordinate textureCoordinate;
+                    if (
+                        !TexCoordFromXml(
+                            texcoord,
+                            "TEXCOORD",
+                            &textureCoordinate,
+                            pCoreMesh,
+                            pCoreSubmesh)
+                    ) {
                         return InvalidFileFormat();
                     }
-
-                    xml_node* texcoord = norm->next_sibling();
-                    int textureCoordinateId;
-                    for (textureCoordinateId = 0; textureCoordinateId < textureCoordinateCount; ++textureCoordinateId) {
-                        CalCoreSubmesh::TextureCoordinate textureCoordinate;
-                        if (
-                            !TexCoordFromXml(
-                                texcoord,
-                                "TEXCOORD",
-                                &textureCoordinate,
-                                pCoreMesh,
-                                pCoreSubmesh)
-                        ) {
-                            return InvalidFileFormat();
-                        }
-                        texcoord = texcoord->next_sibling();
-                    }
-                    blendVert = blendVert->next_sibling();
-                    Vertex.vertexId = blendVertI;
-                    Vertex.position -= pCoreSubmesh->getVectorVertex()[blendVertI].position;
-                    Vertex.normal -= pCoreSubmesh->getVectorVertex()[blendVertI].normal;
-                    vertexOffsets.push_back(Vertex);
+                    texcoord = texcoord->next_sibling();
                 }
+                blendVert = blendVert->next_sibling();
+                Vertex.vertexId = blendVertI;
+                Vertex.position -= pCoreSubmesh->getVectorVertex()[blendVertI].position;
+                Vertex.normal -= pCoreSubmesh->getVectorVertex()[blendVertI].normal;
+                vertexOffsets.push_back(Vertex);
             }
+        }
 
-            auto nameAttribute = morph->first_attribute("name", 0, false);
-            const char* name;
-            if (!nameAttribute) {
-                name = "";
-            } else {
-                name = nameAttribute->value();
-            }
+        auto nameAttribute = morph->first_attribute("name", 0, false);
+        const char* name;
+        if (!nameAttribute) {
+            name = "";
+        } else {
+            name = nameAttribute->value();
+        }
 
-            CalCoreMorphTargetPtr morphTarget(new CalCoreMorphTarget(name, vertexCount, vertexOffsets));
-            pCoreSubmesh->addMorphTarget(morphTarget);
+        CalCoreMorphTargetPtr morphTarget(new CalCoreMorphTarget(name, vertexCount, vertexOffsets));
+        pCoreSubmesh->addMorphTarget(morphTarget);
 
-            morph = morph->next_sibling();
+        morph = morph->next_sibling();
+    }
+
+    face = morph;
+    // load all faces
+    for (int faceId = 0; faceId < faceCount; ++faceId) {
+        if (!has_name(face, "FACE")) {
+            return InvalidFileFormat();
         }
+        int tmp[3];
+        ReadTripleInt(get_string_attribute(face, "VERTEXID"), tmp, tmp + 1, tmp + 2);
 
-        face = morph;
-        // load all faces
-        for (int faceId = 0; faceId < faceCount; ++faceId) {
-            if (!has_name(face, "FACE")) {
+        if (sizeof(CalIndex) == 2) {
+            if (tmp[0] > 65535 || tmp[1] > 65535 || tmp[2] > 65535) {
                 return InvalidFileFormat();
             }
-            int tmp[3];
-            ReadTripleInt(get_string_attribute(face, "VERTEXID"), tmp, tmp + 1, tmp + 2);
+        }
+        pCoreSubmesh->addFace(CalCoreSubmesh::Face(tmp[0], tmp[1], tmp[2]));
 
-            if (sizeof(CalIndex) == 2) {
-                if (tmp[0] > 65535 || tmp[1] > 65535 || tmp[2] > 65535) {
-                    return InvalidFileFormat();
-                }
-            }
-            pCoreSubmesh->addFace(CalCoreSubmesh::Face(tmp[0], tmp[1], tmp[2]));
+        face = face->next_sibling();
+    }
+
+    return pCoreSubmesh;
+}
+
+CalCoreMeshPtr CalLoader::loadXmlCoreMeshDoc(const rapidxml::xml_document<>& doc, unsigned threadCount) {
+    typedef rapidxml::xml_node<> xml_node;
+
+    xml_node* header = doc.first_node();
+    if (!header || !has_name(header, "header")) {
+        return InvalidFileFormat();
+    }
+
+    if (!isHeaderWellFormed(header)) {
+        return InvalidFileFormat();
+    }
+
+    if (!has_attribute_value(header, "magic", cal3d::MESH_XMLFILE_EXTENSION)) {
+        return InvalidFileFormat();
+    }
 
-            face = face->next_sibling();
+    int version = get_int_attribute(header, "version");
+    if (version < cal3d::EARLIEST_COMPATIBLE_FILE_VERSION) {
+        return InvalidFileFormat();
+    }
+
+    bool hasVertexColors = (version >= cal3d::FIRST_FILE_VERSION_WITH_VERTEX_COLORS);
+
+    xml_node* mesh = header->next_sibling();
+    if (!mesh || !has_name(mesh, "mesh")) {
+        return InvalidFileFormat();
+    }
+
+    std::vector<xml_node*> submeshNodes;
+    size_t totalVertexCount = 0;
+    for (xml_node* submesh = mesh->first_node(); submesh; submesh = submesh->next_sibling()) {
+        if (has_name(submesh, "submesh")) {
+            submeshNodes.push_back(submesh);
+            totalVertexCount += std::max(0, get_int_attribute(submesh, "numvertices"));
         }
+    }
 
-        // add the core submesh to the core mesh instance
-        pCoreMesh->submeshes.push_back(pCoreSubmesh);
+    // Threads only pay for themselves once there's real work to split.
+    const size_t minimumParallelVertexCount = 4096;
+    if (totalVertexCount < minimumParallelVertexCount) {
+        threadCount = 1;
     }
 
+    // uselocale is per thread, so each worker needs its own ForceCLocale
+    std::vector<CalCoreSubmeshPtr> submeshes(submeshNodes.size());
+    const bool loaded = cal3d::parallelFor<ForceCLocale>(submeshNodes.size(), threadCount, [&](size_t i) {
+        submeshes[i] = loadXmlCoreSubmesh(submeshNodes[i], hasVertexColors);
+        return bool(submeshes[i]);
+    });
+    if (!loaded) {
+        // CalError is per thread; report the failure on the caller's
+        return InvalidFileFormat();
+    }
+
+    CalCoreMeshPtr pCoreMesh(new CalCoreMesh);
+    pCoreMesh->submeshes = std::move(submeshes);
     return pCoreMesh;
 }
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "cal3d/global.h"
+
 namespace cal3d {
     // zero-terminated.
     const char SKELETON_XMLFILE_EXTENSION[]      = "XSF";
@@ -7,4 +9,12 @@ namespace cal3d {
     const char ANIMATEDMORPH_XMLFILE_EXTENSION[] = "XPF";
     const char MESH_XMLFILE_EXTENSION[]          = "XMF";
     const char MATERIAL_XMLFILE_EXTENSION[]      = "XRF";
+
+    // Parses a float as sscanf(" %f") does in the C locale.  Plain decimal
+    // numbers never consult the locale; anything else (nan, inf, hex, more
+    // than 15 significant digits) falls back to sscanf, so callers outside
+    // the loaders should force the C locale themselves.  Returns the
+    // character after the number, or null, leaving *result alone, when there
+    // is no number.
+    CAL3D_API const char* parseFloat(const char* p, float* result);
 }
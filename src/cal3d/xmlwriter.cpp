@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "cal3d/xmlwriter.h"
+
+static const size_t streamChunkSize = 64 * 1024;
+
+// TinyXML hashes attributes into three buckets by their first letter and
+// prints bucket by bucket.
+static int attributeBucket(const char* name) {
+    char firstLetter = char(tolower(name[0]));
+    if (firstLetter > 'z' || firstLetter < 'a') {
+        firstLetter = 'a';
+    }
+    return ('z' - firstLetter) % 3;
+}
+
+CalXmlWriter::CalXmlWriter(std::string& output)
+    : output(&output)
+    , stream(0)
+{}
+
+CalXmlWriter::CalXmlWriter(std::ostream& stream)
+    : output(&buffer)
+    , stream(&stream)
+{}
+
+CalXmlWriter::~CalXmlWriter() {
+    flush();
+}
+
+void CalXmlWriter::openElement(const char* name) {
+    if (!elements.empty()) {
+        openContent(false);
+    }
+    indent(elements.size());
+    *output += '<';
+    append(name);
+
+    Element element = { name, true, false, false };
+    elements.push_back(element);
+}
+
+void CalXmlWriter::closeElement() {
+    const Element& element = elements.back();
+    if (element.startTagOpen) {
+        finishStartTag();
+        append(" />");
+    } else {
+        if (element.hasChildren) {
+            *output += '\n';
+            indent(elements.size() - 1);
+        }
+        append("</");
+        append(element.name);
+        *output += '>';
+    }
+    elements.pop_back();
+
+    if (elements.empty()) {
+        *output += '\n';
+    }
+    flushIfLarge();
+}
+
+void CalXmlWriter::attribute(const char* name, const char* value) {
+    addAttribute(name, value, value + strlen(value));
+}
+
+void CalXmlWriter::attribute(const char* name, const std::string& value) {
+    addAttribute(name, value.data(), value.data() + value.size());
+}
+
+void CalXmlWriter::intAttribute(const char* name, int value) {
+    intsAttribute(name, &value, 1);
+}
+
+void CalXmlWriter::floatAttribute(const char* name, float value) {
+    floatsAttribute(name, &value, 1);
+}
+
+// numbers never need escaping, so they are formatted in place
+void CalXmlWriter::intsAttribute(const char* name, const int* values, size_t count) {
+    Attribute a = { name, attributeValues.size(), 0, false };
+    char number[16];
+    for (size_t i = 0; i < count; ++i) {
+        if (i) {
+            attributeValues += ' ';
+        }
+        attributeValues.append(number, formatInt(number, values[i]));
+    }
+    a.end = attributeValues.size();
+    attributes.push_back(a);
+}
+
+void CalXmlWriter::floatsAttribute(const char* name, const float* values, size_t count) {
+    Attribute a = { name, attributeValues.size(), 0, false };
+    char number[16];
+    for (size_t i = 0; i < count; ++i) {
+        if (i) {
+            attributeValues += ' ';
+        }
+        attributeValues.append(number, formatFloat(number, values[i]));
+    }
+    a.end = attributeValues.size();
+    attributes.push_back(a);
+}
+
+void CalXmlWriter::text(const char* value) {
+    openContent(true);
+    appendEscaped(*output, value, value + strlen(value));
+}
+
+void CalXmlWriter::intText(int value) {
+    openContent(true);
+    char number[16];
+    output->append(number, formatInt(number, value));
+}
+
+void CalXmlWriter::floatsText(const float* values, size_t count) {
+    openContent(true);
+    char number[16];
+    for (size_t i = 0; i < count; ++i) {
+        if (i) {
+            *output += ' ';
+        }
+        output->append(number, formatFloat(number, values[i]));
+    }
+}
+
+bool CalXmlWriter::flush() {
+    if (!stream) {
+        return true;
+    }
+    stream->write(buffer.data(), buffer.size());
+    buffer.clear();
+    return !stream->fail();
+}
+
+/*****************************************************************************/
+/** Formats a float as "%g" does, without going through printf.
+  *
+  * The float is exact in a double, and scaling it by a power of ten into
+  * [10^5, 10^6) costs at most a couple of ulps, far less than the distance
+  * to a rounding boundary unless the value sits almost exactly halfway
+  * between two six-digit decimals.  Those, and nan and infinity, go to
+  * sprintf, so the output always matches it.
+  *****************************************************************************/
+
+char* CalXmlWriter::formatFloat(char* buffer, float value) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+        1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+        1e20, 1e21, 1e22, 1e23, 1e24, 1e25, 1e26, 1e27, 1e28, 1e29,
+        1e30, 1e31, 1e32, 1e33, 1e34, 1e35, 1e36, 1e37, 1e38, 1e39,
+        1e40, 1e41, 1e42, 1e43, 1e44, 1e45, 1e46, 1e47, 1e48, 1e49,
+        1e50, 1e51,
+    };
+    const int precision = 6;
+
+    char* p = buffer;
+    double d = value;
+    if (d != d || d - d != 0.0) {
+        return buffer + sprintf(buffer, "%g", d);
+    }
+    if (std::signbit(d)) {
+        *p++ = '-';
+        d = -d;
+    }
+    if (d == 0.0) {
+        *p++ = '0';
+        return p;
+    }
+
+    // an estimate of floor(log10(d)) that is at most one too small
+    int binaryExponent;
+    frexp(d, &binaryExponent);
+    int exponent = int(floor((binaryExponent - 1) * 0.30102999566398120));
+
+    int power = precision - 1 - exponent;
+    double scaled = power >= 0 ? d * powersOfTen[power] : d / powersOfTen[-power];
+    if (scaled >= 1e6) {
+        ++exponent;
+        --power;
+        scaled = power >= 0 ? d * powersOfTen[power] : d / powersOfTen[-power];
+    }
+
+    int digits = int(scaled);
+    const double fraction = scaled - digits;
+    if (fabs(fraction - 0.5) < 1e-7) {
+        return buffer + sprintf(buffer, "%g", double(value));
+    }
+    digits += fraction > 0.5;
+    if (digits == 1000000) {
+        digits = 100000;
+        ++exponent;
+    }
+
+    char decimal[precision];
+    for (int i = precision - 1; i >= 0; --i) {
+        decimal[i] = char('0' + digits % 10);
+        digits /= 10;
+    }
+    int significant = precision;
+    while (decimal[significant - 1] == '0') {
+        --significant;
+    }
+
+    if (exponent < -4 || exponent >= precision) {
+        *p++ = decimal[0];
+        if (significant > 1) {
+            *p++ = '.';
+            memcpy(p, decimal + 1, significant - 1);
+            p += significant - 1;
+        }
+        *p++ = 'e';
+        *p++ = exponent < 0 ? '-' : '+';
+        const int magnitude = exponent < 0 ? -exponent : exponent;
+        if (magnitude >= 100) {
+            *p++ = char('0' + magnitude / 100);
+        }
+        *p++ = char('0' + magnitude / 10 % 10);
+        *p++ = char('0' + magnitude % 10);
+    } else if (exponent >= 0) {
+        memcpy(p, decimal, exponent + 1);
+        p += exponent + 1;
+        if (significant > exponent + 1) {
+            *p++ = '.';
+            memcpy(p, decimal + exponent + 1, significant - exponent - 1);
+            p += significant - exponent - 1;
+        }
+    } else {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > exponent; --i) {
+            *p++ = '0';
+        }
+        memcpy(p, decimal, significant);
+        p += significant;
+    }
+    return p;
+}
+
+char* CalXmlWriter::formatInt(char* buffer, int value) {
+    char* p = buffer;
+    unsigned magnitude = unsigned(value);
+    if (value < 0) {
+        *p++ = '-';
+        magnitude = 0u - magnitude;
+    }
+    char reversed[10];
+    int length = 0;
+    do {
+        reversed[length++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    while (length) {
+        *p++ = reversed[--length];
+    }
+    return p;
+}
+
+void CalXmlWriter::openContent(bool forText) {
+    Element& parent = elements.back();
+    if (parent.startTagOpen) {
+        finishStartTag();
+        *output += '>';
+    }
+    if (forText) {
+        parent.hasText = true;
+    } else {
+        parent.hasChildren = true;
+        *output += '\n';
+    }
+}
+
+void CalXmlWriter::finishStartTag() {
+    for (int bucket = 0; bucket < 3; ++bucket) {
+        for (auto a = attributes.begin(); a != attributes.end(); ++a) {
+            if (attributeBucket(a->name) != bucket) {
+                continue;
+            }
+            const char quote = a->quoted ? '\'' : '"';
+            *output += ' ';
+            append(a->name);
+            *output += '=';
+            *output += quote;
+            output->append(attributeValues, a->begin, a->end - a->begin);
+            *output += quote;
+        }
+    }
+    attributes.clear();
+    attributeValues.clear();
+    elements.back().startTagOpen = false;
+}
+
+void CalXmlWriter::addAttribute(const char* name, const char* begin, const char* end) {
+    Attribute a = { name, attributeValues.size(), 0, std::find(begin, end, '"') != end };
+    appendEscaped(attributeValues, begin, end);
+    a.end = attributeValues.size();
+    attributes.push_back(a);
+}
+
+void CalXmlWriter::indent(size_t depth) {
+    for (size_t i = 0; i < depth; ++i) {
+        output->append("    ", 4);
+    }
+}
+
+void CalXmlWriter::append(const char* s) {
+    output->append(s);
+}
+
+// as TiXmlBase::PutString, including passing "&#x...;" references through
+void CalXmlWriter::appendEscaped(std::string& out, const char* begin, const char* end) {
+    for (const char* p = begin; p != end;) {
+        const int c = *p;
+        if (c == '&' && end - p > 2 && p[1] == '#' && p[2] == 'x') {
+            while (p != end) {
+                out += *p++;
+                if (p != end && *p == ';') {
+                    break;
+                }
+            }
+        } else if (c == '&') {
+            out.append("&amp;", 5);
+            ++p;
+        } else if (c == '<') {
+            out.append("&lt;", 4);
+            ++p;
+        } else if (c == '>') {
+            out.append("&gt;", 4);
+            ++p;
+        } else if (c == '"') {
+            out.append("&quot;", 6);
+            ++p;
+        } else if (c == '\'') {
+            out.append("&apos;", 6);
+            ++p;
+        } else if (c < 32 || c > 126) {
+            char reference[8];
+            out.append(reference, sprintf(reference, "&#x%02X;", unsigned(c & 0xff)));
+            ++p;
+        } else {
+            out += char(c);
+            ++p;
+        }
+    }
+}
+
+void CalXmlWriter::flushIfLarge() {
+    if (stream && buffer.size() >= streamChunkSize) {
+        flush();
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "cal3d/global.h"
+
+// Writes XML as it goes, with the same bytes TinyXML's Print would produce
+// for the equivalent document: four-space indentation, text-only elements
+// on one line, childless elements as <foo />, attributes in TinyXML's
+// bucket order, and TinyXML's escaping.  Numbers are formatted as a
+// default std::ostream would format them in the C locale.
+//
+// Element and attribute names must outlive the element; they are string
+// literals everywhere CalSaver uses them.
+class CAL3D_API CalXmlWriter : private boost::noncopyable {
+public:
+    // appends to output
+    explicit CalXmlWriter(std::string& output);
+    // writes to stream in chunks, and the rest on flush or destruction
+    explicit CalXmlWriter(std::ostream& stream);
+    ~CalXmlWriter();
+
+    void openElement(const char* name);
+    void closeElement();
+
+    // before any text or child element
+    void attribute(const char* name, const char* value);
+    void attribute(const char* name, const std::string& value);
+    void intAttribute(const char* name, int value);
+    void floatAttribute(const char* name, float value);
+    // space separated
+    void intsAttribute(const char* name, const int* values, size_t count);
+    void floatsAttribute(const char* name, const float* values, size_t count);
+
+    void text(const char* value);
+    void intText(int value);
+    // space separated
+    void floatsText(const float* values, size_t count);
+
+    // Hands everything written so far to the stream.  Returns false if the
+    // stream has failed.
+    bool flush();
+
+    // Writes value as std::ostream << value does with the default precision
+    // and the classic locale, and returns the end.  buffer needs 16 bytes.
+    static char* formatFloat(char* buffer, float value);
+    static char* formatInt(char* buffer, int value);
+
+private:
+    struct Attribute {
+        const char* name;
+        size_t begin; // in attributeValues, escaped
+        size_t end;
+        bool quoted;  // the value contains '"'
+    };
+
+    struct Element {
+        const char* name;
+        bool startTagOpen;
+        bool hasText;
+        bool hasChildren;
+    };
+
+    void openContent(bool forText);
+    void finishStartTag();
+    void addAttribute(const char* name, const char* begin, const char* end);
+    void indent(size_t depth);
+    void append(const char* s);
+    void appendEscaped(std::string& out, const char* begin, const char* end);
+    void flushIfLarge();
+
+    std::string buffer;   // used with a stream
+    std::string* output;
+    std::ostream* stream;
+
+    std::vector<Element> elements;
+    std::vector<Attribute> attributes;
+    std::string attributeValues;
+};
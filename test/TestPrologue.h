@@ -6,12 +6,27 @@
 #include <cal3d/streamops.h>
 
 #include <TestFramework/TestFramework.h>
+#include <cal3d/corebone.h>
+#include <cal3d/coreskeleton.h>
 #include <cal3d/vector4.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/scoped_array.hpp>
 
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#else
+
+// "=A" only means edx:eax on 32-bit targets, so read the halves explicitly
+inline cal3d_uint64 __rdtsc(void) {
+    unsigned lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (cal3d_uint64(hi) << 32) | lo;
+}
+
+#endif
+
 using boost::scoped_ptr;
 using boost::shared_ptr;
 using boost::lexical_cast;
@@ -24,3 +39,16 @@ inline bool AreClose(
 ) {
     return (p1.asCalVector4() - p2.asCalVector4()).length() < tolerance;
 }
+
+// Bone i sits at (1, i, 0) in its parent's space, so every bone's bind
+// translation differs.  Bone i's parent is parents[i], or bone i - 1 when
+// parents is null, making a chain.
+inline CalCoreSkeletonPtr MakeChainSkeleton(unsigned boneCount, const int* parents = 0) {
+    CalCoreSkeletonPtr skeleton(new CalCoreSkeleton);
+    for (unsigned i = 0; i < boneCount; ++i) {
+        CalCoreBonePtr bone(new CalCoreBone("bone", parents ? parents[i] : int(i) - 1));
+        bone->relativeTransform.translation = CalVector(1.0f, float(i), 0.0f);
+        skeleton->addCoreBone(bone);
+    }
+    return skeleton;
+}
@@ -1,6 +1,15 @@
 #include "TestPrologue.h"
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <cal3d/buffersource.h>
+#include <cal3d/coreanimation.h>
+#include <cal3d/corebone.h>
+#include <cal3d/coreskeleton.h>
 #include <cal3d/coretrack.h>
 #include <cal3d/corekeyframe.h>
+#include <cal3d/loader.h>
+#include <cal3d/saver.h>
 
 FIXTURE(AnimationCompressionFixture) {
 };
@@ -30,3 +39,304 @@ TEST_F(AnimationCompressionFixture, four_frames_are_merged_if_identical) {
     CalCoreTrackPtr p = t.compress(0.1, 0.1, 0);
     CHECK_EQUAL(2u, p->keyframes.size());
 }
+
+// a bone swinging about z, sampled at 30 Hz
+static CalCoreTrack makeSwingTrack(unsigned boneId, size_t frameCount) {
+    CalCoreTrack::KeyframeList keyframes;
+    for (size_t i = 0; i < frameCount; ++i) {
+        const float time = i / 30.0f;
+        CalQuaternion rotation;
+        rotation.setAxisAngle(CalVector(0, 0, 1), 0.5f * sinf(time * 3.0f));
+        keyframes.push_back(CalCoreKeyframe(time, CalVector(0, 1, 0), rotation));
+    }
+    return CalCoreTrack(boneId, keyframes);
+}
+
+static float maxEffectorError(const CalCoreTrack& original, const CalCoreTrack& reduced, const std::vector<CalVector>& offsets) {
+    float error = 0.0f;
+    for (size_t i = 0; i < original.keyframes.size(); ++i) {
+        const cal3d::RotateTranslate expected = original.keyframes[i].transform;
+        const cal3d::RotateTranslate actual = reduced.getCurrentTransform(original.keyframes[i].time);
+        error = std::max(error, (expected.translation - actual.translation).length());
+        for (size_t j = 0; j < offsets.size(); ++j) {
+            error = std::max(error, (expected * offsets[j] - actual * offsets[j]).length());
+        }
+    }
+    return error;
+}
+
+TEST_F(AnimationCompressionFixture, reduce_removes_runs_of_linear_keyframes) {
+    CalCoreTrack::KeyframeList keyframes;
+    for (int i = 0; i < 10; ++i) {
+        keyframes.push_back(CalCoreKeyframe(float(i), CalVector(float(i), 0, 0), CalQuaternion()));
+    }
+    CalCoreTrack t(0, keyframes);
+
+    CalCoreTrackPtr p = t.reduce(std::vector<CalVector>(), 0.001f, 0);
+    CHECK_EQUAL(2u, p->keyframes.size());
+    CHECK_EQUAL(CalVector(9, 0, 0), p->keyframes[1].transform.translation);
+}
+
+TEST_F(AnimationCompressionFixture, reduce_caps_the_gap_between_surviving_keyframes) {
+    CalCoreTrack::KeyframeList keyframes;
+    for (int i = 0; i < 2000; ++i) {
+        keyframes.push_back(CalCoreKeyframe(float(i), CalVector(1, 2, 3), CalQuaternion()));
+    }
+    CalCoreTrack t(0, keyframes);
+
+    CalCoreTrackPtr p = t.reduce(std::vector<CalVector>(), 0.001f, 0);
+    CHECK(p->keyframes.size() < 20);
+    for (size_t i = 1; i < p->keyframes.size(); ++i) {
+        CHECK(p->keyframes[i].time - p->keyframes[i - 1].time <= 256.0f);
+    }
+}
+
+TEST_F(AnimationCompressionFixture, reduce_stays_within_tolerance_at_effectors) {
+    CalCoreTrack t = makeSwingTrack(0, 90);
+
+    std::vector<CalVector> offsets;
+    offsets.push_back(CalVector(10, 0, 0));
+
+    CalCoreTrackPtr rootOnly = t.reduce(std::vector<CalVector>(), 0.05f, 0);
+    CalCoreTrackPtr withEffector = t.reduce(offsets, 0.05f, 0);
+
+    CHECK(withEffector->keyframes.size() < t.keyframes.size());
+    CHECK(maxEffectorError(t, *withEffector, offsets) <= 0.05f);
+
+    // rotation alone does not move the bone's origin, but it does swing the
+    // effector, so ignoring the hierarchy loses accuracy
+    CHECK(rootOnly->keyframes.size() < withEffector->keyframes.size());
+    CHECK(maxEffectorError(t, *rootOnly, offsets) > 0.05f);
+}
+
+TEST_F(AnimationCompressionFixture, descendant_offsets_compose_bind_pose) {
+    CalCoreSkeleton skeleton;
+    const int parents[] = { -1, 0, 1, 0 };
+    for (int i = 0; i < 4; ++i) {
+        CalCoreBonePtr bone(new CalCoreBone("bone", parents[i]));
+        bone->relativeTransform.translation = CalVector(0, float(i), 0);
+        skeleton.addCoreBone(bone);
+    }
+
+    std::vector<CalVector> offsets = skeleton.getDescendantOffsets(0);
+    CHECK_EQUAL(3u, offsets.size());
+    CHECK_EQUAL(CalVector(0, 1, 0), offsets[0]);
+    CHECK_EQUAL(CalVector(0, 3, 0), offsets[1]);
+    CHECK_EQUAL(CalVector(0, 3, 0), offsets[2]);
+
+    CHECK_EQUAL(0u, skeleton.getDescendantOffsets(2).size());
+}
+
+TEST_F(AnimationCompressionFixture, parallel_reduction_matches_serial_reduction) {
+    CalCoreSkeleton skeleton;
+    CalCoreAnimation serial;
+    CalCoreAnimation parallel;
+    for (unsigned i = 0; i < 16; ++i) {
+        CalCoreBonePtr bone(new CalCoreBone("bone", int(i) - 1));
+        bone->relativeTransform.translation = CalVector(0, 1, 0);
+        skeleton.addCoreBone(bone);
+        serial.tracks.push_back(makeSwingTrack(i, 60 + i));
+        parallel.tracks.push_back(makeSwingTrack(i, 60 + i));
+    }
+
+    serial.reduceKeyframes(skeleton, 0.01f, 1);
+    parallel.reduceKeyframes(skeleton, 0.01f, 4);
+    CHECK(serial.tracks == parallel.tracks);
+
+    // deeper in the chain means fewer descendants, so more can go
+    CHECK(serial.tracks[0].keyframes.size() >= serial.tracks[15].keyframes.size());
+}
+
+TEST_F(AnimationCompressionFixture, spline_track_passes_through_its_keyframes) {
+    CalCoreTrack t = makeSwingTrack(0, 4);
+    t.keyframes[1].transform.translation = CalVector(0, 2, 0);
+    t.splineInterpolated = true;
+
+    for (size_t i = 0; i < t.keyframes.size(); ++i) {
+        const cal3d::RotateTranslate sampled = t.getCurrentTransform(t.keyframes[i].time);
+        CHECK((t.keyframes[i].transform.translation - sampled.translation).length() < 1e-5f);
+        CHECK(std::abs(dot(t.keyframes[i].transform.rotation, sampled.rotation)) > 0.99999f);
+    }
+
+    // leaving the bump at key 1, the curve keeps its zero tangent rather
+    // than following the straight line down
+    CalCoreTrack linear(t);
+    linear.splineInterpolated = false;
+    const float mid = 0.5f * (t.keyframes[1].time + t.keyframes[2].time);
+    CHECK(t.getCurrentTransform(mid).translation.y > linear.getCurrentTransform(mid).translation.y);
+}
+
+TEST_F(AnimationCompressionFixture, fit_spline_needs_fewer_keyframes_than_reduce) {
+    CalCoreTrack t = makeSwingTrack(0, 90);
+
+    std::vector<CalVector> offsets;
+    offsets.push_back(CalVector(10, 0, 0));
+
+    CalCoreTrackPtr reduced = t.reduce(offsets, 0.01f, 0);
+    CalCoreTrackPtr spline = t.fitSpline(offsets, 0.01f, 0);
+
+    CHECK(!reduced->splineInterpolated);
+    CHECK(spline->splineInterpolated);
+    CHECK(maxEffectorError(t, *spline, offsets) <= 0.01f);
+    CHECK(spline->keyframes.size() < reduced->keyframes.size());
+}
+
+TEST_F(AnimationCompressionFixture, spline_tracks_stay_splines_when_reduced_again) {
+    CalCoreTrack t = makeSwingTrack(0, 90);
+
+    std::vector<CalVector> offsets;
+    offsets.push_back(CalVector(10, 0, 0));
+
+    CalCoreTrackPtr spline = t.fitSpline(offsets, 0.01f, 0);
+
+    CalCoreTrackPtr reduced = spline->reduce(offsets, 0.01f, 0);
+    CHECK(reduced->splineInterpolated);
+    CHECK(maxEffectorError(*spline, *reduced, offsets) <= 0.01f);
+
+    CalCoreTrackPtr compressed = spline->compress(0.1, 10.0, 0);
+    CHECK(compressed->splineInterpolated);
+    CHECK(compressed->keyframes == spline->keyframes);
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+typedef std::vector<std::pair<CalCoreSkeletonPtr, CalCoreAnimationPtr>> SampleAnimations;
+
+// every fixed-up animation in data/, or none if the data is missing
+static SampleAnimations loadSampleAnimations() {
+    const char* const models[] = { "cally", "paladin", "skeleton" };
+    const char* const animationNames[] = { "idle", "walk", "jog", "strut", "wave", "shoot_arrow" };
+
+    SampleAnimations animations;
+    for (size_t m = 0; m < sizeof(models) / sizeof(*models); ++m) {
+        const std::string prefix = std::string("../data/") + models[m] + "/" + models[m];
+        const std::string skeletonData = readFile(prefix + ".csf");
+        if (skeletonData.empty()) {
+            return SampleAnimations();
+        }
+        CalBufferSource skeletonSource(skeletonData.data(), skeletonData.size());
+        CalCoreSkeletonPtr skeleton = CalLoader::loadCoreSkeleton(skeletonSource);
+        if (!skeleton) {
+            return SampleAnimations();
+        }
+
+        for (size_t a = 0; a < sizeof(animationNames) / sizeof(*animationNames); ++a) {
+            const std::string animationData = readFile(prefix + "_" + animationNames[a] + ".caf");
+            if (!animationData.empty()) {
+                CalBufferSource animationSource(animationData.data(), animationData.size());
+                CalCoreAnimationPtr animation = CalLoader::loadCoreAnimation(animationSource);
+                if (!animation) {
+                    return SampleAnimations();
+                }
+                animation->fixup(skeleton);
+                animations.push_back(std::make_pair(skeleton, animation));
+            }
+        }
+    }
+    return animations;
+}
+
+TEST_F(AnimationCompressionFixture, benchmark_reduction_over_sample_data) {
+    const SampleAnimations animations = loadSampleAnimations();
+    if (animations.empty()) {
+        printf("sample data not found; skipping reduction benchmark\n");
+        return;
+    }
+
+    // compress's rotation tolerance has no lever arm, so measure the error it
+    // actually produces and give reduce the same budget
+    size_t originalKeyframes = 0;
+    size_t compressedKeyframes = 0;
+    float compressedError = 0.0f;
+    cal3d_uint64 start = __rdtsc();
+    for (size_t i = 0; i < animations.size(); ++i) {
+        const CalCoreSkeletonPtr& skeleton = animations[i].first;
+        const CalCoreAnimation& animation = *animations[i].second;
+        for (size_t t = 0; t < animation.tracks.size(); ++t) {
+            const CalCoreTrack& track = animation.tracks[t];
+            CalCoreTrackPtr compressed = track.compress(0.05, 1.0, skeleton.get());
+            originalKeyframes += track.keyframes.size();
+            compressedKeyframes += compressed->keyframes.size();
+            compressedError = std::max(compressedError, maxEffectorError(track, *compressed, skeleton->getDescendantOffsets(track.coreBoneId)));
+        }
+    }
+    const cal3d_uint64 compressCycles = __rdtsc() - start;
+
+    size_t reducedKeyframes = 0;
+    float reducedError = 0.0f;
+    start = __rdtsc();
+    for (size_t i = 0; i < animations.size(); ++i) {
+        CalCoreAnimation reduced(*animations[i].second);
+        reduced.reduceKeyframes(*animations[i].first, compressedError);
+        for (size_t t = 0; t < reduced.tracks.size(); ++t) {
+            const CalCoreTrack& track = animations[i].second->tracks[t];
+            reducedKeyframes += reduced.tracks[t].keyframes.size();
+            reducedError = std::max(reducedError, maxEffectorError(track, reduced.tracks[t], animations[i].first->getDescendantOffsets(track.coreBoneId)));
+        }
+    }
+    const cal3d_uint64 reduceCycles = __rdtsc() - start;
+
+    CHECK(reducedError <= compressedError);
+    CHECK(reducedKeyframes < compressedKeyframes);
+    printf("Keyframes over %d animations: %d original, %d after compress, %d after reduce (max effector error %f vs %f)\n",
+        int(animations.size()), int(originalKeyframes), int(compressedKeyframes), int(reducedKeyframes), compressedError, reducedError);
+    printf("Mcycles including error measurement: compress %d, reduce %d\n",
+        int(compressCycles / 1000000), int(reduceCycles / 1000000));
+}
+
+// cycles per track sample, sampling every track at evenly spaced times
+static double cyclesPerSample(const CalCoreAnimation& animation) {
+    const int sampleCount = 200;
+    volatile float sink = 0.0f;
+    const cal3d_uint64 start = __rdtsc();
+    for (int i = 0; i < sampleCount; ++i) {
+        const float time = animation.duration * i / sampleCount;
+        for (size_t t = 0; t < animation.tracks.size(); ++t) {
+            sink = sink + animation.tracks[t].getCurrentTransform(time).translation.x;
+        }
+    }
+    const cal3d_uint64 cycles = __rdtsc() - start;
+    return double(cycles) / (sampleCount * animation.tracks.size());
+}
+
+TEST_F(AnimationCompressionFixture, benchmark_spline_fitting_over_sample_data) {
+    const SampleAnimations animations = loadSampleAnimations();
+    if (animations.empty()) {
+        printf("sample data not found; skipping spline benchmark\n");
+        return;
+    }
+
+    const float tolerance = 0.05f;
+    size_t reducedBytes = 0;
+    size_t splineBytes = 0;
+    double reducedCycles = 0.0;
+    double splineCycles = 0.0;
+    float splineError = 0.0f;
+    for (size_t i = 0; i < animations.size(); ++i) {
+        const CalCoreSkeleton& skeleton = *animations[i].first;
+        CalCoreAnimationPtr reduced(new CalCoreAnimation(*animations[i].second));
+        CalCoreAnimationPtr spline(new CalCoreAnimation(*animations[i].second));
+        reduced->reduceKeyframes(skeleton, tolerance);
+        spline->fitSplines(skeleton, tolerance);
+
+        reducedBytes += CalSaver::saveCoreAnimationToBuffer(reduced).size();
+        splineBytes += CalSaver::saveCoreAnimationToBuffer(spline).size();
+        reducedCycles += cyclesPerSample(*reduced);
+        splineCycles += cyclesPerSample(*spline);
+
+        for (size_t t = 0; t < spline->tracks.size(); ++t) {
+            const CalCoreTrack& track = animations[i].second->tracks[t];
+            splineError = std::max(splineError, maxEffectorError(track, spline->tracks[t], skeleton.getDescendantOffsets(track.coreBoneId)));
+        }
+    }
+
+    CHECK(splineError <= tolerance);
+    CHECK(splineBytes < reducedBytes);
+    printf("Bytes over %d animations at tolerance %f: %d linear, %d spline\n",
+        int(animations.size()), tolerance, int(reducedBytes), int(splineBytes));
+    printf("Cycles per track sample: linear %d, spline %d\n",
+        int(reducedCycles / animations.size()), int(splineCycles / animations.size()));
+}
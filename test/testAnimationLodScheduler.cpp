@@ -0,0 +1,179 @@
+#include "TestPrologue.h"
+#include <cal3d/animation.h>
+#include <cal3d/animationlodscheduler.h>
+#include <cal3d/coreanimation.h>
+#include <cal3d/corebone.h>
+#include <cal3d/coreskeleton.h>
+#include <cal3d/mixer.h>
+#include <cal3d/skeleton.h>
+
+// moves every bone from x = 0 at t = 0 to x = 1 at t = 1
+static CalCoreAnimationPtr makeSlideAnimation(unsigned boneCount) {
+    CalCoreAnimationPtr coreAnimation(new CalCoreAnimation);
+    coreAnimation->duration = 1.0f;
+    for (unsigned i = 0; i < boneCount; ++i) {
+        CalCoreTrack::KeyframeList keyframes;
+        keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(0, 0, 0), CalQuaternion()));
+        keyframes.push_back(CalCoreKeyframe(1.0f, CalVector(1, 0, 0), CalQuaternion()));
+        coreAnimation->tracks.push_back(CalCoreTrack(i, keyframes));
+    }
+    return coreAnimation;
+}
+
+FIXTURE(AnimationLodSchedulerFixture) {
+    SETUP(AnimationLodSchedulerFixture)
+        : coreSkeleton(MakeChainSkeleton(1))
+        , skeleton(coreSkeleton)
+        , animation(new CalAnimation(makeSlideAnimation(1), 1.0f, 0))
+    {
+        mixer.addAnimation(animation);
+    }
+
+    CalCoreSkeletonPtr coreSkeleton;
+    CalSkeleton skeleton;
+    CalMixer mixer;
+    CalAnimationPtr animation;
+    CalAnimationLodScheduler scheduler;
+};
+
+TEST_F(AnimationLodSchedulerFixture, interval_one_solves_every_frame) {
+    scheduler.addInstance(&mixer, &skeleton, 1);
+
+    animation->time = 0.25f;
+    CHECK_EQUAL(1u, scheduler.update());
+    CHECK_EQUAL(0.25f, skeleton.boneTransforms[0].rowx.w);
+
+    animation->time = 0.5f;
+    CHECK_EQUAL(1u, scheduler.update());
+    CHECK_EQUAL(0.5f, skeleton.boneTransforms[0].rowx.w);
+}
+
+TEST_F(AnimationLodSchedulerFixture, frames_between_solves_step_toward_the_newest_solve) {
+    scheduler.addInstance(&mixer, &skeleton, 2);
+
+    animation->time = 0.0f;
+    CHECK_EQUAL(1u, scheduler.update());
+    CHECK_EQUAL(0.0f, skeleton.boneTransforms[0].rowx.w);
+
+    animation->time = 0.25f;
+    CHECK_EQUAL(0u, scheduler.update());
+    CHECK_EQUAL(0.0f, skeleton.boneTransforms[0].rowx.w);
+
+    // a solve frame moves halfway toward the new solve
+    animation->time = 0.5f;
+    CHECK_EQUAL(1u, scheduler.update());
+    CHECK_CLOSE(0.25f, skeleton.boneTransforms[0].rowx.w, 0.0001f);
+
+    // and the frame before the next solve reaches it
+    animation->time = 0.75f;
+    CHECK_EQUAL(0u, scheduler.update());
+    CHECK_CLOSE(0.5f, skeleton.boneTransforms[0].rowx.w, 0.0001f);
+
+    animation->time = 1.0f;
+    CHECK_EQUAL(1u, scheduler.update());
+    CHECK_CLOSE(0.75f, skeleton.boneTransforms[0].rowx.w, 0.0001f);
+}
+
+TEST_F(AnimationLodSchedulerFixture, first_update_follows_the_assigned_phase) {
+    CalMixer other;
+    scheduler.addInstance(&mixer, &skeleton, 2);
+    scheduler.addInstance(&other, &skeleton, 2);
+
+    CHECK_EQUAL(1u, scheduler.update());
+    CHECK_EQUAL(1u, scheduler.update());
+}
+
+TEST_F(AnimationLodSchedulerFixture, changing_the_interval_holds_the_pose_until_the_next_solve) {
+    const CalAnimationLodScheduler::InstanceId id = scheduler.addInstance(&mixer, &skeleton, 2);
+
+    animation->time = 0.0f;
+    scheduler.update();
+    animation->time = 0.25f;
+    scheduler.update();
+    animation->time = 0.5f;
+    scheduler.update();
+    CHECK_CLOSE(0.25f, skeleton.boneTransforms[0].rowx.w, 0.0001f);
+
+    // frame 3 is mid-interval for the new phase; the palettes spaced for
+    // the old interval would jump to 0.5
+    scheduler.setUpdateInterval(id, 4);
+    animation->time = 0.75f;
+    CHECK_EQUAL(0u, scheduler.update());
+    CHECK_CLOSE(0.25f, skeleton.boneTransforms[0].rowx.w, 0.0001f);
+
+    animation->time = 1.0f;
+    CHECK_EQUAL(1u, scheduler.update());
+    CHECK_CLOSE(0.4375f, skeleton.boneTransforms[0].rowx.w, 0.0001f);
+}
+
+TEST_F(AnimationLodSchedulerFixture, solves_are_spread_evenly_across_frames) {
+    CalMixer mixers[16];
+    for (unsigned i = 0; i < 16; ++i) {
+        scheduler.addInstance(&mixers[i], &skeleton, 4);
+    }
+
+    for (unsigned frame = 0; frame < 8; ++frame) {
+        CHECK_EQUAL(4u, scheduler.update());
+    }
+}
+
+TEST_F(AnimationLodSchedulerFixture, unknown_instance_throws) {
+    CHECK_THROW(scheduler.setUpdateInterval(42, 2), std::runtime_error);
+}
+
+TEST_F(AnimationLodSchedulerFixture, interval_out_of_range_throws) {
+    CHECK_THROW(scheduler.addInstance(&mixer, &skeleton, CalAnimationLodScheduler::MaxUpdateInterval + 1), std::runtime_error);
+}
+
+TEST(animation_lod_crowd_frame_cost) {
+    const unsigned CrowdSize = 200;
+    const unsigned BoneCount = 60;
+    const unsigned FrameCount = 64;
+
+    CalCoreSkeletonPtr coreSkeleton(MakeChainSkeleton(BoneCount));
+    CalCoreAnimationPtr coreAnimation(makeSlideAnimation(BoneCount));
+
+    std::vector<boost::shared_ptr<CalSkeleton> > skeletons;
+    std::vector<boost::shared_ptr<CalMixer> > mixers;
+    std::vector<CalAnimationPtr> animations;
+
+    CalAnimationLodScheduler scheduler;
+    for (unsigned i = 0; i < CrowdSize; ++i) {
+        skeletons.push_back(boost::shared_ptr<CalSkeleton>(new CalSkeleton(coreSkeleton)));
+        mixers.push_back(boost::shared_ptr<CalMixer>(new CalMixer));
+        animations.push_back(CalAnimationPtr(new CalAnimation(coreAnimation, 1.0f, 0)));
+        mixers.back()->addAnimation(animations.back());
+
+        // a quarter of the crowd is near, the rest falls off to every 8th frame
+        const unsigned interval = (i < CrowdSize / 4) ? 1 : 2 + i % 7;
+        scheduler.addInstance(mixers.back().get(), skeletons.back().get(), interval);
+    }
+
+    cal3d_int64 minCycles = 99999999999999LL;
+    cal3d_int64 maxCycles = 0;
+    cal3d_int64 totalCycles = 0;
+    size_t minSolves = CrowdSize;
+    size_t maxSolves = 0;
+    for (unsigned frame = 0; frame < FrameCount; ++frame) {
+        for (unsigned i = 0; i < CrowdSize; ++i) {
+            animations[i]->time = float(frame) / float(FrameCount);
+        }
+
+        cal3d_int64 start = __rdtsc();
+        size_t solves = scheduler.update();
+        cal3d_int64 elapsed = __rdtsc() - start;
+
+        minCycles = std::min(minCycles, elapsed);
+        maxCycles = std::max(maxCycles, elapsed);
+        totalCycles += elapsed;
+        minSolves = std::min(minSolves, solves);
+        maxSolves = std::max(maxSolves, solves);
+    }
+
+    printf("Crowd of %u: solves per frame %d-%d, cycles per frame min %d mean %d max %d\n",
+        CrowdSize, (int)minSolves, (int)maxSolves,
+        (int)minCycles, (int)(totalCycles / FrameCount), (int)maxCycles);
+
+    // staggering keeps the busiest frame close to the average
+    CHECK(maxSolves - minSolves <= 8);
+}
@@ -0,0 +1,193 @@
+#include "TestPrologue.h"
+#include <thread>
+#include <cal3d/assetcache.h>
+#include <cal3d/corebone.h>
+#include <cal3d/corematerial.h>
+#include <cal3d/coremesh.h>
+#include <cal3d/coremorphtarget.h>
+#include <cal3d/coreskeleton.h>
+#include <cal3d/coresubmesh.h>
+#include <cal3d/saver.h>
+
+// cubes with different material threads: distinct files of equal size
+static std::string cubeMeshFile(int material = 0) {
+    CalCoreMeshPtr mesh(new CalCoreMesh);
+    mesh->submeshes.push_back(MakeCube());
+    mesh->submeshes[0]->coreMaterialThreadId = material;
+    return CalSaver::saveCoreMeshToBuffer(mesh);
+}
+
+TEST(content_hash_matches_murmur3_reference) {
+    struct Vector {
+        std::string data;
+        cal3d_uint64 low;
+        cal3d_uint64 high;
+    };
+    std::string bytes;
+    for (int i = 0; i < 31; ++i) {
+        bytes += char(i);
+    }
+    const Vector vectors[] = {
+        { "", 0, 0 },
+        { "hello", 0xcbd8a7b341bd9b02ULL, 0x5b1e906a48ae1d19ULL },
+        { "The quick brown fox jumps over the lazy dog", 0xe34bbc7bbc071b6cULL, 0x7a433ca9c49a9347ULL },
+        { bytes, 0x053dd3e1a32cd094ULL, 0x9ee59aefb4005490ULL },
+    };
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(*vectors); ++i) {
+        const CalAssetCache::ContentHash hash = CalAssetCache::hashContent(vectors[i].data.data(), vectors[i].data.size());
+        CHECK_EQUAL(vectors[i].low, hash.low);
+        CHECK_EQUAL(vectors[i].high, hash.high);
+    }
+}
+
+TEST(asset_cache_shares_assets_loaded_from_identical_bytes) {
+    CalAssetCache cache(1 << 20);
+    const std::string file = cubeMeshFile();
+
+    CalCoreMeshPtr first = cache.loadCoreMesh(file);
+    CalCoreMeshPtr second = cache.loadCoreMesh(std::string(file));
+    CHECK(first);
+    CHECK_EQUAL(first.get(), second.get());
+
+    CalAssetCache::Stats stats = cache.getStats();
+    CHECK_EQUAL(1u, stats.hits);
+    CHECK_EQUAL(1u, stats.misses);
+    CHECK_EQUAL(0u, stats.evictions);
+    CHECK_EQUAL(1u, stats.entries);
+    CHECK_EQUAL(first->sizeInBytes(), stats.bytes);
+
+    // the same bytes as another asset type are a different entry, and fail
+    CHECK(!cache.loadCoreSkeleton(file));
+    CHECK_EQUAL(2u, cache.getStats().misses);
+    CHECK_EQUAL(1u, cache.getStats().entries);
+}
+
+TEST(asset_cache_does_not_cache_failures) {
+    CalAssetCache cache(1 << 20);
+    CHECK(!cache.loadCoreMesh("not a mesh"));
+    CHECK(!cache.loadCoreMesh("not a mesh"));
+
+    CalAssetCache::Stats stats = cache.getStats();
+    CHECK_EQUAL(0u, stats.hits);
+    CHECK_EQUAL(2u, stats.misses);
+    CHECK_EQUAL(0u, stats.entries);
+    CHECK_EQUAL(0u, stats.bytes);
+}
+
+TEST(asset_cache_evicts_least_recently_used_over_budget) {
+    const std::string a = cubeMeshFile(1);
+    const std::string b = cubeMeshFile(2);
+    const std::string c = cubeMeshFile(3);
+    CalAssetCache sizing(1 << 20);
+    const size_t size = sizing.loadCoreMesh(a)->sizeInBytes();
+
+    CalAssetCache cache(size * 5 / 2);
+    CalCoreMeshPtr meshA = cache.loadCoreMesh(a);
+    CalCoreMeshPtr meshB = cache.loadCoreMesh(b);
+    CHECK_EQUAL(meshA.get(), cache.loadCoreMesh(a).get());
+    CalCoreMeshPtr meshC = cache.loadCoreMesh(c);
+
+    CalAssetCache::Stats stats = cache.getStats();
+    CHECK_EQUAL(1u, stats.evictions);
+    CHECK_EQUAL(2u, stats.entries);
+    CHECK_EQUAL(2 * size, stats.bytes);
+
+    // b was evicted; its holders keep it, but it is decoded again
+    CHECK_EQUAL(2, meshB->submeshes[0]->coreMaterialThreadId);
+    CalCoreMeshPtr reloadedB = cache.loadCoreMesh(b);
+    CHECK(reloadedB.get() != meshB.get());
+    // which evicted a, the least recently used of a and c
+    CHECK_EQUAL(meshC.get(), cache.loadCoreMesh(c).get());
+    CHECK_EQUAL(2u, cache.getStats().evictions);
+
+    cache.setBudget(0);
+    stats = cache.getStats();
+    CHECK_EQUAL(4u, stats.evictions);
+    CHECK_EQUAL(0u, stats.entries);
+    CHECK_EQUAL(0u, stats.bytes);
+    CHECK_EQUAL(1u, meshC->submeshes.size());
+}
+
+TEST(asset_cache_returns_assets_over_budget_without_caching_them) {
+    CalAssetCache cache(16);
+    const std::string file = cubeMeshFile();
+    CalCoreMeshPtr first = cache.loadCoreMesh(file);
+    CHECK(first);
+    CHECK(cache.loadCoreMesh(file).get() != first.get());
+
+    CalAssetCache::Stats stats = cache.getStats();
+    CHECK_EQUAL(2u, stats.misses);
+    CHECK_EQUAL(0u, stats.evictions);
+    CHECK_EQUAL(0u, stats.entries);
+}
+
+TEST(asset_cache_accounts_skeletons_and_materials) {
+    CalCoreSkeletonPtr skeleton(new CalCoreSkeleton);
+    skeleton->addCoreBone(CalCoreBonePtr(new CalCoreBone("a bone name too long for small string storage")));
+    skeleton->addCoreBone(CalCoreBonePtr(new CalCoreBone("child", 0)));
+    CalCoreMaterialPtr material(new CalCoreMaterial);
+    material->maps.resize(2);
+    material->maps[0].filename = "skin.tga";
+    material->maps[1].filename = "a texture file name too long for small string storage.tga";
+
+    CalAssetCache cache(1 << 20);
+    CalCoreSkeletonPtr cachedSkeleton = cache.loadCoreSkeleton(CalSaver::saveCoreSkeletonToBuffer(skeleton));
+    CalCoreMaterialPtr cachedMaterial = cache.loadCoreMaterial(CalSaver::saveCoreMaterialToBuffer(material));
+    CHECK(cachedSkeleton);
+    CHECK(cachedMaterial);
+    CHECK(cachedSkeleton->sizeInBytes() > sizeof(CalCoreSkeleton) + 2 * sizeof(CalCoreBone) + 40);
+    CHECK(cachedMaterial->sizeInBytes() > sizeof(CalCoreMaterial) + 2 * sizeof(CalCoreMaterial::Map) + 50);
+    CHECK_EQUAL(cachedSkeleton->sizeInBytes() + cachedMaterial->sizeInBytes(), cache.getStats().bytes);
+}
+
+TEST(submesh_size_counts_texture_coordinates_and_morph_targets) {
+    CalCoreSubmeshPtr cube = MakeCube();
+    const size_t before = cube->sizeInBytes();
+
+    CalCoreMorphTarget::VertexOffsetArray offsets;
+    for (size_t i = 0; i < cube->getVertexCount(); ++i) {
+        offsets.push_back(VertexOffset(i, CalPoint4(1, 2, 3), CalVector4(0, 0, 1, 0)));
+    }
+    cube->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget("bulge", cube->getVertexCount(), offsets)));
+    CHECK(cube->sizeInBytes() >= before + cube->getVertexCount() * sizeof(VertexOffset));
+
+    CalCoreSubmesh textured(8, true, 0);
+    CalCoreSubmesh untextured(8, false, 0);
+    CHECK_EQUAL(8 * sizeof(CalCoreSubmesh::TextureCoordinate), textured.sizeInBytes() - untextured.sizeInBytes());
+}
+
+TEST(asset_cache_shares_assets_between_threads) {
+    std::vector<std::string> files;
+    for (int i = 0; i < 4; ++i) {
+        files.push_back(cubeMeshFile(i));
+    }
+
+    CalAssetCache cache(1 << 20);
+    const unsigned threadCount = 8;
+    const int loadsPerThread = 200;
+    std::vector<std::vector<CalCoreMeshPtr> > lastLoads(threadCount, std::vector<CalCoreMeshPtr>(files.size()));
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadCount; ++t) {
+        threads.push_back(std::thread([&, t] {
+            for (int n = 0; n < loadsPerThread; ++n) {
+                const size_t i = (n + t) % files.size();
+                lastLoads[t][i] = cache.loadCoreMesh(files[i]);
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    for (unsigned t = 0; t < threadCount; ++t) {
+        for (size_t i = 0; i < files.size(); ++i) {
+            CHECK(lastLoads[t][i]);
+            CHECK_EQUAL(lastLoads[0][i].get(), lastLoads[t][i].get());
+            CHECK_EQUAL(int(i), lastLoads[t][i]->submeshes[0]->coreMaterialThreadId);
+        }
+    }
+    CalAssetCache::Stats stats = cache.getStats();
+    CHECK_EQUAL(threadCount * loadsPerThread, stats.hits + stats.misses);
+    CHECK_EQUAL(files.size(), stats.entries);
+    CHECK_EQUAL(0u, stats.evictions);
+}
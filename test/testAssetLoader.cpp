@@ -0,0 +1,145 @@
+#include "TestPrologue.h"
+#include <atomic>
+#include <cal3d/assetloader.h>
+#include <cal3d/buffersource.h>
+#include <cal3d/coreanimation.h>
+#include <cal3d/corematerial.h>
+#include <cal3d/coremesh.h>
+#include <cal3d/coreskeleton.h>
+#include <cal3d/coresubmesh.h>
+#include <cal3d/error.h>
+#include <cal3d/loader.h>
+#include <cal3d/saver.h>
+
+static std::string cubeMeshFile() {
+    CalCoreMeshPtr mesh(new CalCoreMesh);
+    mesh->submeshes.push_back(MakeCube());
+    return CalSaver::saveCoreMeshToBuffer(mesh);
+}
+
+TEST(asset_loader_futures_deliver_loads_and_failures) {
+    CalAssetLoader loader(2);
+    CHECK_EQUAL(2u, loader.getThreadCount());
+
+    std::future<CalCoreMeshPtr> cube = loader.loadCoreMesh(cubeMeshFile());
+    std::future<CalCoreMeshPtr> garbage = loader.loadCoreMesh("not a mesh");
+    std::future<CalCoreSkeletonPtr> empty = loader.loadCoreSkeleton(std::string());
+
+    CalCoreMeshPtr mesh = cube.get();
+    CHECK(mesh);
+    CHECK_EQUAL(1u, mesh->submeshes.size());
+    CHECK_EQUAL(MakeCube()->getVertexCount(), mesh->submeshes[0]->getVertexCount());
+    CHECK(!garbage.get());
+    CHECK(!empty.get());
+
+    loader.waitForAll();
+    CalAssetLoader::StageTimes meshes = loader.getStageTimes(CalAssetLoader::MESH);
+    CHECK_EQUAL(2u, meshes.count);
+    CHECK_EQUAL(1u, meshes.failures);
+    CHECK_EQUAL(0.0, meshes.read);
+    CHECK_EQUAL(1u, loader.getStageTimes(CalAssetLoader::SKELETON).failures);
+    CHECK_EQUAL(0u, loader.getStageTimes(CalAssetLoader::ANIMATION).count);
+}
+
+TEST(asset_loader_runs_every_callback_before_destruction) {
+    const std::string file = cubeMeshFile();
+    std::atomic<int> loaded(0);
+    std::atomic<int> failed(0);
+    {
+        CalAssetLoader loader(4);
+        for (int i = 0; i < 100; ++i) {
+            loader.loadCoreMesh(i % 10 ? file : std::string("junk"), [&](const CalCoreMeshPtr& mesh) {
+                ++(mesh ? loaded : failed);
+            });
+        }
+    }
+    CHECK_EQUAL(90, loaded.load());
+    CHECK_EQUAL(10, failed.load());
+}
+
+TEST(asset_loader_survives_throwing_callbacks) {
+    const std::string file = cubeMeshFile();
+    std::atomic<int> called(0);
+    CalAssetLoader loader(2);
+    for (int i = 0; i < 10; ++i) {
+        loader.loadCoreMesh(file, [&](const CalCoreMeshPtr&) {
+            ++called;
+            throw std::runtime_error("callback failed");
+        });
+    }
+    loader.waitForAll();
+    CHECK_EQUAL(10, called.load());
+    CHECK_EQUAL(10u, loader.getStageTimes(CalAssetLoader::MESH).count);
+    CHECK_EQUAL(0u, loader.getStageTimes(CalAssetLoader::MESH).failures);
+}
+
+TEST(asset_loader_loads_model_cfg_bundles) {
+    CalAssetLoader loader;
+    CalCoreModelBundle bundle = loader.loadCoreModel("../data/cally/cally.cfg");
+    if (!bundle.skeleton) {
+        printf("sample data not found; skipping model bundle test\n");
+        return;
+    }
+
+    CHECK_EQUAL(1.0f, bundle.scale);
+    CHECK_EQUAL(1u, bundle.animations.size());
+    CHECK_EQUAL(17u, bundle.meshes.size());
+    CHECK_EQUAL(4u, bundle.materials.size());
+    for (size_t i = 0; i < bundle.meshes.size(); ++i) {
+        CHECK(bundle.meshes[i]);
+    }
+    for (size_t i = 0; i < bundle.materials.size(); ++i) {
+        CHECK(bundle.materials[i]);
+    }
+    CHECK(bundle.animations[0]);
+
+    // file order is preserved: cally_calf_left comes first, and has one submesh
+    CHECK_EQUAL(1u, bundle.meshes[0]->submeshes.size());
+
+    loader.waitForAll();
+    CalAssetLoader::StageTimes meshes = loader.getStageTimes(CalAssetLoader::MESH);
+    CHECK_EQUAL(17u, meshes.count);
+    CHECK_EQUAL(0u, meshes.failures);
+    CHECK(meshes.read > 0.0);
+    CHECK(meshes.decoded > 0.0);
+}
+
+TEST(asset_loader_missing_cfg_gives_an_empty_bundle) {
+    CalAssetLoader loader(1);
+    CalError::setLastError(CalError::OK, __FILE__, __LINE__);
+    CalCoreModelBundle bundle = loader.loadCoreModel("no/such/model.cfg");
+    CHECK(!bundle.skeleton);
+    CHECK(bundle.meshes.empty());
+    CHECK_EQUAL(CalError::FILE_NOT_FOUND, CalError::getLastErrorCode());
+}
+
+TEST(benchmark_model_bundle_loading) {
+    const std::string cfg = "../data/cally/cally.cfg";
+    {
+        CalAssetLoader warm(1);
+        if (!warm.loadCoreModel(cfg).skeleton) {
+            printf("sample data not found; skipping model bundle benchmark\n");
+            return;
+        }
+    }
+
+    cal3d_uint64 start = __rdtsc();
+    CalAssetLoader serial(1);
+    serial.loadCoreModel(cfg);
+    const cal3d_uint64 serialCycles = __rdtsc() - start;
+
+    start = __rdtsc();
+    CalAssetLoader pool;
+    pool.loadCoreModel(cfg);
+    const cal3d_uint64 poolCycles = __rdtsc() - start;
+
+    pool.waitForAll();
+    CalAssetLoader::StageTimes meshes = pool.getStageTimes(CalAssetLoader::MESH);
+    printf("Cycles loading cally: 1 thread %d, %u threads %d; per mesh us queued %d, read %d, decoded %d\n",
+        int(serialCycles),
+        pool.getThreadCount(),
+        int(poolCycles),
+        int(meshes.queued * 1e6 / meshes.count),
+        int(meshes.read * 1e6 / meshes.count),
+        int(meshes.decoded * 1e6 / meshes.count));
+}
@@ -131,6 +131,176 @@ TEST_F(BoneMixerFixture, boneTransform_accumulates_transforms_and_scales) {
     CHECK_EQUAL(CalVector(27, 24, 28), transformPoint(skeleton.boneTransforms[2], CalVector(2, 4, 8)));
 }
 
+TEST_F(BoneMixerFixture, masked_bones_share_nearest_active_ancestor_transform) {
+    skeleton.setBoneMask(std::vector<bool>{true, true, false});
+    CHECK(skeleton.isBoneActive(1));
+    CHECK(!skeleton.isBoneActive(2));
+
+    mixer.updateSkeleton(&skeleton, std::vector<BoneTransformAdjustment>(), std::vector<BoneScaleAdjustment>());
+
+    CHECK_EQUAL(11, skeleton.boneTransforms[1].rowx.w);
+    CHECK_EQUAL(skeleton.boneTransforms[1], skeleton.boneTransforms[2]);
+}
+
+TEST_F(BoneMixerFixture, bones_below_a_masked_bone_are_masked) {
+    skeleton.setBoneMask(std::vector<bool>{true, false, true});
+    CHECK(!skeleton.isBoneActive(1));
+    CHECK(!skeleton.isBoneActive(2));
+
+    mixer.updateSkeleton(&skeleton, std::vector<BoneTransformAdjustment>(), std::vector<BoneScaleAdjustment>());
+    CHECK_EQUAL(skeleton.boneTransforms[0], skeleton.boneTransforms[2]);
+
+    skeleton.clearBoneMask();
+    mixer.updateSkeleton(&skeleton, std::vector<BoneTransformAdjustment>(), std::vector<BoneScaleAdjustment>());
+    CHECK_EQUAL(23, skeleton.boneTransforms[2].rowx.w);
+}
+
+FIXTURE(BatchedPoseFixture) {
+    SETUP(BatchedPoseFixture)
+        : coreSkeleton(makeBranchingSkeleton())
+        , skeleton(coreSkeleton)
+    {}
+
+    CalCoreSkeletonPtr coreSkeleton;
+    CalSkeleton skeleton;
+
+    static cal3d::RotateTranslate makeTransform(float angle, float x, float y, float z) {
+        CalQuaternion q;
+        q.setAxisAngle(CalVector(x, y, z) / CalVector(x, y, z).length(), angle);
+        return cal3d::RotateTranslate(q, CalVector(x, y, z));
+    }
+
+    // two chains under one root, deep enough for several groups per level
+    static CalCoreSkeletonPtr makeBranchingSkeleton() {
+        const int parents[] = { -1, 0, 0, 1, 2, 3, 3, 4, 6 };
+        CalCoreSkeletonPtr cs(new CalCoreSkeleton);
+        for (int i = 0; i < 9; ++i) {
+            CalCoreBonePtr bone(new CalCoreBone("bone", parents[i]));
+            bone->relativeTransform = makeTransform(0.3f * (i + 1), 1.0f + i, 2.0f, -1.0f * i);
+            bone->inverseBindPoseTransform = makeTransform(-0.2f * (i + 1), 1.0f, -3.0f, 0.5f * i);
+            cs->addCoreBone(bone);
+        }
+        return cs;
+    }
+
+    void checkMatchesPerBoneSolve() {
+        checkMatchesPerBoneSolve(skeleton);
+    }
+
+    // what CalBone::calculateAbsolutePose produces one bone at a time
+    void checkMatchesPerBoneSolve(CalSkeleton& instance) {
+        CalSkeleton reference(coreSkeleton);
+        for (size_t i = 0; i < reference.bones.size(); ++i) {
+            reference.bones[i].setRelativeTransform(instance.bones[i].getRelativeTransform());
+            reference.bones[i].scale = instance.bones[i].scale;
+        }
+        for (size_t i = 0; i < reference.bones.size(); ++i) {
+            reference.bones[i].calculateAbsolutePose(reference.bones.data());
+        }
+
+        instance.calculateAbsolutePose();
+
+        for (size_t i = 0; i < reference.bones.size(); ++i) {
+            const BoneTransform expected = reference.bones[i].absoluteTransform * reference.inverseBindPoseTransforms[i];
+            const BoneTransform& actual = instance.boneTransforms[i];
+            for (size_t c = 0; c < 4; ++c) {
+                CHECK_CLOSE((&expected.rowx.x)[c], (&actual.rowx.x)[c], 0.0005f);
+                CHECK_CLOSE((&expected.rowy.x)[c], (&actual.rowy.x)[c], 0.0005f);
+                CHECK_CLOSE((&expected.rowz.x)[c], (&actual.rowz.x)[c], 0.0005f);
+            }
+            CHECK_CLOSE(reference.bones[i].absoluteTransform.translation.x, instance.bones[i].absoluteTransform.translation.x, 0.0005f);
+            CHECK_CLOSE(reference.bones[i].absoluteTransform.basis.cy.z, instance.bones[i].absoluteTransform.basis.cy.z, 0.0005f);
+        }
+    }
+};
+
+TEST_F(BatchedPoseFixture, unscaled_solve_matches_per_bone_solve) {
+    checkMatchesPerBoneSolve();
+}
+
+TEST_F(BatchedPoseFixture, scaled_chains_match_per_bone_solve) {
+    skeleton.bones[3].scale = cal3d::Scale(CalVector(2, 1, 0.5f));
+    checkMatchesPerBoneSolve();
+
+    skeleton.bones[0].scale = cal3d::Scale(CalVector(3, 3, 3));
+    checkMatchesPerBoneSolve();
+
+    skeleton.resetPose();
+    checkMatchesPerBoneSolve();
+}
+
+TEST_F(BatchedPoseFixture, only_changed_subtrees_are_recomputed) {
+    skeleton.calculateAbsolutePose();
+
+    // poison a bone outside the changed subtree to see whether it is rewritten
+    const BoneTransform solved = skeleton.boneTransforms[1];
+    const BoneTransform poison(CalVector4(9, 9, 9, 9), CalVector4(9, 9, 9, 9), CalVector4(9, 9, 9, 9));
+    skeleton.boneTransforms[1] = poison;
+
+    skeleton.bones[4].setRelativeTransform(makeTransform(1.0f, 0.0f, 1.0f, 0.0f));
+    skeleton.calculateAbsolutePose();
+    CHECK_EQUAL(poison, skeleton.boneTransforms[1]);
+    const BoneTransform incremental = skeleton.boneTransforms[7];
+
+    skeleton.invalidatePose();
+    checkMatchesPerBoneSolve();
+    CHECK_EQUAL(solved, skeleton.boneTransforms[1]);
+    CHECK_CLOSE(incremental.rowx.w, skeleton.boneTransforms[7].rowx.w, 0.0005f);
+    CHECK_CLOSE(incremental.rowy.x, skeleton.boneTransforms[7].rowy.x, 0.0005f);
+}
+
+TEST_F(BatchedPoseFixture, unchanged_pose_after_reset_is_not_recomputed) {
+    skeleton.calculateAbsolutePose();
+    skeleton.boneTransforms[8] = BoneTransform(cal3d::Transform());
+
+    skeleton.resetPose();
+    skeleton.calculateAbsolutePose();
+    CHECK_EQUAL(BoneTransform(cal3d::Transform()), skeleton.boneTransforms[8]);
+}
+
+TEST_F(BatchedPoseFixture, spawned_instances_pose_independently) {
+    CalSkeletonPrototypePtr prototype(new CalSkeletonPrototype(coreSkeleton));
+    CHECK_EQUAL(9u, prototype->getBoneCount());
+
+    std::vector<CalSkeleton> instances;
+    CalSkeleton::spawn(prototype, 3, instances);
+    CHECK_EQUAL(3u, instances.size());
+
+    instances[1].bones[4].setRelativeTransform(makeTransform(1.0f, 0.0f, 1.0f, 0.0f));
+    instances[2].bones[3].scale = cal3d::Scale(CalVector(2, 1, 0.5f));
+    for (size_t i = 0; i < instances.size(); ++i) {
+        checkMatchesPerBoneSolve(instances[i]);
+    }
+    CHECK(!(instances[0].boneTransforms[7] == instances[1].boneTransforms[7]));
+
+    skeleton.calculateAbsolutePose();
+    for (size_t i = 0; i < skeleton.bones.size(); ++i) {
+        CHECK_EQUAL(skeleton.boneTransforms[i], instances[0].boneTransforms[i]);
+    }
+}
+
+TEST_F(BatchedPoseFixture, benchmark_spawn_against_construction) {
+    const size_t count = 500;
+    CalSkeletonPrototypePtr prototype(new CalSkeletonPrototype(coreSkeleton));
+
+    cal3d_uint64 start = __rdtsc();
+    std::vector<boost::shared_ptr<CalSkeleton>> constructed;
+    for (size_t i = 0; i < count; ++i) {
+        constructed.push_back(boost::shared_ptr<CalSkeleton>(new CalSkeleton(coreSkeleton)));
+    }
+    const cal3d_uint64 constructedCycles = __rdtsc() - start;
+
+    start = __rdtsc();
+    std::vector<CalSkeleton> spawned;
+    CalSkeleton::spawn(prototype, count, spawned);
+    const cal3d_uint64 spawnedCycles = __rdtsc() - start;
+
+    CHECK_EQUAL(count, spawned.size());
+    printf("Cycles per skeleton instance: constructor %d, spawn %d\n",
+        int(constructedCycles / count),
+        int(spawnedCycles / count));
+}
+
 FIXTURE(BoneScaleFixture) {
 };
 
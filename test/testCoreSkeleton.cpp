@@ -73,6 +73,33 @@ TEST_F(CoreSkeletonFixture, second_root_animations_are_transformed_relative_to_f
     CHECK_EQUAL(CalVector(-2, -2, -2), skeleton.bones[1].absoluteTransform.translation);
 }
 
+TEST_F(CoreSkeletonFixture, bone_mask_for_depth_keeps_shallow_bones) {
+    CalCoreSkeleton cs;
+    cs.addCoreBone(CalCoreBonePtr(new CalCoreBone("root")));
+    cs.addCoreBone(CalCoreBonePtr(new CalCoreBone("hand", 0)));
+    cs.addCoreBone(CalCoreBonePtr(new CalCoreBone("finger", 1)));
+
+    std::vector<bool> mask = cs.getBoneMaskForDepth(1);
+    CHECK_EQUAL(3u, mask.size());
+    CHECK(mask[0]);
+    CHECK(mask[1]);
+    CHECK(!mask[2]);
+}
+
+TEST_F(CoreSkeletonFixture, bone_mask_excluding_names_masks_descendants) {
+    CalCoreSkeleton cs;
+    cs.addCoreBone(CalCoreBonePtr(new CalCoreBone("root")));
+    cs.addCoreBone(CalCoreBonePtr(new CalCoreBone("finger", 0)));
+    cs.addCoreBone(CalCoreBonePtr(new CalCoreBone("fingertip", 1)));
+    cs.addCoreBone(CalCoreBonePtr(new CalCoreBone("head", 0)));
+
+    std::vector<bool> mask = cs.getBoneMaskExcluding(std::vector<std::string>(1, "finger"));
+    CHECK(mask[0]);
+    CHECK(!mask[1]);
+    CHECK(!mask[2]);
+    CHECK(mask[3]);
+}
+
 TEST_F(CoreSkeletonFixture, loader_topologically_sorts) {
     std::vector<CalCoreBonePtr> bones;
     bones.push_back(CalCoreBonePtr(new CalCoreBone("a", 1)));
@@ -267,6 +294,31 @@ TEST_F(CoreSkeletonFixture, fixup_zeroes_out_transforms_of_root_bone_keyframes)
     CHECK_EQUAL(CalVector(2, 2, 2), ca.tracks[1].keyframes[0].transform.translation);
 }
 
+TEST_F(CoreSkeletonFixture, fixed_up_root_tracks_sample_the_root_transform_translation) {
+    CalCoreBonePtr root(new CalCoreBone("root"));
+    root->relativeTransform.translation = CalVector(5, 5, 5);
+    CalCoreSkeletonPtr cs(new CalCoreSkeleton);
+    cs->addCoreBone(root);
+
+    CalQuaternion aboutZ;
+    aboutZ.setAxisAngle(CalVector(0, 0, 1), 1.0f);
+    std::vector<CalCoreKeyframe> keyframes;
+    keyframes.push_back(CalCoreKeyframe(0, InvalidTranslation, CalQuaternion()));
+    keyframes.push_back(CalCoreKeyframe(1, InvalidTranslation, aboutZ));
+    CalCoreTrack track(0, keyframes);
+    track.translationRequired = false;
+
+    CalCoreAnimation ca;
+    ca.tracks.push_back(track);
+    const cal3d::RotateTranslate rt(aboutZ, CalVector(1, 2, 3));
+    ca.fixup(cs, rt);
+
+    const CalCoreTrack& fixedUp = ca.tracks[0];
+    CHECK(fixedUp.hasStaticTranslation());
+    CHECK_EQUAL(rt.translation, fixedUp.getCurrentTransform(0.5f).translation);
+    CHECK_EQUAL(rt.translation, fixedUp.getCurrentTransform(0.5f, root->relativeTransform.translation).translation);
+}
+
 TEST_F(CoreSkeletonFixture, loader_zeroes_out_root_transform_of_skeleton) {
     CalCoreBonePtr root0(new CalCoreBone("root0"));
     CalCoreBonePtr root1(new CalCoreBone("root1"));
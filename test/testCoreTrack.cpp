@@ -1,4 +1,5 @@
 #include "TestPrologue.h"
+#include <cal3d/coreanimation.h>
 #include <cal3d/coretrack.h>
 
 FIXTURE(TrackFixture) {
@@ -82,3 +83,77 @@ TEST_F(TrackFixture, getState_with_two_keyframes_at_same_time) {
     CHECK_EQUAL(CalQuaternion(), t.rotation);
     CHECK_EQUAL(CalVector(6, 6, 6), t.translation);
 }
+
+TEST_F(TrackFixture, getCurrentRotation_matches_getCurrentTransform) {
+    CalQuaternion aboutZ;
+    aboutZ.setAxisAngle(CalVector(0, 0, 1), 1.0f);
+
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0, CalVector(2, 2, 2), CalQuaternion()));
+    keyframes.push_back(CalCoreKeyframe(1, CalVector(2, 2, 2), aboutZ));
+    CalCoreTrack track(0, keyframes);
+
+    CHECK_EQUAL(track.getCurrentTransform(-1).rotation, track.getCurrentRotation(-1));
+    CHECK_EQUAL(track.getCurrentTransform(0.25f).rotation, track.getCurrentRotation(0.25f));
+    CHECK_EQUAL(track.getCurrentTransform(2).rotation, track.getCurrentRotation(2));
+}
+
+TEST_F(TrackFixture, static_translation_follows_compression_flags) {
+    CalCoreTrack track(0, CalCoreTrack::KeyframeList());
+    CHECK(!track.hasStaticTranslation());
+
+    track.translationIsDynamic = false;
+    CHECK(track.hasStaticTranslation());
+
+    track.translationIsDynamic = true;
+    track.translationRequired = false;
+    CHECK(track.hasStaticTranslation());
+}
+
+TEST_F(TrackFixture, getNextCoreTrack_follows_tracks_for_the_same_bone) {
+    CalCoreAnimation animation;
+    animation.tracks.push_back(CalCoreTrack(2, CalCoreTrack::KeyframeList()));
+    animation.tracks.push_back(CalCoreTrack(5, CalCoreTrack::KeyframeList()));
+    animation.tracks.push_back(CalCoreTrack(2, CalCoreTrack::KeyframeList()));
+
+    CHECK_EQUAL(&animation.tracks[2], animation.getNextCoreTrack(&animation.tracks[0]));
+    CHECK(!animation.getNextCoreTrack(&animation.tracks[2]));
+
+    animation.buildTrackTable();
+    CHECK_EQUAL(&animation.tracks[2], animation.getNextCoreTrack(&animation.tracks[0]));
+    CHECK(!animation.getNextCoreTrack(&animation.tracks[1]));
+    CHECK(!animation.getNextCoreTrack(&animation.tracks[2]));
+}
+
+TEST_F(TrackFixture, getCoreTrack_finds_tracks_by_bone_with_and_without_table) {
+    CalCoreAnimation animation;
+    animation.tracks.push_back(CalCoreTrack(5, CalCoreTrack::KeyframeList()));
+    animation.tracks.push_back(CalCoreTrack(2, CalCoreTrack::KeyframeList()));
+
+    CHECK_EQUAL(&animation.tracks[1], animation.getCoreTrack(2));
+    CHECK(!animation.getCoreTrack(3));
+
+    animation.buildTrackTable();
+    CHECK_EQUAL(&animation.tracks[0], animation.getCoreTrack(5));
+    CHECK_EQUAL(&animation.tracks[1], animation.getCoreTrack(2));
+    CHECK(!animation.getCoreTrack(3));
+    CHECK(!animation.getCoreTrack(100));
+
+    // tracks added after the table was built are still found, by the scan
+    animation.tracks.push_back(CalCoreTrack(3, CalCoreTrack::KeyframeList()));
+    CHECK_EQUAL(&animation.tracks[2], animation.getCoreTrack(3));
+
+    // a bone id edit needs a rebuild, since the track count doesn't change
+    animation.buildTrackTable();
+    animation.tracks[2].coreBoneId = 4;
+    animation.buildTrackTable();
+    CHECK_EQUAL(&animation.tracks[2], animation.getCoreTrack(4));
+    CHECK(!animation.getCoreTrack(3));
+
+    // ids past the table are only scanned for when some track has one
+    CHECK(!animation.getCoreTrack(0x7fffffffu));
+    animation.tracks.push_back(CalCoreTrack(0x7fffffffu, CalCoreTrack::KeyframeList()));
+    animation.buildTrackTable();
+    CHECK_EQUAL(&animation.tracks[3], animation.getCoreTrack(0x7fffffffu));
+    CHECK(!animation.getCoreTrack(0x7ffffffeu));
+}
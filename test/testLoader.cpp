@@ -2,18 +2,28 @@
 #include <cal3d/buffersource.h>
 #include <cal3d/coreanimation.h>
 #include <cal3d/corekeyframe.h>
+#include <cal3d/corematerial.h>
 #include <cal3d/coremesh.h>
+#include <cal3d/coremorphanimation.h>
+#include <cal3d/coremorphtrack.h>
+#include <cal3d/coremorphtarget.h>
 #include <cal3d/coresubmesh.h>
 #include <cal3d/coretrack.h>
 #include <cal3d/coreskeleton.h>
 #include <cal3d/corebone.h>
+#include <cal3d/error.h>
 #include <cal3d/loader.h>
 #include <cal3d/saver.h>
+#include <cal3d/xmlformat.h>
 
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <iterator>
 #include <limits>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 inline int getIntFromBuf(char* pbuf) {
@@ -176,7 +186,7 @@ TEST_F(LoaderFixture, loading_mesh_sorts_influences) {
 }
 
 const char animationText[] =
-    "<HEADER MAGIC=\"XAF\" VERSION=\"919\" />\n"
+    "<HEADER MAGIC=\"XAF\" VERSION=\"920\" />\n"
     "<ANIMATION NUMTRACKS=\"1\" DURATION=\"40\">\n"
     "    <TRACK BONEID=\"0\" TRANSLATIONREQUIRED=\"0\" TRANSLATIONISDYNAMIC=\"0\" HIGHRANGEREQUIRED=\"1\" NUMKEYFRAMES=\"2\">\n"
     "        <KEYFRAME TIME=\"0\">\n"
@@ -356,6 +366,31 @@ TEST_F(LoaderFixture, load_animation_with_mismatched_counts) {
 }
 
 
+TEST_F(LoaderFixture, spline_tracks_round_trip_through_binary_and_xml) {
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(1, 2, 3), CalQuaternion()));
+    keyframes.push_back(CalCoreKeyframe(1.0f, CalVector(2, 2, 3), CalQuaternion(0.5, 0.5, 0.5, 0.5)));
+    CalCoreAnimation animation;
+    animation.duration = 1.0f;
+    animation.tracks.push_back(CalCoreTrack(0, keyframes));
+    animation.tracks.push_back(CalCoreTrack(1, keyframes));
+    animation.tracks[1].splineInterpolated = true;
+
+    const std::string binary = CalSaver::saveCoreAnimationToBuffer(CalCoreAnimationPtr(new CalCoreAnimation(animation)));
+    CalBufferSource binarySource(binary.data(), binary.size());
+    CalCoreAnimationPtr fromBinary = CalLoader::loadCoreAnimation(binarySource);
+    CHECK(fromBinary);
+    CHECK(animation.tracks == fromBinary->tracks);
+
+    const std::string xml = CalSaver::saveCoreAnimationXmlToBuffer(CalCoreAnimationPtr(new CalCoreAnimation(animation)));
+    CalBufferSource xmlSource(xml.data(), xml.size());
+    CalCoreAnimationPtr fromXml = CalLoader::loadCoreAnimation(xmlSource);
+    CHECK(fromXml);
+    CHECK_EQUAL(false, fromXml->tracks[0].splineInterpolated);
+    CHECK_EQUAL(true, fromXml->tracks[1].splineInterpolated);
+}
+
+
 const char simple_two_bone_skeleton[] =
     "<HEADER MAGIC=\"XSF\" VERSION=\"919\" />"
     "<SKELETON NUMBONES=\"2\" SCENEAMBIENTCOLOR=\"0.5 0.5 0.5\">"
@@ -705,3 +740,795 @@ TEST_F(LoaderFixture, morph_loader_doesnt_crash_on_invalid_data) {
     // passes on mac, fails on windows...  weird.
     //CHECK(CalLoader::loadCoreMorphAnimation(header_only_without_magic));
 }
+
+static CalCoreAnimationPtr loadAnimationWithBoneId(int boneId, bool xml) {
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(1, 2, 3), CalQuaternion()));
+    CalCoreAnimationPtr animation(new CalCoreAnimation);
+    animation->duration = 1.0f;
+    animation->tracks.push_back(CalCoreTrack(0, keyframes));
+    animation->tracks.push_back(CalCoreTrack(boneId, keyframes));
+
+    const std::string file = xml
+        ? CalSaver::saveCoreAnimationXmlToBuffer(animation)
+        : CalSaver::saveCoreAnimationToBuffer(animation);
+    CalBufferSource cbs(file.data(), file.size());
+    return CalLoader::loadCoreAnimation(cbs);
+}
+
+TEST_F(LoaderFixture, animations_with_huge_or_negative_bone_ids_load_without_a_huge_track_table) {
+    const CalCoreAnimationPtr loaded[] = {
+        loadAnimationWithBoneId(0x7fffffff, false),
+        loadAnimationWithBoneId(0x7fffffff, true),
+        loadAnimationWithBoneId(-1, true),
+    };
+    const unsigned boneIds[] = { 0x7fffffffu, 0x7fffffffu, 0xffffffffu };
+    for (size_t i = 0; i < sizeof(loaded) / sizeof(*loaded); ++i) {
+        CHECK(loaded[i]);
+        if (loaded[i]) {
+            CHECK(loaded[i]->sizeInBytes() < 4096);
+            CHECK_EQUAL(&loaded[i]->tracks[0], loaded[i]->getCoreTrack(0));
+            CHECK_EQUAL(&loaded[i]->tracks[1], loaded[i]->getCoreTrack(boneIds[i]));
+            CHECK(!loaded[i]->getCoreTrack(1));
+        }
+    }
+
+    // binary files have always rejected negative bone ids
+    CHECK(!loadAnimationWithBoneId(-1, false));
+}
+
+TEST_F(LoaderFixture, binary_mesh_round_trips_and_rejects_truncation) {
+    CalCoreMeshPtr mesh(new CalCoreMesh);
+    CalCoreSubmeshPtr cube = MakeCube();
+    CalCoreMorphTarget::VertexOffsetArray offsets;
+    offsets.push_back(VertexOffset(5, CalPoint4(1, 2, 3), CalVector4(0, 0, 1, 0)));
+    cube->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget("bulge", cube->getVertexCount(), offsets)));
+    mesh->submeshes.push_back(cube);
+
+    const std::string data = CalSaver::saveCoreMeshToBuffer(mesh);
+    CalBufferSource cbs(data.data(), data.size());
+    CalCoreMeshPtr loaded = CalLoader::loadCoreMesh(cbs);
+    CHECK(loaded);
+    const CalCoreSubmesh& sm = *loaded->submeshes[0];
+    CHECK_EQUAL(cube->getVertexCount(), sm.getVertexCount());
+    for (size_t i = 0; i < sm.getVertexCount(); ++i) {
+        CHECK_EQUAL(cube->getVectorVertex()[i], sm.getVectorVertex()[i]);
+    }
+    CHECK(cube->getTextureCoordinates() == sm.getTextureCoordinates());
+    CHECK(cube->getInfluences() == sm.getInfluences());
+    CHECK(cube->getFaces() == sm.getFaces());
+    CHECK_EQUAL(1u, sm.getMorphTargets().size());
+    CHECK_EQUAL(CalVector(1, 2, 3), sm.getMorphTargets()[0]->vertexOffsets[0].position.asCalVector());
+
+    for (size_t length = 0; length < data.size(); length += 7) {
+        CalBufferSource truncated(data.data(), length);
+        CHECK(!CalLoader::loadCoreMesh(truncated));
+    }
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// every mesh listed in the .cfg files under data/
+static std::vector<std::string> loadSampleMeshFiles() {
+    const char* const models[] = { "cally", "paladin", "skeleton" };
+
+    std::vector<std::string> files;
+    for (size_t m = 0; m < sizeof(models) / sizeof(*models); ++m) {
+        const std::string directory = std::string("../data/") + models[m] + "/";
+        std::ifstream cfg((directory + models[m] + ".cfg").c_str());
+        std::string line;
+        while (std::getline(cfg, line)) {
+            if (line.compare(0, 5, "mesh=") == 0) {
+                std::string name = line.substr(5);
+                name.erase(name.find_last_not_of(" \r\n\t") + 1);
+                files.push_back(readFile(directory + name));
+            }
+        }
+    }
+    return files;
+}
+
+TEST_F(LoaderFixture, benchmark_binary_mesh_loading_over_sample_data) {
+    const std::vector<std::string> files = loadSampleMeshFiles();
+    if (files.empty()) {
+        printf("sample data not found; skipping mesh loading benchmark\n");
+        return;
+    }
+
+    const int iterations = 10;
+    size_t bytes = 0;
+    size_t vertexCount = 0;
+    const cal3d_uint64 start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < files.size(); ++i) {
+            CalBufferSource cbs(files[i].data(), files[i].size());
+            CalCoreMeshPtr mesh = CalLoader::loadCoreMesh(cbs);
+            CHECK(mesh);
+            bytes += files[i].size();
+            for (size_t s = 0; mesh && s < mesh->submeshes.size(); ++s) {
+                vertexCount += mesh->submeshes[s]->getVertexCount();
+            }
+        }
+    }
+    const cal3d_uint64 cycles = __rdtsc() - start;
+
+    printf("Binary mesh loading over %d files: %d cycles per vertex, %d cycles per KB\n",
+        int(files.size()),
+        int(cycles / vertexCount),
+        int(cycles * 1024 / bytes));
+}
+
+struct SampleFile {
+    std::string type;
+    std::string data;
+};
+
+// every file listed in the .cfg files under data/, by cfg key
+static std::vector<SampleFile> loadSampleFiles() {
+    const char* const models[] = { "cally", "paladin", "skeleton" };
+
+    std::vector<SampleFile> files;
+    for (size_t m = 0; m < sizeof(models) / sizeof(*models); ++m) {
+        const std::string directory = std::string("../data/") + models[m] + "/";
+        std::ifstream cfg((directory + models[m] + ".cfg").c_str());
+        std::string line;
+        while (std::getline(cfg, line)) {
+            const size_t equals = line.find('=');
+            if (line.empty() || line[0] == '#' || equals == std::string::npos) {
+                continue;
+            }
+            SampleFile file;
+            file.type = line.substr(0, equals);
+            std::string name = line.substr(equals + 1);
+            name.erase(name.find_last_not_of(" \r\n\t") + 1);
+            if (file.type != "scale") {
+                file.data = readFile(directory + name);
+                files.push_back(file);
+            }
+        }
+    }
+    return files;
+}
+
+// a summary of whatever file holds, to compare loads
+static std::string loadSummary(const SampleFile& file) {
+    CalBufferSource cbs(file.data.data(), file.data.size());
+    std::ostringstream os;
+    if (file.type == "skeleton") {
+        CalCoreSkeletonPtr skeleton = CalLoader::loadCoreSkeleton(cbs);
+        os << (skeleton ? skeleton->coreBones.size() : 0);
+    } else if (file.type == "animation") {
+        CalCoreAnimationPtr animation = CalLoader::loadCoreAnimation(cbs);
+        os << (animation ? CalSaver::saveCoreAnimationToBuffer(animation) : "");
+    } else if (file.type == "mesh") {
+        CalCoreMeshPtr mesh = CalLoader::loadCoreMesh(cbs);
+        os << (mesh ? CalSaver::saveCoreMeshToBuffer(mesh) : "");
+    } else if (file.type == "material") {
+        CalCoreMaterialPtr material = CalLoader::loadCoreMaterial(cbs);
+        os << (material ? CalSaver::saveCoreMaterialToBuffer(material) : "");
+    }
+    return os.str();
+}
+
+TEST_F(LoaderFixture, concurrent_loads_match_serial_loads) {
+    std::vector<SampleFile> files = loadSampleFiles();
+    if (files.empty()) {
+        printf("sample data not found; skipping concurrent loading test\n");
+        return;
+    }
+
+    // an XML animation too, which parses numbers under ForceCLocale
+    CalBufferSource cbs(fromString(animationText));
+    SampleFile xmlAnimation;
+    xmlAnimation.type = "animation";
+    xmlAnimation.data = CalSaver::saveCoreAnimationXmlToBuffer(CalLoader::loadCoreAnimation(cbs));
+    files.push_back(xmlAnimation);
+
+    // and a compressed animation, for the compressed track headers
+    SampleFile compressedAnimation;
+    compressedAnimation.type = "animation";
+    compressedAnimation.data.assign(hmmmAnimation, hmmmAnimation + sizeof(hmmmAnimation));
+    files.push_back(compressedAnimation);
+
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < files.size(); ++i) {
+        expected.push_back(loadSummary(files[i]));
+        CHECK(!expected.back().empty());
+    }
+
+    const unsigned threadCount = 8;
+    std::vector<int> mismatches(threadCount);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < threadCount; ++t) {
+        threads.push_back(std::thread([&, t] {
+            for (int pass = 0; pass < 2; ++pass) {
+                for (size_t n = 0; n < files.size(); ++n) {
+                    // each thread starts at a different file
+                    const size_t i = (n + t * files.size() / threadCount) % files.size();
+                    if (loadSummary(files[i]) != expected[i]) {
+                        ++mismatches[t];
+                    }
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    for (unsigned t = 0; t < threadCount; ++t) {
+        CHECK_EQUAL(0, mismatches[t]);
+    }
+}
+
+// the buffer saver, the stream saver and a reload agree on whatever file holds
+static bool savesConsistently(const SampleFile& file) {
+    CalBufferSource cbs(file.data.data(), file.data.size());
+    std::string buffer;
+    std::string resaved;
+    std::ostringstream os;
+    if (file.type == "skeleton") {
+        CalCoreSkeletonPtr skeleton = CalLoader::loadCoreSkeleton(cbs);
+        buffer = CalSaver::saveCoreSkeletonToBuffer(skeleton);
+        CalSaver::saveCoreSkeleton(os, skeleton.get());
+        CalBufferSource reload(buffer.data(), buffer.size());
+        resaved = CalSaver::saveCoreSkeletonToBuffer(CalLoader::loadCoreSkeleton(reload));
+    } else if (file.type == "animation") {
+        CalCoreAnimationPtr animation = CalLoader::loadCoreAnimation(cbs);
+        buffer = CalSaver::saveCoreAnimationToBuffer(animation);
+        CalSaver::saveCoreAnimation(os, animation.get());
+        CalBufferSource reload(buffer.data(), buffer.size());
+        resaved = CalSaver::saveCoreAnimationToBuffer(CalLoader::loadCoreAnimation(reload));
+    } else if (file.type == "mesh") {
+        CalCoreMeshPtr mesh = CalLoader::loadCoreMesh(cbs);
+        buffer = CalSaver::saveCoreMeshToBuffer(mesh);
+        CalSaver::saveCoreMesh(os, mesh.get());
+        CalBufferSource reload(buffer.data(), buffer.size());
+        resaved = CalSaver::saveCoreMeshToBuffer(CalLoader::loadCoreMesh(reload));
+    } else if (file.type == "material") {
+        CalCoreMaterialPtr material = CalLoader::loadCoreMaterial(cbs);
+        buffer = CalSaver::saveCoreMaterialToBuffer(material);
+        CalSaver::saveCoreMaterial(os, material.get());
+        CalBufferSource reload(buffer.data(), buffer.size());
+        resaved = CalSaver::saveCoreMaterialToBuffer(CalLoader::loadCoreMaterial(reload));
+    } else {
+        return true;
+    }
+    return !buffer.empty() && buffer == os.str() && buffer == resaved;
+}
+
+TEST_F(LoaderFixture, binary_savers_agree_over_sample_data) {
+    const std::vector<SampleFile> files = loadSampleFiles();
+    for (size_t i = 0; i < files.size(); ++i) {
+        CHECK(savesConsistently(files[i]));
+    }
+
+    CalCoreMorphAnimationPtr morphAnimation(new CalCoreMorphAnimation);
+    morphAnimation->duration = 2.0f;
+    morphAnimation->tracks.push_back(CalCoreMorphTrack());
+    morphAnimation->tracks[0].morphName = "smile";
+    morphAnimation->tracks[0].keyframes.push_back(CalCoreMorphKeyframe(0.0f, 0.25f));
+    morphAnimation->tracks[0].keyframes.push_back(CalCoreMorphKeyframe(1.5f, 1.0f));
+
+    const std::string buffer = CalSaver::saveCoreMorphAnimationToBuffer(morphAnimation);
+    std::ostringstream os;
+    CHECK(CalSaver::saveCoreMorphAnimation(os, morphAnimation.get()));
+    CHECK_EQUAL(os.str(), buffer);
+
+    CalBufferSource cbs(buffer.data(), buffer.size());
+    CalCoreMorphAnimationPtr loaded = CalLoader::loadCoreMorphAnimation(cbs);
+    CHECK(loaded);
+    CHECK_EQUAL(1u, loaded->tracks.size());
+    CHECK_EQUAL("smile", loaded->tracks[0].morphName);
+    CHECK_EQUAL(2u, loaded->tracks[0].keyframes.size());
+    CHECK_EQUAL(1.5f, loaded->tracks[0].keyframes[1].time);
+    CHECK_EQUAL(1.0f, loaded->tracks[0].keyframes[1].weight);
+}
+
+TEST_F(LoaderFixture, benchmark_binary_mesh_saving_over_sample_data) {
+    const std::vector<std::string> files = loadSampleMeshFiles();
+    if (files.empty()) {
+        printf("sample data not found; skipping mesh saving benchmark\n");
+        return;
+    }
+
+    std::vector<CalCoreMeshPtr> meshes;
+    size_t vertexCount = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        CalBufferSource cbs(files[i].data(), files[i].size());
+        meshes.push_back(CalLoader::loadCoreMesh(cbs));
+        for (size_t s = 0; s < meshes.back()->submeshes.size(); ++s) {
+            vertexCount += meshes.back()->submeshes[s]->getVertexCount();
+        }
+    }
+
+    const int iterations = 10;
+    size_t bytes = 0;
+    const cal3d_uint64 start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < meshes.size(); ++i) {
+            bytes += CalSaver::saveCoreMeshToBuffer(meshes[i]).size();
+        }
+    }
+    const cal3d_uint64 cycles = __rdtsc() - start;
+
+    printf("Binary mesh saving over %d files: %d cycles per vertex, %d cycles per KB\n",
+        int(meshes.size()),
+        int(cycles / (vertexCount * iterations)),
+        int(cycles * 1024 / bytes));
+}
+
+TEST_F(LoaderFixture, benchmark_binary_animation_loading_over_sample_data) {
+    std::vector<SampleFile> files = loadSampleFiles();
+    files.erase(
+        std::remove_if(files.begin(), files.end(), [](const SampleFile& f) { return f.type != "animation"; }),
+        files.end());
+    if (files.empty()) {
+        printf("sample data not found; skipping animation loading benchmark\n");
+        return;
+    }
+
+    const int iterations = 10;
+    size_t keyframeCount = 0;
+    const cal3d_uint64 start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < files.size(); ++i) {
+            CalBufferSource cbs(files[i].data.data(), files[i].data.size());
+            CalCoreAnimationPtr animation = CalLoader::loadCoreAnimation(cbs);
+            CHECK(animation);
+            for (size_t t = 0; animation && t < animation->tracks.size(); ++t) {
+                keyframeCount += animation->tracks[t].keyframes.size();
+            }
+        }
+    }
+    const cal3d_uint64 cycles = __rdtsc() - start;
+
+    printf("Binary animation loading over %d files: %d cycles per keyframe\n",
+        int(files.size()),
+        int(cycles / keyframeCount));
+}
+
+// Packs fields lowest bit first, as BitReader unpacks them.
+class BitWriter {
+public:
+    BitWriter()
+        : buffer(0)
+        , bufferedBits(0)
+    {}
+
+    void write(unsigned value, unsigned bits) {
+        buffer |= cal3d_uint64(value) << bufferedBits;
+        bufferedBits += bits;
+        while (bufferedBits >= 8) {
+            bytes.push_back(char(buffer & 0xff));
+            buffer >>= 8;
+            bufferedBits -= 8;
+        }
+    }
+
+    std::string bytes;
+
+private:
+    cal3d_uint64 buffer;
+    unsigned bufferedBits;
+};
+
+static void appendInteger(std::string& s, int value) {
+    for (int i = 0; i < 4; ++i) {
+        s.push_back(char((unsigned(value) >> (8 * i)) & 0xff));
+    }
+}
+
+static void appendFloat(std::string& s, float value) {
+    int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    appendInteger(s, bits);
+}
+
+static unsigned quantizeMagnitude(float f, unsigned bits) {
+    return unsigned(std::min(1.0f, fabsf(f)) * ((1u << bits) - 1) + 0.5f);
+}
+
+static void writeCompressedTranslation(BitWriter& w, const CalVector& t, bool highRange) {
+    const unsigned bits = highRange ? CalLoader::keyframeBitsPerUnsignedPosComponent : CalLoader::keyframeBitsPerUnsignedPosComponentSmall;
+    const float range = highRange ? CalLoader::keyframePosRange : CalLoader::keyframePosRangeSmall;
+    const float components[3] = { t.x, t.y, t.z };
+    for (int i = 0; i < 3; ++i) {
+        w.write(quantizeMagnitude(components[i] / range, bits), bits);
+        w.write(components[i] < 0, 1);
+    }
+    w.write(0, highRange ? CalLoader::keyframeBitsPerPosPadding : CalLoader::keyframeBitsPerPosPaddingSmall);
+}
+
+// the translation decoding CalLoader did with BitReader, for reference
+static CalVector readCompressedTranslation(const unsigned char* p, bool highRange) {
+    const unsigned bits = highRange ? CalLoader::keyframeBitsPerUnsignedPosComponent : CalLoader::keyframeBitsPerUnsignedPosComponentSmall;
+    const float range = highRange ? CalLoader::keyframePosRange : CalLoader::keyframePosRangeSmall;
+    BitReader br(p);
+    float components[3];
+    for (int i = 0; i < 3; ++i) {
+        unsigned value, sign;
+        br.read(&value, bits);
+        br.read(&sign, 1);
+        components[i] = FixedPointToFloatZeroToOne(value, bits) * range;
+        if (sign) {
+            components[i] = -components[i];
+        }
+    }
+    return CalVector(components[0], components[1], components[2]);
+}
+
+static void writeCompressedRotation(BitWriter& w, const CalQuaternion& q, unsigned steps) {
+    // the loader negates w
+    float components[4] = { q.x, q.y, q.z, -q.w };
+    int largest = 0;
+    for (int i = 1; i < 4; ++i) {
+        if (fabsf(components[i]) > fabsf(components[largest])) {
+            largest = i;
+        }
+    }
+    const float sign = components[largest] < 0 ? -1.0f : 1.0f;
+
+    w.write(largest, 2);
+    for (int i = 0; i < 4; ++i) {
+        if (i != largest) {
+            w.write(sign * components[i] < 0, 1);
+            w.write(quantizeMagnitude(components[i], CalLoader::keyframeBitsPerOriComponent), CalLoader::keyframeBitsPerOriComponent);
+        }
+    }
+    w.write(steps, CalLoader::keyframeBitsPerTime);
+}
+
+struct CompressedAnimation {
+    std::string file;
+    // what the reference decoders make of the file's keyframes
+    std::vector<CalCoreTrack::KeyframeList> expected;
+};
+
+// animation, written as a compressed .caf of the given version
+static CompressedAnimation compressAnimation(const CalCoreAnimation& animation, int version) {
+    CompressedAnimation result;
+    std::string& file = result.file;
+    file.append(cal3d::ANIMATION_FILE_MAGIC, 4);
+    appendInteger(file, version);
+    if (cal3d::versionHasCompressionFlag(version)) {
+        appendInteger(file, 1);
+    }
+    appendFloat(file, animation.duration);
+    appendInteger(file, int(animation.tracks.size()));
+
+    for (size_t t = 0; t < animation.tracks.size(); ++t) {
+        const CalCoreTrack& track = animation.tracks[t];
+        bool highRange = false;
+        for (size_t k = 0; k < track.keyframes.size(); ++k) {
+            const CalVector& v = track.keyframes[k].transform.translation;
+            highRange |= std::max(fabsf(v.x), std::max(fabsf(v.y), fabsf(v.z))) >= CalLoader::keyframePosRangeSmall;
+        }
+
+        file.push_back(char(track.coreBoneId & 0xff));
+        file.push_back(char(((track.coreBoneId >> 8) & 0x1f) |
+            (track.translationRequired ? 0x80 : 0) |
+            (highRange ? 0x40 : 0) |
+            (track.translationIsDynamic ? 0x20 : 0)));
+        file.push_back(char(track.keyframes.size() & 0xff));
+        file.push_back(char(track.keyframes.size() >> 8));
+        if (version >= cal3d::FIRST_FILE_VERSION_WITH_SPLINE_TRACKS) {
+            appendInteger(file, 0);
+        }
+
+        CalCoreTrack::KeyframeList expected;
+        CalVector translation = InvalidTranslation;
+        unsigned steps = 0;
+        for (size_t k = 0; k < track.keyframes.size(); ++k) {
+            const CalCoreKeyframe& keyframe = track.keyframes[k];
+            // keep times distinct, so sorting can't reorder keyframes
+            steps = std::max(k ? steps + 1 : 0, unsigned(keyframe.time * 30.0f + 0.5f));
+
+            BitWriter w;
+            const bool writesTranslation = track.translationRequired && (k == 0 || track.translationIsDynamic);
+            if (writesTranslation) {
+                writeCompressedTranslation(w, keyframe.transform.translation, highRange);
+            }
+            writeCompressedRotation(w, keyframe.transform.rotation, steps);
+
+            const unsigned char* p = reinterpret_cast<const unsigned char*>(w.bytes.data());
+            if (writesTranslation) {
+                translation = readCompressedTranslation(p, highRange);
+                p += highRange ? CalLoader::keyframePosBytes : CalLoader::keyframePosBytesSmall;
+            }
+            float q[4];
+            unsigned decodedSteps;
+            ReadQuatAndExtra(p, q, &decodedSteps, CalLoader::keyframeBitsPerOriComponent, CalLoader::keyframeBitsPerTime);
+            expected.push_back(CalCoreKeyframe(decodedSteps / 30.0f, translation, CalQuaternion(q[0], q[1], q[2], -q[3])));
+
+            file += w.bytes;
+        }
+        result.expected.push_back(expected);
+    }
+    return result;
+}
+
+static bool sameBits(const CalCoreKeyframe& a, const CalCoreKeyframe& b) {
+    const cal3d::RotateTranslate& at = a.transform;
+    const cal3d::RotateTranslate& bt = b.transform;
+    return a.time == b.time &&
+        at.translation.x == bt.translation.x && at.translation.y == bt.translation.y && at.translation.z == bt.translation.z &&
+        at.rotation.x == bt.rotation.x && at.rotation.y == bt.rotation.y &&
+        at.rotation.z == bt.rotation.z && at.rotation.w == bt.rotation.w;
+}
+
+static std::vector<CalCoreAnimationPtr> loadSampleAnimations() {
+    const std::vector<SampleFile> files = loadSampleFiles();
+    std::vector<CalCoreAnimationPtr> animations;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (files[i].type == "animation") {
+            CalBufferSource cbs(files[i].data.data(), files[i].data.size());
+            animations.push_back(CalLoader::loadCoreAnimation(cbs));
+        }
+    }
+    return animations;
+}
+
+// tracks with each translation encoding: high range, small range, static
+// and none
+static CalCoreAnimationPtr makeTranslationEncodingAnimation() {
+    CalCoreAnimationPtr animation(new CalCoreAnimation);
+    animation->duration = 1.0f;
+    const float scales[] = { 3000.0f, 100.0f, 20.0f, 5.0f };
+    for (unsigned bone = 0; bone < 4; ++bone) {
+        CalCoreTrack::KeyframeList keyframes;
+        for (int k = 0; k < 30; ++k) {
+            CalQuaternion rotation;
+            rotation.setAxisAngle(CalVector(0.6f, 0.8f, 0.0f), 0.2f * k - 2.0f);
+            const float s = scales[bone];
+            keyframes.push_back(CalCoreKeyframe(k / 30.0f, CalVector(s * sinf(float(k)), -s * 0.5f, s * cosf(k * 0.3f)), rotation));
+        }
+        animation->tracks.push_back(CalCoreTrack(bone, keyframes));
+    }
+    animation->tracks[2].translationIsDynamic = false;
+    animation->tracks[3].translationRequired = false;
+    return animation;
+}
+
+TEST_F(LoaderFixture, compressed_keyframes_decode_as_the_reference_decoders_do) {
+    std::vector<CalCoreAnimationPtr> animations = loadSampleAnimations();
+    if (animations.empty()) {
+        printf("sample data not found; checking synthetic tracks only\n");
+    }
+    animations.push_back(makeTranslationEncodingAnimation());
+
+    // before and after the block decoding of version 6, and with spline flags
+    const int versions[] = {
+        cal3d::FIRST_FILE_VERSION_WITH_ANIMATION_COMPRESSION,
+        cal3d::FIRST_FILE_VERSION_WITH_ANIMATION_COMPRESSION6,
+        cal3d::CURRENT_FILE_VERSION,
+    };
+    for (size_t a = 0; a < animations.size(); ++a) {
+        for (size_t v = 0; v < sizeof(versions) / sizeof(*versions); ++v) {
+            const CompressedAnimation compressed = compressAnimation(*animations[a], versions[v]);
+            CalBufferSource cbs(compressed.file.data(), compressed.file.size());
+            CalCoreAnimationPtr loaded = CalLoader::loadCoreAnimation(cbs);
+            CHECK(loaded);
+            if (!loaded) {
+                continue;
+            }
+
+            CHECK_EQUAL(compressed.expected.size(), loaded->tracks.size());
+            size_t mismatches = 0;
+            for (size_t t = 0; t < loaded->tracks.size(); ++t) {
+                const CalCoreTrack::KeyframeList& keyframes = loaded->tracks[t].keyframes;
+                CHECK_EQUAL(compressed.expected[t].size(), keyframes.size());
+                for (size_t k = 0; k < keyframes.size() && k < compressed.expected[t].size(); ++k) {
+                    mismatches += !sameBits(compressed.expected[t][k], keyframes[k]);
+                }
+            }
+            CHECK_EQUAL(0u, mismatches);
+
+            CalBufferSource truncated(compressed.file.data(), compressed.file.size() - 1);
+            CHECK(!CalLoader::loadCoreAnimation(truncated));
+        }
+    }
+}
+
+TEST_F(LoaderFixture, benchmark_compressed_animation_loading_over_sample_data) {
+    const std::vector<CalCoreAnimationPtr> animations = loadSampleAnimations();
+    if (animations.empty()) {
+        printf("sample data not found; skipping compressed animation loading benchmark\n");
+        return;
+    }
+
+    std::vector<std::string> files;
+    for (size_t i = 0; i < animations.size(); ++i) {
+        files.push_back(compressAnimation(*animations[i], cal3d::CURRENT_FILE_VERSION).file);
+    }
+
+    const int iterations = 20;
+    size_t keyframeCount = 0;
+    const cal3d_uint64 start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < files.size(); ++i) {
+            CalBufferSource cbs(files[i].data(), files[i].size());
+            CalCoreAnimationPtr animation = CalLoader::loadCoreAnimation(cbs);
+            CHECK(animation);
+            for (size_t t = 0; animation && t < animation->tracks.size(); ++t) {
+                keyframeCount += animation->tracks[t].keyframes.size();
+            }
+        }
+    }
+    const cal3d_uint64 cycles = __rdtsc() - start;
+
+    printf("Compressed animation loading over %d files: %d cycles per keyframe\n",
+        int(files.size()),
+        int(cycles / keyframeCount));
+}
+
+// parseFloat must agree with sscanf in every bit and in where it stops
+static bool parsesAsSscanf(const char* text) {
+    float expected = 12345.0f;
+    int length = 0;
+    const bool scanned = sscanf(text, " %f%n", &expected, &length) == 1;
+
+    float actual = 12345.0f;
+    const char* end = cal3d::parseFloat(text, &actual);
+    if (!scanned) {
+        return !end;
+    }
+    return end == text + length && 0 == memcmp(&expected, &actual, sizeof(float));
+}
+
+TEST(parse_float_matches_sscanf) {
+    const char* const special[] = {
+        "0", "-0", "+1.5", ".5", "5.", "-.25e1", "1e", "1e+", "2E-3x", " \t\n 7",
+        "nan", "-inf", "infinity", "0x1p3", "junk", "", "-", ".", "1.5 2.5",
+        "3.4028235e38", "3.4028236e38", "1e39", "1.17549435e-38", "1e-39", "1e-46",
+        "0.000000000000000000000000000000000000000000001",
+        "123456789012345678901234567890", "1.00000005960464477539062500000001",
+        "16777217", "0.1", "1e22", "1e23", "9007199254740993",
+    };
+    for (size_t i = 0; i < sizeof(special) / sizeof(*special); ++i) {
+        CHECK(parsesAsSscanf(special[i]));
+    }
+
+    const char* const formats[] = { "%g", "%.6f", "%.9g", "%.17g", "%e", "%.3e" };
+    unsigned state = 1;
+    for (int n = 0; n < 200000; ++n) {
+        state = state * 1664525 + 1013904223;
+        float f;
+        memcpy(&f, &state, sizeof(f));
+        if (f != f || f - f != 0.0f) {
+            continue;
+        }
+        char text[64];
+        sprintf(text, formats[n % (sizeof(formats) / sizeof(*formats))], f);
+        if (!parsesAsSscanf(text)) {
+            CHECK_EQUAL("", text);
+        }
+    }
+}
+
+// Coordinates are multiples of 1/8 below 1024, so they survive the XML
+// saver's six significant digits.
+static CalCoreSubmeshPtr makeGridSubmesh(int columns, int rows, int material) {
+    CalCoreSubmeshPtr submesh(new CalCoreSubmesh(columns * rows, true, 2 * (columns - 1) * (rows - 1)));
+    submesh->coreMaterialThreadId = material;
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < columns; ++x) {
+            CalCoreSubmesh::Vertex vertex;
+            vertex.position = CalPoint4(x * 0.25f, y * 0.125f, float(material));
+            vertex.normal = CalVector4(0, 0, 1, 0);
+            std::vector<CalCoreSubmesh::Influence> influences;
+            influences.push_back(CalCoreSubmesh::Influence(x % 4, 0.75f, false));
+            influences.push_back(CalCoreSubmesh::Influence(4 + y % 4, 0.25f, true));
+            submesh->addVertex(vertex, CalMakeColor(CalVector(1, 1, 0)), influences);
+            submesh->setTextureCoordinate(y * columns + x, CalCoreSubmesh::TextureCoordinate(x * 0.125f, y * 0.0625f));
+        }
+    }
+    for (int y = 0; y + 1 < rows; ++y) {
+        for (int x = 0; x + 1 < columns; ++x) {
+            const int v = y * columns + x;
+            submesh->addFace(CalCoreSubmesh::Face(v, v + 1, v + columns));
+            submesh->addFace(CalCoreSubmesh::Face(v + 1, v + columns + 1, v + columns));
+        }
+    }
+    return submesh;
+}
+
+// large enough that the submeshes are converted in parallel when threads
+// are asked for
+static CalCoreMeshPtr makeGridMesh() {
+    CalCoreMeshPtr mesh(new CalCoreMesh);
+    for (int material = 0; material < 4; ++material) {
+        mesh->submeshes.push_back(makeGridSubmesh(64, 32 + material, material));
+    }
+    return mesh;
+}
+
+TEST_F(LoaderFixture, xml_mesh_round_trips_every_submesh) {
+    CalCoreMeshPtr mesh = makeGridMesh();
+    std::ostringstream os;
+    CalSaver::saveXmlCoreMesh(os, mesh.get());
+    const std::string xml = os.str();
+
+    CalBufferSource cbs(xml.data(), xml.size());
+    CalCoreMeshPtr loaded = CalLoader::loadCoreMesh(cbs, 4);
+    CHECK(loaded);
+    CHECK_EQUAL(mesh->submeshes.size(), loaded->submeshes.size());
+    for (size_t s = 0; loaded && s < loaded->submeshes.size(); ++s) {
+        const CalCoreSubmesh& expected = *mesh->submeshes[s];
+        const CalCoreSubmesh& actual = *loaded->submeshes[s];
+        CHECK_EQUAL(expected.coreMaterialThreadId, actual.coreMaterialThreadId);
+        CHECK_EQUAL(expected.getVertexCount(), actual.getVertexCount());
+        CHECK(std::equal(expected.getVectorVertex().begin(), expected.getVectorVertex().end(), actual.getVectorVertex().begin()));
+        CHECK(expected.getVertexColors() == actual.getVertexColors());
+        CHECK(expected.getTextureCoordinates() == actual.getTextureCoordinates());
+        CHECK(expected.getInfluences() == actual.getInfluences());
+        CHECK(expected.getFaces() == actual.getFaces());
+    }
+}
+
+TEST_F(LoaderFixture, xml_mesh_with_one_bad_submesh_fails_on_the_calling_thread) {
+    CalCoreMeshPtr mesh = makeGridMesh();
+    std::ostringstream os;
+    CalSaver::saveXmlCoreMesh(os, mesh.get());
+    std::string xml = os.str();
+
+    // a negative influence count in the third submesh
+    size_t submesh = xml.find("<SUBMESH");
+    submesh = xml.find("<SUBMESH", submesh + 1);
+    submesh = xml.find("<SUBMESH", submesh + 1);
+    const char count[] = "NUMINFLUENCES=\"2\"";
+    const size_t at = xml.find(count, submesh);
+    CHECK(submesh != std::string::npos && at != std::string::npos);
+    xml.replace(at, sizeof(count) - 1, "NUMINFLUENCES=\"-1\"");
+
+    CalError::setLastError(CalError::OK, __FILE__, __LINE__);
+    CalBufferSource cbs(xml.data(), xml.size());
+    CHECK(!CalLoader::loadCoreMesh(cbs, 4));
+    CHECK_EQUAL(CalError::INVALID_FILE_FORMAT, CalError::getLastErrorCode());
+}
+
+TEST_F(LoaderFixture, benchmark_xml_mesh_loading_over_sample_data) {
+    const std::vector<std::string> files = loadSampleMeshFiles();
+    if (files.empty()) {
+        printf("sample data not found; skipping XML mesh loading benchmark\n");
+        return;
+    }
+
+    std::vector<std::string> xmlFiles;
+    for (size_t i = 0; i < files.size(); ++i) {
+        CalBufferSource cbs(files[i].data(), files[i].size());
+        CalCoreMeshPtr mesh = CalLoader::loadCoreMesh(cbs);
+        std::ostringstream os;
+        CalSaver::saveXmlCoreMesh(os, mesh.get());
+        xmlFiles.push_back(os.str());
+    }
+    // one large mesh, as the parallel path sees it
+    std::ostringstream grid;
+    CalSaver::saveXmlCoreMesh(grid, makeGridMesh().get());
+    xmlFiles.push_back(grid.str());
+
+    const int iterations = 3;
+    size_t bytes = 0;
+    size_t vertexCount = 0;
+    const cal3d_uint64 start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < xmlFiles.size(); ++i) {
+            CalBufferSource cbs(xmlFiles[i].data(), xmlFiles[i].size());
+            CalCoreMeshPtr mesh = CalLoader::loadCoreMesh(cbs, 0);
+            CHECK(mesh);
+            bytes += xmlFiles[i].size();
+            for (size_t s = 0; mesh && s < mesh->submeshes.size(); ++s) {
+                vertexCount += mesh->submeshes[s]->getVertexCount();
+            }
+        }
+    }
+    const cal3d_uint64 cycles = __rdtsc() - start;
+
+    printf("XML mesh loading over %d files: %d cycles per vertex, %d cycles per KB\n",
+        int(xmlFiles.size()),
+        int(cycles / vertexCount),
+        int(cycles * 1024 / bytes));
+}
@@ -3,6 +3,7 @@
 #include <cal3d/coreanimation.h>
 #include <cal3d/coreskeleton.h>
 #include <cal3d/mixer.h>
+#include <cal3d/posesamplecache.h>
 #include <cal3d/skeleton.h>
 
 FIXTURE(MixerFixture) {
@@ -87,3 +88,275 @@ TEST_F(MixerFixture, second_high_priority_trumps_first) {
     updateSkeleton();
     CHECK_EQUAL(CalVector(-1, -1, -1), skeleton.bones[0].absoluteTransform.translation);
 }
+
+TEST_F(MixerFixture, equal_weight_low_priority_animations_average) {
+    CalAnimationPtr first(makeAnimation(CalVector(1, 1, 1), 0));
+    CalAnimationPtr second(makeAnimation(CalVector(3, 3, 3), 0));
+
+    mixer.addAnimation(first);
+    mixer.addAnimation(second);
+
+    updateSkeleton();
+    CHECK_EQUAL(CalVector(2, 2, 2), skeleton.bones[0].absoluteTransform.translation);
+}
+
+TEST_F(MixerFixture, partially_ramped_replace_animation_blends_with_lower_priority) {
+    CalAnimationPtr low(makeAnimation(CalVector(10, 10, 10), 0));
+    CalAnimationPtr high(makeAnimation(CalVector(2, 2, 2), 1));
+    high->rampValue = 0.8f;
+
+    mixer.addAnimation(low);
+    mixer.addAnimation(high);
+
+    updateSkeleton();
+    CHECK_EQUAL(CalVector(3.6f, 3.6f, 3.6f), skeleton.bones[0].absoluteTransform.translation);
+}
+
+TEST_F(MixerFixture, bone_adjustment_replaces_animation_rotation) {
+    CalAnimationPtr anim(makeAnimation(CalVector(1, 1, 1), 1));
+    mixer.addAnimation(anim);
+
+    CalQuaternion aboutZ;
+    aboutZ.setAxisAngle(CalVector(0, 0, 1), 3.1415927410125732421875f / 2.0f);
+
+    BoneTransformAdjustment adjustment;
+    adjustment.boneId = 0;
+    adjustment.localOri = aboutZ;
+    adjustment.rampValue = 1.0f;
+
+    mixer.updateSkeleton(
+        &skeleton,
+        std::vector<BoneTransformAdjustment>(1, adjustment),
+        std::vector<BoneScaleAdjustment>());
+
+    CHECK_EQUAL(aboutZ, skeleton.bones[0].getRelativeTransform().rotation);
+    CHECK_EQUAL(CalVector(0, 0, 0), skeleton.bones[0].absoluteTransform.translation);
+}
+
+TEST_F(MixerFixture, opposite_hemisphere_quaternions_blend_to_same_rotation) {
+    CalQuaternion aboutZ;
+    aboutZ.setAxisAngle(CalVector(0, 0, 1), 1.0f);
+    CalQuaternion negated(-aboutZ.x, -aboutZ.y, -aboutZ.z, -aboutZ.w);
+
+    CalCoreTrack::KeyframeList k1;
+    k1.push_back(CalCoreKeyframe(0, CalVector(), aboutZ));
+    CalCoreTrack::KeyframeList k2;
+    k2.push_back(CalCoreKeyframe(0, CalVector(), negated));
+
+    CalCoreAnimationPtr c1(new CalCoreAnimation());
+    c1->tracks.push_back(CalCoreTrack(0, k1));
+    CalCoreAnimationPtr c2(new CalCoreAnimation());
+    c2->tracks.push_back(CalCoreTrack(0, k2));
+
+    mixer.addAnimation(CalAnimationPtr(new CalAnimation(c1, 1.0f, 0)));
+    mixer.addAnimation(CalAnimationPtr(new CalAnimation(c2, 1.0f, 0)));
+    updateSkeleton();
+
+    // q and -q are the same rotation; the blend must not cancel them out
+    CHECK_CLOSE(1.0f, fabsf(dot(aboutZ, skeleton.bones[0].getRelativeTransform().rotation)), 0.0001f);
+}
+
+TEST_F(MixerFixture, removing_animation_by_handle_leaves_others_active) {
+    CalAnimationPtr low(makeAnimation(CalVector(1, 1, 1), 0));
+    CalAnimationPtr high(makeAnimation(CalVector(-1, -1, -1), 1));
+
+    CalMixer::AnimationHandle lowHandle = mixer.addAnimation(low);
+    CalMixer::AnimationHandle highHandle = mixer.addAnimation(high);
+    CHECK(lowHandle != highHandle);
+    CHECK_EQUAL(2u, mixer.getAnimationCount());
+
+    mixer.removeAnimation(highHandle);
+    CHECK_EQUAL(1u, mixer.getAnimationCount());
+    CHECK(0 == mixer.getAnimation(highHandle));
+    CHECK(low.get() == mixer.getAnimation(lowHandle));
+
+    updateSkeleton();
+    CHECK_EQUAL(CalVector(1, 1, 1), skeleton.bones[0].absoluteTransform.translation);
+}
+
+TEST_F(MixerFixture, handles_are_not_reused_after_removal) {
+    CalAnimationPtr anim(makeAnimation(CalVector(1, 1, 1), 0));
+
+    CalMixer::AnimationHandle first = mixer.addAnimation(anim);
+    mixer.removeAnimation(first);
+    CalMixer::AnimationHandle second = mixer.addAnimation(anim);
+
+    CHECK(first != second);
+    CHECK(0 == mixer.getAnimation(first));
+    CHECK(anim.get() == mixer.getAnimation(second));
+}
+
+TEST_F(MixerFixture, removing_animation_by_pointer_removes_it) {
+    CalAnimationPtr anim(makeAnimation(CalVector(1, 1, 1), 0));
+
+    mixer.addAnimation(anim);
+    mixer.removeAnimation(anim);
+    CHECK_EQUAL(0u, mixer.getAnimationCount());
+
+    updateSkeleton();
+    CHECK_EQUAL(cal3d::Transform(), skeleton.bones[0].absoluteTransform);
+}
+
+TEST_F(MixerFixture, track_without_required_translation_uses_bind_translation) {
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0, InvalidTranslation, CalQuaternion()));
+    CalCoreTrack track(0, keyframes);
+    track.translationRequired = false;
+
+    CalCoreAnimationPtr coreAnimation(new CalCoreAnimation());
+    coreAnimation->tracks.push_back(track);
+    mixer.addAnimation(CalAnimationPtr(new CalAnimation(coreAnimation, 1.0f, 0)));
+
+    updateSkeleton();
+    CHECK_EQUAL(skeleton.bones[0].getOriginalTranslation(), skeleton.bones[0].absoluteTransform.translation);
+}
+
+TEST_F(MixerFixture, track_with_constant_translation_uses_first_keyframe) {
+    CalQuaternion aboutZ;
+    aboutZ.setAxisAngle(CalVector(0, 0, 1), 1.0f);
+
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0, CalVector(1, 2, 3), CalQuaternion()));
+    keyframes.push_back(CalCoreKeyframe(1, CalVector(1, 2, 3), aboutZ));
+    CalCoreTrack track(0, keyframes);
+    track.translationIsDynamic = false;
+
+    CalCoreAnimationPtr coreAnimation(new CalCoreAnimation());
+    coreAnimation->tracks.push_back(track);
+    CalAnimationPtr anim(new CalAnimation(coreAnimation, 1.0f, 0));
+    anim->time = 0.5f;
+    mixer.addAnimation(anim);
+
+    updateSkeleton();
+    CHECK_EQUAL(CalVector(1, 2, 3), skeleton.bones[0].absoluteTransform.translation);
+    CHECK_EQUAL(track.getCurrentRotation(0.5f), skeleton.bones[0].getRelativeTransform().rotation);
+}
+
+FIXTURE(BoneQueryFixture) {
+    SETUP(BoneQueryFixture)
+        : skeleton(makeArmAndLegSkeleton())
+    {}
+
+    // root -> arm -> hand, plus a leg off the root
+    static CalCoreSkeletonPtr makeArmAndLegSkeleton() {
+        const int parents[] = { -1, 0, 1, 0 };
+        return MakeChainSkeleton(4, parents);
+    }
+
+    static CalAnimationPtr makeTurn(unsigned boneId, float angle, unsigned priority) {
+        CalQuaternion start;
+        CalQuaternion end;
+        end.setAxisAngle(CalVector(0, 0, 1), angle);
+
+        CalCoreTrack::KeyframeList keyframes;
+        keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(1, 2, 3), start));
+        keyframes.push_back(CalCoreKeyframe(1.0f, CalVector(3, 2, 1), end));
+
+        CalCoreAnimationPtr coreAnimation(new CalCoreAnimation);
+        coreAnimation->duration = 1.0f;
+        coreAnimation->tracks.push_back(CalCoreTrack(boneId, keyframes));
+        return CalAnimationPtr(new CalAnimation(coreAnimation, 1.0f, priority));
+    }
+
+    void checkClose(const cal3d::Transform& expected, const cal3d::Transform& actual) {
+        CHECK_CLOSE(expected.translation.x, actual.translation.x, 0.0001f);
+        CHECK_CLOSE(expected.translation.y, actual.translation.y, 0.0001f);
+        CHECK_CLOSE(expected.translation.z, actual.translation.z, 0.0001f);
+        CHECK_CLOSE(expected.basis.cx.x, actual.basis.cx.x, 0.0001f);
+        CHECK_CLOSE(expected.basis.cx.y, actual.basis.cx.y, 0.0001f);
+        CHECK_CLOSE(expected.basis.cy.x, actual.basis.cy.x, 0.0001f);
+    }
+
+    CalSkeleton skeleton;
+    CalMixer mixer;
+    std::vector<BoneTransformAdjustment> boneTransformAdjustments;
+    std::vector<BoneScaleAdjustment> boneScaleAdjustments;
+};
+
+TEST_F(BoneQueryFixture, single_bone_query_matches_full_update) {
+    CalAnimationPtr arm = makeTurn(1, 1.0f, 0);
+    CalAnimationPtr hand = makeTurn(2, -0.5f, 1);
+    arm->time = 0.5f;
+    hand->time = 0.25f;
+    hand->rampValue = 0.5f;
+    mixer.addAnimation(arm);
+    mixer.addAnimation(hand);
+    mixer.addAnimation(makeTurn(2, 2.0f, 0));
+
+    BoneTransformAdjustment adjustment;
+    adjustment.boneId = 0;
+    adjustment.localOri.setAxisAngle(CalVector(1, 0, 0), 0.3f);
+    adjustment.rampValue = 1.0f;
+    boneTransformAdjustments.push_back(adjustment);
+    boneScaleAdjustments.push_back(BoneScaleAdjustment(1, CalVector(2, 1, 1)));
+
+    const cal3d::Transform queried = mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments);
+    mixer.updateSkeleton(&skeleton, boneTransformAdjustments, boneScaleAdjustments);
+
+    checkClose(skeleton.bones[2].absoluteTransform, queried);
+}
+
+TEST_F(BoneQueryFixture, single_bone_query_blends_every_track_for_the_bone) {
+    CalAnimationPtr arm = makeTurn(1, 1.0f, 0);
+    CalQuaternion back;
+    back.setAxisAngle(CalVector(0, 0, 1), -2.0f);
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(0, 1, 0), back));
+    // a second track for the arm, behind one for the leg
+    arm->coreAnimation->tracks.push_back(CalCoreTrack(3, keyframes));
+    arm->coreAnimation->tracks.push_back(CalCoreTrack(1, keyframes));
+    arm->coreAnimation->buildTrackTable();
+    arm->time = 0.5f;
+    mixer.addAnimation(arm);
+
+    const cal3d::Transform queried = mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments);
+    mixer.updateSkeleton(&skeleton, boneTransformAdjustments, boneScaleAdjustments);
+
+    checkClose(skeleton.bones[2].absoluteTransform, queried);
+}
+
+TEST_F(BoneQueryFixture, single_bone_query_samples_through_the_pose_cache) {
+    CalAnimationPtr arm = makeTurn(1, 1.0f, 0);
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(0, 1, 0), CalQuaternion()));
+    arm->coreAnimation->tracks.push_back(CalCoreTrack(1, keyframes));
+    arm->coreAnimation->buildTrackTable();
+    // between two steps of the cache's quantum
+    arm->time = 0.3f;
+    mixer.setPoseSampleCache(CalPoseSampleCachePtr(new CalPoseSampleCache(4, 0.25f)));
+    mixer.addAnimation(arm);
+
+    const cal3d::Transform queried = mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments);
+    mixer.updateSkeleton(&skeleton, boneTransformAdjustments, boneScaleAdjustments);
+
+    checkClose(skeleton.bones[2].absoluteTransform, queried);
+}
+
+TEST_F(BoneQueryFixture, query_is_cached_until_cleared) {
+    CalAnimationPtr arm = makeTurn(1, 1.0f, 0);
+    mixer.addAnimation(arm);
+
+    const cal3d::Transform before = mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments);
+
+    arm->time = 1.0f;
+    CHECK_EQUAL(before, mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments));
+
+    mixer.clearBoneQueryCache();
+    const cal3d::Transform after = mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments);
+    CHECK(!(before == after));
+
+    mixer.updateSkeleton(&skeleton, boneTransformAdjustments, boneScaleAdjustments);
+    checkClose(skeleton.bones[2].absoluteTransform, after);
+}
+
+TEST_F(BoneQueryFixture, changing_animations_invalidates_queries) {
+    const cal3d::Transform bind = mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments);
+    CHECK_EQUAL(CalVector(2, 3, 0), bind.translation);
+
+    CalAnimationPtr arm = makeTurn(1, 1.0f, 0);
+    CalMixer::AnimationHandle handle = mixer.addAnimation(arm);
+    CHECK(!(bind == mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments)));
+
+    mixer.removeAnimation(handle);
+    CHECK_EQUAL(bind, mixer.getBoneAbsoluteTransform(&skeleton, 2, boneTransformAdjustments, boneScaleAdjustments));
+}
@@ -0,0 +1,106 @@
+#include "TestPrologue.h"
+#include <cal3d/coremorphanimation.h>
+#include <cal3d/coremorphkeyframe.h>
+#include <cal3d/coremorphtrack.h>
+#include <cal3d/morphsampler.h>
+
+FIXTURE(MorphSamplerFixture) {
+    SETUP(MorphSamplerFixture)
+        : animation(new CalCoreMorphAnimation)
+    {
+        animation->duration = 4.0f;
+        for (int i = 0; i < 6; ++i) {
+            CalCoreMorphTrack::MorphKeyframeList keyframes;
+            for (int k = 0; k <= 4 + i; ++k) {
+                keyframes.push_back(CalCoreMorphKeyframe(k * 4.0f / (4 + i), float((k * 7 + i) % 5) / 4.0f));
+            }
+            animation->tracks.push_back(CalCoreMorphTrack("morph", keyframes));
+        }
+    }
+
+    void checkMatchesGetState(CalMorphSampler& sampler, float time) {
+        const float* weights = sampler.sample(time);
+        for (size_t i = 0; i < animation->tracks.size(); ++i) {
+            CHECK_CLOSE(animation->tracks[i].getState(time), weights[i], 1e-5f);
+        }
+    }
+
+    CalCoreMorphAnimationPtr animation;
+};
+
+TEST_F(MorphSamplerFixture, matches_get_state_during_playback) {
+    CalMorphSampler sampler(animation);
+    CHECK_EQUAL(6u, sampler.getTrackCount());
+    for (float time = 0.0f; time <= 4.0f; time += 1.0f / 30.0f) {
+        checkMatchesGetState(sampler, time);
+    }
+}
+
+TEST_F(MorphSamplerFixture, matches_get_state_when_seeking) {
+    CalMorphSampler sampler(animation);
+    const float times[] = { 3.9f, 0.1f, -1.0f, 2.0f, 1.0f, 10.0f, 4.0f, 0.0f, 2.5f };
+    for (size_t i = 0; i < sizeof(times) / sizeof(*times); ++i) {
+        checkMatchesGetState(sampler, times[i]);
+    }
+}
+
+TEST_F(MorphSamplerFixture, repeated_keyframe_times_step_like_get_state) {
+    CalCoreMorphTrack::MorphKeyframeList keyframes;
+    keyframes.push_back(CalCoreMorphKeyframe(0.0f, 0.0f));
+    keyframes.push_back(CalCoreMorphKeyframe(1.0f, 0.5f));
+    keyframes.push_back(CalCoreMorphKeyframe(1.0f, 1.0f));
+    keyframes.push_back(CalCoreMorphKeyframe(2.0f, 0.0f));
+    animation->tracks.push_back(CalCoreMorphTrack("step", keyframes));
+
+    CalMorphSampler sampler(animation);
+    const float times[] = { 0.5f, 0.999f, 1.0f, 1.5f, 0.75f };
+    for (size_t i = 0; i < sizeof(times) / sizeof(*times); ++i) {
+        checkMatchesGetState(sampler, times[i]);
+    }
+}
+
+TEST_F(MorphSamplerFixture, empty_tracks_sample_zero) {
+    CalCoreMorphAnimationPtr empty(new CalCoreMorphAnimation);
+    empty->tracks.push_back(CalCoreMorphTrack());
+
+    CalMorphSampler sampler(empty);
+    CHECK_EQUAL(0.0f, sampler.sample(1.0f)[0]);
+
+    CalMorphSampler noTracks(CalCoreMorphAnimationPtr(new CalCoreMorphAnimation));
+    CHECK(noTracks.sample(1.0f));
+}
+
+TEST_F(MorphSamplerFixture, benchmark_against_get_state) {
+    CalCoreMorphAnimationPtr face(new CalCoreMorphAnimation);
+    for (int i = 0; i < 64; ++i) {
+        CalCoreMorphTrack::MorphKeyframeList keyframes;
+        for (int k = 0; k < 120; ++k) {
+            keyframes.push_back(CalCoreMorphKeyframe(k / 30.0f, float((k + i) % 7) / 7.0f));
+        }
+        face->tracks.push_back(CalCoreMorphTrack("channel", keyframes));
+    }
+
+    const int frameCount = 120;
+    std::vector<float> weights(face->tracks.size());
+    cal3d_uint64 start = __rdtsc();
+    for (int f = 0; f < frameCount; ++f) {
+        const float time = f / 30.0f;
+        for (size_t i = 0; i < face->tracks.size(); ++i) {
+            weights[i] = face->tracks[i].getState(time);
+        }
+    }
+    const cal3d_uint64 getStateCycles = __rdtsc() - start;
+
+    CalMorphSampler sampler(face);
+    float sum = 0.0f;
+    start = __rdtsc();
+    for (int f = 0; f < frameCount; ++f) {
+        sum += sampler.sample(f / 30.0f)[0];
+    }
+    const cal3d_uint64 samplerCycles = __rdtsc() - start;
+
+    CHECK(sum >= 0.0f);
+    printf("Cycles per morph track sample: getState %d, CalMorphSampler %d\n",
+        int(getStateCycles / (frameCount * face->tracks.size())),
+        int(samplerCycles / (frameCount * face->tracks.size())));
+}
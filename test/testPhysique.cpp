@@ -6,18 +6,6 @@
 
 #include <cstring>
 
-#if defined(_MSC_VER)
-#   include <intrin.h>
-#else
-
-inline cal3d_uint64 __rdtsc(void) {
-    cal3d_uint64 myvar;
-    __asm__ volatile("rdtsc \n\t" : "=A"(myvar));
-    return myvar;
-}
-
-#endif
-
 FIXTURE(PhysiqueFixture) {
 };
 
@@ -0,0 +1,171 @@
+#include "TestPrologue.h"
+#include <cal3d/bone.h>
+#include <cal3d/coreanimation.h>
+#include <cal3d/corebone.h>
+#include <cal3d/coreskeleton.h>
+#include <cal3d/coretrack.h>
+#include <cal3d/mixer.h>
+#include <cal3d/pose.h>
+#include <cal3d/skeleton.h>
+
+FIXTURE(PoseFixture) {
+    SETUP(PoseFixture)
+        : coreSkeleton(MakeChainSkeleton(6))
+        , skeleton(coreSkeleton)
+    {}
+
+    // every bone rotated by angle about z and moved along x
+    static CalCoreAnimationPtr makeBend(unsigned boneCount, float angle) {
+        CalCoreAnimationPtr animation(new CalCoreAnimation());
+        animation->duration = 1.0f;
+        for (unsigned i = 0; i < boneCount; ++i) {
+            CalQuaternion rotation;
+            rotation.setAxisAngle(CalVector(0, 0, 1), angle);
+            CalCoreTrack::KeyframeList keyframes;
+            keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(angle, 1, 0), rotation));
+            animation->tracks.push_back(CalCoreTrack(i, keyframes));
+        }
+        return animation;
+    }
+
+    CalCoreSkeletonPtr coreSkeleton;
+    CalSkeleton skeleton;
+};
+
+static bool close(const cal3d::RotateTranslate& a, const cal3d::RotateTranslate& b) {
+    return (a.translation - b.translation).length() < 1e-5f &&
+           std::abs(dot(a.rotation, b.rotation)) > 0.99999f;
+}
+
+TEST_F(PoseFixture, sampled_pose_matches_mixer) {
+    CalCoreAnimationPtr bend = makeBend(6, 0.5f);
+    CalMixer mixer;
+    mixer.addAnimation(CalAnimationPtr(new CalAnimation(bend, 1.0f, 0)));
+    mixer.updateSkeleton(&skeleton, std::vector<BoneTransformAdjustment>(), std::vector<BoneScaleAdjustment>());
+    std::vector<cal3d::Transform> expected;
+    for (size_t i = 0; i < skeleton.bones.size(); ++i) {
+        expected.push_back(skeleton.bones[i].absoluteTransform);
+    }
+
+    CalSkeleton posed(coreSkeleton);
+    CalPose pose;
+    pose.sample(&posed, *bend, 0.0f);
+    pose.writeTo(&posed);
+    posed.calculateAbsolutePose();
+
+    for (size_t i = 0; i < posed.bones.size(); ++i) {
+        const cal3d::Transform& actual = posed.bones[i].absoluteTransform;
+        CHECK((expected[i].translation - actual.translation).length() < 1e-5f);
+        CHECK((expected[i].basis.cx - actual.basis.cx).length() < 1e-5f);
+        CHECK((expected[i].basis.cy - actual.basis.cy).length() < 1e-5f);
+        CHECK((expected[i].basis.cz - actual.basis.cz).length() < 1e-5f);
+    }
+}
+
+TEST_F(PoseFixture, blend_matches_two_layer_mixer) {
+    CalCoreAnimationPtr a = makeBend(6, 0.5f);
+    CalCoreAnimationPtr b = makeBend(6, -1.0f);
+    CalMixer mixer;
+    mixer.addAnimation(CalAnimationPtr(new CalAnimation(a, 0.75f, 0)));
+    mixer.addAnimation(CalAnimationPtr(new CalAnimation(b, 0.25f, 0)));
+    mixer.updateSkeleton(&skeleton, std::vector<BoneTransformAdjustment>(), std::vector<BoneScaleAdjustment>());
+
+    CalPose pose;
+    CalPose target;
+    pose.sample(&skeleton, *a, 0.0f);
+    target.sample(&skeleton, *b, 0.0f);
+    pose.blend(target, 0.25f);
+
+    for (size_t i = 0; i < skeleton.bones.size(); ++i) {
+        CHECK(close(skeleton.bones[i].getRelativeTransform(), pose.getTransform(i)));
+    }
+}
+
+TEST_F(PoseFixture, blend_takes_the_shorter_arc) {
+    CalQuaternion rotation;
+    rotation.setAxisAngle(CalVector(1, 0, 0), 1.0f);
+    const CalQuaternion negated(-rotation.x, -rotation.y, -rotation.z, -rotation.w);
+
+    CalPose pose(1);
+    CalPose target(1);
+    pose.setTransform(0, cal3d::RotateTranslate(rotation, CalVector()));
+    target.setTransform(0, cal3d::RotateTranslate(negated, CalVector(2, 0, 0)));
+    pose.blend(target, 0.5f);
+
+    CHECK(close(cal3d::RotateTranslate(rotation, CalVector(1, 0, 0)), pose.getTransform(0)));
+}
+
+TEST_F(PoseFixture, masked_blend_only_moves_weighted_bones) {
+    CalPose pose;
+    CalPose target;
+    pose.setBindPose(&skeleton);
+    target.sample(&skeleton, *makeBend(6, 0.5f), 0.0f);
+
+    std::vector<float> boneWeights(6, 0.0f);
+    boneWeights[1] = 1.0f;
+    boneWeights[5] = 0.5f;
+    pose.blend(target, 1.0f, boneWeights);
+
+    CHECK(close(target.getTransform(1), pose.getTransform(1)));
+    CHECK(close(skeleton.bones[0].getOriginalTransform(), pose.getTransform(0)));
+    CHECK(close(skeleton.bones[4].getOriginalTransform(), pose.getTransform(4)));
+    // halfway from the bind translation, x = 1, to the bend's 0.5
+    CHECK_EQUAL(0.75f, pose.getTransform(5).translation.x);
+}
+
+TEST_F(PoseFixture, difference_added_to_reference_restores_pose) {
+    CalPose reference;
+    CalPose bent;
+    reference.sample(&skeleton, *makeBend(6, 0.25f), 0.0f);
+    bent.sample(&skeleton, *makeBend(6, 1.0f), 0.0f);
+
+    CalPose difference;
+    difference.setDifference(bent, reference);
+
+    CalPose pose;
+    pose.sample(&skeleton, *makeBend(6, 0.25f), 0.0f);
+    pose.add(difference, 0.0f);
+    for (size_t i = 0; i < 6; ++i) {
+        CHECK(close(reference.getTransform(i), pose.getTransform(i)));
+    }
+
+    pose.add(difference, 1.0f);
+    for (size_t i = 0; i < 6; ++i) {
+        CHECK(close(bent.getTransform(i), pose.getTransform(i)));
+    }
+}
+
+TEST_F(PoseFixture, benchmark_blend_against_transform_accumulator) {
+    const size_t boneCount = 64;
+    const int iterations = 1000;
+
+    CalPose pose(boneCount);
+    CalPose target(boneCount);
+    CalQuaternion rotation;
+    rotation.setAxisAngle(CalVector(0, 1, 0), 0.5f);
+    for (size_t i = 0; i < boneCount; ++i) {
+        target.setTransform(i, cal3d::RotateTranslate(rotation, CalVector(1, 2, 3)));
+    }
+
+    cal3d_uint64 start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        pose.blend(target, 0.01f);
+    }
+    const cal3d_uint64 poseCycles = __rdtsc() - start;
+
+    std::vector<cal3d::TransformAccumulator> accumulators(boneCount);
+    const cal3d::RotateTranslate transform(rotation, CalVector(1, 2, 3));
+    start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < boneCount; ++i) {
+            accumulators[i].reset(cal3d::RotateTranslate());
+            accumulators[i].addTransform(0.99f, accumulators[i].getWeightedMean());
+            accumulators[i].addTransform(0.01f, transform);
+        }
+    }
+    const cal3d_uint64 accumulatorCycles = __rdtsc() - start;
+
+    printf("Cycles per bone blend: CalPose %d, TransformAccumulator %d\n",
+        int(poseCycles / (iterations * boneCount)),
+        int(accumulatorCycles / (iterations * boneCount)));
+}
@@ -0,0 +1,145 @@
+#include "TestPrologue.h"
+#include <thread>
+#include <cal3d/animation.h>
+#include <cal3d/coreanimation.h>
+#include <cal3d/corebone.h>
+#include <cal3d/coreskeleton.h>
+#include <cal3d/mixer.h>
+#include <cal3d/posesamplecache.h>
+#include <cal3d/skeleton.h>
+
+// moves bone 0 from x = 0 at t = 0 to x = 1 at t = 1
+static CalCoreAnimationPtr makeSlideAnimation() {
+    CalCoreTrack::KeyframeList keyframes;
+    keyframes.push_back(CalCoreKeyframe(0.0f, CalVector(0, 0, 0), CalQuaternion()));
+    keyframes.push_back(CalCoreKeyframe(1.0f, CalVector(1, 0, 0), CalQuaternion()));
+
+    CalCoreAnimationPtr coreAnimation(new CalCoreAnimation);
+    coreAnimation->duration = 1.0f;
+    coreAnimation->tracks.push_back(CalCoreTrack(0, keyframes));
+    return coreAnimation;
+}
+
+FIXTURE(PoseSampleCacheFixture) {
+    SETUP(PoseSampleCacheFixture)
+        : coreAnimation(makeSlideAnimation())
+        , cache(new CalPoseSampleCache(4, 0.25f))
+    {}
+
+    CalCoreAnimationPtr coreAnimation;
+    CalPoseSampleCachePtr cache;
+};
+
+TEST_F(PoseSampleCacheFixture, nearby_times_share_a_sample) {
+    CalSampledPosePtr first = cache->sample(coreAnimation, 0.5f);
+    CalSampledPosePtr second = cache->sample(coreAnimation, 0.52f);
+
+    CHECK(first == second);
+    CHECK_EQUAL(1u, cache->getMissCount());
+    CHECK_EQUAL(1u, cache->getHitCount());
+    CHECK_EQUAL(1u, first->boneIds.size());
+    CHECK_EQUAL(CalVector(0.5f, 0, 0), first->transforms[0].translation);
+}
+
+TEST_F(PoseSampleCacheFixture, times_are_snapped_to_the_quantum) {
+    CalSampledPosePtr pose = cache->sample(coreAnimation, 0.7f);
+    CHECK_EQUAL(0.75f, pose->time);
+    CHECK_EQUAL(CalVector(0.75f, 0, 0), pose->transforms[0].translation);
+}
+
+TEST_F(PoseSampleCacheFixture, least_recently_used_entry_is_evicted) {
+    CalSampledPosePtr oldest = cache->sample(coreAnimation, 0.0f);
+    cache->sample(coreAnimation, 0.25f);
+    cache->sample(coreAnimation, 0.5f);
+    cache->sample(coreAnimation, 0.75f);
+    cache->sample(coreAnimation, 0.0f); // touch
+    cache->sample(coreAnimation, 1.0f);
+
+    CHECK_EQUAL(4u, cache->getEntryCount());
+    CHECK(oldest == cache->sample(coreAnimation, 0.0f));
+
+    size_t misses = cache->getMissCount();
+    cache->sample(coreAnimation, 0.25f);
+    CHECK_EQUAL(misses + 1, cache->getMissCount());
+}
+
+// records the cache's entry count when the animation is finally released,
+// which would deadlock if it happened under the cache's lock
+struct CountEntriesOnRelease {
+    CalPoseSampleCache* cache;
+    size_t* entryCount;
+
+    void operator()(CalCoreAnimation* animation) const {
+        *entryCount = cache->getEntryCount();
+        delete animation;
+    }
+};
+
+TEST_F(PoseSampleCacheFixture, evicted_animations_are_released_outside_the_lock) {
+    size_t entryCount = 0;
+    CountEntriesOnRelease release = { cache.get(), &entryCount };
+    CalCoreAnimationPtr transient(new CalCoreAnimation(*coreAnimation), release);
+    cache->sample(transient, 0.0f);
+    transient.reset();
+
+    for (int i = 0; i < 4; ++i) {
+        cache->sample(coreAnimation, 0.25f * i);
+    }
+    CHECK_EQUAL(4u, entryCount);
+
+    CalCoreAnimationPtr cleared(new CalCoreAnimation(*coreAnimation), release);
+    cache->sample(cleared, 0.0f);
+    cleared.reset();
+    cache->clear();
+    CHECK_EQUAL(0u, entryCount);
+}
+
+TEST_F(PoseSampleCacheFixture, mixers_sharing_a_cache_match_direct_sampling) {
+    CalCoreSkeletonPtr coreSkeleton(new CalCoreSkeleton);
+    coreSkeleton->addCoreBone(CalCoreBonePtr(new CalCoreBone("root")));
+
+    CalSkeleton direct(coreSkeleton);
+    CalSkeleton cached(coreSkeleton);
+
+    CalAnimationPtr animation(new CalAnimation(coreAnimation, 1.0f, 0));
+    animation->time = 0.25f;
+
+    CalMixer directMixer;
+    directMixer.addAnimation(animation);
+    directMixer.updateSkeleton(&direct, std::vector<BoneTransformAdjustment>(), std::vector<BoneScaleAdjustment>());
+
+    CalMixer cachedMixer;
+    cachedMixer.setPoseSampleCache(cache);
+    cachedMixer.addAnimation(animation);
+    cachedMixer.updateSkeleton(&cached, std::vector<BoneTransformAdjustment>(), std::vector<BoneScaleAdjustment>());
+
+    CHECK_EQUAL(direct.boneTransforms[0], cached.boneTransforms[0]);
+    CHECK_EQUAL(1u, cache->getMissCount());
+}
+
+TEST_F(PoseSampleCacheFixture, concurrent_readers_get_consistent_poses) {
+    const int ThreadCount = 8;
+    const int Iterations = 1000;
+
+    bool ok[ThreadCount];
+    std::vector<std::thread> threads;
+    for (int t = 0; t < ThreadCount; ++t) {
+        ok[t] = true;
+        threads.push_back(std::thread([&, t] {
+            for (int i = 0; i < Iterations; ++i) {
+                const float time = float((i + t) % 5) * 0.25f;
+                CalSampledPosePtr pose = cache->sample(coreAnimation, time);
+                if (!(pose->transforms[0].translation == CalVector(time, 0, 0))) {
+                    ok[t] = false;
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < ThreadCount; ++t) {
+        threads[t].join();
+        CHECK(ok[t]);
+    }
+
+    CHECK(cache->getEntryCount() <= 4u);
+    CHECK_EQUAL(size_t(ThreadCount * Iterations), cache->getHitCount() + cache->getMissCount());
+}
@@ -0,0 +1,291 @@
+#include "TestPrologue.h"
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <cal3d/buffersource.h>
+#include <cal3d/coreanimation.h>
+#include <cal3d/coremesh.h>
+#include <cal3d/coremorphtarget.h>
+#include <cal3d/coresubmesh.h>
+#include <cal3d/coretrack.h>
+#include <cal3d/error.h>
+#include <cal3d/loader.h>
+#include <cal3d/runtimeimage.h>
+
+// runtime images must start 16-byte aligned, as a mapped file does
+static cal3d::SSEArray<char> aligned(const std::string& image) {
+    return cal3d::SSEArray<char>(image.begin(), image.end());
+}
+
+static bool sameVertices(const CalCoreSubmesh& a, const CalCoreSubmesh& b) {
+    return a.getVertexCount() == b.getVertexCount() &&
+        std::equal(a.getVectorVertex().begin(), a.getVectorVertex().end(), b.getVectorVertex().begin());
+}
+
+static bool sameMorphTargets(const CalCoreSubmesh& a, const CalCoreSubmesh& b) {
+    const CalCoreSubmesh::MorphTargetArray& am = a.getMorphTargets();
+    const CalCoreSubmesh::MorphTargetArray& bm = b.getMorphTargets();
+    if (am.size() != bm.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < am.size(); ++i) {
+        if (am[i]->name != bm[i]->name ||
+            am[i]->morphTargetType != bm[i]->morphTargetType ||
+            am[i]->vertexOffsets.size() != bm[i]->vertexOffsets.size()) {
+            return false;
+        }
+        for (size_t v = 0; v < am[i]->vertexOffsets.size(); ++v) {
+            const VertexOffset& ao = am[i]->vertexOffsets[v];
+            const VertexOffset& bo = bm[i]->vertexOffsets[v];
+            if (ao.vertexId != bo.vertexId || !(ao.position == bo.position) || !(ao.normal == bo.normal)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool sameSubmesh(const CalCoreSubmesh& a, const CalCoreSubmesh& b) {
+    return a.coreMaterialThreadId == b.coreMaterialThreadId &&
+        sameVertices(a, b) &&
+        a.getVertexColors() == b.getVertexColors() &&
+        a.getTextureCoordinates() == b.getTextureCoordinates() &&
+        a.getInfluences() == b.getInfluences() &&
+        a.getFaces() == b.getFaces() &&
+        a.isStatic() == b.isStatic() &&
+        a.getMinimumVertexBufferSize() == b.getMinimumVertexBufferSize() &&
+        a.getBoundingVolume().min == b.getBoundingVolume().min &&
+        a.getBoundingVolume().max == b.getBoundingVolume().max &&
+        sameMorphTargets(a, b);
+}
+
+static CalCoreMeshPtr makeMorphingCubes() {
+    CalCoreMeshPtr mesh(new CalCoreMesh);
+    mesh->submeshes.push_back(MakeCube());
+
+    CalCoreSubmeshPtr morphing = MakeCube();
+    CalCoreMorphTarget::VertexOffsetArray offsets;
+    offsets.push_back(VertexOffset(3, CalPoint4(1, 2, 3), CalVector4(0, 1, 0, 0)));
+    offsets.push_back(VertexOffset(7, CalPoint4(-1, 0, 0), CalVector4(0, 0, 1, 0)));
+    morphing->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget("smile.exclusive", morphing->getVertexCount(), offsets)));
+    morphing->coreMaterialThreadId = 2;
+    mesh->submeshes.push_back(morphing);
+    return mesh;
+}
+
+static CalCoreAnimationPtr makeAnimation() {
+    CalCoreAnimationPtr animation(new CalCoreAnimation);
+    animation->duration = 2.0f;
+    for (unsigned bone = 0; bone < 3; ++bone) {
+        CalCoreTrack::KeyframeList keyframes;
+        for (int k = 0; k < 5; ++k) {
+            CalQuaternion rotation;
+            rotation.setAxisAngle(CalVector(0, 0, 1), 0.25f * k + bone);
+            keyframes.push_back(CalCoreKeyframe(0.5f * k, CalVector(float(k), float(bone), 0), rotation));
+        }
+        animation->tracks.push_back(CalCoreTrack(bone * 2, keyframes));
+    }
+    animation->tracks[1].translationRequired = false;
+    animation->tracks[2].splineInterpolated = true;
+    animation->buildTrackTable();
+    return animation;
+}
+
+TEST(runtime_image_round_trips_meshes) {
+    CalCoreMeshPtr mesh = makeMorphingCubes();
+    const cal3d::SSEArray<char> image = aligned(CalRuntimeImage::saveCoreMesh(*mesh));
+
+    CalCoreMeshPtr loaded = CalRuntimeImage::loadCoreMesh(image.data(), image.size());
+    CHECK(loaded);
+    CHECK_EQUAL(2u, loaded->submeshes.size());
+    CHECK(sameSubmesh(*mesh->submeshes[0], *loaded->submeshes[0]));
+    CHECK(sameSubmesh(*mesh->submeshes[1], *loaded->submeshes[1]));
+    CHECK_EQUAL(1u, loaded->submeshes[1]->getMorphTargets().size());
+}
+
+TEST(runtime_image_round_trips_animations) {
+    CalCoreAnimationPtr animation = makeAnimation();
+    const cal3d::SSEArray<char> image = aligned(CalRuntimeImage::saveCoreAnimation(*animation));
+
+    CalCoreAnimationPtr loaded = CalRuntimeImage::loadCoreAnimation(image.data(), image.size());
+    CHECK(loaded);
+    CHECK(*animation == *loaded);
+    CHECK(!loaded->tracks[1].translationRequired);
+    CHECK(loaded->tracks[2].splineInterpolated);
+    CHECK(loaded->getCoreTrack(4) == &loaded->tracks[2]);
+}
+
+TEST(runtime_image_rejects_malformed_images) {
+    const std::string bytes = CalRuntimeImage::saveCoreMesh(*makeMorphingCubes());
+    cal3d::SSEArray<char> image = aligned(bytes);
+
+    // truncated
+    CHECK(!CalRuntimeImage::loadCoreMesh(image.data(), 16));
+    CHECK(!CalRuntimeImage::loadCoreMesh(image.data(), image.size() - 1));
+
+    // wrong kind
+    CHECK(!CalRuntimeImage::loadCoreAnimation(image.data(), image.size()));
+
+    // misaligned
+    cal3d::SSEArray<char> shifted(image.size() + 1);
+    std::copy(image.begin(), image.end(), shifted.begin() + 1);
+    CHECK(!CalRuntimeImage::loadCoreMesh(shifted.data() + 1, image.size()));
+
+    // another version
+    image[4] += 1;
+    CHECK(!CalRuntimeImage::loadCoreMesh(image.data(), image.size()));
+    CHECK_EQUAL(CalError::INCOMPATIBLE_FILE_VERSION, CalError::getLastErrorCode());
+}
+
+static bool loadsAsInvalid(const std::string& bytes) {
+    const cal3d::SSEArray<char> image = aligned(bytes);
+    CalError::setLastError(CalError::OK, __FILE__, __LINE__);
+    return !CalRuntimeImage::loadCoreMesh(image.data(), image.size()) &&
+        CalError::getLastErrorCode() == CalError::INVALID_FILE_FORMAT;
+}
+
+// the image holds the first submesh's influences verbatim; patch one in place
+static std::string withInfluence(const CalCoreMesh& mesh, size_t index, const CalCoreSubmesh::Influence& patched) {
+    std::string bytes = CalRuntimeImage::saveCoreMesh(mesh);
+    const CalCoreSubmesh::InfluenceVector& influences = mesh.submeshes[0]->getInfluences();
+    const size_t offset = bytes.find(std::string(
+        reinterpret_cast<const char*>(&influences[0]),
+        sizeof(influences[0]) * influences.size()));
+    CHECK(offset != std::string::npos);
+    bytes.replace(offset + index * sizeof(patched), sizeof(patched), reinterpret_cast<const char*>(&patched), sizeof(patched));
+    return bytes;
+}
+
+static std::string withInfluenceLastFlag(const CalCoreMesh& mesh, size_t index, unsigned last) {
+    CalCoreSubmesh::Influence patched = mesh.submeshes[0]->getInfluences()[index];
+    patched.lastInfluenceForThisVertex = last;
+    return withInfluence(mesh, index, patched);
+}
+
+TEST(runtime_image_rejects_influences_that_do_not_end_once_per_vertex) {
+    CalCoreMeshPtr mesh = makeMorphingCubes();
+    const size_t influenceCount = mesh->submeshes[0]->getInfluences().size();
+    CHECK(!loadsAsInvalid(withInfluenceLastFlag(*mesh, 0, 1)));
+
+    // a vertex whose run never ends runs into the next vertex's
+    CHECK(loadsAsInvalid(withInfluenceLastFlag(*mesh, 0, 0)));
+    // the final run must end inside the array
+    CHECK(loadsAsInvalid(withInfluenceLastFlag(*mesh, influenceCount - 1, 0)));
+}
+
+TEST(runtime_image_derives_static_influences_from_the_influences) {
+    CalCoreMeshPtr mesh = makeMorphingCubes();
+    CHECK(mesh->submeshes[0]->isStatic());
+
+    CalCoreSubmesh::Influence moved = mesh->submeshes[0]->getInfluences()[5];
+    moved.boneId = 1;
+    const cal3d::SSEArray<char> image = aligned(withInfluence(*mesh, 5, moved));
+    CalCoreMeshPtr loaded = CalRuntimeImage::loadCoreMesh(image.data(), image.size());
+    CHECK(loaded);
+    CHECK(loaded && !loaded->submeshes[0]->isStatic());
+}
+
+TEST(runtime_image_rejects_faces_outside_the_vertices) {
+    CalCoreMeshPtr mesh = makeMorphingCubes();
+    const CalIndex vertexCount = CalIndex(mesh->submeshes[0]->getVertexCount());
+    mesh->submeshes[0]->addFace(CalCoreSubmesh::Face(0, 1, vertexCount));
+    CHECK(loadsAsInvalid(CalRuntimeImage::saveCoreMesh(*mesh)));
+}
+
+TEST(runtime_image_rejects_morphs_of_vertices_outside_the_mesh) {
+    CalCoreMeshPtr mesh = makeMorphingCubes();
+    const size_t vertexCount = mesh->submeshes[0]->getVertexCount();
+    CalCoreMorphTarget::VertexOffsetArray offsets;
+    offsets.push_back(VertexOffset(vertexCount, CalPoint4(1, 2, 3), CalVector4(0, 1, 0, 0)));
+    mesh->submeshes[0]->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget("grow", vertexCount + 1, offsets)));
+    CHECK(loadsAsInvalid(CalRuntimeImage::saveCoreMesh(*mesh)));
+}
+
+TEST(runtime_image_rejects_negative_bone_ids) {
+    CalCoreAnimationPtr animation = makeAnimation();
+    animation->tracks[1].coreBoneId = 0xffffffffu;
+    const cal3d::SSEArray<char> image = aligned(CalRuntimeImage::saveCoreAnimation(*animation));
+    CHECK(!CalRuntimeImage::loadCoreAnimation(image.data(), image.size()));
+    CHECK_EQUAL(CalError::INVALID_FILE_FORMAT, CalError::getLastErrorCode());
+
+    animation->tracks[1].coreBoneId = 0x7fffffffu;
+    const cal3d::SSEArray<char> huge = aligned(CalRuntimeImage::saveCoreAnimation(*animation));
+    CalCoreAnimationPtr loaded = CalRuntimeImage::loadCoreAnimation(huge.data(), huge.size());
+    CHECK(loaded);
+    CHECK(loaded && loaded->getCoreTrack(0x7fffffffu) == &loaded->tracks[1]);
+}
+
+TEST(runtime_image_rejects_bad_durations_and_unsorted_keyframes) {
+    CalCoreAnimationPtr animation = makeAnimation();
+    animation->duration = std::numeric_limits<float>::quiet_NaN();
+    const cal3d::SSEArray<char> nan = aligned(CalRuntimeImage::saveCoreAnimation(*animation));
+    CHECK(!CalRuntimeImage::loadCoreAnimation(nan.data(), nan.size()));
+    CHECK_EQUAL(CalError::INVALID_FILE_FORMAT, CalError::getLastErrorCode());
+
+    animation = makeAnimation();
+    animation->tracks[1].keyframes[3].time = 0.25f;
+    const cal3d::SSEArray<char> unsorted = aligned(CalRuntimeImage::saveCoreAnimation(*animation));
+    CHECK(!CalRuntimeImage::loadCoreAnimation(unsorted.data(), unsorted.size()));
+    CHECK_EQUAL(CalError::INVALID_FILE_FORMAT, CalError::getLastErrorCode());
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TEST(benchmark_runtime_image_against_binary_mesh_loading) {
+    const char* const parts[] = {
+        "calf_left", "calf_right", "chest", "foot_left", "foot_right", "hand_left", "hand_right",
+        "head", "lowerarm_left", "lowerarm_right", "neck", "pelvis", "ponytail",
+        "thigh_left", "thigh_right", "upperarm_left", "upperarm_right",
+    };
+    const size_t partCount = sizeof(parts) / sizeof(*parts);
+
+    std::vector<std::string> files;
+    for (size_t i = 0; i < partCount; ++i) {
+        files.push_back(readFile(std::string("../data/cally/cally_") + parts[i] + ".cmf"));
+        if (files.back().empty()) {
+            printf("sample data not found; skipping runtime image benchmark\n");
+            return;
+        }
+    }
+
+    std::vector<CalCoreMeshPtr> meshes;
+    cal3d_uint64 start = __rdtsc();
+    for (size_t i = 0; i < partCount; ++i) {
+        CalBufferSource source(files[i].data(), files[i].size());
+        meshes.push_back(CalLoader::loadCoreMesh(source));
+    }
+    const cal3d_uint64 binaryCycles = __rdtsc() - start;
+
+    std::vector<std::string> images;
+    for (size_t i = 0; i < partCount; ++i) {
+        images.push_back(CalRuntimeImage::saveCoreMesh(*meshes[i]));
+    }
+    std::vector<cal3d::SSEArray<char>*> mapped;
+    for (size_t i = 0; i < partCount; ++i) {
+        mapped.push_back(new cal3d::SSEArray<char>(images[i].begin(), images[i].end()));
+    }
+
+    std::vector<CalCoreMeshPtr> loaded;
+    start = __rdtsc();
+    for (size_t i = 0; i < partCount; ++i) {
+        loaded.push_back(CalRuntimeImage::loadCoreMesh(mapped[i]->data(), mapped[i]->size()));
+    }
+    const cal3d_uint64 imageCycles = __rdtsc() - start;
+
+    size_t vertexCount = 0;
+    for (size_t i = 0; i < partCount; ++i) {
+        CHECK_EQUAL(meshes[i]->submeshes.size(), loaded[i]->submeshes.size());
+        for (size_t s = 0; s < meshes[i]->submeshes.size(); ++s) {
+            CHECK(sameSubmesh(*meshes[i]->submeshes[s], *loaded[i]->submeshes[s]));
+            vertexCount += meshes[i]->submeshes[s]->getVertexCount();
+        }
+        delete mapped[i];
+    }
+
+    printf("Cycles per vertex loading cally: binary %d, runtime image %d\n",
+        int(binaryCycles / vertexCount),
+        int(imageCycles / vertexCount));
+}
@@ -8,7 +8,9 @@
 #include <cal3d/physique.h>
 #include <cal3d/vector4.h>
 #include <cal3d/coreskeleton.h>
+#include <cal3d/coremorphanimation.h>
 #include <cal3d/coremorphtarget.h>
+#include <cal3d/morphsampler.h>
 
 #include <cmath>
 #include <limits>
@@ -783,3 +785,82 @@ TEST_F(SubmeshFixture, exportInfluences_limits_influences_and_renormalizes) {
     unsigned int expUsedBoneIds4Arr[] = {0, 1, 2, 3};
     CHECK_EQUAL(arrayToVector(expUsedBoneIds4Arr), influences4.usedBoneIds);
 }
+
+static CalCoreSubmeshPtr makeSubmeshWithMorphTargets(const char* first, const char* second) {
+    CalCoreSubmeshPtr csm(new CalCoreSubmesh(1, 0, 0));
+    csm->addVertex(CalCoreSubmesh::Vertex(), CalColor32(), CalCoreSubmesh::InfluenceVector());
+
+    CalCoreMorphTarget::VertexOffsetArray vertexOffsets;
+    VertexOffset mv;
+    mv.vertexId = 0;
+    vertexOffsets.push_back(mv);
+    csm->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget(first, 1, vertexOffsets)));
+    csm->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget(second, 1, vertexOffsets)));
+    return csm;
+}
+
+static CalCoreMorphTrack makeMorphTrack(const char* name, float start, float end) {
+    CalCoreMorphTrack::MorphKeyframeList keyframes;
+    keyframes.push_back(CalCoreMorphKeyframe(0.0f, start));
+    keyframes.push_back(CalCoreMorphKeyframe(1.0f, end));
+    return CalCoreMorphTrack(name, keyframes);
+}
+
+TEST(morph_channel_table_maps_tracks_to_morph_targets) {
+    CalCoreSubmeshPtr csm = makeSubmeshWithMorphTargets("a", "b");
+
+    CalCoreMorphAnimation animation;
+    animation.tracks.push_back(makeMorphTrack("b", 0.0f, 1.0f));
+    animation.tracks.push_back(makeMorphTrack("missing", 0.0f, 1.0f));
+    animation.tracks.push_back(makeMorphTrack("a", 0.0f, 1.0f));
+
+    const std::vector<int> table = animation.getMorphChannelTable(*csm);
+    CHECK_EQUAL(3u, table.size());
+    CHECK_EQUAL(1, table[0]);
+    CHECK_EQUAL(-1, table[1]);
+    CHECK_EQUAL(0, table[2]);
+}
+
+TEST(blending_morph_animation_through_table_matches_blending_by_name) {
+    CalCoreSubmeshPtr csm = makeSubmeshWithMorphTargets("a.Exclusive", "b");
+
+    CalCoreMorphAnimation animation;
+    animation.tracks.push_back(makeMorphTrack("b", 0.0f, 0.8f));
+    animation.tracks.push_back(makeMorphTrack("a.Exclusive", 1.0f, 0.5f));
+
+    CalSubmesh byName(csm);
+    CalSubmesh byTable(csm);
+
+    const float time = 0.25f;
+    for (size_t i = 0; i < animation.tracks.size(); ++i) {
+        byName.blendMorphTargetScale(animation.tracks[i].morphName, animation.tracks[i].getState(time), 0.5f, 0.75f, true);
+    }
+    byTable.blendMorphAnimation(animation, animation.getMorphChannelTable(*csm), time, 0.5f, 0.75f, true);
+
+    for (size_t i = 0; i < 2; ++i) {
+        CHECK_EQUAL(byName.morphTargets[i].weight, byTable.morphTargets[i].weight);
+        CHECK_EQUAL(byName.morphTargets[i].accumulatedWeight, byTable.morphTargets[i].accumulatedWeight);
+        CHECK_EQUAL(byName.morphTargets[i].replacementAttenuation, byTable.morphTargets[i].replacementAttenuation);
+    }
+    CHECK_CLOSE(0.2f * 0.75f, byTable.morphTargets[1].weight, 0.0001f);
+}
+
+TEST(blending_sampled_morph_weights_matches_blending_morph_animation) {
+    CalCoreSubmeshPtr csm = makeSubmeshWithMorphTargets("a", "b");
+
+    CalCoreMorphAnimationPtr animation(new CalCoreMorphAnimation);
+    animation->tracks.push_back(makeMorphTrack("b", 0.0f, 0.8f));
+    animation->tracks.push_back(makeMorphTrack("a", 1.0f, 0.5f));
+    const std::vector<int> table = animation->getMorphChannelTable(*csm);
+
+    CalSubmesh fromAnimation(csm);
+    CalSubmesh fromWeights(csm);
+    CalMorphSampler sampler(animation);
+
+    fromAnimation.blendMorphAnimation(*animation, table, 0.5f, 1.0f, 1.0f, false);
+    fromWeights.blendMorphWeights(sampler.sample(0.5f), table, 1.0f, 1.0f, false);
+
+    for (size_t i = 0; i < 2; ++i) {
+        CHECK_CLOSE(fromAnimation.morphTargets[i].weight, fromWeights.morphTargets[i].weight, 1e-6f);
+    }
+}
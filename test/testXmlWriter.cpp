@@ -0,0 +1,310 @@
+#include "TestPrologue.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <cal3d/buffersource.h>
+#include <cal3d/coreanimation.h>
+#include <cal3d/corebone.h>
+#include <cal3d/coremesh.h>
+#include <cal3d/coremorphtarget.h>
+#include <cal3d/coreskeleton.h>
+#include <cal3d/coresubmesh.h>
+#include <cal3d/coretrack.h>
+#include <cal3d/loader.h>
+#include <cal3d/saver.h>
+#include <cal3d/tinyxml.h>
+#include <cal3d/xmlwriter.h>
+
+static std::string formatted(float f) {
+    char buffer[16];
+    return std::string(buffer, CalXmlWriter::formatFloat(buffer, f));
+}
+
+static std::string streamed(float f) {
+    std::ostringstream os;
+    os << f;
+    return os.str();
+}
+
+TEST(format_float_matches_ostream) {
+    const float special[] = {
+        0.0f, -0.0f, 1.0f, -1.0f, 0.1f, 100000.0f, 999999.0f, 999999.5f, 1000000.0f,
+        1234565.0f, 0.0001f, 0.00001f, 1e-5f, 9.999995e-5f, 123456.5f,
+        3.4028235e38f, 1.17549435e-38f, 1e-45f, 1.0f / 3.0f,
+        std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::quiet_NaN(),
+    };
+    for (size_t i = 0; i < sizeof(special) / sizeof(*special); ++i) {
+        CHECK_EQUAL(streamed(special[i]), formatted(special[i]));
+    }
+
+    unsigned state = 1;
+    for (int n = 0; n < 200000; ++n) {
+        state = state * 1664525 + 1013904223;
+        float f;
+        memcpy(&f, &state, sizeof(f));
+        // also values with few significant digits, where ties can happen
+        if (n % 4 == 0) {
+            f = float(int(state % 20000000) - 10000000) / 1024.0f;
+        }
+        if (f != f) {
+            continue;
+        }
+        const std::string expected = streamed(f);
+        if (formatted(f) != expected) {
+            CHECK_EQUAL(expected, formatted(f));
+        }
+    }
+}
+
+TEST(format_int_matches_ostream) {
+    const int values[] = { 0, 7, -7, 10, 65535, -2147483647 - 1, 2147483647 };
+    for (size_t i = 0; i < sizeof(values) / sizeof(*values); ++i) {
+        char buffer[16];
+        std::ostringstream os;
+        os << values[i];
+        CHECK_EQUAL(os.str(), std::string(buffer, CalXmlWriter::formatInt(buffer, values[i])));
+    }
+}
+
+TEST(xml_writer_matches_tinyxml_print) {
+    TiXmlDocument doc;
+    TiXmlElement header("HEADER");
+    header.SetAttribute("MAGIC", "XMF");
+    header.SetAttribute("VERSION", 1200);
+    doc.InsertEndChild(header);
+
+    TiXmlElement root("ROOT");
+    // one attribute per TinyXML bucket, out of order, plus a non-letter
+    root.SetAttribute("ZEBRA", 1);
+    root.SetAttribute("YAK", "a\"b");
+    root.SetAttribute("XENOPUS", "<&'>");
+    root.SetAttribute("ANT", "&#xA9; \x01\xe9");
+    root.SetAttribute("_UNDER", -5);
+
+    TiXmlElement empty("EMPTY");
+    root.InsertEndChild(empty);
+
+    TiXmlElement numbers("NUMBERS");
+    numbers.SetAttribute("LIST", "1 2 3");
+    TiXmlText numbersText("0.1 -2.5 1e+10");
+    numbers.InsertEndChild(numbersText);
+    root.InsertEndChild(numbers);
+
+    TiXmlElement outer("OUTER");
+    TiXmlElement inner("INNER");
+    TiXmlText innerText("a < b");
+    inner.InsertEndChild(innerText);
+    outer.InsertEndChild(inner);
+    TiXmlElement blank("BLANK");
+    TiXmlText blankText("");
+    blank.InsertEndChild(blankText);
+    outer.InsertEndChild(blank);
+    root.InsertEndChild(outer);
+    doc.InsertEndChild(root);
+
+    std::ostringstream expected;
+    doc.Print(expected);
+
+    std::string written;
+    {
+        CalXmlWriter xml(written);
+        xml.openElement("HEADER");
+        xml.attribute("MAGIC", "XMF");
+        xml.intAttribute("VERSION", 1200);
+        xml.closeElement();
+
+        xml.openElement("ROOT");
+        xml.intAttribute("ZEBRA", 1);
+        xml.attribute("YAK", "a\"b");
+        xml.attribute("XENOPUS", std::string("<&'>"));
+        xml.attribute("ANT", "&#xA9; \x01\xe9");
+        xml.intAttribute("_UNDER", -5);
+
+        xml.openElement("EMPTY");
+        xml.closeElement();
+
+        const int list[] = { 1, 2, 3 };
+        const float values[] = { 0.1f, -2.5f, 1e10f };
+        xml.openElement("NUMBERS");
+        xml.intsAttribute("LIST", list, 3);
+        xml.floatsText(values, 3);
+        xml.closeElement();
+
+        xml.openElement("OUTER");
+        xml.openElement("INNER");
+        xml.text("a < b");
+        xml.closeElement();
+        xml.openElement("BLANK");
+        xml.text("");
+        xml.closeElement();
+        xml.closeElement();
+
+        xml.closeElement();
+    }
+    CHECK_EQUAL(expected.str(), written);
+
+    // the stream form writes the same bytes
+    std::ostringstream os;
+    {
+        CalXmlWriter xml(os);
+        xml.openElement("OUTER");
+        xml.openElement("INNER");
+        xml.text("a < b");
+        xml.closeElement();
+        xml.closeElement();
+        CHECK(xml.flush());
+    }
+    CHECK_EQUAL("<OUTER>\n    <INNER>a &lt; b</INNER>\n</OUTER>\n", os.str());
+}
+
+TEST(xml_skeleton_round_trips_through_the_loader) {
+    CalCoreSkeletonPtr skeleton(new CalCoreSkeleton);
+    skeleton->sceneAmbientColor = CalVector(0.25f, 0.5f, 1.0f);
+    CalCoreBonePtr root(new CalCoreBone("root"));
+    root->lightType = LIGHT_TYPE_OMNI;
+    root->lightColor = CalVector(1.0f, 0.75f, 0.0f);
+    skeleton->addCoreBone(root);
+    CalCoreBonePtr child(new CalCoreBone("child", 0));
+    child->relativeTransform.translation = CalVector(1.5f, -2.25f, 3.0f);
+    child->relativeTransform.rotation = CalQuaternion(0.5f, 0.5f, 0.5f, 0.5f);
+    child->inverseBindPoseTransform.translation = CalVector(0.0f, 0.125f, -8.0f);
+    skeleton->addCoreBone(child);
+
+    std::ostringstream os;
+    CHECK(CalSaver::saveXmlCoreSkeleton(os, skeleton.get()));
+    const std::string xml = os.str();
+
+    CalBufferSource cbs(xml.data(), xml.size());
+    CalCoreSkeletonPtr loaded = CalLoader::loadCoreSkeleton(cbs);
+    CHECK(loaded);
+    CHECK_EQUAL(2u, loaded->coreBones.size());
+    CHECK_EQUAL(skeleton->sceneAmbientColor, loaded->sceneAmbientColor);
+    CHECK_EQUAL("root", loaded->coreBones[0]->name);
+    CHECK_EQUAL(LIGHT_TYPE_OMNI, loaded->coreBones[0]->lightType);
+    CHECK_EQUAL(root->lightColor, loaded->coreBones[0]->lightColor);
+    CHECK_EQUAL(0, loaded->coreBones[1]->parentId);
+    CHECK_EQUAL(child->relativeTransform.translation, loaded->coreBones[1]->relativeTransform.translation);
+    CHECK_EQUAL(child->inverseBindPoseTransform.translation, loaded->coreBones[1]->inverseBindPoseTransform.translation);
+
+    // saving what was loaded reproduces the file
+    std::ostringstream again;
+    CalSaver::saveXmlCoreSkeleton(again, loaded.get());
+    CHECK_EQUAL(xml, again.str());
+}
+
+TEST(xml_animation_round_trips_through_the_loader) {
+    CalCoreAnimationPtr animation(new CalCoreAnimation);
+    animation->duration = 1.5f;
+    for (unsigned bone = 0; bone < 3; ++bone) {
+        CalCoreTrack::KeyframeList keyframes;
+        for (int k = 0; k < 4; ++k) {
+            keyframes.push_back(CalCoreKeyframe(0.5f * k, CalVector(0.25f * k, float(bone), -1.0f), CalQuaternion(0.0f, 0.0f, 0.0f, 1.0f)));
+        }
+        animation->tracks.push_back(CalCoreTrack(bone, keyframes));
+    }
+    animation->tracks[1].translationRequired = false;
+    animation->tracks[2].splineInterpolated = true;
+
+    const std::string xml = CalSaver::saveCoreAnimationXmlToBuffer(animation);
+    CalBufferSource cbs(xml.data(), xml.size());
+    CalCoreAnimationPtr loaded = CalLoader::loadCoreAnimation(cbs);
+    CHECK(loaded);
+    CHECK_EQUAL(3u, loaded->tracks.size());
+    CHECK_EQUAL(1.5f, loaded->duration);
+    CHECK(!loaded->tracks[1].translationRequired);
+    CHECK(loaded->tracks[2].splineInterpolated);
+    CHECK_EQUAL(4u, loaded->tracks[0].keyframes.size());
+    CHECK_EQUAL(CalVector(0.75f, 0.0f, -1.0f), loaded->tracks[0].keyframes[3].transform.translation);
+
+    CHECK_EQUAL(xml, CalSaver::saveCoreAnimationXmlToBuffer(loaded));
+}
+
+TEST(xml_mesh_round_trips_through_the_loader) {
+    CalCoreMeshPtr mesh(new CalCoreMesh);
+    CalCoreSubmeshPtr cube = MakeCube();
+    CalCoreMorphTarget::VertexOffsetArray offsets;
+    offsets.push_back(VertexOffset(3, CalPoint4(1, 2, 3), CalVector4(0, 1, 0, 0)));
+    offsets.push_back(VertexOffset(7, CalPoint4(-1, 0, 0), CalVector4(0, 0, 1, 0)));
+    cube->addMorphTarget(CalCoreMorphTargetPtr(new CalCoreMorphTarget("smile.exclusive", cube->getVertexCount(), offsets)));
+    cube->coreMaterialThreadId = 2;
+    mesh->submeshes.push_back(cube);
+
+    std::ostringstream os;
+    CHECK(CalSaver::saveXmlCoreMesh(os, mesh.get()));
+    const std::string xml = os.str();
+
+    CalBufferSource cbs(xml.data(), xml.size());
+    CalCoreMeshPtr loaded = CalLoader::loadCoreMesh(cbs);
+    CHECK(loaded);
+    CHECK_EQUAL(1u, loaded->submeshes.size());
+    const CalCoreSubmesh& submesh = *loaded->submeshes[0];
+    CHECK_EQUAL(2, submesh.coreMaterialThreadId);
+    CHECK_EQUAL(cube->getVertexCount(), submesh.getVertexCount());
+    CHECK(std::equal(cube->getVectorVertex().begin(), cube->getVectorVertex().end(), submesh.getVectorVertex().begin()));
+    CHECK(cube->getFaces() == submesh.getFaces());
+    CHECK(cube->getTextureCoordinates() == submesh.getTextureCoordinates());
+    CHECK(cube->getInfluences() == submesh.getInfluences());
+
+    CHECK_EQUAL(1u, submesh.getMorphTargets().size());
+    const CalCoreMorphTarget& morph = *submesh.getMorphTargets()[0];
+    CHECK_EQUAL("smile.exclusive", morph.name);
+    CHECK_EQUAL(CalMorphTargetTypeExclusive, morph.morphTargetType);
+    CHECK_EQUAL(2u, morph.vertexOffsets.size());
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        CHECK_EQUAL(offsets[i].vertexId, morph.vertexOffsets[i].vertexId);
+        // the file stores only xyz, so compare offsets without w
+        CHECK_EQUAL(offsets[i].position.asCalVector(), morph.vertexOffsets[i].position.asCalVector());
+        CHECK_EQUAL(offsets[i].normal.asCalVector(), morph.vertexOffsets[i].normal.asCalVector());
+    }
+
+    std::ostringstream again;
+    CalSaver::saveXmlCoreMesh(again, loaded.get());
+    CHECK_EQUAL(xml, again.str());
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TEST(benchmark_xml_mesh_saving) {
+    const char* const parts[] = {
+        "calf_left", "calf_right", "chest", "foot_left", "foot_right", "hand_left", "hand_right",
+        "head", "lowerarm_left", "lowerarm_right", "neck", "pelvis", "ponytail",
+        "thigh_left", "thigh_right", "upperarm_left", "upperarm_right",
+    };
+    const size_t partCount = sizeof(parts) / sizeof(*parts);
+
+    std::vector<CalCoreMeshPtr> meshes;
+    size_t vertexCount = 0;
+    for (size_t i = 0; i < partCount; ++i) {
+        const std::string file = readFile(std::string("../data/cally/cally_") + parts[i] + ".cmf");
+        if (file.empty()) {
+            printf("sample data not found; skipping XML mesh saving benchmark\n");
+            return;
+        }
+        CalBufferSource cbs(file.data(), file.size());
+        meshes.push_back(CalLoader::loadCoreMesh(cbs));
+        for (size_t s = 0; s < meshes.back()->submeshes.size(); ++s) {
+            vertexCount += meshes.back()->submeshes[s]->getVertexCount();
+        }
+    }
+
+    const int iterations = 5;
+    size_t bytes = 0;
+    const cal3d_uint64 start = __rdtsc();
+    for (int n = 0; n < iterations; ++n) {
+        for (size_t i = 0; i < partCount; ++i) {
+            std::ostringstream os;
+            CalSaver::saveXmlCoreMesh(os, meshes[i].get());
+            bytes += os.str().size();
+        }
+    }
+    const cal3d_uint64 cycles = __rdtsc() - start;
+
+    printf("XML mesh saving over cally: %d cycles per vertex, %d cycles per KB\n",
+        int(cycles / (vertexCount * iterations)),
+        int(cycles * 1024 / bytes));
+}